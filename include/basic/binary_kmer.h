@@ -36,7 +36,8 @@
 #include "global.h"
 #include "event_encoding.h"
 
-#define BINVERSION 6
+#define BINVERSION 6 //the version written unless another is asked for
+#define BINVERSION_MAX 7 //the latest version we can read and write - compressed blocks
 
 typedef uint64_t bitfield_of_64bits;
 
@@ -47,6 +48,13 @@ typedef bitfield_of_64bits BinaryKmer[NUMBER_OF_BITFIELDS_IN_BINARY_KMER];
 #define BINARY_KMER_BYTES ((NUMBER_OF_BITFIELDS_IN_BINARY_KMER) * sizeof(uint64_t))
 
 
+// A kmer and its reverse complement, kept up to date together as bases are
+// added, so the key of each kmer in a read needs no reverse complement
+typedef struct
+{
+  BinaryKmer forward, reverse;
+} RollingBinaryKmer;
+
 typedef struct
 {
   int nkmers;
@@ -90,6 +98,14 @@ char * seq_reverse_complement(char * in, int length, char * out);
 
 BinaryKmer* binary_kmer_reverse_complement(BinaryKmer* kmer, short kmer_size, BinaryKmer* prealloc_reverse_kmer);
 
+void binary_kmer_rolling_set(RollingBinaryKmer* rolling, BinaryKmer* kmer, short kmer_size);
+// Shifts a base in at the right hand end of the kmer
+void binary_kmer_rolling_add_base(RollingBinaryKmer* rolling, Nucleotide n, short kmer_size);
+// The lesser of the kmer and its reverse complement (the same key as
+// element_get_key), and which of the two that is
+BinaryKmer* binary_kmer_rolling_get_key(RollingBinaryKmer* rolling, short kmer_size,
+                                        Orientation* orientation);
+
 Nucleotide binary_kmer_get_first_nucleotide(BinaryKmer* kmer, short kmer_size);
 Nucleotide binary_kmer_get_last_nucleotide(BinaryKmer* kmer);
 
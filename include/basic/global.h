@@ -39,6 +39,10 @@ typedef uint32_t Covg;
 // COVG_MAX is defined as UINT_MAX in global.c
 extern const Covg COVG_MAX;
 
+// threads used by every multithreaded stage - loading, dumping binaries, cleaning,
+// calling, genotyping and error correction. Set from --threads
+extern int NUM_THREADS;
+
 Covg mean_of_covgs(Covg a, Covg b);
 Covg sum_covgs(Covg a, Covg b);
 
@@ -0,0 +1,125 @@
+/*
+ * Copyright 2009-2011 Zamin Iqbal and Mario Caccamo
+ *
+ * CORTEX project contacts:
+ * 		M. Caccamo (mario.caccamo@bbsrc.ac.uk) and
+ * 		Z. Iqbal (zam@well.ox.ac.uk)
+ *
+ * **********************************************************************
+ *
+ * This file is part of CORTEX.
+ *
+ * CORTEX is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CORTEX is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CORTEX.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * **********************************************************************
+ */
+/*
+  binary_blocks.h
+
+  Records of a version 7 binary. After the usual (version 6) header come
+  compressed blocks of up to BINARY_BLOCK_RECORDS records, then an index of the
+  blocks and a fixed size footer:
+
+    block:  uint32 num_records, uint32 raw_len, uint32 compressed_len,
+            compressed_len bytes of deflate data
+    index:  for each block, int64 offset of the block in the file, uint32 num_records
+    footer: int64 num_blocks, int64 offset of the index, "CORTEX"
+
+  Within a block the records are sorted by kmer. Each kmer is stored as the
+  number of leading bitfields it shares with the previous kmer (0 for the first
+  in the block), the difference in the first bitfield that differs as a varint,
+  and then the remaining bitfields raw. Coverages follow as varints and edges as
+  raw bytes, one per colour.
+*/
+
+#ifndef BINARY_BLOCKS_H_
+#define BINARY_BLOCKS_H_
+
+#include <stdio.h>
+
+#include "global.h"
+#include "binary_kmer.h"
+#include "element.h"
+
+#define BINARY_BLOCK_RECORDS 65536
+
+typedef struct
+{
+  long long offset;
+  uint32_t num_records;
+} BinaryBlockIndexEntry;
+
+// Encodes records into compressed blocks held in memory, so ranges of a graph
+// can be encoded by separate threads and then written in order
+typedef struct
+{
+  int num_colours;
+  size_t record_size; // as a version 6 record
+  char* records;      // version 6 records not yet in a block
+  const char** sorted;
+  int num_records;
+  char* raw;
+  char* out;          // encoded blocks
+  size_t out_len, out_capacity;
+  BinaryBlockIndexEntry* index; // offsets into out
+  long long num_blocks, index_capacity;
+} BinaryBlockEncoder;
+
+typedef struct
+{
+  FILE* fp;
+  BinaryBlockIndexEntry* index;
+  long long num_blocks, index_capacity;
+} BinaryBlockWriter;
+
+typedef struct
+{
+  const char* file; // whole file, mapped
+  char* filename;
+  int num_colours;
+  size_t record_size;
+  BinaryBlockIndexEntry* index;
+  long long index_offset;
+  long long num_blocks, next_block;
+  int num_threads;
+  char* decoded;
+  size_t decoded_capacity;
+} BinaryBlockReader;
+
+
+BinaryBlockEncoder* binary_block_encoder_new(int num_colours);
+void binary_block_encoder_add(BinaryBlockEncoder* enc, BinaryKmer kmer,
+                              Covg* covgs, Edges* edges);
+// Puts any records not yet in a block into one
+void binary_block_encoder_flush(BinaryBlockEncoder* enc);
+void binary_block_encoder_free(BinaryBlockEncoder* enc);
+
+// The fp must be positioned just after the header
+void binary_block_writer_init(BinaryBlockWriter* writer, FILE* fp);
+// Writes the blocks of enc to the file (flushing it first) and empties it
+void binary_block_writer_append(BinaryBlockWriter* writer, BinaryBlockEncoder* enc);
+// Writes the index and footer. Does not close fp
+void binary_block_writer_finish(BinaryBlockWriter* writer);
+
+// file/file_len is the whole binary mapped into memory, data_start is the end of the header.
+// Dies if the blocks, index or footer are inconsistent.
+void binary_block_reader_open(BinaryBlockReader* reader, const char* file, size_t file_len,
+                              size_t data_start, int num_colours, int num_threads,
+                              char* filename);
+// Decodes the next block(s) into packed version 6 records, up to one block per
+// thread. Returns the number of bytes in *records, 0 once all blocks are read.
+size_t binary_block_reader_next(BinaryBlockReader* reader, const char** records);
+void binary_block_reader_close(BinaryBlockReader* reader);
+
+#endif /* BINARY_BLOCKS_H_ */
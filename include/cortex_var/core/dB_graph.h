@@ -55,5 +55,10 @@ int db_graph_clip_tip(dBNode * node, int limit,dBGraph * db_graph);
 
 void db_graph_set_all_visited_nodes_to_status_none(dBGraph* hash_table);
 
+// Same as applying db_node_action_unset_status_visited_or_visited_and_exists_in_reference
+// to every node, but by starting a new epoch of visited marks, without going
+// through the table (except once every 256 calls)
+void db_graph_unset_all_visited_status(dBGraph* db_graph);
+
 
 #endif /* DB_GRAPH_H_ */
@@ -55,6 +55,11 @@ dBNode * db_graph_get_next_node_for_specific_person_or_pop(dBNode * current_node
                                                            Orientation * next_orientation,
                                                            Nucleotide edge, Nucleotide * reverse_edge,dBGraph * db_graph, int index);
 
+//Looks the kmer up in the hash table, and does not check the node is in any subgraph
+dBNode * db_graph_find_next_node(dBNode * current_node, Orientation current_orientation,
+				 Orientation * next_orientation,
+				 Nucleotide edge, Nucleotide * reverse_edge, dBGraph * db_graph);
+
 //This function does not  check that it there is such an edge in the specified person/colour - but it does check if the target node is in the specific person.
 //if you want to be sure the dge exists in that colour, then check it before calling this function
 //The last argument allows you to apply the operation to some subgraph - eg you might take the unuiion of colours 2 and 3, or of all colours.
@@ -440,6 +445,10 @@ void db_graph_remove_low_coverage_nodes_ignoring_colours(Covg coverage, dBGraph
 int db_graph_dump_binary(char *filename, boolean (*condition)(dBNode *node),
                          dBGraph *db_graph, GraphInfo *db_graph_info, int version);
 
+// An image of the graph (see hash_table_write_image), after a binary header for
+// the colours in use, which a later run can map with load_graph_image
+void db_graph_dump_image(char *filename, dBGraph *db_graph, GraphInfo *db_graph_info);
+
 void db_graph_dump_single_colour_binary_of_colour0(char *filename,
                                                    boolean (*condition)(dBNode *node),
                                                    dBGraph *db_graph, 
@@ -610,6 +619,27 @@ int db_graph_make_reference_path_based_sv_calls_given_list_of_colours_for_indiv(
   AssumptionsOnGraphCleaning assump, int start_numbering_vars_from_this_number
   );
 
+// Calls each chromosome in ref_chroms in turn (or each colour of the list in turn
+// if each_colour_separately), with NUM_THREADS threads calling different
+// chromosomes at once. On one thread, nodes visited on one chromosome are not
+// called again on a later one (when calling the union of the colours); on several
+// they may be. The calls are written in the order of ref_chroms, numbered from 1.
+// When each colour is called separately they are the same whatever the number of
+// threads. Returns the number of variants found.
+int db_graph_make_reference_path_based_sv_calls_for_list_of_chroms(
+  char** ref_chroms, int num_ref_chroms,
+  int* list, int len_list, boolean each_colour_separately,
+  int ref_colour,
+  int min_fiveprime_flank_anchor, int min_threeprime_flank_anchor,
+  int max_anchor_span, Covg min_covg, Covg max_covg,
+  int max_expected_size_of_supernode, int length_of_arrays, dBGraph* db_graph,
+  FILE* output_file,
+  boolean (*condition)(VariantBranchesAndFlanks* var,  int colour_of_ref,
+  Edges (*get_colour)(const dBNode*), Covg (*get_covg)(const dBNode*)),
+  void (*action_for_branches_of_called_variants)(VariantBranchesAndFlanks* var),
+  void (*print_extra_info)(AnnotatedPutativeVariant* var, FILE* fout),
+  GraphAndModelInfo* model_info, AssumptionsOnGraphCleaning assump);
+
 boolean condition_always_true(dBNode** flank_5p, int len5p, dBNode** ref_branch,
                               int len_ref, dBNode** var_branch, int len_var,
 			                        dBNode** flank_3p, int len3p, int colour_of_ref,
@@ -682,6 +712,12 @@ long long db_graph_clean_orphan_edges(dBGraph * db_graph);
 void db_graph_wipe_colour(int colour, dBGraph* db_graph);
 void db_graph_wipe_two_colours_in_one_traversal(int colour1, int colour2, dBGraph* db_graph);
 
+// overlaps[j*num1+i] is the number of nodes in both colour first_col_list[i] and
+// colour second_col_list[j]. The whole matrix takes one pass through the graph
+void db_graph_get_colour_overlap_matrix(int* first_col_list, int num1,
+                                        int* second_col_list, int num2,
+                                        long long* overlaps, dBGraph* db_graph);
+
 void db_graph_print_colour_overlap_matrix(int* first_col_list, int num1,
                                           int* second_col_list, int num2,
 					  dBGraph* db_graph);
@@ -695,6 +731,17 @@ void print_call_given_var_and_modelinfo(VariantBranchesAndFlanks* var,
 					AssumptionsOnGraphCleaning assump,
 					CovgArray* working_ca);
 
+// sites are genotyped in batches of this many, shared out between the threads
+#define GENOTYPE_BATCH_SITES 1024
+
+// Genotypes every site in the callfile fp (as printed by the bubble or path
+// divergence callers), with NUM_THREADS threads, printing them to fout
+// in the order they are in fp. Returns the number of sites read.
+long long db_graph_genotype_callfile(FILE* fp, FILE* fout, int max_read_length, int max_var_len,
+				     DiscoveryMethod which_caller, dBGraph* db_graph,
+				     void (*print_extra_info)(AnnotatedPutativeVariant*, FILE*),
+				     GraphAndModelInfo* model_info);
+
 
 void db_graph_get_stats_of_supernodes_that_split_two_colour(int max_length, int colour1, int colour2,
 							    dBGraph * db_graph, Edges (*get_colour)(const dBNode*), Covg (*get_covg)(const dBNode*),
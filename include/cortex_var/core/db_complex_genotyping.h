@@ -71,6 +71,37 @@ typedef struct {
   int max_sup_len;//used for the path_blah allocation
 } GenotypingWorkingPackage;
 
+// The supernodes (in one sample's colour) which can count as errors against some
+// genotype of a complex site: those with a node not in the reference-minus-site,
+// reached from the alleles through other such nodes. They are found once per
+// sample, and every genotype is then scored against them, rather than against
+// every node in the graph.
+typedef struct {
+  int colour;
+  int colour_ref_minus_site;
+  int num_supernodes;
+  int supernodes_capacity;
+  int* first_node;  //index in nodes of the first node of each supernode
+  int* lengths;     //each supernode has lengths[i]+1 nodes
+  dBNode** start_nodes; //the node each supernode was walked from
+  Covg* num_reads;
+  boolean* too_short;
+  dBNode** nodes;
+  int num_nodes;
+  int nodes_capacity;
+} ComplexSiteNeighbourhood;
+
+ComplexSiteNeighbourhood* alloc_complex_site_neighbourhood();
+void dealloc_complex_site_neighbourhood(ComplexSiteNeighbourhood* nbhd);
+
+// Assumes no node has visited status, and leaves none with it
+void get_complex_site_neighbourhood(ComplexSiteNeighbourhood* nbhd,
+                                    dBNode*** alleles, int* allele_lens, int num_alleles,
+                                    int colour_indiv, int colour_ref_minus_site,
+                                    dBNode** p_nodes, Orientation* p_orientations,
+                                    Nucleotide* p_labels, char* p_string, int max_sup_len,
+                                    dBGraph* db_graph);
+
 GenotypingWorkingPackage* alloc_genotyping_work_package(int max_allele_len,
                                                         int max_sup_len,
                                                         int working_colour1,
@@ -120,7 +151,7 @@ double calc_log_likelihood_of_genotype_with_complex_alleles(
   char* p_string, int max_allele_length,
   boolean using_1net, Covg (*get_covg_in_1net_of_genotype)(dBNode*), 
   boolean using_2net, Covg (*get_covg_in_2net_of_genotype)(dBNode*),
-  double min_acceptable_llk);
+  double min_acceptable_llk, ComplexSiteNeighbourhood* neighbourhood);
 
 
 void wipe_colour_and_load_binaries(dBGraph* db_graph, int colour, char* bin1, char* bin2);
@@ -251,6 +251,15 @@ double get_log_likelihood_of_genotype_on_variant_called_by_bubblecaller(
 long long get_big_theta(AnnotatedPutativeVariant* annovar);
 
 
+// Which allele (one, two or both) each node of a site is on, while the coverage on
+// the unique part of each branch is counted. Kept here rather than in the nodes, so
+// sites which share nodes can be genotyped on several threads at once
+typedef struct {
+  dBNode** nodes;
+  char* status;
+  int size; // a power of 2
+} AlleleMarks;
+
 //utility functions
 boolean get_num_effective_reads_on_branch(Covg* array, dBNode** allele, int how_many_nodes, 
 					  boolean use_median, CovgArray* working_ca, GraphInfo* ginfo, int kmer);
@@ -274,7 +283,7 @@ Covg min_covg_on_allele_in_specific_colour(dBNode** allele, int len, int colour,
 
 Covg median_covg_on_allele_in_specific_colour_with_allele_presence_constraint(dBNode** allele, int len, CovgArray* working_ca,
 									      int colour, boolean* too_short, AlleleStatus st,
-									      float eff_depth);
+									      AlleleMarks* marks, float eff_depth);
 Covg median_of_CovgArray(CovgArray* array, CovgArray* working_array);
 
 #endif /* DB_VARIANTS_H_ */
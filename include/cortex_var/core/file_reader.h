@@ -125,6 +125,12 @@ void load_pe_filelists_into_graph_colour(
   unsigned long *readlen_count_array, unsigned long readlen_count_array_size,
   boolean (*subsample_func)() );
 
+// Estimate of the number of distinct kmers that loading the sequence files in
+// these filelists (a NULL-terminated array) would add to the graph
+long long estimate_distinct_kmers_in_filelists(char **filelists, short kmer_size,
+                                               int qual_thresh, int homopol_limit,
+                                               char ascii_fq_offset);
+
 // End of loading sequence data
 
 void initialise_binary_header_info(BinaryHeaderInfo* binfo, GraphInfo* ginfo);
@@ -167,6 +173,10 @@ int load_seq_into_array(FILE* chrom_fptr, int number_of_nodes_to_load, int lengt
 //functions for loading multicolour graphs
 long long load_multicolour_binary_from_filename_into_graph(char* filename,  dBGraph* db_graph, GraphInfo* ginfo, int* num_cols_in_loaded_binary); 
 
+// Maps a graph image written by db_graph_dump_image, instead of making a new hash
+// table and loading a binary into it. The header goes into ginfo as for a binary
+dBGraph* load_graph_image(char* filename, short kmer_size, GraphInfo* ginfo, int* num_cols_in_loaded_binary);
+
 // last arg is to load the "union" of graphs. This is not a special case of load_multicolour
 long long load_single_colour_binary_data_from_filename_into_graph(char* filename,  dBGraph* db_graph, 
 								  GraphInfo* ginfo, 
@@ -186,7 +196,7 @@ long long load_population_as_binaries_from_graph(char* filename, int first_colou
 						 boolean only_load_kmers_already_in_hash, int colour_clean,
 						 boolean load_all_kmers_but_only_increment_covg_on_new_ones);
 
-void dump_successive_cleaned_binaries(char* filename, int in_colour, int clean_colour, char* suffix, dBGraph* db_graph, GraphInfo* db_graph_info );
+void dump_successive_cleaned_binaries(char* filename, int in_colour, int clean_colour, char* suffix, dBGraph* db_graph, GraphInfo* db_graph_info, int binary_version);
 
 
 
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2009-2011 Zamin Iqbal and Mario Caccamo
+ *
+ * CORTEX project contacts:
+ * 		M. Caccamo (mario.caccamo@bbsrc.ac.uk) and
+ * 		Z. Iqbal (zam@well.ox.ac.uk)
+ *
+ * **********************************************************************
+ *
+ * This file is part of CORTEX.
+ *
+ * CORTEX is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CORTEX is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CORTEX.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * **********************************************************************
+ */
+/*
+  kmer_sketch.h
+
+  HyperLogLog sketch, for estimating how many distinct kmers there are in some
+  data without storing them. 2^KMER_SKETCH_BITS one-byte registers give an
+  estimate with a standard error of about 1.04/sqrt(2^KMER_SKETCH_BITS), ie 0.8%.
+*/
+
+#ifndef KMER_SKETCH_H_
+#define KMER_SKETCH_H_
+
+#include <stdint.h>
+
+#include "global.h"
+#include "binary_kmer.h"
+
+#define KMER_SKETCH_BITS 14
+#define KMER_SKETCH_REGISTERS (1<<KMER_SKETCH_BITS)
+
+typedef struct
+{
+  uint8_t registers[KMER_SKETCH_REGISTERS];
+} KmerSketch;
+
+void kmer_sketch_initialise(KmerSketch* sketch);
+// key should be the canonical kmer (see element_get_key), so a kmer and its
+// reverse complement are counted once
+void kmer_sketch_add(KmerSketch* sketch, BinaryKmer* key);
+// afterwards into estimates the kmers added to either
+void kmer_sketch_merge(KmerSketch* into, KmerSketch* from);
+long long kmer_sketch_estimate(KmerSketch* sketch);
+
+#endif /* KMER_SKETCH_H_ */
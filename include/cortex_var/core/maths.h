@@ -34,6 +34,9 @@
 #include "element.h"
 #include "dB_graph.h"
 
+// log(n!), looked up in a table for n < LOG_FACTORIAL_TABLE_SIZE
+#define LOG_FACTORIAL_TABLE_SIZE 65536
+
 double log_factorial(int number);
 double log_factorial_uint64_t(uint64_t number);
 int min_of_ints(int a, int b);
@@ -0,0 +1,105 @@
+/*
+ * Copyright 2009-2011 Zamin Iqbal and Mario Caccamo
+ *
+ * CORTEX project contacts:
+ * 		M. Caccamo (mario.caccamo@bbsrc.ac.uk) and
+ * 		Z. Iqbal (zam@well.ox.ac.uk)
+ *
+ * **********************************************************************
+ *
+ * This file is part of CORTEX.
+ *
+ * CORTEX is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CORTEX is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CORTEX.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * **********************************************************************
+ */
+/*
+  unitig_index.h
+
+  Index of the unitigs (supernodes in the union of all colours) of a graph. The
+  nodes of each unitig are stored one after the other, with the edges between
+  them, and each end of a unitig remembers which nodes it leads to. Once a graph
+  is indexed, db_graph_get_next_node_in_subgraph_defined_by_func_of_colours steps
+  through these arrays instead of looking up every kmer in the hash table.
+
+  Only adding kmers to the graph (or growing the table) makes an index stale -
+  cleaning, changing edges and statuses do not, as the index only says which
+  node a kmer is, not whether it is in any subgraph. A stale index is ignored.
+*/
+
+#ifndef UNITIG_INDEX_H_
+#define UNITIG_INDEX_H_
+
+#include <stdint.h>
+
+#include "global.h"
+#include "element.h"
+#include "dB_graph.h"
+
+//forward_edge of the last node of a unitig, and backward_edge of the first
+#define UNITIG_END 4
+
+typedef struct
+{
+  dBNode * node;
+  uint32_t unitig;
+  uint8_t orientation;   //orientation in which the unitig runs through node
+  uint8_t forward_edge;  //edge from node to the next node in the unitig
+  uint8_t backward_edge; //edge from node, in the opposite orientation, to the previous node
+  uint8_t reverse_edge;  //the reverse_edge of a step from node in forward orientation
+} UnitigPosition;
+
+typedef struct
+{
+  //the node (and its orientation) reached by each nucleotide, NULL if there is none
+  dBNode * node[4];
+  Orientation orientation[4];
+} UnitigEnd;
+
+typedef struct
+{
+  long long start; //index of the first node in UnitigIndex.positions
+  long long length;
+  //[0] stepping back off the first node, [1] stepping on from the last
+  UnitigEnd ends[2];
+} Unitig;
+
+typedef struct UnitigIndex
+{
+  //of the graph when it was indexed
+  long long generation;
+  long long unique_kmers;
+  long long num_slots;
+
+  long long num_positions;
+  UnitigPosition * positions;
+  long long num_unitigs;
+  Unitig * unitigs;
+  //by node - db_graph->table, -1 for empty slots
+  long long * slot_to_position;
+} UnitigIndex;
+
+//builds the index and attaches it to db_graph (replacing any old one).
+//Returns false if there is not enough memory
+boolean db_graph_build_unitig_index(dBGraph * db_graph);
+void db_graph_free_unitig_index(dBGraph * db_graph);
+
+//If the index can answer, sets next_node (NULL if there is no such kmer in the graph),
+//next_orientation and reverse_edge exactly as a hash table lookup would, and returns true.
+//Does not check next_node is in any subgraph
+boolean unitig_index_get_next_node(UnitigIndex * index, dBNode * current_node, Orientation current_orientation,
+				   Nucleotide edge, dBNode ** next_node, Orientation * next_orientation,
+				   Nucleotide * reverse_edge, dBGraph * db_graph);
+
+#endif /* UNITIG_INDEX_H_ */
@@ -63,6 +63,12 @@ typedef struct
   int max_read_length;
   int max_var_len;
   int remv_low_covg_sups_threshold;
+  int num_threads; //--threads, copied to NUM_THREADS (global.h)
+  boolean mem_grow; //double the hash table when it fills up
+  boolean mem_auto; //size the hash table from an estimate of the kmers in the input
+  boolean unitig_index; //index the supernodes after cleaning, for faster walks
+  boolean freeze_graph; //pack the cleaned graph behind a minimal perfect hash
+  int dump_binary_version; //version of any binaries dumped - BINVERSION unless asked for another
   
 
 
@@ -118,11 +124,13 @@ typedef struct
   int num_colours_in_input_colour_list;
   char multicolour_bin[MAX_FILENAME_LEN];
   int num_colours_in_multicol_bin;
+  boolean multicol_bin_is_image; //--graph_image rather than --multicolour_bin
 
   char se_list[MAX_FILENAME_LEN];
   char pe_list_lh_mates[MAX_FILENAME_LEN];
   char pe_list_rh_mates[MAX_FILENAME_LEN];
   char output_binary_filename[MAX_FILENAME_LEN];
+  char output_graph_image[MAX_FILENAME_LEN];
   char output_supernodes[MAX_FILENAME_LEN];
   char output_detect_bubbles1[MAX_FILENAME_LEN];
   char output_detect_bubbles2[MAX_FILENAME_LEN];
@@ -164,6 +172,7 @@ typedef struct
   boolean load_colours_only_where_overlap_clean_colour;
   boolean successively_dump_cleaned_colours;
   boolean dump_binary;
+  boolean dump_graph_image;
   boolean print_supernode_fasta;
   boolean remove_low_coverage_nodes;
   boolean detect_bubbles1;
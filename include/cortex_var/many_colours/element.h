@@ -68,6 +68,7 @@ typedef enum
     special_pruned = 14,
     fw_strand = 15,
     rv_strand = 16,
+    being_inserted = 17, //only while a thread is inserting this element into the hash table
   } NodeStatus;
 
 
@@ -80,12 +81,30 @@ typedef enum
   } AlleleStatus;
 
 
+// Coverage as stored in a node. 32 bits by default, but with many colours,
+// building with COVG_BITS=8 or 16 (see the Makefile) makes every node much
+// smaller, and coverages saturate at NODE_COVG_MAX instead. Outside element.c
+// coverages are always Covg, through db_node_get_coverage and friends.
+#if NODE_COVG_BITS == 8
+typedef uint8_t NodeCovg;
+#define NODE_COVG_MAX UINT8_MAX
+#elif NODE_COVG_BITS == 16
+typedef uint16_t NodeCovg;
+#define NODE_COVG_MAX UINT16_MAX
+#elif !defined(NODE_COVG_BITS) || NODE_COVG_BITS == 32
+typedef uint32_t NodeCovg;
+#define NODE_COVG_MAX UINT32_MAX
+#else
+#error "COVG_BITS must be 8, 16 or 32"
+#endif
+
 typedef struct{
   BinaryKmer kmer;
-  Covg       coverage[NUMBER_OF_COLOURS];
+  NodeCovg   coverage[NUMBER_OF_COLOURS];
   Edges      individual_edges[NUMBER_OF_COLOURS];
   char       status; // will cast a NodeStatus to char
   char       allele_status;
+  unsigned char visited_epoch; // epoch in which the node was last given a status
 } Element;
 
 
@@ -123,6 +142,7 @@ Covg element_get_covg_colour1(const dBNode* e);
 Covg element_get_covg_last_colour(const dBNode* e);
 
 void add_edges(Element* e, int colour, Edges edge_char);
+void add_edges_atomic(Element* e, int colour, Edges edge_char);
 void set_edges(Element* e, int colour, Edges edge_char);
 void reset_one_edge(Element* e, Orientation orientation, Nucleotide nucleotide, int colour);
 
@@ -138,6 +158,11 @@ void element_initialise_kmer_covgs_edges_and_status_to_zero(Element * e);
 
 void element_set_kmer(Element *e, Key kmer, short kmer_size);
 
+// for concurrent insertion into the hash table
+boolean element_claim_if_unassigned(Element * e);
+void element_initialise_and_publish(Element * e, Key kmer, short kmer_size);
+void element_wait_until_published(Element * e);
+
 
 // reverse orientation
 Orientation opposite_orientation(Orientation);
@@ -145,6 +170,7 @@ Orientation db_node_get_orientation(BinaryKmer*, dBNode *, short kmer_size);
 
 // add an edge between nodes -- NB: it adds both edges: forward and reverse
 boolean db_node_add_edge(dBNode *, dBNode *, Orientation, Orientation, short kmer_size, int colour); 
+boolean db_node_add_edge_atomic(dBNode *, dBNode *, Orientation, Orientation, short kmer_size, int colour);
 
 
 // returns yes if the label defined by the nucleotide coresponds to an 
@@ -228,6 +254,13 @@ void db_node_action_unset_status_visited_or_visited_and_exists_in_reference(dBNo
 
 void db_node_action_unset_status_visited_or_visited_and_exists_in_reference_or_ignore_this_node(dBNode * node);
 
+// A node marked visited (or visited_and_exists_in_reference) in an earlier epoch
+// reads as none (or exists_in_reference), so starting a new epoch unsets the
+// visited status of every node at once. See db_graph_unset_all_visited_status
+extern unsigned char db_node_visited_epoch;
+// Unsets the visited status whatever the epoch it was set in
+void db_node_action_unset_status_visited_of_any_epoch(dBNode * node);
+
 
 void db_node_action_do_nothing(dBNode * node);
 
@@ -255,6 +288,7 @@ boolean db_node_condition_always_true(dBNode* node);
 
 void db_node_increment_coverage(dBNode* e, int colour);
 void db_node_update_coverage(dBNode* e, int colour, long update);
+void db_node_update_coverage_atomic(dBNode* e, int colour, long update);
 Covg db_node_get_coverage_tolerate_null(const dBNode* e, int colour);
 Covg db_node_get_coverage(const dBNode* e, int colour);
 void db_node_set_coverage(dBNode* e, int colour, Covg covg);
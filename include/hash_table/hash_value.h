@@ -35,4 +35,20 @@
 
 uint32_t hash_value(Key key, int number_buckets);
 
+// Hash of key with rehash added to its last bitfield, which is how the hash
+// tables rehash. The hash used is chosen at compile time (make HASH=...)
+uint32_t hash_value_with_rehash(Key key, int rehash, int number_buckets);
+
+// the individual hashes, for comparing them
+uint32_t hashlittle(const void *key, size_t length, uint32_t initval);
+uint32_t hash_value_bob_jenkins(Key key, int rehash, int number_buckets);
+uint32_t hash_value_mix64(Key key, int rehash, int number_buckets);
+
+#if defined(__SSE4_2__) || defined(__ARM_FEATURE_CRC32)
+#define HASH_VALUE_HAVE_CRC32C 1
+uint32_t hash_value_crc32c(Key key, int rehash, int number_buckets);
+#elif defined(HASH_CRC32C)
+#error "HASH=crc32c needs a CPU with SSE4.2 or ARMv8 CRC32 instructions"
+#endif
+
 #endif /* HASH_VALUE_H_ */
@@ -34,8 +34,11 @@
 #ifndef OPEN_HASH_TABLE_H_
 #define OPEN_HASH_TABLE_H_
 
+#include <pthread.h>
+
 #include "global.h"
 #include "element.h"
+#include "perfect_hash.h"
 
 typedef struct
 {
@@ -47,6 +50,19 @@ typedef struct
   long long * collisions;
   long long unique_kmers;
   int max_rehash_tries;
+  //if set, inserting into a table that is too full doubles it instead of dying
+  boolean grow_when_full;
+  //incremented every time the table grows - all elements move, so anyone holding
+  //pointers into the table must look them up again when this changes
+  long long generation;
+  pthread_rwlock_t grow_lock;
+  //the supernodes of the graph, if they have been indexed (see unitig_index.h)
+  struct UnitigIndex * unitig_index;
+  //set once the table is frozen - see hash_table_freeze
+  PerfectHash * perfect_hash;
+  //if the table was opened from an image, the mapping its arrays are in
+  void * image;
+  size_t image_size;
 } HashTable;
 
 
@@ -54,12 +70,53 @@ HashTable * hash_table_new(int number_bits, int bucket_size, int max_rehash_trie
 
 void hash_table_free(HashTable * * hash_table);
 
+//Growing. Inserts which would otherwise die (too much rehashing), including those of
+//apply_or_insert, double the number of buckets and move every element. Only the loading code, which copes with elements
+//moving, should switch this on
+void hash_table_set_grow_when_full(HashTable * hash_table, boolean grow_when_full);
+//returns false if there is not enough memory
+boolean hash_table_grow(HashTable * hash_table);
+//arguments for hash_table_new to hold num_kmers, with buckets at least min_bucket_size
+void hash_table_size_for_kmers(long long num_kmers, int min_bucket_size, int * number_bits, int * bucket_size);
+//threads using the _concurrent inserts on a table which may grow must do so between
+//these two calls (the table only grows while no thread is inside)
+void hash_table_begin_concurrent_inserts(HashTable * hash_table);
+void hash_table_end_concurrent_inserts(HashTable * hash_table);
+
+//Freezing. Once no more kmers are to be added, the elements can be packed into an
+//array of exactly unique_kmers, with a minimal perfect hash of the kmers giving each
+//its place. Finds then look at one element, with no rehashing, and the empty slots
+//are gone. Afterwards the table has unique_kmers buckets of 1, so traversals carry on
+//working, but inserting a new kmer dies. Elements move, so generation goes up.
+//Returns false if there is not enough memory (the table is unchanged)
+boolean hash_table_freeze(HashTable * hash_table);
+boolean hash_table_is_frozen(HashTable * hash_table);
+
+//Images. A table can be written out as it is in memory, and later runs can map it
+//straight back in instead of inserting every kmer again. The mapping is private, so
+//processes opening the same image share its pages (through the page cache) until
+//they change an element, and changes never reach the file. An image only opens in
+//an executable with the same MAXK, NUMBER_OF_COLOURS and hash function.
+//Writes the table to fp from where it is, returning false if it cannot write it all.
+//Nodes marked visited are written unvisited, as the marks depend on this process's epoch
+boolean hash_table_write_image(HashTable * hash_table, FILE * fp);
+//Maps the image written offset bytes into filename. Returns NULL, with a warning
+//saying why, if it cannot
+HashTable * hash_table_open_image(char * filename, long long offset);
+
 //if the key is present applies f otherwise adds a new element for kmer
 boolean hash_table_apply_or_insert(Key key, void (*f)(Element*), HashTable *);
 
 //applies f to every element of the table
 void hash_table_traverse(void (*f)(Element *),HashTable *);
 long long hash_table_traverse_returning_sum(long long (*f)(Element *),HashTable * hash_table);
+//the same with num_threads threads, each applying f to chunks of the table in turn.
+//f may only change the element it is given (the threads can apply it in any order)
+void hash_table_traverse_multithreaded(void (*f)(Element *), HashTable * hash_table, int num_threads);
+long long hash_table_traverse_returning_sum_multithreaded(long long (*f)(Element *), HashTable * hash_table, int num_threads);
+//f is also given the index (0 to num_threads-1) of the thread applying it, eg to
+//add to counts of its own which the caller sums afterwards
+void hash_table_traverse_multithreaded_with_thread_index(void (*f)(Element *, int), HashTable * hash_table, int num_threads);
 void hash_table_traverse_passing_int(void (*f)(Element *, int*),HashTable * hash_table, int* num);
 void hash_table_traverse_passing_ints_and_path(
   void (*f)(Element *, int*, int*, dBNode**, Orientation*, Nucleotide*, char*, int),
@@ -72,10 +129,23 @@ void hash_table_traverse_passing_3ints_and_path(
   dBNode** p_n, Orientation* p_o, Nucleotide* p_lab, char* p_str, int len);
 
 
-//if the element is not in table create an element with key and adds it
+//if the element is not in table create an element with key and adds it.
+//These, and the batched versions, may grow the table (see above)
 Element * hash_table_find_or_insert(Key key, boolean * found, HashTable * hash_table);
 Element * hash_table_insert(Key key, HashTable * hash_table);
 
+//thread-safe versions, for when several threads insert into the same table. Coverages
+//and edges of the returned elements must be updated with the _atomic functions in element.h
+Element * hash_table_find_or_insert_concurrent(Key key, boolean * found, HashTable * hash_table);
+boolean hash_table_apply_or_insert_concurrent(Key key, void (*f)(Element*), HashTable * hash_table);
+
+//batched versions of the above - elements[i] (and found[i]) are the results for keys[i].
+//Buckets are prefetched ahead of being searched, which is much faster for big tables
+void hash_table_find_or_insert_batch(BinaryKmer * keys, int num_keys, Element ** elements, boolean * found, HashTable * hash_table);
+void hash_table_find_or_insert_batch_concurrent(BinaryKmer * keys, int num_keys, Element ** elements, boolean * found, HashTable * hash_table);
+void hash_table_insert_batch(BinaryKmer * keys, int num_keys, Element ** elements, HashTable * hash_table);
+void hash_table_find_batch(BinaryKmer * keys, int num_keys, Element ** elements, HashTable * hash_table);
+
 void hash_table_print_stats(HashTable *);
 
 long long hash_table_get_unique_kmers(HashTable *);
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2009-2011 Zamin Iqbal and Mario Caccamo
+ *
+ * CORTEX project contacts:
+ * 		M. Caccamo (mario.caccamo@bbsrc.ac.uk) and
+ * 		Z. Iqbal (zam@well.ox.ac.uk)
+ *
+ * **********************************************************************
+ *
+ * This file is part of CORTEX.
+ *
+ * CORTEX is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CORTEX is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CORTEX.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * **********************************************************************
+ */
+/*
+  perfect_hash.h
+
+  Minimal perfect hash of a fixed set of n kmers: every kmer in the set gets its own
+  number from 0 to n-1. Built as in BBHash (Limasset et al. 2017) - each level is a
+  bit array twice the size of the kmers still to place, and a kmer which lands on a
+  bit no other kmer lands on is placed there, the others go on to the next level.
+  About 4 bits per kmer.
+
+  Kmers not in the set also get a number (or -1), so the caller must check that what
+  it finds there is the kmer it looked up.
+*/
+
+#ifndef PERFECT_HASH_H_
+#define PERFECT_HASH_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "global.h"
+#include "element.h"
+
+#define PERFECT_HASH_MAX_LEVELS 64
+
+typedef struct PerfectHash
+{
+  long long num_keys;
+  int num_levels;
+  //each level is blocks of 8 words - the number of bits set in the level before the
+  //block, then 448 bits
+  uint64_t * levels[PERFECT_HASH_MAX_LEVELS];
+  long long level_bits[PERFECT_HASH_MAX_LEVELS];
+  long long level_offset[PERFECT_HASH_MAX_LEVELS]; //keys placed in earlier levels
+  boolean mapped; //the levels are in a mapped image (see perfect_hash_map), not allocated
+} PerfectHash;
+
+//the keys are the kmers of the elements of table (num_slots of them) which are not
+//ALL_OFF. Returns NULL if there is not enough memory
+PerfectHash * perfect_hash_new(Element * table, long long num_slots);
+void perfect_hash_free(PerfectHash * perfect_hash);
+
+//0 to num_keys-1 for the keys it was built from, anything (or -1) for other keys
+long long perfect_hash_lookup(Key key, PerfectHash * perfect_hash);
+
+long long perfect_hash_get_bytes(PerfectHash * perfect_hash);
+
+//Images. perfect_hash_write writes perfect_hash_get_bytes bytes to fp, and
+//perfect_hash_map makes a perfect hash out of them once they are in memory (8 byte
+//aligned), with the levels left where they are
+boolean perfect_hash_write(PerfectHash * perfect_hash, FILE * fp);
+PerfectHash * perfect_hash_map(char * image);
+
+#endif /* PERFECT_HASH_H_ */
@@ -50,6 +50,10 @@ void test_binary_kmer_nucleotide_iterator();
 
 void test_binary_kmer_reverse_complement();
 
+void test_binary_kmer_reverse_complement_of_random_kmers();
+
+void test_binary_kmer_rolling();
+
 void test_seq_reverse_complement();
 
 void test_get_sliding_windows_from_sequence();
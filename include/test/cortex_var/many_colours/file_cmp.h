@@ -0,0 +1,38 @@
+/*
+ * 
+ * CORTEX project contacts:  
+ * 		M. Caccamo (mario.caccamo@bbsrc.ac.uk) and 
+ * 		Z. Iqbal (zam@well.ox.ac.uk)
+ *
+ * **********************************************************************
+ *
+ * This file is part of CORTEX.
+ *
+ * CORTEX is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CORTEX is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CORTEX.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * **********************************************************************
+ */
+/*
+  file_cmp.h
+*/
+
+#ifndef TEST_FILE_CMP_H_
+#define TEST_FILE_CMP_H_
+
+#include "global.h"
+
+//true if both files can be opened, and their contents are the same
+boolean files_are_identical(char* file1, char* file2);
+
+#endif /* TEST_FILE_CMP_H_ */
@@ -64,5 +64,12 @@ void test_get_covg_of_nodes_in_one_but_not_other_of_two_arrays();
 void test_apply_to_all_nodes_in_path_defined_by_fasta();
 void test_does_this_path_exist_in_this_colour();
 void test_dump_covg_distribution();
+void test_detect_vars_is_the_same_with_several_threads();
+void test_pd_calls_on_several_chromosomes_with_several_threads();
+void test_graph_passes_are_the_same_with_several_threads();
+void test_colour_overlap_matrix();
+void test_unitig_index_gives_the_same_steps_and_calls();
+void test_frozen_graph_gives_the_same_genotypes_and_calls();
+void test_graph_image_gives_the_same_graph_and_calls();
 
 #endif /* TEST_DB_GRAPH_POP_H_ */
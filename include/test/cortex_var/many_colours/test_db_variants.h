@@ -34,6 +34,9 @@
 #include "global.h"
 
 void test_count_reads_on_allele_in_specific_colour();
+void test_unique_branch_covg_ignores_and_keeps_allele_status_of_nodes();
 void test_get_log_likelihood_of_genotype_on_variant_called_by_bubblecaller();
+void test_log_factorial_table_gives_unchanged_genotype_likelihoods();
+void test_complex_site_neighbourhood_gives_same_genotype_likelihoods_as_whole_graph();
 
 #endif /* TEST_DB_VARIANTS_H_ */
@@ -4,3 +4,4 @@ void test_get_first_good_kmer_and_populate_qual_array();
 void test_error_correct_file_against_graph();
 void test_take_n_greedy_random_steps();
 void test_reverse_comp_according_ref_pos_strand();
+void test_error_correct_file_is_the_same_with_several_threads();
@@ -50,5 +50,12 @@ void test_read_next_variant_from_full_flank_file_4();
 void test_getting_readlength_distribution();
 void test_loading_binary_data_iff_it_overlaps_a_fixed_colour();
 void test_load_binversion5_binary();
+void test_multithreaded_loading_gives_same_graph_as_single_threaded();
+void test_parallel_loading_of_colour_list();
+void test_compressed_binary_matches_binversion6();
+void test_dump_binary_is_the_same_with_several_threads();
+void test_default_dump_of_real_data_is_the_same_as_the_per_record_writer();
+void test_estimate_kmers_and_grow_table_while_loading();
+void test_genotyping_callfile_is_the_same_with_several_threads();
 
 #endif /* TEST_FILE_READER_H_ */
@@ -40,5 +40,7 @@ void test_increment_coverage();
 void test_get_coverage();
 void test_element_status_set_and_checks();
 void test_element_assign();
+void test_compact_coverage_saturates();
+void test_unset_all_visited_status();
 
 #endif /* TEST_POP_ELEMENT_H_ */
@@ -34,5 +34,11 @@
 
 void test_hash_table_find_or_insert();
 void test_hash_table_apply_or_insert();
+void test_hash_table_find_or_insert_concurrent();
+void test_hash_table_find_or_insert_batch();
+void test_hash_table_grow_when_full();
+void test_hash_table_freeze();
+void test_hash_table_traverse_multithreaded();
+void test_hash_value_speed_and_distribution();
 
 #endif /* TEST_HASH_H_ */
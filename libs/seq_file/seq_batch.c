@@ -0,0 +1,500 @@
+/*
+ seq_batch.c
+ project: seq_file
+ url: https://github.com/noporpoise/seq_file
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <unistd.h> // dup
+
+#include "seq_batch.h"
+
+//
+// Reading thread
+//
+
+static void* _seq_batch_inflate(void *arg)
+{
+  SeqBatchReader *reader = (SeqBatchReader*)arg;
+
+  while(1)
+  {
+    pthread_mutex_lock(&reader->lock);
+    while(reader->num_full == SEQ_BATCH_NUM_BLOCKS && !reader->stop)
+      pthread_cond_wait(&reader->cond_empty, &reader->lock);
+
+    if(reader->stop)
+    {
+      pthread_mutex_unlock(&reader->lock);
+      return NULL;
+    }
+
+    int slot = (reader->next_full + reader->num_full) % SEQ_BATCH_NUM_BLOCKS;
+    pthread_mutex_unlock(&reader->lock);
+
+    // the block is not full so is not being looked at by anyone else
+    SeqBatchBlock *block = &reader->blocks[slot];
+    int len = reader->bgzf != NULL
+              ? seq_bgzf_read(reader->bgzf, block->data, SEQ_BATCH_BLOCK_SIZE)
+              : gzread(reader->gz_file, block->data, SEQ_BATCH_BLOCK_SIZE);
+
+    if(len < 0)
+    {
+      fprintf(stderr, "%s:%i: Error -- couldn't read file: %s\n",
+              __FILE__, __LINE__, reader->path);
+      len = 0;
+    }
+
+    pthread_mutex_lock(&reader->lock);
+    if(len > 0)
+    {
+      block->len = (size_t)len;
+      reader->num_full++;
+    }
+    else
+    {
+      reader->inflated_all = 1;
+    }
+    pthread_cond_signal(&reader->cond_full);
+    pthread_mutex_unlock(&reader->lock);
+
+    if(len == 0)
+      return NULL;
+  }
+}
+
+//
+// Cutting reads out of the inflated blocks
+//
+
+// Moves the data not yet parsed to the start of the buffer, and appends the
+// next block to it. Returns 0 if there are no more blocks
+static char _seq_batch_refill(SeqBatchReader *reader)
+{
+  if(reader->eof)
+    return 0;
+
+  pthread_mutex_lock(&reader->lock);
+  while(reader->num_full == 0 && !reader->inflated_all)
+    pthread_cond_wait(&reader->cond_full, &reader->lock);
+
+  if(reader->num_full == 0)
+  {
+    reader->eof = 1;
+    pthread_mutex_unlock(&reader->lock);
+    return 0;
+  }
+
+  SeqBatchBlock *block = &reader->blocks[reader->next_full];
+  pthread_mutex_unlock(&reader->lock);
+
+  size_t left = reader->buf_len - reader->buf_start;
+  memmove(reader->buf, reader->buf + reader->buf_start, left);
+
+  if(left + block->len > reader->buf_capacity)
+  {
+    reader->buf_capacity = 2 * (left + block->len);
+    reader->buf = realloc(reader->buf, reader->buf_capacity);
+
+    if(reader->buf == NULL)
+    {
+      fprintf(stderr, "%s:%i: Error -- out of memory\n", __FILE__, __LINE__);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  memcpy(reader->buf + left, block->data, block->len);
+  reader->buf_start = 0;
+  reader->buf_len = left + block->len;
+
+  pthread_mutex_lock(&reader->lock);
+  reader->next_full = (reader->next_full + 1) % SEQ_BATCH_NUM_BLOCKS;
+  reader->num_full--;
+  pthread_cond_signal(&reader->cond_empty);
+  pthread_mutex_unlock(&reader->lock);
+
+  return 1;
+}
+
+// Sets line/len to the next line, without its newline. The line is only
+// valid until the next call. Returns 0 at the end of the file
+static char _seq_batch_next_line(SeqBatchReader *reader, char **line, size_t *len)
+{
+  // bytes already searched for a newline
+  size_t searched = 0;
+  char *end;
+
+  while((end = memchr(reader->buf + reader->buf_start + searched, '\n',
+                      reader->buf_len - reader->buf_start - searched)) == NULL)
+  {
+    searched = reader->buf_len - reader->buf_start;
+
+    if(!_seq_batch_refill(reader))
+    {
+      if(reader->buf_start == reader->buf_len)
+        return 0;
+
+      // last line has no newline
+      end = reader->buf + reader->buf_len;
+      break;
+    }
+  }
+
+  *line = reader->buf + reader->buf_start;
+  *len = (size_t)(end - *line);
+
+  reader->buf_start = (size_t)(end - reader->buf);
+  if(reader->buf_start < reader->buf_len)
+    reader->buf_start++;
+
+  if(*len > 0 && (*line)[*len-1] == '\r')
+    (*len)--;
+
+  reader->line_number++;
+  return 1;
+}
+
+// Returns the next character without using it up, -1 at the end of the file
+static int _seq_batch_peek(SeqBatchReader *reader)
+{
+  if(reader->buf_start == reader->buf_len && !_seq_batch_refill(reader))
+    return -1;
+
+  return reader->buf[reader->buf_start];
+}
+
+static void _seq_batch_append(SeqBatch *batch, const char *str, size_t len)
+{
+  if(batch->data_len + len + 1 > batch->data_capacity)
+  {
+    batch->data_capacity = 2 * (batch->data_len + len + 1);
+    batch->data = realloc(batch->data, batch->data_capacity);
+
+    if(batch->data == NULL)
+    {
+      fprintf(stderr, "%s:%i: Error -- out of memory\n", __FILE__, __LINE__);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  memcpy(batch->data + batch->data_len, str, len);
+  batch->data_len += len;
+}
+
+static void _seq_batch_terminate(SeqBatch *batch)
+{
+  _seq_batch_append(batch, "", 0);
+  batch->data[batch->data_len++] = '\0';
+}
+
+// Returns 0 if there are no more reads
+static char _seq_batch_next_fasta(SeqBatchReader *reader, SeqBatch *batch)
+{
+  SeqBatchRead *read = &batch->reads[batch->num_reads];
+  size_t *offsets = &batch->offsets[2*batch->num_reads];
+  char *line;
+  size_t len;
+
+  do
+  {
+    if(!_seq_batch_next_line(reader, &line, &len))
+      return 0;
+  }
+  while(len == 0);
+
+  if(line[0] != '>')
+  {
+    fprintf(stderr, "%s:%i: FASTA header does not begin with '>' (%c) "
+                    "[file: %s; line: %lu]\n",
+            __FILE__, __LINE__, line[0], reader->path, reader->line_number);
+    return 0;
+  }
+
+  offsets[0] = batch->data_len;
+  read->name_len = len - 1;
+  _seq_batch_append(batch, line + 1, len - 1);
+  _seq_batch_terminate(batch);
+
+  offsets[1] = batch->data_len;
+  read->seq_len = 0;
+
+  int c;
+  while((c = _seq_batch_peek(reader)) != -1 && c != '>')
+  {
+    _seq_batch_next_line(reader, &line, &len);
+    _seq_batch_append(batch, line, len);
+    read->seq_len += len;
+  }
+
+  _seq_batch_terminate(batch);
+  read->qual_len = 0;
+  return 1;
+}
+
+// Returns 0 if there are no more reads
+static char _seq_batch_next_fastq(SeqBatchReader *reader, SeqBatch *batch)
+{
+  SeqBatchRead *read = &batch->reads[batch->num_reads];
+  size_t *offsets = &batch->offsets[3*batch->num_reads];
+  char *line;
+  size_t len;
+
+  do
+  {
+    if(!_seq_batch_next_line(reader, &line, &len))
+      return 0;
+  }
+  while(len == 0);
+
+  if(line[0] != '@')
+  {
+    fprintf(stderr, "%s:%i: FASTQ header does not begin with '@' (%c) "
+                    "[file: %s; line: %lu]\n",
+            __FILE__, __LINE__, line[0], reader->path, reader->line_number);
+    return 0;
+  }
+
+  offsets[0] = batch->data_len;
+  read->name_len = len - 1;
+  _seq_batch_append(batch, line + 1, len - 1);
+  _seq_batch_terminate(batch);
+
+  // Sequence lines, up to the '+' separator
+  offsets[1] = batch->data_len;
+  read->seq_len = 0;
+
+  char plus = 0;
+  while(_seq_batch_next_line(reader, &line, &len))
+  {
+    if(len > 0 && line[0] == '+')
+    {
+      plus = 1;
+      break;
+    }
+
+    _seq_batch_append(batch, line, len);
+    read->seq_len += len;
+  }
+
+  _seq_batch_terminate(batch);
+
+  if(!plus)
+  {
+    fprintf(stderr, "%s:%i: Missing '+' in FASTQ [file: %s; line: %lu]\n",
+            __FILE__, __LINE__, reader->path, reader->line_number);
+  }
+
+  // As many lines of quality scores as it takes to cover the sequence
+  offsets[2] = batch->data_len;
+  read->qual_len = 0;
+
+  while(read->qual_len < read->seq_len &&
+        _seq_batch_next_line(reader, &line, &len))
+  {
+    _seq_batch_append(batch, line, len);
+    read->qual_len += len;
+  }
+
+  _seq_batch_terminate(batch);
+  return 1;
+}
+
+size_t seq_batch_read(SeqBatchReader *reader, SeqBatch *batch)
+{
+  char fastq = (reader->file_type == SEQ_FASTQ);
+
+  batch->num_reads = 0;
+  batch->data_len = 0;
+
+  while(batch->num_reads < batch->max_reads &&
+        (fastq ? _seq_batch_next_fastq(reader, batch)
+               : _seq_batch_next_fasta(reader, batch)))
+  {
+    batch->num_reads++;
+  }
+
+  // data has stopped moving, so point the reads into it
+  size_t i;
+  int num_fields = fastq ? 3 : 2;
+
+  for(i = 0; i < batch->num_reads; i++)
+  {
+    size_t *offsets = &batch->offsets[num_fields*i];
+    batch->reads[i].name = batch->data + offsets[0];
+    batch->reads[i].seq = batch->data + offsets[1];
+    batch->reads[i].qual = fastq ? batch->data + offsets[2] : NULL;
+  }
+
+  return batch->num_reads;
+}
+
+//
+// Opening and closing
+//
+
+SeqBatchReader* seq_batch_reader_open(const char *path)
+{
+  SeqFileType file_type = SEQ_UNKNOWN;
+  char zipped = 0;
+
+  if(strcmp(path, "-") != 0)
+  {
+    seq_guess_filetype_from_path(path, &file_type, &zipped);
+
+    if(file_type == SEQ_SAM || file_type == SEQ_BAM)
+    {
+      fprintf(stderr, "%s:%i: Error -- can only read FASTA/FASTQ in batches: %s\n",
+              __FILE__, __LINE__, path);
+      return NULL;
+    }
+  }
+
+  SeqBgzf *bgzf = NULL;
+  gzFile gz_file = NULL;
+
+  if(strcmp(path, "-") == 0)
+    gz_file = gzdopen(dup(fileno(stdin)), "r");
+  else if(seq_bgzf_threads <= 1 || !seq_bgzf_is_bgzf(path) ||
+          (bgzf = seq_bgzf_open(path, seq_bgzf_threads)) == NULL)
+    gz_file = gzopen(path, "r");
+
+  if(gz_file == NULL && bgzf == NULL)
+  {
+    fprintf(stderr, "%s:%i: Error -- couldn't open gz_file\n",
+            __FILE__, __LINE__);
+    return NULL;
+  }
+
+  SeqBatchReader *reader = (SeqBatchReader*) malloc(sizeof(SeqBatchReader));
+
+  reader->path = path;
+  reader->gz_file = gz_file;
+  reader->bgzf = bgzf;
+  reader->file_type = SEQ_UNKNOWN;
+
+  int i;
+  for(i = 0; i < SEQ_BATCH_NUM_BLOCKS; i++)
+  {
+    reader->blocks[i].data = malloc(SEQ_BATCH_BLOCK_SIZE);
+    reader->blocks[i].len = 0;
+  }
+
+  reader->next_full = 0;
+  reader->num_full = 0;
+  reader->inflated_all = 0;
+  reader->stop = 0;
+  pthread_mutex_init(&reader->lock, NULL);
+  pthread_cond_init(&reader->cond_full, NULL);
+  pthread_cond_init(&reader->cond_empty, NULL);
+
+  reader->buf_capacity = 2 * SEQ_BATCH_BLOCK_SIZE;
+  reader->buf = malloc(reader->buf_capacity);
+  reader->buf_start = 0;
+  reader->buf_len = 0;
+  reader->eof = 0;
+  reader->line_number = 0;
+
+  if(pthread_create(&reader->thread, NULL, _seq_batch_inflate, reader) != 0)
+  {
+    fprintf(stderr, "%s:%i: Error -- couldn't start a thread to read %s\n",
+            __FILE__, __LINE__, path);
+    exit(EXIT_FAILURE);
+  }
+
+  // File type from the first character, as seq_file_open() does
+  int first_char = _seq_batch_peek(reader);
+
+  if(first_char == -1)
+  {
+    fprintf(stderr, "%s:%i: Warning -- empty sequence file\n", __FILE__, __LINE__);
+    reader->file_type = SEQ_FASTA;
+  }
+  else if(first_char == '>')
+  {
+    reader->file_type = SEQ_FASTA;
+  }
+  else if(first_char == '@')
+  {
+    reader->file_type = SEQ_FASTQ;
+  }
+  else
+  {
+    fprintf(stderr, "%s:%i: Error -- can only read FASTA/FASTQ in batches: %s\n",
+            __FILE__, __LINE__, path);
+    seq_batch_reader_close(reader);
+    return NULL;
+  }
+
+  return reader;
+}
+
+void seq_batch_reader_close(SeqBatchReader *reader)
+{
+  pthread_mutex_lock(&reader->lock);
+  reader->stop = 1;
+  pthread_cond_signal(&reader->cond_empty);
+  pthread_mutex_unlock(&reader->lock);
+  pthread_join(reader->thread, NULL);
+
+  pthread_mutex_destroy(&reader->lock);
+  pthread_cond_destroy(&reader->cond_full);
+  pthread_cond_destroy(&reader->cond_empty);
+
+  int i;
+  for(i = 0; i < SEQ_BATCH_NUM_BLOCKS; i++)
+    free(reader->blocks[i].data);
+
+  free(reader->buf);
+  if(reader->bgzf != NULL)
+    seq_bgzf_close(reader->bgzf);
+  else
+    gzclose(reader->gz_file);
+  free(reader);
+}
+
+char seq_batch_reader_has_quality_scores(const SeqBatchReader *reader)
+{
+  return (reader->file_type == SEQ_FASTQ);
+}
+
+SeqBatch* seq_batch_new(size_t max_reads)
+{
+  SeqBatch *batch = (SeqBatch*) malloc(sizeof(SeqBatch));
+
+  batch->reads = (SeqBatchRead*) malloc(max_reads * sizeof(SeqBatchRead));
+  batch->offsets = (size_t*) malloc(3 * max_reads * sizeof(size_t));
+  batch->num_reads = 0;
+  batch->max_reads = max_reads;
+
+  batch->data_capacity = 256 * max_reads;
+  batch->data = malloc(batch->data_capacity);
+  batch->data_len = 0;
+
+  if(batch->reads == NULL || batch->offsets == NULL || batch->data == NULL)
+  {
+    fprintf(stderr, "%s:%i: Error -- out of memory\n", __FILE__, __LINE__);
+    exit(EXIT_FAILURE);
+  }
+
+  return batch;
+}
+
+void seq_batch_free(SeqBatch *batch)
+{
+  free(batch->reads);
+  free(batch->offsets);
+  free(batch->data);
+  free(batch);
+}
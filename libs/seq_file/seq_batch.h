@@ -0,0 +1,63 @@
+/*
+ seq_batch.h
+ project: seq_file
+ url: https://github.com/noporpoise/seq_file
+ 
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ 
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SEQ_BATCH_HEADER_SEEN
+#define SEQ_BATCH_HEADER_SEEN
+
+#include <pthread.h>
+
+#include "seq_common.h"
+
+// Size and number of the blocks the file is inflated into
+#define SEQ_BATCH_BLOCK_SIZE (4*1024*1024)
+#define SEQ_BATCH_NUM_BLOCKS 4
+
+typedef struct
+{
+  char *data;
+  size_t len;
+} SeqBatchBlock;
+
+struct SeqBatchReader
+{
+  const char *path;
+  // bgzf if the file is BGZF and read with several threads, gz_file otherwise
+  gzFile gz_file;
+  struct SeqBgzf *bgzf;
+  SeqFileType file_type;
+
+  // Blocks inflated by the reading thread, num_full of them waiting to be
+  // parsed starting at next_full
+  SeqBatchBlock blocks[SEQ_BATCH_NUM_BLOCKS];
+  int next_full, num_full;
+  // reading thread has reached the end of the file / been told to stop
+  char inflated_all, stop;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond_full, cond_empty;
+
+  // Inflated data not yet parsed is buf[buf_start..buf_len)
+  char *buf;
+  size_t buf_start, buf_len, buf_capacity;
+  char eof;
+
+  unsigned long line_number;
+};
+
+#endif
@@ -0,0 +1,560 @@
+/*
+ seq_bgzf.c
+ project: seq_file
+ url: https://github.com/noporpoise/seq_file
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+
+#include "seq_bgzf.h"
+
+#define BGZF_HEADER_LENGTH 18
+
+int seq_bgzf_threads = 1;
+
+static inline uint32_t _unpack_int16(const unsigned char *buffer)
+{
+  return (uint32_t)buffer[0] | ((uint32_t)buffer[1] << 8);
+}
+
+static inline uint32_t _unpack_int32(const unsigned char *buffer)
+{
+  return (uint32_t)buffer[0] | ((uint32_t)buffer[1] << 8) |
+         ((uint32_t)buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
+}
+
+// gzip header with a single 'BC' extra subfield holding the block size
+static char _check_header(const unsigned char *header)
+{
+  return (header[0] == 31 && header[1] == 139 && header[2] == 8 &&
+          (header[3] & 4) != 0 && _unpack_int16(header + 10) == 6 &&
+          header[12] == 'B' && header[13] == 'C' &&
+          _unpack_int16(header + 14) == 2);
+}
+
+char seq_bgzf_is_bgzf(const char *path)
+{
+  unsigned char header[BGZF_HEADER_LENGTH];
+  FILE *file = fopen(path, "r");
+
+  if(file == NULL)
+    return 0;
+
+  size_t n = fread(header, 1, BGZF_HEADER_LENGTH, file);
+  fclose(file);
+
+  return (n == BGZF_HEADER_LENGTH && _check_header(header));
+}
+
+//
+// Reading thread: fills jobs with runs of compressed blocks
+//
+
+// Returns 1 if a block was read, 0 at the end of the file, -1 on error
+static int _read_block(SeqBgzf *bgzf, SeqBgzfJob *job)
+{
+  size_t start = job->num_blocks == 0 ? 0 : job->block_ends[job->num_blocks-1];
+  unsigned char *block = job->compressed + start;
+
+  size_t n = fread(block, 1, BGZF_HEADER_LENGTH, bgzf->file);
+
+  if(n == 0)
+    return 0;
+
+  if(n != BGZF_HEADER_LENGTH || !_check_header(block))
+  {
+    fprintf(stderr, "%s:%i: Error -- invalid BGZF block header [file: %s]\n",
+            __FILE__, __LINE__, bgzf->path);
+    return -1;
+  }
+
+  size_t block_len = _unpack_int16(block + 16) + 1;
+
+  if(block_len < BGZF_HEADER_LENGTH + 8 ||
+     fread(block + BGZF_HEADER_LENGTH, 1, block_len - BGZF_HEADER_LENGTH,
+           bgzf->file) != block_len - BGZF_HEADER_LENGTH)
+  {
+    fprintf(stderr, "%s:%i: Error -- truncated BGZF block [file: %s]\n",
+            __FILE__, __LINE__, bgzf->path);
+    return -1;
+  }
+
+  job->block_ends[job->num_blocks++] = start + block_len;
+  return 1;
+}
+
+static void* _bgzf_reader_thread(void *arg)
+{
+  SeqBgzf *bgzf = (SeqBgzf*)arg;
+  int status = 1;
+
+  while(status == 1)
+  {
+    pthread_mutex_lock(&bgzf->lock);
+    while(bgzf->num_read - bgzf->num_used == bgzf->num_jobs && !bgzf->stop)
+      pthread_cond_wait(&bgzf->cond_free, &bgzf->lock);
+
+    if(bgzf->stop)
+    {
+      pthread_mutex_unlock(&bgzf->lock);
+      return NULL;
+    }
+    pthread_mutex_unlock(&bgzf->lock);
+
+    // nobody else looks at a job until it has been read
+    SeqBgzfJob *job = &bgzf->jobs[bgzf->num_read % bgzf->num_jobs];
+    job->num_blocks = 0;
+    job->inflated = 0;
+    job->error = 0;
+
+    while(job->num_blocks < SEQ_BGZF_BLOCKS_PER_JOB &&
+          (status = _read_block(bgzf, job)) == 1);
+
+    pthread_mutex_lock(&bgzf->lock);
+    if(job->num_blocks > 0)
+    {
+      bgzf->num_read++;
+      pthread_cond_signal(&bgzf->cond_read);
+    }
+    if(status != 1)
+    {
+      bgzf->read_all = 1;
+      bgzf->error = (status < 0);
+      pthread_cond_broadcast(&bgzf->cond_read);
+      pthread_cond_broadcast(&bgzf->cond_inflated);
+    }
+    pthread_mutex_unlock(&bgzf->lock);
+  }
+
+  return NULL;
+}
+
+//
+// Worker threads: inflate jobs
+//
+
+static void _inflate_job(SeqBgzf *bgzf, SeqBgzfJob *job, z_stream *zs)
+{
+  size_t start = 0;
+  int i;
+
+  job->data_len = 0;
+
+  for(i = 0; i < job->num_blocks; i++)
+  {
+    size_t end = job->block_ends[i];
+    uint32_t isize = _unpack_int32(job->compressed + end - 4);
+
+    inflateReset(zs);
+    zs->next_in = job->compressed + start + BGZF_HEADER_LENGTH;
+    zs->avail_in = (uInt)(end - start - BGZF_HEADER_LENGTH);
+    zs->next_out = job->data + job->data_len;
+    zs->avail_out = SEQ_BGZF_MAX_BLOCK_SIZE;
+
+    if(inflate(zs, Z_FINISH) != Z_STREAM_END || zs->total_out != isize)
+    {
+      fprintf(stderr, "%s:%i: Error -- couldn't inflate BGZF block [file: %s]\n",
+              __FILE__, __LINE__, bgzf->path);
+      job->error = 1;
+      return;
+    }
+
+    job->data_len += isize;
+    start = end;
+  }
+}
+
+static void* _bgzf_worker_thread(void *arg)
+{
+  SeqBgzf *bgzf = (SeqBgzf*)arg;
+
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+
+  if(inflateInit2(&zs, -15) != Z_OK)
+  {
+    fprintf(stderr, "%s:%i: Error -- couldn't initialise zlib\n",
+            __FILE__, __LINE__);
+    exit(EXIT_FAILURE);
+  }
+
+  while(1)
+  {
+    pthread_mutex_lock(&bgzf->lock);
+    while(bgzf->num_taken == bgzf->num_read && !bgzf->read_all && !bgzf->stop)
+      pthread_cond_wait(&bgzf->cond_read, &bgzf->lock);
+
+    if(bgzf->stop || bgzf->num_taken == bgzf->num_read)
+    {
+      pthread_mutex_unlock(&bgzf->lock);
+      break;
+    }
+
+    SeqBgzfJob *job = &bgzf->jobs[bgzf->num_taken % bgzf->num_jobs];
+    bgzf->num_taken++;
+    pthread_mutex_unlock(&bgzf->lock);
+
+    _inflate_job(bgzf, job, &zs);
+
+    pthread_mutex_lock(&bgzf->lock);
+    job->inflated = 1;
+    pthread_cond_broadcast(&bgzf->cond_inflated);
+    pthread_mutex_unlock(&bgzf->lock);
+  }
+
+  inflateEnd(&zs);
+  return NULL;
+}
+
+//
+// Reading through the inflated data, in order
+//
+
+// Moves on to the next job. Returns its first character, or -1 at the end of
+// the file (or on error)
+int seq_bgzf_next_job(SeqBgzf *bgzf)
+{
+  while(1)
+  {
+    pthread_mutex_lock(&bgzf->lock);
+
+    if(bgzf->curr != NULL)
+    {
+      // done with this one
+      bgzf->curr = NULL;
+      bgzf->num_used++;
+      pthread_cond_signal(&bgzf->cond_free);
+    }
+
+    SeqBgzfJob *job = &bgzf->jobs[bgzf->num_used % bgzf->num_jobs];
+
+    while(!(bgzf->num_used < bgzf->num_read && job->inflated) &&
+          !(bgzf->read_all && bgzf->num_used == bgzf->num_read))
+    {
+      pthread_cond_wait(&bgzf->cond_inflated, &bgzf->lock);
+    }
+
+    if(bgzf->num_used == bgzf->num_read)
+    {
+      pthread_mutex_unlock(&bgzf->lock);
+      return -1;
+    }
+
+    bgzf->curr = job;
+    bgzf->curr_pos = 0;
+    pthread_mutex_unlock(&bgzf->lock);
+
+    if(job->error)
+    {
+      bgzf->error = 1;
+      return -1;
+    }
+
+    if(job->data_len > 0)
+      return job->data[bgzf->curr_pos++];
+  }
+}
+
+int seq_bgzf_ungetc(int c, SeqBgzf *bgzf)
+{
+  if(c == -1 || bgzf->curr == NULL || bgzf->curr_pos == 0)
+    return -1;
+
+  bgzf->curr->data[--bgzf->curr_pos] = (unsigned char)c;
+  return c;
+}
+
+int seq_bgzf_read(SeqBgzf *bgzf, void *data, size_t len)
+{
+  unsigned char *out = (unsigned char*)data;
+  size_t num_read = 0;
+
+  while(num_read < len)
+  {
+    if(bgzf->curr == NULL || bgzf->curr_pos == bgzf->curr->data_len)
+    {
+      int c = seq_bgzf_next_job(bgzf);
+
+      if(c == -1)
+        break;
+
+      bgzf->curr_pos--;
+    }
+
+    size_t n = MIN(len - num_read, bgzf->curr->data_len - bgzf->curr_pos);
+    memcpy(out + num_read, bgzf->curr->data + bgzf->curr_pos, n);
+    bgzf->curr_pos += n;
+    num_read += n;
+  }
+
+  return bgzf->error ? -1 : (int)num_read;
+}
+
+t_buf_pos seq_bgzf_readline(StrBuf *sbuf, SeqBgzf *bgzf)
+{
+  t_buf_pos count = 0;
+
+  while(1)
+  {
+    if(bgzf->curr == NULL || bgzf->curr_pos == bgzf->curr->data_len)
+    {
+      if(seq_bgzf_next_job(bgzf) == -1)
+        break;
+
+      bgzf->curr_pos--;
+    }
+
+    unsigned char *start = bgzf->curr->data + bgzf->curr_pos;
+    size_t avail = bgzf->curr->data_len - bgzf->curr_pos;
+    unsigned char *newline = memchr(start, '\n', avail);
+    size_t n = newline == NULL ? avail : (size_t)(newline - start) + 1;
+
+    strbuf_ensure_capacity(sbuf, sbuf->len + n);
+    memcpy(sbuf->buff + sbuf->len, start, n);
+    sbuf->len += n;
+    sbuf->buff[sbuf->len] = '\0';
+    bgzf->curr_pos += n;
+    count += n;
+
+    if(newline != NULL)
+      break;
+  }
+
+  return count;
+}
+
+t_buf_pos seq_bgzf_skip_line(SeqBgzf *bgzf)
+{
+  int c;
+  t_buf_pos count = 0;
+
+  while((c = seq_bgzf_getc(bgzf)) != -1)
+  {
+    count++;
+
+    if(c == '\n' || c == '\r')
+      break;
+  }
+
+  return count;
+}
+
+//
+// BAM
+//
+
+static char _is_big_endian()
+{
+  uint16_t one = 1;
+  return *(uint8_t*)&one == 0;
+}
+
+int seq_bgzf_skip_bam_header(SeqBgzf *bgzf)
+{
+  unsigned char buf[4];
+  uint32_t i, n, num_targets;
+
+  if(seq_bgzf_read(bgzf, buf, 4) != 4 || memcmp(buf, "BAM\1", 4) != 0)
+    return -1;
+
+  // text
+  if(seq_bgzf_read(bgzf, buf, 4) != 4)
+    return -1;
+
+  for(n = _unpack_int32(buf); n > 0; n--)
+  {
+    if(seq_bgzf_getc(bgzf) == -1)
+      return -1;
+  }
+
+  // reference names and lengths
+  if(seq_bgzf_read(bgzf, buf, 4) != 4)
+    return -1;
+
+  num_targets = _unpack_int32(buf);
+
+  for(i = 0; i < num_targets; i++)
+  {
+    if(seq_bgzf_read(bgzf, buf, 4) != 4)
+      return -1;
+
+    for(n = _unpack_int32(buf) + 4; n > 0; n--)
+    {
+      if(seq_bgzf_getc(bgzf) == -1)
+        return -1;
+    }
+  }
+
+  return 0;
+}
+
+int seq_bgzf_read_bam(SeqBgzf *bgzf, bam1_t *b)
+{
+  bam1_core_t *c = &b->core;
+  unsigned char buf[36];
+  uint32_t x[8];
+  int32_t block_len;
+  int i;
+
+  int ret = seq_bgzf_read(bgzf, buf, 4);
+
+  if(ret != 4)
+    return ret == 0 ? -1 : -2;
+
+  if(seq_bgzf_read(bgzf, buf + 4, 32) != 32)
+    return -3;
+
+  block_len = (int32_t)_unpack_int32(buf);
+  for(i = 0; i < 8; i++)
+    x[i] = _unpack_int32(buf + 4 + 4*i);
+
+  c->tid = x[0]; c->pos = x[1];
+  c->bin = x[2]>>16; c->qual = x[2]>>8&0xff; c->l_qname = x[2]&0xff;
+  c->flag = x[3]>>16; c->n_cigar = x[3]&0xffff;
+  c->l_qseq = x[4];
+  c->mtid = x[5]; c->mpos = x[6]; c->isize = x[7];
+
+  b->l_data = block_len - 32;
+
+  if(b->l_data < 0)
+    return -4;
+
+  if(b->m_data < b->l_data)
+  {
+    b->m_data = 2 * b->l_data;
+    b->data = (uint8_t*)realloc(b->data, b->m_data);
+  }
+
+  if(seq_bgzf_read(bgzf, b->data, b->l_data) != b->l_data)
+    return -4;
+
+  return 4 + block_len;
+}
+
+//
+// Opening and closing
+//
+
+SeqBgzf* seq_bgzf_open(const char *path, int num_threads)
+{
+  // Records are unpacked as little endian
+  if(_is_big_endian())
+    return NULL;
+
+  FILE *file = fopen(path, "r");
+
+  if(file == NULL)
+    return NULL;
+
+  SeqBgzf *bgzf = (SeqBgzf*) malloc(sizeof(SeqBgzf));
+
+  bgzf->path = path;
+  bgzf->file = file;
+  bgzf->num_threads = num_threads;
+  bgzf->num_jobs = 2 * num_threads + 2;
+  bgzf->jobs = (SeqBgzfJob*) malloc(bgzf->num_jobs * sizeof(SeqBgzfJob));
+  bgzf->workers = (pthread_t*) malloc(num_threads * sizeof(pthread_t));
+
+  if(bgzf->jobs == NULL || bgzf->workers == NULL)
+  {
+    fprintf(stderr, "%s:%i: Error -- out of memory\n", __FILE__, __LINE__);
+    exit(EXIT_FAILURE);
+  }
+
+  int i;
+  for(i = 0; i < bgzf->num_jobs; i++)
+  {
+    bgzf->jobs[i].compressed = malloc(SEQ_BGZF_BLOCKS_PER_JOB *
+                                      SEQ_BGZF_MAX_BLOCK_SIZE);
+    bgzf->jobs[i].data = malloc(SEQ_BGZF_BLOCKS_PER_JOB *
+                                SEQ_BGZF_MAX_BLOCK_SIZE);
+
+    if(bgzf->jobs[i].compressed == NULL || bgzf->jobs[i].data == NULL)
+    {
+      fprintf(stderr, "%s:%i: Error -- out of memory\n", __FILE__, __LINE__);
+      exit(EXIT_FAILURE);
+    }
+
+    bgzf->jobs[i].num_blocks = 0;
+    bgzf->jobs[i].data_len = 0;
+    bgzf->jobs[i].inflated = 0;
+    bgzf->jobs[i].error = 0;
+  }
+
+  bgzf->num_read = 0;
+  bgzf->num_taken = 0;
+  bgzf->num_used = 0;
+  bgzf->read_all = 0;
+  bgzf->stop = 0;
+  bgzf->error = 0;
+  bgzf->curr = NULL;
+  bgzf->curr_pos = 0;
+
+  pthread_mutex_init(&bgzf->lock, NULL);
+  pthread_cond_init(&bgzf->cond_free, NULL);
+  pthread_cond_init(&bgzf->cond_read, NULL);
+  pthread_cond_init(&bgzf->cond_inflated, NULL);
+
+  if(pthread_create(&bgzf->reader, NULL, _bgzf_reader_thread, bgzf) != 0)
+  {
+    fprintf(stderr, "%s:%i: Error -- couldn't start a thread to read %s\n",
+            __FILE__, __LINE__, path);
+    exit(EXIT_FAILURE);
+  }
+
+  for(i = 0; i < num_threads; i++)
+  {
+    if(pthread_create(&bgzf->workers[i], NULL, _bgzf_worker_thread, bgzf) != 0)
+    {
+      fprintf(stderr, "%s:%i: Error -- couldn't start a thread to inflate %s\n",
+              __FILE__, __LINE__, path);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  return bgzf;
+}
+
+void seq_bgzf_close(SeqBgzf *bgzf)
+{
+  pthread_mutex_lock(&bgzf->lock);
+  bgzf->stop = 1;
+  pthread_cond_broadcast(&bgzf->cond_free);
+  pthread_cond_broadcast(&bgzf->cond_read);
+  pthread_mutex_unlock(&bgzf->lock);
+
+  pthread_join(bgzf->reader, NULL);
+
+  int i;
+  for(i = 0; i < bgzf->num_threads; i++)
+    pthread_join(bgzf->workers[i], NULL);
+
+  pthread_mutex_destroy(&bgzf->lock);
+  pthread_cond_destroy(&bgzf->cond_free);
+  pthread_cond_destroy(&bgzf->cond_read);
+  pthread_cond_destroy(&bgzf->cond_inflated);
+
+  for(i = 0; i < bgzf->num_jobs; i++)
+  {
+    free(bgzf->jobs[i].compressed);
+    free(bgzf->jobs[i].data);
+  }
+
+  free(bgzf->jobs);
+  free(bgzf->workers);
+  fclose(bgzf->file);
+  free(bgzf);
+}
@@ -0,0 +1,106 @@
+/*
+ seq_bgzf.h
+ project: seq_file
+ url: https://github.com/noporpoise/seq_file
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ Reading BGZF files (bgzip'd FASTA/FASTQ, BAM) with the blocks inflated on
+ several threads. BGZF blocks are independent gzip members of at most 64KB,
+ so one thread reads runs of blocks from the file, worker threads inflate
+ them, and the reader is handed the inflated runs in file order.
+*/
+
+#ifndef SEQ_BGZF_HEADER_SEEN
+#define SEQ_BGZF_HEADER_SEEN
+
+#include <pthread.h>
+
+#include "seq_common.h"
+
+#define SEQ_BGZF_MAX_BLOCK_SIZE 0x10000
+// number of blocks inflated at a time by one thread
+#define SEQ_BGZF_BLOCKS_PER_JOB 64
+
+typedef struct
+{
+  unsigned char *compressed; // the blocks, one after the other
+  size_t block_ends[SEQ_BGZF_BLOCKS_PER_JOB];
+  int num_blocks;
+  unsigned char *data; // inflated
+  size_t data_len;
+  char inflated, error;
+} SeqBgzfJob;
+
+typedef struct SeqBgzf
+{
+  const char *path;
+  FILE *file;
+
+  // jobs[i % num_jobs] is the i-th run of blocks in the file. Jobs up to
+  // num_read have been read from the file, up to num_taken have been taken by
+  // a worker, and up to num_used have been read through
+  int num_jobs;
+  SeqBgzfJob *jobs;
+  long long num_read, num_taken, num_used;
+  char read_all, stop, error;
+
+  int num_threads;
+  pthread_t reader;
+  pthread_t *workers;
+  pthread_mutex_t lock;
+  pthread_cond_t cond_free, cond_read, cond_inflated;
+
+  // Inflated data of job num_used, being read through
+  SeqBgzfJob *curr;
+  size_t curr_pos;
+} SeqBgzf;
+
+// Number of threads BGZF files are inflated with. With 1 (the default), they
+// are read like any other gzip file
+extern int seq_bgzf_threads;
+
+// Returns 1 if the file starts with a BGZF block
+char seq_bgzf_is_bgzf(const char *path);
+
+// Returns NULL if the file cannot be opened
+SeqBgzf* seq_bgzf_open(const char *path, int num_threads);
+void seq_bgzf_close(SeqBgzf *bgzf);
+
+// Reads up to len bytes. Returns the number of bytes read, 0 at the end of the
+// file and -1 on error
+int seq_bgzf_read(SeqBgzf *bgzf, void *data, size_t len);
+
+// Like fgetc, returns -1 at the end of the file
+int seq_bgzf_next_job(SeqBgzf *bgzf);
+#define seq_bgzf_getc(b) ((b)->curr != NULL && (b)->curr_pos < (b)->curr->data_len \
+                            ? (int)(b)->curr->data[(b)->curr_pos++] \
+                            : seq_bgzf_next_job(b))
+
+// c must be the character just read
+int seq_bgzf_ungetc(int c, SeqBgzf *bgzf);
+
+// As strbuf_readline / strbuf_skip_line
+t_buf_pos seq_bgzf_readline(StrBuf *sbuf, SeqBgzf *bgzf);
+t_buf_pos seq_bgzf_skip_line(SeqBgzf *bgzf);
+
+// BAM files: skip the header, then read records as bam_read1() does.
+// Returns 0 on success, -1 if the file is not BAM
+int seq_bgzf_skip_bam_header(SeqBgzf *bgzf);
+// Returns the record size, or < 0 at the end of the file or on error
+int seq_bgzf_read_bam(SeqBgzf *bgzf, bam1_t *b);
+
+#endif
@@ -36,6 +36,8 @@
 typedef enum WriteState
   {WS_READ_ONLY, WS_BEGIN, WS_NAME, WS_SEQ, WS_QUAL} WriteState;
 
+struct SeqBgzf;
+
 struct SeqFile
 {
   const char *path;
@@ -43,6 +45,9 @@ struct SeqFile
   // for reading FASTA/FASTQ/plain
   gzFile gz_file;
 
+  // for reading BGZF files (FASTA/FASTQ/plain and BAM) with several threads
+  struct SeqBgzf *bgzf;
+
   // For reading sam/bams
   samFile *sam_file;
   bam1_t *bam;
@@ -99,20 +104,23 @@ struct SeqFile
   ? (size_t)fwrite((str), sizeof(char), (size_t)(len), (f)->plain_file) \
   : (size_t)gzwrite((f)->gz_file, (str), (unsigned int)(len)))
 
-#define seq_getc(seq) ((seq)->plain_file != NULL ? fgetc((seq)->plain_file) \
-                                                 : gzgetc((seq)->gz_file))
+#define seq_getc(seq) ((seq)->bgzf != NULL ? seq_bgzf_getc((seq)->bgzf) \
+  : (seq)->plain_file != NULL ? fgetc((seq)->plain_file) \
+                              : gzgetc((seq)->gz_file))
 
-#define seq_ungetc(c,seq) ((seq)->plain_file != NULL \
-  ? ungetc((c),(seq)->plain_file) \
-  : gzungetc((c),(seq)->gz_file))
+#define seq_ungetc(c,seq) ((seq)->bgzf != NULL ? seq_bgzf_ungetc((c),(seq)->bgzf) \
+  : (seq)->plain_file != NULL ? ungetc((c),(seq)->plain_file) \
+                              : gzungetc((c),(seq)->gz_file))
 
-#define seq_readline(sbuf,seq) ((seq)->plain_file != NULL \
-  ? strbuf_readline((sbuf), (seq)->plain_file) \
-  : strbuf_gzreadline((sbuf), (seq)->gz_file))
+#define seq_readline(sbuf,seq) ((seq)->bgzf != NULL \
+  ? seq_bgzf_readline((sbuf), (seq)->bgzf) \
+  : (seq)->plain_file != NULL ? strbuf_readline((sbuf), (seq)->plain_file) \
+                              : strbuf_gzreadline((sbuf), (seq)->gz_file))
 
-#define seq_skip_line(seq) ((seq)->plain_file != NULL \
-  ? strbuf_skip_line((seq)->plain_file) \
-  : strbuf_gzskip_line((seq)->gz_file))
+#define seq_skip_line(seq) ((seq)->bgzf != NULL \
+  ? seq_bgzf_skip_line((seq)->bgzf) \
+  : (seq)->plain_file != NULL ? strbuf_skip_line((seq)->plain_file) \
+                              : strbuf_gzskip_line((seq)->gz_file))
 
 #define MIN(x,y) ((x) <= (y) ? (x) : (y))
 
@@ -128,4 +136,6 @@ struct SeqFile
 
 size_t _write_wrapped(SeqFile *sf, const char *str, size_t str_len);
 
+#include "seq_bgzf.h"
+
 #endif
@@ -140,6 +140,22 @@ void seq_guess_filetype_from_path(const char *path, SeqFileType *file_type,
 
 void _init_sam_bam(SeqFile *sf)
 {
+  // BAM with several threads
+  if(sf->file_type == SEQ_BAM && seq_bgzf_threads > 1 &&
+     seq_bgzf_is_bgzf(sf->path) &&
+     (sf->bgzf = seq_bgzf_open(sf->path, seq_bgzf_threads)) != NULL)
+  {
+    if(seq_bgzf_skip_bam_header(sf->bgzf) != 0)
+    {
+      fprintf(stderr, "%s:%i: Failed to read BAM header: %s\n",
+              __FILE__, __LINE__, sf->path);
+      exit(EXIT_FAILURE);
+    }
+
+    sf->bam = bam_init1();
+    return;
+  }
+
   // SAM/BAM
   const char *mode = sf->file_type == SEQ_SAM ? "rs" : "rb";
   sf->sam_file = sam_open(sf->path, mode, 0);
@@ -165,6 +181,11 @@ void _init_plain_fasta_fastq(SeqFile *sf)
     //sf->gz_file = gzdopen(fileno(stdin), "r");
     sf->plain_file = stdin;
   }
+  else if(seq_bgzf_threads > 1 && seq_bgzf_is_bgzf(sf->path) &&
+          (sf->bgzf = seq_bgzf_open(sf->path, seq_bgzf_threads)) != NULL)
+  {
+    // bgzip'd, inflated on several threads
+  }
   else
   {
     sf->gz_file = gzopen(sf->path, "r");
@@ -271,6 +292,7 @@ SeqFile* _create_default_seq_file(const char* file_path)
   sf->path = file_path;
 
   sf->gz_file = NULL;
+  sf->bgzf = NULL;
 
   sf->sam_file = NULL;
   sf->bam = NULL;
@@ -464,11 +486,20 @@ size_t seq_file_close(SeqFile* sf)
     gzclose(sf->gz_file);
   }
 
+  if(sf->bgzf != NULL)
+  {
+    seq_bgzf_close(sf->bgzf);
+  }
+
   if(sf->file_type == SEQ_SAM || sf->file_type == SEQ_BAM)
   {
     bam_destroy1(sf->bam);
-    bam_hdr_destroy(sf->sam_header);
-    sam_close(sf->sam_file);
+
+    if(sf->sam_file != NULL)
+    {
+      bam_hdr_destroy(sf->sam_header);
+      sam_close(sf->sam_file);
+    }
   }
 
   if(sf->bases_buff != NULL)
@@ -489,6 +520,11 @@ size_t seq_file_close(SeqFile* sf)
   return num_bytes_printed;
 }
 
+void seq_file_set_threads(int num_threads)
+{
+  seq_bgzf_threads = num_threads > 1 ? num_threads : 1;
+}
+
 SeqFileType seq_file_get_type(const SeqFile* sf)
 {
   return sf->file_type;
@@ -36,6 +36,11 @@ enum SeqFileType
 // Open for reading
 SeqFile* seq_file_open(const char* path);
 
+// Number of threads to inflate BGZF files (bgzip'd FASTA/FASTQ, BAM) with,
+// for files opened after this call. The default is 1, which reads them with
+// zlib/htslib on the calling thread
+void seq_file_set_threads(int num_threads);
+
 // Open a file assuming a given filetype
 //SeqFile* seq_file_open_filetype(const char* file_path,
 //                                SeqFileType file_type);
@@ -124,4 +129,47 @@ size_t seq_file_write_name(SeqFile *sf, const char *name);
 size_t seq_file_write_seq(SeqFile *sf, const char *seq);
 size_t seq_file_write_qual(SeqFile *sf, const char *qual);
 
+//
+// Reading FASTA/FASTQ (gzipped or not) a batch of reads at a time.
+// The file is inflated on a separate thread into large blocks, and reads are
+// cut out of the blocks with memchr, rather than a character at a time.
+//
+
+typedef struct SeqBatchReader SeqBatchReader;
+
+typedef struct
+{
+  // null terminated, qual is NULL if the file has no quality scores
+  char *name, *seq, *qual;
+  size_t name_len, seq_len, qual_len;
+} SeqBatchRead;
+
+typedef struct
+{
+  SeqBatchRead *reads;
+  size_t num_reads, max_reads;
+
+  // the names, bases and quality scores of the reads
+  char *data;
+  size_t data_len, data_capacity;
+  // offsets of the reads into data while the batch is being filled
+  size_t *offsets;
+} SeqBatch;
+
+// Returns NULL if the file cannot be opened or is not FASTA/FASTQ
+SeqBatchReader* seq_batch_reader_open(const char *path);
+void seq_batch_reader_close(SeqBatchReader *reader);
+
+// Returns 1 if the reads have quality scores, 0 otherwise
+char seq_batch_reader_has_quality_scores(const SeqBatchReader *reader);
+
+SeqBatch* seq_batch_new(size_t max_reads);
+void seq_batch_free(SeqBatch *batch);
+
+// Fills batch with the next batch->max_reads reads (fewer at the end of the
+// file). Returns the number of reads, 0 once all have been read.
+// Batches may be passed on to other threads, but calls for one reader must
+// not be made by two threads at once.
+size_t seq_batch_read(SeqBatchReader *reader, SeqBatch *batch);
+
 #endif
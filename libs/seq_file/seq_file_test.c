@@ -22,6 +22,10 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "bgzf.h"
 
 #include "seq_file.h"
 
@@ -105,11 +109,240 @@ void test_get_type(char* file_path)
   seq_file_close(file);
 }
 
+double seconds_since(struct timeval *start)
+{
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) / 1e6;
+}
+
+// Reads the whole file with seq_next_read(), counting reads and bases and
+// summing the bases into a checksum. Returns the seconds taken
+double time_seq_next_read(char *file_path, unsigned long *reads,
+                          unsigned long *bases, unsigned long *sum)
+{
+  struct timeval start;
+  size_t j;
+
+  *reads = *bases = *sum = 0;
+
+  SeqFile *sf = seq_file_open(file_path);
+
+  if(sf == NULL)
+  {
+    fprintf(stderr, "%s:%i: Couldn't open file %s\n",
+            __FILE__, __LINE__, file_path);
+    return 0;
+  }
+
+  StrBuf *seq = strbuf_new();
+  StrBuf *qual = strbuf_new();
+  char read_qual = seq_has_quality_scores(sf);
+
+  gettimeofday(&start, NULL);
+  while(seq_next_read(sf))
+  {
+    if(read_qual)
+      seq_read_all_bases_and_quals(sf, seq, qual);
+    else
+      seq_read_all_bases(sf, seq);
+
+    (*reads)++;
+    *bases += strbuf_len(seq);
+    for(j = 0; j < strbuf_len(seq); j++)
+      *sum += (unsigned char)seq->buff[j] * (j+1);
+    *sum += strlen(seq_get_read_name(sf));
+  }
+  double secs = seconds_since(&start);
+
+  seq_file_close(sf);
+  strbuf_free(seq);
+  strbuf_free(qual);
+  return secs;
+}
+
+// As time_seq_next_read(), reading the file in batches
+double time_seq_batch_read(char *file_path, unsigned long *reads,
+                           unsigned long *bases, unsigned long *sum)
+{
+  struct timeval start;
+  size_t i, j;
+
+  *reads = *bases = *sum = 0;
+
+  SeqBatchReader *reader = seq_batch_reader_open(file_path);
+
+  if(reader == NULL)
+  {
+    fprintf(stderr, "%s:%i: Couldn't open file %s in batches\n",
+            __FILE__, __LINE__, file_path);
+    return 0;
+  }
+
+  SeqBatch *batch = seq_batch_new(10000);
+
+  gettimeofday(&start, NULL);
+  while(seq_batch_read(reader, batch))
+  {
+    for(i = 0; i < batch->num_reads; i++)
+    {
+      SeqBatchRead *read = &batch->reads[i];
+      (*reads)++;
+      *bases += read->seq_len;
+      for(j = 0; j < read->seq_len; j++)
+        *sum += (unsigned char)read->seq[j] * (j+1);
+      *sum += read->name_len;
+    }
+  }
+  double secs = seconds_since(&start);
+
+  seq_batch_free(batch);
+  seq_batch_reader_close(reader);
+  return secs;
+}
+
+// Reads the file a read at a time and in batches, with one thread and then
+// num_threads to inflate BGZF files, checks they all give the same reads and
+// prints how fast each was
+void test_read_speed(char *file_path, int num_threads)
+{
+  unsigned long reads[4], bases[4], sum[4];
+  double secs[4];
+  const char *names[4] = {"seq_next_read", "seq_batch_read",
+                          "seq_next_read", "seq_batch_read"};
+  int i, num_runs = num_threads > 1 ? 4 : 2;
+
+  // SAM/BAM cannot be read in batches
+  SeqFileType file_type;
+  char zipped;
+  seq_guess_filetype_from_path(file_path, &file_type, &zipped);
+  char batches = (file_type != SEQ_SAM && file_type != SEQ_BAM);
+
+  for(i = 0; i < num_runs; i++)
+  {
+    if(i % 2 == 1 && !batches)
+      continue;
+
+    seq_file_set_threads(i < 2 ? 1 : num_threads);
+
+    if(i % 2 == 0)
+      secs[i] = time_seq_next_read(file_path, &reads[i], &bases[i], &sum[i]);
+    else
+      secs[i] = time_seq_batch_read(file_path, &reads[i], &bases[i], &sum[i]);
+
+    printf("%s, %i thread(s): %lu reads, %lu bases in %.2f secs "
+           "(%.1f Mbases/sec)\n",
+           names[i], i < 2 ? 1 : num_threads, reads[i], bases[i], secs[i],
+           bases[i] / secs[i] / 1e6);
+
+    if(reads[i] != reads[0] || bases[i] != bases[0] || sum[i] != sum[0])
+    {
+      printf("Error: the reads are not the same as with seq_next_read\n");
+    }
+  }
+
+  seq_file_set_threads(1);
+}
+
+// Writes file_path as BGZF to bgzf_path, flushing every 4KB so there are
+// several runs of blocks for the threads to inflate
+int write_bgzf_copy(char *file_path, char *bgzf_path)
+{
+  FILE *in = fopen(file_path, "r");
+  BGZF *out = bgzf_open(bgzf_path, "w");
+
+  if(in == NULL || out == NULL)
+  {
+    fprintf(stderr, "%s:%i: Couldn't copy %s to %s\n",
+            __FILE__, __LINE__, file_path, bgzf_path);
+    if(in != NULL) fclose(in);
+    if(out != NULL) bgzf_close(out);
+    return 0;
+  }
+
+  char buf[4096];
+  size_t len;
+
+  while((len = fread(buf, 1, sizeof(buf), in)) > 0)
+  {
+    bgzf_write(out, buf, len);
+    bgzf_flush(out);
+  }
+
+  fclose(in);
+  bgzf_close(out);
+  return 1;
+}
+
+// Checks that a BGZF copy of a FASTA/FASTQ file, inflated on one thread and
+// on num_threads, a read at a time and in batches, gives the same reads as the
+// plain file. Returns 1 if it does
+int test_bgzf_threads(char *file_path, char *bgzf_path, int num_threads)
+{
+  unsigned long reads[5], bases[5], sum[5];
+  const char *names[5] = {"plain file", "seq_next_read", "seq_batch_read",
+                          "seq_next_read", "seq_batch_read"};
+  int i, passed = 1;
+
+  if(!write_bgzf_copy(file_path, bgzf_path))
+    return 0;
+
+  seq_file_set_threads(1);
+  time_seq_next_read(file_path, &reads[0], &bases[0], &sum[0]);
+
+  for(i = 1; i < 5; i++)
+  {
+    seq_file_set_threads(i < 3 ? 1 : num_threads);
+
+    if(i % 2 == 1)
+      time_seq_next_read(bgzf_path, &reads[i], &bases[i], &sum[i]);
+    else
+      time_seq_batch_read(bgzf_path, &reads[i], &bases[i], &sum[i]);
+
+    printf("%s, %i thread(s): %lu reads, %lu bases\n",
+           names[i], i < 3 ? 1 : num_threads, reads[i], bases[i]);
+
+    if(reads[i] != reads[0] || bases[i] != bases[0] || sum[i] != sum[0])
+    {
+      printf("Error: the reads are not the same as in %s\n", file_path);
+      passed = 0;
+    }
+  }
+
+  seq_file_set_threads(1);
+
+  if(reads[0] == 0)
+  {
+    printf("Error: no reads in %s\n", file_path);
+    passed = 0;
+  }
+
+  return passed;
+}
+
 int main(int argc, char** argv)
 {
+  if((argc == 3 || argc == 4) && strcmp(argv[1], "--bench") == 0)
+  {
+    // compare reading a file a read at a time with reading it in batches,
+    // and inflating BGZF files with several threads
+    test_read_speed(argv[2], argc == 4 ? atoi(argv[3]) : 1);
+    return EXIT_SUCCESS;
+  }
+
+  if((argc == 4 || argc == 5) && strcmp(argv[1], "--bgzf") == 0)
+  {
+    // check bgzip'd files inflated on several threads give the same reads
+    int num_threads = argc == 5 ? atoi(argv[4]) : 4;
+    return test_bgzf_threads(argv[2], argv[3], num_threads) ? EXIT_SUCCESS
+                                                            : EXIT_FAILURE;
+  }
+
   if(argc != 2)
   {
-    printf("usage: seq_file_test <in.fa|fq|sam|bam>\n");
+    printf("usage: seq_file_test <in.fa|fq|sam|bam>\n"
+           "       seq_file_test --bench <in.fa|fq|bam> [threads]\n"
+           "       seq_file_test --bgzf <in.fa|fq> <out.gz> [threads]\n");
     return -1;
   }
 
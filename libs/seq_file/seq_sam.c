@@ -36,7 +36,8 @@ char seq_next_read_sam(SeqFile *sf)
                                sf->entry_offset;
   }
 
-  if(sam_read1(sf->sam_file, sf->sam_header, sf->bam) < 0)
+  if(sf->bgzf != NULL ? seq_bgzf_read_bam(sf->bgzf, sf->bam) < 0
+                      : sam_read1(sf->sam_file, sf->sam_header, sf->bam) < 0)
     return 0;
 
   // Get name
@@ -56,15 +56,29 @@ my $bubble_graph_log = $bubble_graph.".log";
 my $cmd3 = $ctx_binary1." --se_list $branches_list --mem_height $mem_height --mem_width $mem_width --kmer_size 31  --dump_binary $bubble_graph  > $bubble_graph_log 2>&1";
 qx{$cmd3};
 
-print "Finished building a graph just of the bubble branches/alleles. Now intersect the ref binary\n";
+print "Finished building a graph just of the bubble branches/alleles. Now dump an image of it for the parallel jobs to share\n";
 
 
+## The image is of the frozen graph, so is only as big as the bubble graph. Every job
+## (script7) maps it instead of loading the binary into a hash table of its own
 my $ctx_binary2 = check_cortex_compiled_2colours($cortex_dir, $kmer);
+my $bubble_image = $bubble_graph;
+$bubble_image =~ s/ctx$/img/;
+my $bubble_image_log = $bubble_image.".log";
+my $cmd_image = $ctx_binary2." --kmer_size 31 --multicolour_bin $bubble_graph --mem_height $mem_height --mem_width $mem_width --freeze_graph --dump_graph_image $bubble_image > $bubble_image_log 2>&1";
+qx{$cmd_image};
+if (!(-e $bubble_image))
+{
+    die("Failed to create $bubble_image. See logfile $bubble_image_log\n");
+}
+
+print "Now intersect the ref binary\n";
+
 my $suffix = "intersect_bubbles";
 my $ref_intersect_log = basename($ref.".intersect_with_bubbles.log");
 my $ref_col_list=get_ref_col_list($ref);
 
-my $cmd4 = $ctx_binary2." --kmer_size 31 --multicolour_bin $bubble_graph --mem_height 23 --mem_width 100 --colour_list $ref_col_list  --load_colours_only_where_overlap_clean_colour 0 --successively_dump_cleaned_colours $suffix  > $ref_intersect_log 2>&1";
+my $cmd4 = $ctx_binary2." --kmer_size 31 --graph_image $bubble_image --colour_list $ref_col_list  --load_colours_only_where_overlap_clean_colour 0 --successively_dump_cleaned_colours $suffix  > $ref_intersect_log 2>&1";
 qx{$cmd4};
 
 
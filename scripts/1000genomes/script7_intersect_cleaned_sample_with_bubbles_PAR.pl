@@ -41,7 +41,18 @@ my $ctx_binary = check_cortex_compiled_2colours($cortex_dir, $kmer);
 my $colour_list = make_colourlist($sample_cleaned_graph, $sample);
 my $suffix = "intersect_bubbles_thresh".$thresh;
 
-my $cmd = $ctx_binary." --kmer_size $kmer --mem_height $mem_height --mem_width $mem_width --multicolour_bin $bubble_graph --colour_list $colour_list --load_colours_only_where_overlap_clean_colour 0 --successively_dump_cleaned_colours $suffix";
+
+## script6 leaves an image of the bubble graph next to it - mapping that is instant,
+## and the parallel jobs share its memory
+my $bubble_image = $bubble_graph;
+$bubble_image =~ s/ctx$/img/;
+my $bubble_input = " --mem_height $mem_height --mem_width $mem_width --multicolour_bin $bubble_graph";
+if ( ($bubble_image ne $bubble_graph) && (-e $bubble_image) )
+{
+    $bubble_input = " --graph_image $bubble_image";
+}
+
+my $cmd = $ctx_binary." --kmer_size $kmer".$bubble_input." --colour_list $colour_list --load_colours_only_where_overlap_clean_colour 0 --successively_dump_cleaned_colours $suffix";
 print "$cmd\n";
 my $ret = qx{$cmd};
 print "$ret\n";
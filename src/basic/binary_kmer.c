@@ -481,73 +481,79 @@ char * binary_kmer_to_seq(BinaryKmer* bkmer, short kmer_size, char * seq){
 
 // kmer and prealloc_reverse_kmer may point to the same address
 // This is a highly optimised version of the above function
+// Reverse complement of the 32 bases in a bitfield: complement, swap the bases
+// within each byte, then reverse the bytes
+static inline bitfield_of_64bits bitfield_reverse_complement(bitfield_of_64bits word)
+{
+  word = ~word;
+  word = ((word >> 2) & 0x3333333333333333ULL) | ((word & 0x3333333333333333ULL) << 2);
+  word = ((word >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((word & 0x0F0F0F0F0F0F0F0FULL) << 4);
+  return __builtin_bswap64(word);
+}
+
 BinaryKmer* binary_kmer_reverse_complement(BinaryKmer* kmer, short kmer_size,
                                            BinaryKmer* prealloc_reverse_kmer)
 {
-  binary_kmer_initialise_to_zero(prealloc_reverse_kmer);
-
-  BinaryKmer kmer_copy;
-
-  // Copy
-  memcpy(kmer_copy, kmer, BINARY_KMER_BYTES);
-
-  // Complement
+  // Reverse complement all the bitfields as if the kmer filled them, so the
+  // unused bases at the top end up at the bottom...
+  BinaryKmer reversed;
   int i;
   for(i = 0; i < NUMBER_OF_BITFIELDS_IN_BINARY_KMER; i++)
   {
-    kmer_copy[i] = ~kmer_copy[i];
+    reversed[i] = bitfield_reverse_complement((*kmer)[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1-i]);
   }
 
-  // Reverse
-  // Loop over full bitfields
-  int j, k;
-  for(i = NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1; i > 0; i--)
-  {
-    for(j = 0; j < 32; j++)
-    {
-      // Shift destination left
-      for(k = 0; k < NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1; k++)
-      {
-        (*prealloc_reverse_kmer)[k] <<= 2;
-        (*prealloc_reverse_kmer)[k] |= ((*prealloc_reverse_kmer)[k+1] >> 62);
-      }
+  // ...and shift them off the right hand end
+  int shift = 2 * (32 * NUMBER_OF_BITFIELDS_IN_BINARY_KMER - kmer_size);
+  int word_shift = shift / 64;
+  int bit_shift = shift % 64;
 
-      (*prealloc_reverse_kmer)[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1] <<= 2;
+  for(i = NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1; i >= 0; i--)
+  {
+    int from = i - word_shift;
+    bitfield_of_64bits word = 0;
 
-      // Append new base
-      (*prealloc_reverse_kmer)[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1] |= kmer_copy[i] & 0x3;
+    if(from >= 0)
+    {
+      word = reversed[from] >> bit_shift;
 
-      // Shift source right
-      kmer_copy[i] >>= 2;
+      if(from > 0 && bit_shift > 0)
+        word |= reversed[from-1] << (64 - bit_shift);
     }
+
+    (*prealloc_reverse_kmer)[i] = word;
   }
 
-  // Do remaining bases in last bitfield [0]
-  int top_bases = kmer_size % 32;
+  return prealloc_reverse_kmer;
+}
 
-  for(i = 0; i < top_bases; i++)
-  {
-    // Shift destination left
-    for(k = 0; k < NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1; k++)
-    {
-      (*prealloc_reverse_kmer)[k] <<= 2;
-      (*prealloc_reverse_kmer)[k] |= ((*prealloc_reverse_kmer)[k+1] >> 62);
-    }
+void binary_kmer_rolling_set(RollingBinaryKmer* rolling, BinaryKmer* kmer, short kmer_size)
+{
+  binary_kmer_assignment_operator(rolling->forward, *kmer);
+  binary_kmer_reverse_complement(kmer, kmer_size, &rolling->reverse);
+}
 
-    (*prealloc_reverse_kmer)[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1] <<= 2;
+void binary_kmer_rolling_add_base(RollingBinaryKmer* rolling, Nucleotide n, short kmer_size)
+{
+  binary_kmer_left_shift_one_base_and_insert_new_base_at_right_end(&rolling->forward, n, kmer_size);
 
-    // Append new base
-    (*prealloc_reverse_kmer)[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1] |= kmer_copy[0] & 0x3;
-    
-    // Shift source right
-    kmer_copy[0] >>= 2;
-  }
+  // the complement of the new base goes in at the left end of the reverse complement
+  int top_word = NUMBER_OF_BITFIELDS_IN_BINARY_KMER - (kmer_size+31)/32;
+  binary_kmer_right_shift_one_base(rolling->reverse);
+  rolling->reverse[top_word] |= ((bitfield_of_64bits)(~n & 0x3)) << (2 * ((kmer_size-1) % 32));
+}
 
-  // Mask top word (we didn't zero at the beginning!)
-  short top_bits = 2 * top_bases; // bits in top word
-  (*prealloc_reverse_kmer)[0] &= (~(uint64_t)0 >> (64 - top_bits));
+BinaryKmer* binary_kmer_rolling_get_key(RollingBinaryKmer* rolling, short kmer_size,
+                                        Orientation* orientation)
+{
+  if(binary_kmer_less_than(rolling->reverse, rolling->forward, kmer_size))
+  {
+    *orientation = reverse;
+    return &rolling->reverse;
+  }
 
-  return prealloc_reverse_kmer;
+  *orientation = forward;
+  return &rolling->forward;
 }
 
 Nucleotide binary_kmer_get_first_nucleotide(BinaryKmer* kmer, short kmer_size)
@@ -37,6 +37,8 @@
 const Covg COVG_MAX = UINT_MAX;
 //const Covg COVG_MAX = INT_MAX
 
+int NUM_THREADS = 1;
+
 //want to avoid overflow issues,
 //see discussion here:http://stackoverflow.com/questions/1020188/fast-average-without-division
 Covg mean_of_covgs(Covg a, Covg b)
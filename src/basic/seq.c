@@ -37,8 +37,9 @@
 boolean good_base(char c);
 
 
-char current_entry_name[LINE_MAX+1] = "";
-int  last_end_coord;
+// per thread, so threads can each read their own fasta at once
+__thread char current_entry_name[LINE_MAX+1] = "";
+__thread int  last_end_coord;
 
 
 //new_entry tells the parser to expect a new fasta entry (ie starts with >)
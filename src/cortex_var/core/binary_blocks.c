@@ -0,0 +1,499 @@
+/*
+ * Copyright 2009-2011 Zamin Iqbal and Mario Caccamo
+ *
+ * CORTEX project contacts:
+ * 		M. Caccamo (mario.caccamo@bbsrc.ac.uk) and
+ * 		Z. Iqbal (zam@well.ox.ac.uk)
+ *
+ * **********************************************************************
+ *
+ * This file is part of CORTEX.
+ *
+ * CORTEX is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CORTEX is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CORTEX.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * **********************************************************************
+ */
+/*
+  binary_blocks.c - compressed records of version 7 binaries
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <zlib.h>
+
+#include "binary_blocks.h"
+
+#define BINARY_BLOCK_HEADER_SIZE (3*sizeof(uint32_t))
+#define BINARY_BLOCK_INDEX_ENTRY_SIZE (sizeof(long long)+sizeof(uint32_t))
+#define BINARY_BLOCK_FOOTER_SIZE (2*sizeof(long long)+6)
+
+static const char binary_block_magic[6] = {'C','O','R','T','E','X'};
+
+static size_t max_encoded_record_size(int num_colours)
+{
+  // shared bitfields, varint delta, raw bitfields, varint covgs, edges
+  return 1 + 10 + sizeof(bitfield_of_64bits)*(NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1)
+         + num_colours * (5 + sizeof(Edges));
+}
+
+static inline char* put_varint(char* out, uint64_t val)
+{
+  while(val >= 0x80)
+  {
+    *out++ = (char)(val | 0x80);
+    val >>= 7;
+  }
+  *out++ = (char)val;
+  return out;
+}
+
+// Returns NULL if the varint runs past end
+static inline const char* get_varint(const char* in, const char* end, uint64_t* val)
+{
+  uint64_t v = 0;
+  int shift = 0;
+  while(in < end && shift < 64)
+  {
+    unsigned char c = (unsigned char)*in++;
+    v |= (uint64_t)(c & 0x7f) << shift;
+    if(!(c & 0x80))
+    {
+      *val = v;
+      return in;
+    }
+    shift += 7;
+  }
+  return NULL;
+}
+
+//
+// Writing
+//
+
+BinaryBlockEncoder* binary_block_encoder_new(int num_colours)
+{
+  BinaryBlockEncoder* enc = malloc(sizeof(BinaryBlockEncoder));
+  if(enc == NULL)
+    die("Unable to malloc a binary block encoder\n");
+
+  enc->num_colours = num_colours;
+  enc->record_size = sizeof(bitfield_of_64bits)*NUMBER_OF_BITFIELDS_IN_BINARY_KMER
+                     + num_colours * (sizeof(Covg) + sizeof(Edges));
+  enc->num_records = 0;
+  enc->records = malloc(BINARY_BLOCK_RECORDS * enc->record_size);
+  enc->sorted = malloc(BINARY_BLOCK_RECORDS * sizeof(char*));
+  enc->raw = malloc(BINARY_BLOCK_RECORDS * max_encoded_record_size(num_colours));
+  enc->out_capacity = BINARY_BLOCK_HEADER_SIZE
+                      + compressBound(BINARY_BLOCK_RECORDS * max_encoded_record_size(num_colours));
+  enc->out = malloc(enc->out_capacity);
+  enc->out_len = 0;
+  enc->num_blocks = 0;
+  enc->index_capacity = 16;
+  enc->index = malloc(enc->index_capacity * sizeof(BinaryBlockIndexEntry));
+
+  if(enc->records == NULL || enc->sorted == NULL || enc->raw == NULL ||
+     enc->out == NULL || enc->index == NULL)
+  {
+    die("Unable to malloc buffers to write a compressed binary\n");
+  }
+
+  return enc;
+}
+
+void binary_block_encoder_free(BinaryBlockEncoder* enc)
+{
+  free(enc->records);
+  free(enc->sorted);
+  free(enc->raw);
+  free(enc->out);
+  free(enc->index);
+  free(enc);
+}
+
+static int compare_records_by_kmer(const void* a, const void* b)
+{
+  const char* rec_a = *(const char**)a;
+  const char* rec_b = *(const char**)b;
+  int i;
+  for(i = 0; i < NUMBER_OF_BITFIELDS_IN_BINARY_KMER; i++)
+  {
+    bitfield_of_64bits x, y;
+    memcpy(&x, rec_a + i*sizeof(bitfield_of_64bits), sizeof(bitfield_of_64bits));
+    memcpy(&y, rec_b + i*sizeof(bitfield_of_64bits), sizeof(bitfield_of_64bits));
+    if(x != y)
+      return x < y ? -1 : 1;
+  }
+  return 0;
+}
+
+void binary_block_encoder_flush(BinaryBlockEncoder* enc)
+{
+  if(enc->num_records == 0)
+    return;
+
+  const char** sorted = enc->sorted;
+  int i, j;
+  for(i = 0; i < enc->num_records; i++)
+    sorted[i] = enc->records + i * enc->record_size;
+  qsort(sorted, enc->num_records, sizeof(char*), compare_records_by_kmer);
+
+  bitfield_of_64bits prev[NUMBER_OF_BITFIELDS_IN_BINARY_KMER];
+  memset(prev, 0, sizeof(prev));
+  char* out = enc->raw;
+
+  for(i = 0; i < enc->num_records; i++)
+  {
+    const char* rec = sorted[i];
+    bitfield_of_64bits kmer[NUMBER_OF_BITFIELDS_IN_BINARY_KMER];
+    memcpy(kmer, rec, sizeof(kmer));
+
+    int shared = 0;
+    while(shared < NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1 && kmer[shared] == prev[shared])
+      shared++;
+
+    *out++ = (char)shared;
+    out = put_varint(out, kmer[shared] - prev[shared]);
+    for(j = shared+1; j < NUMBER_OF_BITFIELDS_IN_BINARY_KMER; j++)
+    {
+      memcpy(out, &kmer[j], sizeof(bitfield_of_64bits));
+      out += sizeof(bitfield_of_64bits);
+    }
+    memcpy(prev, kmer, sizeof(kmer));
+
+    const char* covgs = rec + sizeof(kmer);
+    for(j = 0; j < enc->num_colours; j++)
+    {
+      Covg covg;
+      memcpy(&covg, covgs + j*sizeof(Covg), sizeof(Covg));
+      out = put_varint(out, covg);
+    }
+    memcpy(out, covgs + enc->num_colours*sizeof(Covg), enc->num_colours*sizeof(Edges));
+    out += enc->num_colours*sizeof(Edges);
+  }
+
+  // room for this block after any already encoded
+  uLong raw_len = out - enc->raw;
+  uLongf compressed_len = compressBound(raw_len);
+  if(enc->out_len + BINARY_BLOCK_HEADER_SIZE + compressed_len > enc->out_capacity)
+  {
+    enc->out_capacity = 2*enc->out_capacity + BINARY_BLOCK_HEADER_SIZE + compressed_len;
+    enc->out = realloc(enc->out, enc->out_capacity);
+    if(enc->out == NULL)
+      die("Unable to grow the buffer of a compressed binary being written\n");
+  }
+
+  char* block = enc->out + enc->out_len;
+  if(compress2((Bytef*)block + BINARY_BLOCK_HEADER_SIZE, &compressed_len,
+               (const Bytef*)enc->raw, raw_len, Z_DEFAULT_COMPRESSION) != Z_OK)
+  {
+    die("Failed to compress a block of the binary being written\n");
+  }
+
+  uint32_t header[3] = {enc->num_records, raw_len, compressed_len};
+  memcpy(block, header, sizeof(header));
+
+  if(enc->num_blocks == enc->index_capacity)
+  {
+    enc->index_capacity *= 2;
+    enc->index = realloc(enc->index, enc->index_capacity * sizeof(BinaryBlockIndexEntry));
+    if(enc->index == NULL)
+      die("Unable to grow the block index of the binary being written\n");
+  }
+  enc->index[enc->num_blocks].offset = enc->out_len;
+  enc->index[enc->num_blocks].num_records = enc->num_records;
+  enc->num_blocks++;
+
+  enc->out_len += BINARY_BLOCK_HEADER_SIZE + compressed_len;
+  enc->num_records = 0;
+}
+
+void binary_block_encoder_add(BinaryBlockEncoder* enc, BinaryKmer kmer,
+                              Covg* covgs, Edges* edges)
+{
+  char* rec = enc->records + enc->num_records * enc->record_size;
+  memcpy(rec, kmer, sizeof(BinaryKmer));
+  rec += sizeof(BinaryKmer);
+  memcpy(rec, covgs, enc->num_colours * sizeof(Covg));
+  rec += enc->num_colours * sizeof(Covg);
+  memcpy(rec, edges, enc->num_colours * sizeof(Edges));
+
+  if(++enc->num_records == BINARY_BLOCK_RECORDS)
+    binary_block_encoder_flush(enc);
+}
+
+void binary_block_writer_init(BinaryBlockWriter* writer, FILE* fp)
+{
+  writer->fp = fp;
+  writer->num_blocks = 0;
+  writer->index_capacity = 64;
+  writer->index = malloc(writer->index_capacity * sizeof(BinaryBlockIndexEntry));
+  if(writer->index == NULL)
+    die("Unable to malloc the block index of the binary being written\n");
+}
+
+void binary_block_writer_append(BinaryBlockWriter* writer, BinaryBlockEncoder* enc)
+{
+  binary_block_encoder_flush(enc);
+
+  long long start = ftell(writer->fp);
+  if(enc->out_len > 0 && fwrite(enc->out, 1, enc->out_len, writer->fp) != enc->out_len)
+    die("Failed to write a block of the binary - out of disk?\n");
+
+  long long i;
+  for(i = 0; i < enc->num_blocks; i++)
+  {
+    if(writer->num_blocks == writer->index_capacity)
+    {
+      writer->index_capacity *= 2;
+      writer->index = realloc(writer->index, writer->index_capacity * sizeof(BinaryBlockIndexEntry));
+      if(writer->index == NULL)
+        die("Unable to grow the block index of the binary being written\n");
+    }
+    writer->index[writer->num_blocks].offset = start + enc->index[i].offset;
+    writer->index[writer->num_blocks].num_records = enc->index[i].num_records;
+    writer->num_blocks++;
+  }
+
+  enc->out_len = 0;
+  enc->num_blocks = 0;
+}
+
+void binary_block_writer_finish(BinaryBlockWriter* writer)
+{
+  long long index_offset = ftell(writer->fp);
+  size_t written = 0;
+  long long i;
+  for(i = 0; i < writer->num_blocks; i++)
+  {
+    written += fwrite(&writer->index[i].offset, sizeof(long long), 1, writer->fp);
+    written += fwrite(&writer->index[i].num_records, sizeof(uint32_t), 1, writer->fp);
+  }
+  written += fwrite(&writer->num_blocks, sizeof(long long), 1, writer->fp);
+  written += fwrite(&index_offset, sizeof(long long), 1, writer->fp);
+  written += fwrite(binary_block_magic, sizeof(char), 6, writer->fp);
+
+  if(written != 2 * (size_t)writer->num_blocks + 2 + 6 || fflush(writer->fp) != 0)
+    die("Failed to write the block index of the binary - out of disk?\n");
+
+  free(writer->index);
+  writer->index = NULL;
+}
+
+//
+// Reading
+//
+
+void binary_block_reader_open(BinaryBlockReader* reader, const char* file, size_t file_len,
+                              size_t data_start, int num_colours, int num_threads,
+                              char* filename)
+{
+  reader->file = file;
+  reader->filename = filename;
+  reader->num_colours = num_colours;
+  reader->record_size = sizeof(bitfield_of_64bits)*NUMBER_OF_BITFIELDS_IN_BINARY_KMER
+                        + num_colours * (sizeof(Covg) + sizeof(Edges));
+  reader->num_threads = num_threads < 1 ? 1 : num_threads;
+  reader->next_block = 0;
+  reader->decoded = NULL;
+  reader->decoded_capacity = 0;
+
+  long long index_offset;
+  const char* footer = file + file_len - BINARY_BLOCK_FOOTER_SIZE;
+
+  if(file_len < data_start + BINARY_BLOCK_FOOTER_SIZE ||
+     memcmp(footer + 2*sizeof(long long), binary_block_magic, 6) != 0)
+  {
+    die("Binary %s is truncated or corrupt - cannot find the block index at the end of the file\n",
+        filename);
+  }
+
+  memcpy(&reader->num_blocks, footer, sizeof(long long));
+  memcpy(&index_offset, footer + sizeof(long long), sizeof(long long));
+  reader->index_offset = index_offset;
+
+  if(reader->num_blocks < 0 || index_offset < (long long)data_start ||
+     index_offset + reader->num_blocks * (long long)BINARY_BLOCK_INDEX_ENTRY_SIZE
+       != (long long)(footer - file))
+  {
+    die("Binary %s is corrupt - the block index is inconsistent with the file size\n", filename);
+  }
+
+  reader->index = malloc((reader->num_blocks+1) * sizeof(BinaryBlockIndexEntry));
+  if(reader->index == NULL)
+    die("Unable to malloc the block index of binary %s\n", filename);
+
+  long long i;
+  const char* entry = file + index_offset;
+  for(i = 0; i < reader->num_blocks; i++)
+  {
+    memcpy(&reader->index[i].offset, entry, sizeof(long long));
+    memcpy(&reader->index[i].num_records, entry + sizeof(long long), sizeof(uint32_t));
+    entry += BINARY_BLOCK_INDEX_ENTRY_SIZE;
+
+    long long block_start = (i == 0 ? (long long)data_start : reader->index[i-1].offset);
+    if((i == 0 ? reader->index[i].offset != block_start : reader->index[i].offset <= block_start) ||
+       reader->index[i].offset + (long long)BINARY_BLOCK_HEADER_SIZE > index_offset)
+    {
+      die("Binary %s is corrupt - block %lld is not where the index says it is\n", filename, i);
+    }
+  }
+}
+
+typedef struct
+{
+  BinaryBlockReader* reader;
+  long long block;
+  char* out;
+} BinaryBlockDecodeJob;
+
+static void decode_block(BinaryBlockReader* reader, long long block, char* out)
+{
+  const char* data = reader->file + reader->index[block].offset;
+  uint32_t header[3];
+  memcpy(header, data, sizeof(header));
+
+  uint32_t num_records = header[0];
+  uLongf raw_len = header[1];
+  uint32_t compressed_len = header[2];
+
+  if(num_records != reader->index[block].num_records ||
+     reader->index[block].offset + (long long)(BINARY_BLOCK_HEADER_SIZE + compressed_len)
+       > reader->index_offset)
+  {
+    die("Binary %s is corrupt - block %lld does not match the index\n", reader->filename, block);
+  }
+
+  char* raw = malloc(raw_len > 0 ? raw_len : 1);
+  if(raw == NULL)
+    die("Unable to malloc to decompress binary %s\n", reader->filename);
+
+  if(uncompress((Bytef*)raw, &raw_len, (const Bytef*)data + BINARY_BLOCK_HEADER_SIZE,
+                compressed_len) != Z_OK || raw_len != header[1])
+  {
+    die("Binary %s is corrupt - block %lld fails to decompress\n", reader->filename, block);
+  }
+
+  bitfield_of_64bits prev[NUMBER_OF_BITFIELDS_IN_BINARY_KMER];
+  memset(prev, 0, sizeof(prev));
+  const char* in = raw;
+  const char* end = raw + raw_len;
+  uint32_t r;
+  int j;
+
+  for(r = 0; r < num_records; r++)
+  {
+    bitfield_of_64bits kmer[NUMBER_OF_BITFIELDS_IN_BINARY_KMER];
+    uint64_t val;
+    int shared = (in < end ? (unsigned char)*in++ : NUMBER_OF_BITFIELDS_IN_BINARY_KMER);
+
+    if(shared >= NUMBER_OF_BITFIELDS_IN_BINARY_KMER || (in = get_varint(in, end, &val)) == NULL)
+      break;
+
+    memcpy(kmer, prev, shared * sizeof(bitfield_of_64bits));
+    kmer[shared] = prev[shared] + val;
+    size_t rest = (NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1-shared) * sizeof(bitfield_of_64bits);
+    if(in + rest > end)
+      break;
+    memcpy(&kmer[shared+1], in, rest);
+    in += rest;
+    memcpy(prev, kmer, sizeof(kmer));
+
+    memcpy(out, kmer, sizeof(kmer));
+    out += sizeof(kmer);
+    for(j = 0; j < reader->num_colours && in != NULL; j++)
+    {
+      in = get_varint(in, end, &val);
+      Covg covg = val;
+      memcpy(out, &covg, sizeof(Covg));
+      out += sizeof(Covg);
+    }
+    if(in == NULL || in + reader->num_colours*sizeof(Edges) > end)
+      break;
+    memcpy(out, in, reader->num_colours*sizeof(Edges));
+    in += reader->num_colours*sizeof(Edges);
+    out += reader->num_colours*sizeof(Edges);
+  }
+
+  if(r != num_records || in != end)
+    die("Binary %s is corrupt - block %lld does not decode\n", reader->filename, block);
+
+  free(raw);
+}
+
+static void* decode_block_thread(void* arg)
+{
+  BinaryBlockDecodeJob* job = arg;
+  decode_block(job->reader, job->block, job->out);
+  return NULL;
+}
+
+size_t binary_block_reader_next(BinaryBlockReader* reader, const char** records)
+{
+  long long first = reader->next_block;
+  long long num = reader->num_blocks - first;
+  if(num > reader->num_threads)
+    num = reader->num_threads;
+  if(num <= 0)
+    return 0;
+
+  size_t len = 0;
+  long long i;
+  for(i = first; i < first+num; i++)
+    len += (size_t)reader->index[i].num_records * reader->record_size;
+
+  if(len > reader->decoded_capacity)
+  {
+    free(reader->decoded);
+    reader->decoded = malloc(len);
+    reader->decoded_capacity = len;
+    if(reader->decoded == NULL)
+      die("Unable to malloc to decompress binary %s\n", reader->filename);
+  }
+
+  if(num == 1)
+  {
+    decode_block(reader, first, reader->decoded);
+  }
+  else
+  {
+    pthread_t threads[num];
+    BinaryBlockDecodeJob jobs[num];
+    char* out = reader->decoded;
+
+    for(i = 0; i < num; i++)
+    {
+      jobs[i].reader = reader;
+      jobs[i].block = first+i;
+      jobs[i].out = out;
+      out += (size_t)reader->index[first+i].num_records * reader->record_size;
+      if(pthread_create(&threads[i], NULL, decode_block_thread, &jobs[i]) != 0)
+        die("Unable to create a thread to decompress binary %s\n", reader->filename);
+    }
+    for(i = 0; i < num; i++)
+      pthread_join(threads[i], NULL);
+  }
+
+  reader->next_block += num;
+  *records = reader->decoded;
+  return len;
+}
+
+void binary_block_reader_close(BinaryBlockReader* reader)
+{
+  free(reader->index);
+  free(reader->decoded);
+  reader->index = NULL;
+  reader->decoded = NULL;
+}
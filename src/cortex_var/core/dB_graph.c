@@ -31,6 +31,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 
 // cortex_var headers
 #include "binary_kmer.h"
@@ -94,6 +95,21 @@ void db_graph_set_all_visited_nodes_to_status_none(dBGraph* hash_table)
   hash_table_traverse(&db_node_set_status_to_none, hash_table);
 }
 
+// Only when the epoch wraps round do we need to go through the table, to unset
+// marks which would otherwise be read as visited again
+void db_graph_unset_all_visited_status(dBGraph* db_graph)
+{
+  if (db_node_visited_epoch == UCHAR_MAX)
+    {
+      hash_table_traverse(&db_node_action_unset_status_visited_of_any_epoch, db_graph);
+      db_node_visited_epoch = 0;
+    }
+  else
+    {
+      db_node_visited_epoch++;
+    }
+}
+
 
 
 
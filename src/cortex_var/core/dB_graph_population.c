@@ -34,6 +34,7 @@
 #include <limits.h>
 #include <math.h>
 #include <inttypes.h>
+#include <pthread.h>
 
 
 // cortex_var headers
@@ -43,10 +44,12 @@
 #include "dB_graph_population.h"
 #include "seq.h"
 #include "file_reader.h"
+#include "binary_blocks.h"
 #include "model_selection.h"
 #include "maths.h"
 #include "db_variants.h"
 #include "db_complex_genotyping.h"
+#include "unitig_index.h"
 
 void print_fasta_from_path_for_specific_person_or_pop(
   FILE *fout, char *name, int length, double avg_coverage,
@@ -122,11 +125,10 @@ void print_minimal_fasta_from_path_in_subgraph_defined_by_func_of_colours(FILE *
 									  );
 
                                                                           
-//This function does not  check that it there is such an edge in the specified person/colour - but it does check if the target node is in the specific person.
-//if you want to be sure the dge exists in that colour, then check it before calling this function
-dBNode * db_graph_get_next_node_for_specific_person_or_pop(dBNode * current_node, Orientation current_orientation, 
-							   Orientation * next_orientation,
-							   Nucleotide edge, Nucleotide * reverse_edge,dBGraph * db_graph, int index)
+//Looks the kmer up in the hash table, and does not check the node is in any subgraph
+dBNode * db_graph_find_next_node(dBNode * current_node, Orientation current_orientation,
+				 Orientation * next_orientation,
+				 Nucleotide edge, Nucleotide * reverse_edge, dBGraph * db_graph)
 {
 
   BinaryKmer local_copy_of_kmer;
@@ -162,6 +164,36 @@ dBNode * db_graph_get_next_node_for_specific_person_or_pop(dBNode * current_node
       //no else
     }
 
+  return next_node;
+}
+
+
+//walking along an indexed unitig needs no hashing
+static dBNode * db_graph_step_to_next_node(dBNode * current_node, Orientation current_orientation,
+					   Orientation * next_orientation,
+					   Nucleotide edge, Nucleotide * reverse_edge, dBGraph * db_graph)
+{
+  dBNode * next_node=NULL;
+
+  if ( (db_graph->unitig_index==NULL) ||
+       (unitig_index_get_next_node(db_graph->unitig_index, current_node, current_orientation, edge,
+				   &next_node, next_orientation, reverse_edge, db_graph)==false) )
+    {
+      next_node = db_graph_find_next_node(current_node, current_orientation, next_orientation,
+					  edge, reverse_edge, db_graph);
+    }
+  return next_node;
+}
+
+
+//This function does not  check that it there is such an edge in the specified person/colour - but it does check if the target node is in the specific person.
+//if you want to be sure the dge exists in that colour, then check it before calling this function
+dBNode * db_graph_get_next_node_for_specific_person_or_pop(dBNode * current_node, Orientation current_orientation, 
+							   Orientation * next_orientation,
+							   Nucleotide edge, Nucleotide * reverse_edge,dBGraph * db_graph, int index)
+{
+  dBNode * next_node = db_graph_step_to_next_node(current_node, current_orientation, next_orientation,
+						  edge, reverse_edge, db_graph);
 
   //need to check the node is in this person's graph
   if (! (db_node_is_this_node_in_this_person_or_populations_graph(next_node, index)))
@@ -186,40 +218,8 @@ dBNode * db_graph_get_next_node_in_subgraph_defined_by_func_of_colours(dBNode *
 								       Edges (*get_colour)(const dBNode*)
 								       )
 {
-
-  BinaryKmer local_copy_of_kmer;
-  binary_kmer_assignment_operator(local_copy_of_kmer, current_node->kmer);
-  
-  BinaryKmer tmp_kmer;
-  dBNode * next_node=NULL;
-  
-  // after the following line tmp_kmer and rev_kmer are pointing to the same B Kmer
-  BinaryKmer* rev_kmer = binary_kmer_reverse_complement(&local_copy_of_kmer,db_graph->kmer_size, &tmp_kmer);
-  
-  
-  if (current_orientation == reverse){   
-    *reverse_edge = binary_kmer_get_last_nucleotide(&local_copy_of_kmer);
-    binary_kmer_assignment_operator(local_copy_of_kmer,*rev_kmer);
-  }
-  else{
-    *reverse_edge = binary_kmer_get_last_nucleotide(rev_kmer);
-  }
-
-
-  binary_kmer_left_shift_one_base_and_insert_new_base_at_right_end(&local_copy_of_kmer, edge, db_graph->kmer_size);
-  
-   //get node from table
-  next_node = hash_table_find(element_get_key(&local_copy_of_kmer,db_graph->kmer_size, &tmp_kmer),db_graph);
-
-  if (next_node != NULL)
-    {
-      *next_orientation = db_node_get_orientation(&local_copy_of_kmer,next_node,db_graph->kmer_size);
-    }
-  else
-    {
-      //no else
-    }
-
+  dBNode * next_node = db_graph_step_to_next_node(current_node, current_orientation, next_orientation,
+						  edge, reverse_edge, db_graph);
 
   //need to check the node is in the specified subgraph graph
   if (! (db_node_is_this_node_in_subgraph_defined_by_func_of_colours(next_node, get_colour)) )
@@ -2515,346 +2515,807 @@ boolean detect_vars_condition_is_hom_nonref_with_min_covg_given_colour_funcs_for
 // argument get_colour specifies some combination of colours, defining the graph within which we look for bubbles.
 // most obvious choices are: colour/edge with index (say)2, or union of all edges, or union of ll except that which is the reference genome
 // model_selection_condition compartes likelihoods of repeat, variation and error models to decide if it is a variant.
-void db_graph_detect_vars(FILE* fout, /*FILE* fout_gls ,*/ int max_length, dBGraph * db_graph, 
-			  boolean (*condition)(VariantBranchesAndFlanks*),
-			  void (*action_branches)(dBNode*),
-			  void (*action_flanks)(dBNode*),
-			  Edges (*get_colour)(const dBNode*),
-			  Covg (*get_covg)(const dBNode*),
-			  void (*print_extra_info)(AnnotatedPutativeVariant*, FILE*),
-			  boolean apply_model_selection, 
-			  boolean (*model_selection_condition)(AnnotatedPutativeVariant*),
-			  GraphAndModelInfo* model_info,
-			  boolean (*start_condition)(dBNode*) )
+// The flanks of a bubble found at node/orientation and ending at end_node/end_orientation.
+// The 5' flank is the supernode leading into the bubble, and the 3' flank the one
+// leading out of it. Nodes inside the flanks have action_flanks applied
+static void db_graph_get_flanks_of_bubble(dBNode* node, Orientation orientation,
+					  dBNode* end_node, Orientation end_orientation,
+					  int flanking_length, void (*action_flanks)(dBNode*),
+					  dBNode** nodes5p, Orientation* orientations5p, Nucleotide* labels_flank5p,
+					  char* seq5p, int* length_flank5p,
+					  dBNode** nodes3p, Orientation* orientations3p, Nucleotide* labels_flank3p,
+					  char* seq3p, int* length_flank3p,
+					  dBGraph* db_graph,
+					  Edges (*get_colour)(const dBNode*),
+					  Covg (*get_covg)(const dBNode*))
 {
-
-  
-  int count_vars = 0; 
-  int flanking_length = 1000; //max length for flanks
-
-  //allocate arrays
-  dBNode** path_nodes1 = (dBNode**) malloc(sizeof(dBNode*)*(max_length+1));
-  dBNode** path_nodes2 = (dBNode**) malloc(sizeof(dBNode*)*(max_length+1));
-  Orientation* path_orientations1 = (Orientation*) malloc(sizeof(Orientation)*(max_length+1));
-  Orientation* path_orientations2 = (Orientation*) malloc(sizeof(Orientation)*(max_length+1));
-  Nucleotide* path_labels1 = (Nucleotide*) malloc(sizeof(Nucleotide)*(max_length+1) );
-  Nucleotide* path_labels2 = (Nucleotide*) malloc(sizeof(Nucleotide)*(max_length+1) );
-  char* seq1 = (char*) malloc(sizeof(char)*(max_length+1));
-  char* seq2 = (char*) malloc(sizeof(char)*(max_length+1));
-  CovgArray* working_ca = alloc_and_init_covg_array(max_length+1);
-  
-  dBNode** nodes5p = (dBNode**) malloc(sizeof(dBNode*) *flanking_length);
-  dBNode** nodes3p = (dBNode**) malloc(sizeof(dBNode*) *flanking_length);
-  Orientation* orientations5p = (Orientation*) malloc(sizeof(Orientation) * flanking_length);
-  Orientation* orientations3p = (Orientation*) malloc(sizeof(Orientation) * flanking_length);
-  Nucleotide* labels_flank5p = (Nucleotide*) malloc(sizeof(Nucleotide) * flanking_length);
-  Nucleotide* labels_flank3p = (Nucleotide*) malloc(sizeof(Nucleotide) * flanking_length);
-  char* seq5p = (char*) malloc(sizeof(char)* (flanking_length+2));
-  char* seq3p = (char*) malloc(sizeof(char)* (flanking_length+2));
-
-
-
-  if ( (path_nodes1==NULL) || (path_nodes2==NULL) || (path_orientations1==NULL) || (path_orientations2==NULL) 
-       || (path_labels1==NULL) || (path_labels2==NULL) || (seq1==NULL) || (seq2==NULL)
-       || (nodes5p==NULL) || (nodes3p==NULL) || (orientations5p==NULL) || (orientations3p==NULL)
-       || (labels_flank5p==NULL) || (labels_flank3p==NULL) || (seq5p==NULL) || (seq3p==NULL) || (working_ca==NULL) )
-    {
-      die("Could not allocate arrays in db_graph_detect_vars. \n"
-          "Out of memory, or you asked for unreasonably big max branch size: %d",
-          max_length);
-    }
-
-
-  /*  
-  VariantBranchesAndFlanks* var = alloc_VariantBranchesAndFlanks_object(flanking_length, max_length, max_length, flanking_length, db_graph->kmer_size);
-  if (var==NULL)
-    {
-      die("Unable to allocate a var object at the start of the Bubble Caller. Abort. \n"
-	  "V low on memory, or you have asked for max var length which is too big");
-    }
-  */
-
-  StrBuf* namebuf = strbuf_new();
-
-  void get_vars(dBNode * node){
-
-   
-    void get_vars_with_orientation(dBNode * node, Orientation orientation){
-
-      int length1=0;
-      int length2=0;
-      seq1[0]='\0';
-      seq2[0]='\0';
-
-
-
-      double avg_coverage1=0;
-      Covg min_coverage1=0;
-      Covg max_coverage1=0;
-      
-      double avg_coverage2=0;
-      Covg min_coverage2=0;
-      Covg max_coverage2=0;
-      
-      dBNode * current_node = node;
-
-      //will reuse this as we traverse the graph
-      VariantBranchesAndFlanks var;
-
-      do{
-	
-
-	//The idea is that db_graph_detect_bubble_in_subgraph_defined_by_func_of_colours will mark anything is sees with action_flanks
-	//However if it does find a bubble, and if you want it to (penultimate argument=true)  then the branches are  marked with action_branches
-	if (db_graph_detect_bubble_in_subgraph_defined_by_func_of_colours(start_condition, current_node,orientation,max_length,action_flanks,
-									  &length1,path_nodes1,path_orientations1,path_labels1,
-									  seq1,&avg_coverage1,&min_coverage1,&max_coverage1,
-									  &length2,path_nodes2,path_orientations2,path_labels2,
-									  seq2,&avg_coverage2,&min_coverage2,&max_coverage2,
-									  db_graph, get_colour, get_covg,
-									  true, action_branches))
-	  {
-
-	    int length_flank5p = 0;	
-	    int length_flank3p = 0;
-	    boolean is_cycle5p=false;
-	    boolean is_cycle3p=false;
+  boolean is_cycle5p=false;
+  boolean is_cycle3p=false;
 	    
-	    double avg_coverage5p=0;
-	    Covg min5p_covg = 0;
-	    Covg max5p_covg = 0;
-	    double avg_coverage3p=0;
+  double avg_coverage5p=0;
+  Covg min5p_covg = 0;
+  Covg max5p_covg = 0;
+  double avg_coverage3p=0;
 	    
-	    Covg min3p_covg = 0;
-	    Covg max3p_covg = 0;
+  Covg min3p_covg = 0;
+  Covg max3p_covg = 0;
 	    
 	    
-	    //compute 5' flanking region       	
-	    int length_flank5p_reverse = db_graph_get_perfect_path_in_subgraph_defined_by_func_of_colours(current_node,opposite_orientation(orientation),
-													  flanking_length, action_flanks,
-													  nodes5p, orientations5p, labels_flank5p,
-													  seq5p, &avg_coverage5p, &min5p_covg, &max5p_covg,
-													  &is_cycle5p,db_graph, get_colour, get_covg);
+  //compute 5' flanking region       	
+  int length_flank5p_reverse = db_graph_get_perfect_path_in_subgraph_defined_by_func_of_colours(node,opposite_orientation(orientation),
+												flanking_length, action_flanks,
+												nodes5p, orientations5p, labels_flank5p,
+												seq5p, &avg_coverage5p, &min5p_covg, &max5p_covg,
+												&is_cycle5p,db_graph, get_colour, get_covg);
 	    
-	    if (length_flank5p_reverse>0){
-	      Nucleotide label;
-	      Orientation next_orientation;
+  if (length_flank5p_reverse>0){
+    Nucleotide label;
+    Orientation next_orientation;
 	     
-	      db_graph_get_next_node_in_subgraph_defined_by_func_of_colours(nodes5p[length_flank5p_reverse-1],orientations5p[length_flank5p_reverse-1],
-									    &next_orientation, labels_flank5p[length_flank5p_reverse-1],&label,
-									    db_graph, get_colour);
+    db_graph_get_next_node_in_subgraph_defined_by_func_of_colours(nodes5p[length_flank5p_reverse-1],orientations5p[length_flank5p_reverse-1],
+								  &next_orientation, labels_flank5p[length_flank5p_reverse-1],&label,
+								  db_graph, get_colour);
 	      
-	      length_flank5p = db_graph_get_perfect_path_with_first_edge_in_subgraph_defined_by_func_of_colours(nodes5p[length_flank5p_reverse],
-														opposite_orientation(orientations5p[length_flank5p_reverse]),
-														flanking_length, label,
-														action_flanks,
-														nodes5p, orientations5p, labels_flank5p,
-														seq5p, &avg_coverage5p, &min3p_covg, &max3p_covg,
-														&is_cycle5p,db_graph, get_colour, get_covg);
-	    }
-	    else{
-	      length_flank5p = 0;
-	    }
+    *length_flank5p = db_graph_get_perfect_path_with_first_edge_in_subgraph_defined_by_func_of_colours(nodes5p[length_flank5p_reverse],
+												       opposite_orientation(orientations5p[length_flank5p_reverse]),
+												       flanking_length, label,
+												       action_flanks,
+												       nodes5p, orientations5p, labels_flank5p,
+												       seq5p, &avg_coverage5p, &min3p_covg, &max3p_covg,
+												       &is_cycle5p,db_graph, get_colour, get_covg);
+  }
+  else{
+    *length_flank5p = 0;
+  }
 	    
 	    
 	    
-	    //compute 3' flanking region
-	    length_flank3p = db_graph_get_perfect_path_in_subgraph_defined_by_func_of_colours(path_nodes2[length2],path_orientations2[length2],
-											      flanking_length, action_flanks,
-											      nodes3p,orientations3p,labels_flank3p,
-											      seq3p,&avg_coverage3p,&min3p_covg,&max3p_covg,
-											      &is_cycle3p,db_graph, get_colour, get_covg);
+  //compute 3' flanking region
+  *length_flank3p = db_graph_get_perfect_path_in_subgraph_defined_by_func_of_colours(end_node,end_orientation,
+										     flanking_length, action_flanks,
+										     nodes3p,orientations3p,labels_flank3p,
+										     seq3p,&avg_coverage3p,&min3p_covg,&max3p_covg,
+										     &is_cycle3p,db_graph, get_colour, get_covg);
+}
 
 
-	    
-	    char name[100];
-	    
-	    
-	    /*
-	    set_alloced_variant_branches_and_flanks_allowing_inputargs_in_either_order(var,
-										       nodes5p, orientations5p, length_flank5p, forward,
-										       path_nodes1, path_orientations1, length1, forward,
-										       path_nodes2, path_orientations2, length2, forward,
-										       nodes3p, orientations3p, length_flank3p, forward,
-										       unknown);
-	    */
-	    // i think this warning is wrong! -->
-      // warning - array of 5prime nodes, oprientations is in reverse order to
-      // what you would expect - it is never used in what follows
-	    set_variant_branches_and_flanks(&var,
-					    nodes5p, orientations5p, length_flank5p,
-					    path_nodes1, path_orientations1, length1, 
-					    path_nodes2, path_orientations2, length2,
-					    nodes3p, orientations3p, length_flank3p,
-					    unknown);
-	    
+// If the bubble passes condition, prints it (as var_1, var_2... counting with *count_vars)
+static void db_graph_print_bubble_if_condition(FILE* fout, VariantBranchesAndFlanks* var,
+					       char* seq5p, char* seq1, char* seq2, char* seq3p,
+					       int* count_vars, StrBuf* namebuf, CovgArray* working_ca,
+					       dBGraph* db_graph,
+					       boolean (*condition)(VariantBranchesAndFlanks*),
+					       void (*print_extra_info)(AnnotatedPutativeVariant*, FILE*),
+					       boolean apply_model_selection, 
+					       boolean (*model_selection_condition)(AnnotatedPutativeVariant*),
+					       GraphAndModelInfo* model_info)
+{
+  char name[100];
 
-	    if (condition(&var)==true) 
-	      {
+  if (condition(var)==true) 
+    {
 
-		AnnotatedPutativeVariant annovar;
-		boolean use_median=true;
-		if ((model_info!=NULL) && (model_info->ginfo!=NULL))
-		  {
+      AnnotatedPutativeVariant annovar;
+      boolean use_median=true;
+      if ((model_info!=NULL) && (model_info->ginfo!=NULL))
+	{
 		    
-		    initialise_putative_variant(&annovar, model_info, &var, BubbleCaller, 
-						db_graph->kmer_size, model_info->assump, working_ca, true, use_median);
-		  }
-		else
-		  {
-		    initialise_putative_variant(&annovar, model_info, &var, BubbleCaller, 
-						db_graph->kmer_size, AssumeUncleaned, working_ca, false, use_median);
+	  initialise_putative_variant(&annovar, model_info, var, BubbleCaller, 
+				      db_graph->kmer_size, model_info->assump, working_ca, true, use_median);
+	}
+      else
+	{
+	  initialise_putative_variant(&annovar, model_info, var, BubbleCaller, 
+				      db_graph->kmer_size, AssumeUncleaned, working_ca, false, use_median);
 		    
-		  }
+	}
 
- 		//initialise_putative_variant(&annovar, model_info, &var, BubbleCaller, db_graph->kmer_size, NoIdeaWhatCleaning, NULL, NULL, NULL);
+      //initialise_putative_variant(&annovar, model_info, &var, BubbleCaller, db_graph->kmer_size, NoIdeaWhatCleaning, NULL, NULL, NULL);
 
 
-		if (annovar.too_short==false)
-		  {
+      if (annovar.too_short==false)
+	{
 		    
-		    count_vars++;
-		    strbuf_reset(namebuf);
-		    strbuf_sprintf(namebuf, "%s%d", "var_", count_vars);
+	  (*count_vars)++;
+	  strbuf_reset(namebuf);
+	  strbuf_sprintf(namebuf, "%s%d", "var_", *count_vars);
 
-		    boolean site_is_variant=true;
-		    if (apply_model_selection==true)
-		      {
-			site_is_variant = model_selection_condition(&annovar);
+	  boolean site_is_variant=true;
+	  if (apply_model_selection==true)
+	    {
+	      site_is_variant = model_selection_condition(&annovar);
 			
-			if (site_is_variant==true)
-			  {
-			    fprintf(fout, "PASSES CLASSIFIER: fits variation model better than repeat model\n");
-			  }
-			else
-			  {
-			    fprintf(fout, "FAILS CLASSIFIER: fits repeat model better than variation model\n");
-			  }
-			fprintf(fout, "DISCOVERY PHASE:  VARIANT vs REPEAT MODEL LOG_LIKELIHOODS:\tllk_var:%.2f\tllk_rep:%.2f\n", 
-				annovar.model_llks.llk_var, annovar.model_llks.llk_rep);
-		      }
+	      if (site_is_variant==true)
+		{
+		  fprintf(fout, "PASSES CLASSIFIER: fits variation model better than repeat model\n");
+		}
+	      else
+		{
+		  fprintf(fout, "FAILS CLASSIFIER: fits repeat model better than variation model\n");
+		}
+	      fprintf(fout, "DISCOVERY PHASE:  VARIANT vs REPEAT MODEL LOG_LIKELIHOODS:\tllk_var:%.2f\tllk_rep:%.2f\n", 
+		      annovar.model_llks.llk_var, annovar.model_llks.llk_rep);
+	    }
 		    
-		    if ( (model_info !=NULL) && (model_info->expt_type != Unspecified))
-		      {
-	
-
-
-
-
-
-
-
-
-
-
-
-
+	  if ( (model_info !=NULL) && (model_info->expt_type != Unspecified))
+	    {
+	      //print the GLs to a separate file.
+	      //print_genotype_likelihoods(fout_gls, &annovar, model_info, namebuf);			
+	      int z;
 
+	      if ( (model_info->expt_type == EachColourADiploidSample) || (model_info->expt_type ==EachColourADiploidSampleExceptTheRefColour) )
+		{
+		  fprintf(fout,"Colour/sample\tGT_call\tllk_hom_br1\tllk_het\tllk_hom_br2\n");
 
-		//print the GLs to a separate file.
-			//print_genotype_likelihoods(fout_gls, &annovar, model_info, namebuf);			
-			int z;
-
-			if ( (model_info->expt_type == EachColourADiploidSample) || (model_info->expt_type ==EachColourADiploidSampleExceptTheRefColour) )
-			  {
-			    fprintf(fout,"Colour/sample\tGT_call\tllk_hom_br1\tllk_het\tllk_hom_br2\n");
-
-			    for (z=0; z<NUMBER_OF_COLOURS; z++)
-			      {
-				if (z==model_info->ref_colour)
-				  {
-				    fprintf(fout, "%d=REF\tNO_CALL\t0\t0\t0\n", z);
-				  }
-				else
-				  {
-				    fprintf(fout,"%d\t", z);
-				    if (annovar.genotype[z]==hom_one)
-				      {
-					fprintf(fout,"HOM1\t");
-				      }
-				    else if (annovar.genotype[z]==het)
-				      {
-					fprintf(fout,"HET\t");
-				      }
-				    else if (annovar.genotype[z]==hom_other)
-				      {
-					fprintf(fout,"HOM2\t");
-				      }
-				    else
-				      {
-					fprintf(fout,"NO_CALL\t");
-				      }
-				    fprintf(fout, "%.2f\t%.2f\t%.2f\n", annovar.gen_log_lh[z].log_lh[hom_one], annovar.gen_log_lh[z].log_lh[het], annovar.gen_log_lh[z].log_lh[hom_other]);
-				  }
-			      }
-			  }
-			else if ( (model_info->expt_type == EachColourAHaploidSample) || (model_info->expt_type ==EachColourAHaploidSampleExceptTheRefColour) )
-			  {
-			    fprintf(fout,"Colour/sample\tGT_call\tllk_hom_br1\tllk_hom_br2\n");
-			    for (z=0; z<NUMBER_OF_COLOURS; z++)
-			      {
-				if (z==model_info->ref_colour)
-				  {
-				    fprintf(fout, "%d=REF\tNO_CALL\t0\t0\n", z);
-				  }
-				else
-				  {
-				    fprintf(fout,"%d\t", z);
-				    if (annovar.genotype[z]==hom_one)
-				      {
-					fprintf(fout,"HOM1\t");
-				      }
-				    else if (annovar.genotype[z]==hom_other)
-				      {
-					fprintf(fout,"HOM2\t");
-				      }
-				    else
-				      {
-					fprintf(fout,"NO_CALL\t");
-				      }
-				    fprintf(fout, "%.2f\t%.2f\n", annovar.gen_log_lh[z].log_lh[hom_one], annovar.gen_log_lh[z].log_lh[hom_other]);
-				  }
-			      }
-			  }
-		      }
+		  for (z=0; z<NUMBER_OF_COLOURS; z++)
+		    {
+		      if (z==model_info->ref_colour)
+			{
+			  fprintf(fout, "%d=REF\tNO_CALL\t0\t0\t0\n", z);
+			}
+		      else
+			{
+			  fprintf(fout,"%d\t", z);
+			  if (annovar.genotype[z]==hom_one)
+			    {
+			      fprintf(fout,"HOM1\t");
+			    }
+			  else if (annovar.genotype[z]==het)
+			    {
+			      fprintf(fout,"HET\t");
+			    }
+			  else if (annovar.genotype[z]==hom_other)
+			    {
+			      fprintf(fout,"HOM2\t");
+			    }
+			  else
+			    {
+			      fprintf(fout,"NO_CALL\t");
+			    }
+			  fprintf(fout, "%.2f\t%.2f\t%.2f\n", annovar.gen_log_lh[z].log_lh[hom_one], annovar.gen_log_lh[z].log_lh[het], annovar.gen_log_lh[z].log_lh[hom_other]);
+			}
+		    }
+		}
+	      else if ( (model_info->expt_type == EachColourAHaploidSample) || (model_info->expt_type ==EachColourAHaploidSampleExceptTheRefColour) )
+		{
+		  fprintf(fout,"Colour/sample\tGT_call\tllk_hom_br1\tllk_hom_br2\n");
+		  for (z=0; z<NUMBER_OF_COLOURS; z++)
+		    {
+		      if (z==model_info->ref_colour)
+			{
+			  fprintf(fout, "%d=REF\tNO_CALL\t0\t0\n", z);
+			}
+		      else
+			{
+			  fprintf(fout,"%d\t", z);
+			  if (annovar.genotype[z]==hom_one)
+			    {
+			      fprintf(fout,"HOM1\t");
+			    }
+			  else if (annovar.genotype[z]==hom_other)
+			    {
+			      fprintf(fout,"HOM2\t");
+			    }
+			  else
+			    {
+			      fprintf(fout,"NO_CALL\t");
+			    }
+			  fprintf(fout, "%.2f\t%.2f\n", annovar.gen_log_lh[z].log_lh[hom_one], annovar.gen_log_lh[z].log_lh[hom_other]);
+			}
+		    }
+		}
+	    }
 		    
 		    
 		    
 
 		    
-		    //print flank5p - 
-		    sprintf(name,"var_%i_5p_flank",count_vars);
+	  //print flank5p - 
+	  sprintf(name,"var_%i_5p_flank",*count_vars);
 		    
-		    print_ultra_minimal_fasta_from_path(fout,name,length_flank5p,
-							nodes5p[0],orientations5p[0],			
-							seq5p,
-							db_graph->kmer_size,true);	
+	  print_ultra_minimal_fasta_from_path(fout,name,var->len_flank5p,
+					      var->flank5p[0],var->flank5p_or[0],			
+					      seq5p,
+					      db_graph->kmer_size,true);	
 		    
-		    //print branches
-		    sprintf(name,"var_%i_branch_1",count_vars);
-		    print_ultra_minimal_fasta_from_path(fout,name,length1,
-							path_nodes1[0],path_orientations1[0],
-							seq1,
-							db_graph->kmer_size,false);
+	  //print branches
+	  sprintf(name,"var_%i_branch_1",*count_vars);
+	  print_ultra_minimal_fasta_from_path(fout,name,var->len_one_allele,
+					      var->one_allele[0],var->one_allele_or[0],
+					      seq1,
+					      db_graph->kmer_size,false);
 		    
-		    sprintf(name,"var_%i_branch_2",count_vars);
-		    print_ultra_minimal_fasta_from_path(fout,name,length2,
-							path_nodes2[0],path_orientations2[0],
-							seq2,
-							db_graph->kmer_size,false);
+	  sprintf(name,"var_%i_branch_2",*count_vars);
+	  print_ultra_minimal_fasta_from_path(fout,name,var->len_other_allele,
+					      var->other_allele[0],var->other_allele_or[0],
+					      seq2,
+					      db_graph->kmer_size,false);
 		    
-		    //print flank3p
-		    sprintf(name,"var_%i_3p_flank",count_vars);
-
-		    print_ultra_minimal_fasta_from_path(fout,name,length_flank3p,
-							nodes3p[0],orientations3p[0],
-							seq3p,
-							db_graph->kmer_size,false);
-		    print_extra_info(&annovar, fout);
+	  //print flank3p
+	  sprintf(name,"var_%i_3p_flank",*count_vars);
+
+	  print_ultra_minimal_fasta_from_path(fout,name,var->len_flank3p,
+					      var->flank3p[0],var->flank3p_or[0],
+					      seq3p,
+					      db_graph->kmer_size,false);
+	  print_extra_info(&annovar, fout);
 		    
 		    
-		  }
-	      }
+	}
+    }
+}
+
+
+//
+// Calling bubbles with several threads
+//
+// The table is split into contiguous ranges of slots, and NUM_THREADS
+// ranges at a time, each thread finds the bubbles (and their flanks) starting at
+// the nodes of its range, without marking any node. The bubbles are then called in
+// table order by the calling thread, which starts at exactly the nodes a single
+// threaded traversal would and applies the same marks to the branches and flanks,
+// so the calls, their names and their order are the same whatever the number of
+// threads. The only difference is that the nodes of paths which turn out not to be
+// part of a bubble are left unmarked.
+
+#define BUBBLE_RANGE_SLOTS (1 << 18)
+
+typedef struct
+{
+  long long slot; // of the node the bubble starts at
+  Orientation orientation;
+  int length1, length2, length_flank5p, length_flank3p;
+  long long first_node; // the branches and flanks, in that order, in nodes/orientations
+  long long first_seq;  // and their (null terminated) sequences, in seq
+} FoundBubble;
+
+typedef struct
+{
+  dBGraph* db_graph;
+  int max_length, flanking_length;
+  Edges (*get_colour)(const dBNode*);
+  Covg (*get_covg)(const dBNode*);
+  boolean (*start_condition)(dBNode*);
+  long long first_slot, end_slot;
+
+  FoundBubble* bubbles;
+  int num_bubbles, bubbles_capacity;
+  dBNode** nodes;
+  Orientation* orientations;
+  long long num_nodes, nodes_capacity;
+  char* seq;
+  long long seq_len, seq_capacity;
+
+  // working space for finding a bubble
+  dBNode** path_nodes1;
+  dBNode** path_nodes2;
+  Orientation* path_orientations1;
+  Orientation* path_orientations2;
+  Nucleotide* path_labels1;
+  Nucleotide* path_labels2;
+  char* seq1;
+  char* seq2;
+  dBNode** nodes5p;
+  dBNode** nodes3p;
+  Orientation* orientations5p;
+  Orientation* orientations3p;
+  Nucleotide* labels_flank5p;
+  Nucleotide* labels_flank3p;
+  char* seq5p;
+  char* seq3p;
+} BubbleRange;
+
+static void bubble_range_init(BubbleRange* range, dBGraph* db_graph, int max_length, int flanking_length,
+			      Edges (*get_colour)(const dBNode*), Covg (*get_covg)(const dBNode*),
+			      boolean (*start_condition)(dBNode*))
+{
+  memset(range, 0, sizeof(BubbleRange));
+  range->db_graph = db_graph;
+  range->max_length = max_length;
+  range->flanking_length = flanking_length;
+  range->get_colour = get_colour;
+  range->get_covg = get_covg;
+  range->start_condition = start_condition;
+
+  range->path_nodes1 = malloc(sizeof(dBNode*)*(max_length+1));
+  range->path_nodes2 = malloc(sizeof(dBNode*)*(max_length+1));
+  range->path_orientations1 = malloc(sizeof(Orientation)*(max_length+1));
+  range->path_orientations2 = malloc(sizeof(Orientation)*(max_length+1));
+  range->path_labels1 = malloc(sizeof(Nucleotide)*(max_length+1));
+  range->path_labels2 = malloc(sizeof(Nucleotide)*(max_length+1));
+  range->seq1 = malloc(sizeof(char)*(max_length+1));
+  range->seq2 = malloc(sizeof(char)*(max_length+1));
+  range->nodes5p = malloc(sizeof(dBNode*)*flanking_length);
+  range->nodes3p = malloc(sizeof(dBNode*)*flanking_length);
+  range->orientations5p = malloc(sizeof(Orientation)*flanking_length);
+  range->orientations3p = malloc(sizeof(Orientation)*flanking_length);
+  range->labels_flank5p = malloc(sizeof(Nucleotide)*flanking_length);
+  range->labels_flank3p = malloc(sizeof(Nucleotide)*flanking_length);
+  range->seq5p = malloc(sizeof(char)*(flanking_length+2));
+  range->seq3p = malloc(sizeof(char)*(flanking_length+2));
+
+  if ( (range->path_nodes1==NULL) || (range->path_nodes2==NULL) || (range->path_orientations1==NULL)
+       || (range->path_orientations2==NULL) || (range->path_labels1==NULL) || (range->path_labels2==NULL)
+       || (range->seq1==NULL) || (range->seq2==NULL) || (range->nodes5p==NULL) || (range->nodes3p==NULL)
+       || (range->orientations5p==NULL) || (range->orientations3p==NULL) || (range->labels_flank5p==NULL)
+       || (range->labels_flank3p==NULL) || (range->seq5p==NULL) || (range->seq3p==NULL) )
+    {
+      die("Could not allocate arrays in db_graph_detect_vars. \n"
+          "Out of memory, or you asked for unreasonably big max branch size: %d",
+          max_length);
+    }
+}
+
+static void bubble_range_free(BubbleRange* range)
+{
+  free(range->bubbles);
+  free(range->nodes);
+  free(range->orientations);
+  free(range->seq);
+  free(range->path_nodes1);
+  free(range->path_nodes2);
+  free(range->path_orientations1);
+  free(range->path_orientations2);
+  free(range->path_labels1);
+  free(range->path_labels2);
+  free(range->seq1);
+  free(range->seq2);
+  free(range->nodes5p);
+  free(range->nodes3p);
+  free(range->orientations5p);
+  free(range->orientations3p);
+  free(range->labels_flank5p);
+  free(range->labels_flank3p);
+  free(range->seq5p);
+  free(range->seq3p);
+}
+
+static void bubble_range_add_path(BubbleRange* range, dBNode** nodes, Orientation* orientations,
+				  int length, char* seq)
+{
+  if (range->num_nodes+length+1 > range->nodes_capacity)
+    {
+      range->nodes_capacity = 2*range->nodes_capacity + length+1;
+      range->nodes = realloc(range->nodes, range->nodes_capacity*sizeof(dBNode*));
+      range->orientations = realloc(range->orientations, range->nodes_capacity*sizeof(Orientation));
+      if ( (range->nodes==NULL) || (range->orientations==NULL) )
+	{
+	  die("Unable to grow the list of bubbles found by a thread - out of memory\n");
+	}
+    }
+  memcpy(range->nodes+range->num_nodes, nodes, (length+1)*sizeof(dBNode*));
+  memcpy(range->orientations+range->num_nodes, orientations, (length+1)*sizeof(Orientation));
+  range->num_nodes += length+1;
+
+  size_t seq_len = strlen(seq)+1;
+  if (range->seq_len+seq_len > range->seq_capacity)
+    {
+      range->seq_capacity = 2*range->seq_capacity + seq_len;
+      range->seq = realloc(range->seq, range->seq_capacity);
+      if (range->seq==NULL)
+	{
+	  die("Unable to grow the list of bubbles found by a thread - out of memory\n");
+	}
+    }
+  memcpy(range->seq+range->seq_len, seq, seq_len);
+  range->seq_len += seq_len;
+}
+
+// Adds the bubble (if any) starting at node/orientation to the bubbles of the range.
+// Marks nothing. Returns true if there is a bubble
+static boolean bubble_range_find_bubble(BubbleRange* range, long long slot,
+					dBNode* node, Orientation orientation)
+{
+  //there is no bubble unless there are two edges out of the node
+  Edges edges = range->get_colour(node);
+  if (orientation==reverse)
+    {
+      edges >>= 4;
+    }
+  if (__builtin_popcount(edges & 0xF)<2)
+    {
+      return false;
+    }
+
+  int length1=0;
+  int length2=0;
+  double avg_coverage1=0;
+  Covg min_coverage1=0;
+  Covg max_coverage1=0;
+  double avg_coverage2=0;
+  Covg min_coverage2=0;
+  Covg max_coverage2=0;
+  range->seq1[0]='\0';
+  range->seq2[0]='\0';
+
+  if (!db_graph_detect_bubble_in_subgraph_defined_by_func_of_colours(range->start_condition, node, orientation,
+								       range->max_length, &db_node_action_do_nothing,
+								       &length1, range->path_nodes1, range->path_orientations1,
+								       range->path_labels1, range->seq1,
+								       &avg_coverage1, &min_coverage1, &max_coverage1,
+								       &length2, range->path_nodes2, range->path_orientations2,
+								       range->path_labels2, range->seq2,
+								       &avg_coverage2, &min_coverage2, &max_coverage2,
+								       range->db_graph, range->get_colour, range->get_covg,
+								       false, &db_node_action_do_nothing))
+    {
+      return false;
+    }
+
+  int length_flank5p=0;
+  int length_flank3p=0;
+  db_graph_get_flanks_of_bubble(node, orientation, range->path_nodes2[length2], range->path_orientations2[length2],
+				range->flanking_length, &db_node_action_do_nothing,
+				range->nodes5p, range->orientations5p, range->labels_flank5p,
+				range->seq5p, &length_flank5p,
+				range->nodes3p, range->orientations3p, range->labels_flank3p,
+				range->seq3p, &length_flank3p,
+				range->db_graph, range->get_colour, range->get_covg);
+
+  if (range->num_bubbles==range->bubbles_capacity)
+    {
+      range->bubbles_capacity = 2*range->bubbles_capacity + 64;
+      range->bubbles = realloc(range->bubbles, range->bubbles_capacity*sizeof(FoundBubble));
+      if (range->bubbles==NULL)
+	{
+	  die("Unable to grow the list of bubbles found by a thread - out of memory\n");
+	}
+    }
+
+  FoundBubble* found = &range->bubbles[range->num_bubbles++];
+  found->slot = slot;
+  found->orientation = orientation;
+  found->length1 = length1;
+  found->length2 = length2;
+  found->length_flank5p = length_flank5p;
+  found->length_flank3p = length_flank3p;
+  found->first_node = range->num_nodes;
+  found->first_seq = range->seq_len;
+
+  bubble_range_add_path(range, range->path_nodes1, range->path_orientations1, length1, range->seq1);
+  bubble_range_add_path(range, range->path_nodes2, range->path_orientations2, length2, range->seq2);
+  bubble_range_add_path(range, range->nodes5p, range->orientations5p, length_flank5p, range->seq5p);
+  bubble_range_add_path(range, range->nodes3p, range->orientations3p, length_flank3p, range->seq3p);
+
+  return true;
+}
+
+static void* bubble_range_find_bubbles(void* arg)
+{
+  BubbleRange* range = arg;
+  long long i;
+
+  range->num_bubbles = 0;
+  range->num_nodes = 0;
+  range->seq_len = 0;
+
+  for (i=range->first_slot; i<range->end_slot; i++)
+    {
+      dBNode* node = &range->db_graph->table[i];
+
+      //nodes which are marked now will not start a bubble call
+      if (db_node_check_for_flag_ALL_OFF(node) || !db_node_check_status_none(node)
+	  || (range->start_condition(node)==false) )
+	{
+	  continue;
+	}
+      bubble_range_find_bubble(range, i, node, forward);
+      bubble_range_find_bubble(range, i, node, reverse);
+    }
+  return NULL;
+}
+
+static void db_graph_detect_vars_multithreaded(FILE* fout, int max_length, dBGraph * db_graph, 
+					       boolean (*condition)(VariantBranchesAndFlanks*),
+					       void (*action_branches)(dBNode*),
+					       void (*action_flanks)(dBNode*),
+					       Edges (*get_colour)(const dBNode*),
+					       Covg (*get_covg)(const dBNode*),
+					       void (*print_extra_info)(AnnotatedPutativeVariant*, FILE*),
+					       boolean apply_model_selection, 
+					       boolean (*model_selection_condition)(AnnotatedPutativeVariant*),
+					       GraphAndModelInfo* model_info,
+					       boolean (*start_condition)(dBNode*) )
+{
+  int count_vars = 0; 
+  int flanking_length = 1000; //max length for flanks
+  int num_threads = NUM_THREADS;
+  long long num_slots = db_graph->number_buckets * db_graph->bucket_size;
+  BubbleRange ranges[num_threads];
+  BubbleRange continuation; // for bubbles found by the calling thread
+  int t;
+
+  for (t=0; t<num_threads; t++)
+    {
+      bubble_range_init(&ranges[t], db_graph, max_length, flanking_length,
+			get_colour, get_covg, start_condition);
+    }
+  bubble_range_init(&continuation, db_graph, max_length, flanking_length,
+		    get_colour, get_covg, start_condition);
+
+  CovgArray* working_ca = alloc_and_init_covg_array(max_length+1);
+  if (working_ca==NULL)
+    {
+      die("Could not allocate arrays in db_graph_detect_vars. \n"
+          "Out of memory, or you asked for unreasonably big max branch size: %d",
+          max_length);
+    }
+  StrBuf* namebuf = strbuf_new();
+
+  //call a bubble found by a thread, just as get_vars_with_orientation does in db_graph_detect_vars
+  void call_bubble(BubbleRange* range, FoundBubble* found, dBNode* node)
+  {
+    while (found!=NULL)
+      {
+	dBNode** path_nodes1 = range->nodes + found->first_node;
+	Orientation* path_orientations1 = range->orientations + found->first_node;
+	dBNode** path_nodes2 = path_nodes1 + found->length1+1;
+	Orientation* path_orientations2 = path_orientations1 + found->length1+1;
+	dBNode** nodes5p = path_nodes2 + found->length2+1;
+	Orientation* orientations5p = path_orientations2 + found->length2+1;
+	dBNode** nodes3p = nodes5p + found->length_flank5p+1;
+	Orientation* orientations3p = orientations5p + found->length_flank5p+1;
+	char* seq1 = range->seq + found->first_seq;
+	char* seq2 = seq1 + strlen(seq1)+1;
+	char* seq5p = seq2 + strlen(seq2)+1;
+	char* seq3p = seq5p + strlen(seq5p)+1;
+	int l;
+
+	//the marks finding the bubble would have made, in the same order
+	for (l=1; l<found->length1; l++)
+	  {
+	    action_flanks(path_nodes1[l]);
+	  }
+	for (l=1; l<found->length2; l++)
+	  {
+	    action_flanks(path_nodes2[l]);
+	  }
+	for (l=1; l<found->length1; l++)
+	  {
+	    action_branches(path_nodes1[l]);
+	  }
+	for (l=1; l<found->length2; l++)
+	  {
+	    action_branches(path_nodes2[l]);
+	  }
+	for (l=1; l<found->length_flank5p; l++)
+	  {
+	    action_flanks(nodes5p[l]);
+	  }
+	for (l=1; l<found->length_flank3p; l++)
+	  {
+	    action_flanks(nodes3p[l]);
+	  }
+
+	VariantBranchesAndFlanks var;
+	set_variant_branches_and_flanks(&var,
+					nodes5p, orientations5p, found->length_flank5p,
+					path_nodes1, path_orientations1, found->length1, 
+					path_nodes2, path_orientations2, found->length2,
+					nodes3p, orientations3p, found->length_flank3p,
+					unknown);
+	db_graph_print_bubble_if_condition(fout, &var, seq5p, seq1, seq2, seq3p,
+					   &count_vars, namebuf, working_ca, db_graph,
+					   condition, print_extra_info,
+					   apply_model_selection, model_selection_condition, model_info);
+
+	dBNode* end_node = path_nodes2[found->length2];
+	Orientation end_orientation = path_orientations2[found->length2];
+	action_branches(end_node);
+
+	//carry on from the end of the bubble if it is still unmarked
+	found = NULL;
+	if ( (end_node!=node) && db_node_check_status_none(end_node) )
+	  {
+	    continuation.num_bubbles = 0;
+	    continuation.num_nodes = 0;
+	    continuation.seq_len = 0;
+	    if (bubble_range_find_bubble(&continuation, -1, end_node, end_orientation))
+	      {
+		range = &continuation;
+		found = &continuation.bubbles[0];
+	      }
+	  }
+      }
+  }
+
+  long long next_slot = 0;
+  while (next_slot < num_slots)
+    {
+      int num_ranges = 0;
+      while ( (num_ranges<num_threads) && (next_slot<num_slots) )
+	{
+	  ranges[num_ranges].first_slot = next_slot;
+	  next_slot += BUBBLE_RANGE_SLOTS;
+	  if (next_slot>num_slots)
+	    {
+	      next_slot = num_slots;
+	    }
+	  ranges[num_ranges].end_slot = next_slot;
+	  num_ranges++;
+	}
+
+      pthread_t threads[num_ranges];
+      for (t=0; t<num_ranges; t++)
+	{
+	  if (pthread_create(&threads[t], NULL, bubble_range_find_bubbles, &ranges[t])!=0)
+	    {
+	      die("Unable to create a thread to call bubbles\n");
+	    }
+	}
+      for (t=0; t<num_ranges; t++)
+	{
+	  pthread_join(threads[t], NULL);
+	}
+
+      for (t=0; t<num_ranges; t++)
+	{
+	  BubbleRange* range = &ranges[t];
+	  int b = 0;
+	  while (b<range->num_bubbles)
+	    {
+	      long long slot = range->bubbles[b].slot;
+	      dBNode* node = &db_graph->table[slot];
+	      int end = b;
+	      while ( (end<range->num_bubbles) && (range->bubbles[end].slot==slot) )
+		{
+		  end++;
+		}
+
+	      //as get_vars in db_graph_detect_vars: the node may have been marked by an earlier bubble
+	      if ( (start_condition(node)==true) && db_node_check_status_none(node) )
+		{
+		  action_flanks(node);
+		  for ( ; b<end; b++)
+		    {
+		      call_bubble(range, &range->bubbles[b], node);
+		    }
+		}
+	      b = end;
+	    }
+	}
+    }
+
+  for (t=0; t<num_threads; t++)
+    {
+      bubble_range_free(&ranges[t]);
+    }
+  bubble_range_free(&continuation);
+  strbuf_free(namebuf);
+  free_covg_array(working_ca);
+}
+
+
+void db_graph_detect_vars(FILE* fout, /*FILE* fout_gls ,*/ int max_length, dBGraph * db_graph, 
+			  boolean (*condition)(VariantBranchesAndFlanks*),
+			  void (*action_branches)(dBNode*),
+			  void (*action_flanks)(dBNode*),
+			  Edges (*get_colour)(const dBNode*),
+			  Covg (*get_covg)(const dBNode*),
+			  void (*print_extra_info)(AnnotatedPutativeVariant*, FILE*),
+			  boolean apply_model_selection, 
+			  boolean (*model_selection_condition)(AnnotatedPutativeVariant*),
+			  GraphAndModelInfo* model_info,
+			  boolean (*start_condition)(dBNode*) )
+{
+
+  if (NUM_THREADS>1)
+    {
+      db_graph_detect_vars_multithreaded(fout, max_length, db_graph, condition, action_branches, action_flanks,
+					 get_colour, get_covg, print_extra_info, apply_model_selection,
+					 model_selection_condition, model_info, start_condition);
+      return;
+    }
+  
+  int count_vars = 0; 
+  int flanking_length = 1000; //max length for flanks
+
+  //allocate arrays
+  dBNode** path_nodes1 = (dBNode**) malloc(sizeof(dBNode*)*(max_length+1));
+  dBNode** path_nodes2 = (dBNode**) malloc(sizeof(dBNode*)*(max_length+1));
+  Orientation* path_orientations1 = (Orientation*) malloc(sizeof(Orientation)*(max_length+1));
+  Orientation* path_orientations2 = (Orientation*) malloc(sizeof(Orientation)*(max_length+1));
+  Nucleotide* path_labels1 = (Nucleotide*) malloc(sizeof(Nucleotide)*(max_length+1) );
+  Nucleotide* path_labels2 = (Nucleotide*) malloc(sizeof(Nucleotide)*(max_length+1) );
+  char* seq1 = (char*) malloc(sizeof(char)*(max_length+1));
+  char* seq2 = (char*) malloc(sizeof(char)*(max_length+1));
+  CovgArray* working_ca = alloc_and_init_covg_array(max_length+1);
+  
+  dBNode** nodes5p = (dBNode**) malloc(sizeof(dBNode*) *flanking_length);
+  dBNode** nodes3p = (dBNode**) malloc(sizeof(dBNode*) *flanking_length);
+  Orientation* orientations5p = (Orientation*) malloc(sizeof(Orientation) * flanking_length);
+  Orientation* orientations3p = (Orientation*) malloc(sizeof(Orientation) * flanking_length);
+  Nucleotide* labels_flank5p = (Nucleotide*) malloc(sizeof(Nucleotide) * flanking_length);
+  Nucleotide* labels_flank3p = (Nucleotide*) malloc(sizeof(Nucleotide) * flanking_length);
+  char* seq5p = (char*) malloc(sizeof(char)* (flanking_length+2));
+  char* seq3p = (char*) malloc(sizeof(char)* (flanking_length+2));
+
+
+
+  if ( (path_nodes1==NULL) || (path_nodes2==NULL) || (path_orientations1==NULL) || (path_orientations2==NULL) 
+       || (path_labels1==NULL) || (path_labels2==NULL) || (seq1==NULL) || (seq2==NULL)
+       || (nodes5p==NULL) || (nodes3p==NULL) || (orientations5p==NULL) || (orientations3p==NULL)
+       || (labels_flank5p==NULL) || (labels_flank3p==NULL) || (seq5p==NULL) || (seq3p==NULL) || (working_ca==NULL) )
+    {
+      die("Could not allocate arrays in db_graph_detect_vars. \n"
+          "Out of memory, or you asked for unreasonably big max branch size: %d",
+          max_length);
+    }
+
+
+  /*  
+  VariantBranchesAndFlanks* var = alloc_VariantBranchesAndFlanks_object(flanking_length, max_length, max_length, flanking_length, db_graph->kmer_size);
+  if (var==NULL)
+    {
+      die("Unable to allocate a var object at the start of the Bubble Caller. Abort. \n"
+	  "V low on memory, or you have asked for max var length which is too big");
+    }
+  */
+
+  StrBuf* namebuf = strbuf_new();
+
+  void get_vars(dBNode * node){
+
+   
+    void get_vars_with_orientation(dBNode * node, Orientation orientation){
+
+      int length1=0;
+      int length2=0;
+      seq1[0]='\0';
+      seq2[0]='\0';
+
+
+
+      double avg_coverage1=0;
+      Covg min_coverage1=0;
+      Covg max_coverage1=0;
+      
+      double avg_coverage2=0;
+      Covg min_coverage2=0;
+      Covg max_coverage2=0;
+      
+      dBNode * current_node = node;
+
+      //will reuse this as we traverse the graph
+      VariantBranchesAndFlanks var;
+
+      do{
+	
+
+	//The idea is that db_graph_detect_bubble_in_subgraph_defined_by_func_of_colours will mark anything is sees with action_flanks
+	//However if it does find a bubble, and if you want it to (penultimate argument=true)  then the branches are  marked with action_branches
+	if (db_graph_detect_bubble_in_subgraph_defined_by_func_of_colours(start_condition, current_node,orientation,max_length,action_flanks,
+									  &length1,path_nodes1,path_orientations1,path_labels1,
+									  seq1,&avg_coverage1,&min_coverage1,&max_coverage1,
+									  &length2,path_nodes2,path_orientations2,path_labels2,
+									  seq2,&avg_coverage2,&min_coverage2,&max_coverage2,
+									  db_graph, get_colour, get_covg,
+									  true, action_branches))
+	  {
+
+	    int length_flank5p = 0;	
+	    int length_flank3p = 0;
+
+	    db_graph_get_flanks_of_bubble(current_node, orientation, path_nodes2[length2], path_orientations2[length2],
+					  flanking_length, action_flanks,
+					  nodes5p, orientations5p, labels_flank5p, seq5p, &length_flank5p,
+					  nodes3p, orientations3p, labels_flank3p, seq3p, &length_flank3p,
+					  db_graph, get_colour, get_covg);
+
+	    // i think this warning is wrong! -->
+      // warning - array of 5prime nodes, oprientations is in reverse order to
+      // what you would expect - it is never used in what follows
+	    set_variant_branches_and_flanks(&var,
+					    nodes5p, orientations5p, length_flank5p,
+					    path_nodes1, path_orientations1, length1, 
+					    path_nodes2, path_orientations2, length2,
+					    nodes3p, orientations3p, length_flank3p,
+					    unknown);
+
+	    db_graph_print_bubble_if_condition(fout, &var, seq5p, seq1, seq2, seq3p,
+					       &count_vars, namebuf, working_ca, db_graph,
+					       condition, print_extra_info,
+					       apply_model_selection, model_selection_condition, model_info);
 	      
 	    
 	    //db_node_action_set_status_visited(path_nodes2[length2]);
@@ -2987,7 +3448,7 @@ void db_graph_detect_vars_after_marking_vars_in_reference_to_be_ignored(
 		       &db_node_condition_always_true//start condition
 		       );
   //unset the nodes marked as visited, but not those marked as to be ignored
-  hash_table_traverse(&db_node_action_unset_status_visited_or_visited_and_exists_in_reference, db_graph);	
+  db_graph_unset_all_visited_status(db_graph);	
 
   //then start again, detecting variants in the individual.
   printf("Now see if can detect anything afer marking stuff to be ignored\n");
@@ -3000,7 +3461,7 @@ void db_graph_detect_vars_after_marking_vars_in_reference_to_be_ignored(
 		       );
 
   //unset the nodes marked as visited, but not those marked as to be ignored
-  hash_table_traverse(&db_node_action_unset_status_visited_or_visited_and_exists_in_reference, db_graph);	
+  db_graph_unset_all_visited_status(db_graph);	
 
 }
 
@@ -3203,7 +3664,7 @@ void db_graph_detect_vars_given_lists_of_colours(FILE* fout, /*FILE* fout_gls,*/
 			   false, NULL, NULL, &db_node_condition_always_true//start condition
 			   );
       //unset the nodes marked as visited, but not those marked as to be ignored
-      hash_table_traverse(&db_node_action_unset_status_visited_or_visited_and_exists_in_reference, db_graph);	
+      db_graph_unset_all_visited_status(db_graph);	
     }
 
 
@@ -3273,7 +3734,7 @@ void db_graph_detect_vars_given_lists_of_colours(FILE* fout, /*FILE* fout_gls,*/
   if (exclude_ref_bubbles_first==true)
     {
       //unset the nodes marked as visited, but not those marked as to be ignored
-      hash_table_traverse(&db_node_action_unset_status_visited_or_visited_and_exists_in_reference, db_graph);	
+      db_graph_unset_all_visited_status(db_graph);	
     }
 
   free(union_list);
@@ -3359,7 +3820,7 @@ void db_graph_print_novel_supernodes(char* outfile, int max_length, dBGraph * db
 
 
   //unset the nodes marked as visited, but not those marked as to be ignored
-  hash_table_traverse(&db_node_action_unset_status_visited_or_visited_and_exists_in_reference, db_graph);	
+  db_graph_unset_all_visited_status(db_graph);	
 
 
 }
@@ -3933,7 +4394,7 @@ void db_graph_get_covgs_in_all_colours_of_col0union1_sups(int max_length, dBGrap
   }
   
   traverse_hash_collecting_sums(&parse_supernode, db_graph, pgf, cox, data1, data2, data3, data4, data5);
-  hash_table_traverse(&db_node_action_unset_status_visited_or_visited_and_exists_in_reference, db_graph); 
+  db_graph_unset_all_visited_status(db_graph); 
 
   free(path_nodes);
   free(path_orientations);
@@ -4107,7 +4568,7 @@ void db_graph_get_proportion_of_cvg_on_each_sup(int max_length, dBGraph * db_gra
 
   fprintf(fout, "Supernode(COX_or_PGF_specific)\tPure_PGF_log_ratio\tPure_COX_log_ratio\tdata1_log_ratio\tdata2_log_ratio\tdata3_log_ratio\tdata4_log_ratio\tdata5_log_ratio\n");
   hash_table_traverse(&parse_supernode, db_graph);
-  hash_table_traverse(&db_node_action_unset_status_visited_or_visited_and_exists_in_reference, db_graph); 
+  db_graph_unset_all_visited_status(db_graph); 
 
   free(path_nodes);
   free(path_orientations);
@@ -4330,7 +4791,7 @@ void print_covg_stats_for_timestamps_for_supernodes(char* outfile, dBGraph * db_
   //traverse graph and get stats:
 
   hash_table_traverse(&print_sup_stats, db_graph);
-  hash_table_traverse(&db_node_action_unset_status_visited_or_visited_and_exists_in_reference, db_graph);
+  db_graph_unset_all_visited_status(db_graph);
 
   
   
@@ -4400,7 +4861,7 @@ void print_likelihoods_of_realseq_and_error_models_for_supernodes(dBGraph * db_g
   }
   
   hash_table_traverse(&check_supernode, db_graph);
-  hash_table_traverse(&db_node_action_unset_status_visited_or_visited_and_exists_in_reference, db_graph);
+  db_graph_unset_all_visited_status(db_graph);
 
 }
 
@@ -4792,7 +5253,7 @@ long long db_graph_remove_supernodes_more_likely_errors_than_sampling(dBGraph *
   
 
   long long number_of_pruned_supernodes  = hash_table_traverse_returning_sum(&prune_supernode_if_it_looks_like_is_induced_by_singlebase_errors, db_graph);
-  hash_table_traverse(&db_node_action_unset_status_visited_or_visited_and_exists_in_reference, db_graph);
+  db_graph_unset_all_visited_status(db_graph);
 
 
   free(path_nodes);
@@ -4853,7 +5314,7 @@ long long db_graph_remove_errors_from_pool_according_to_model(dBGraph * db_graph
       }
 
   long long number_of_pruned_supernodes  = hash_table_traverse_returning_sum(&prune_supernode_if_it_looks_like_is_more_likely_to_be_error_than_sampling, db_graph);
-  hash_table_traverse(&db_node_action_unset_status_visited_or_visited_and_exists_in_reference, db_graph);
+  db_graph_unset_all_visited_status(db_graph);
   return number_of_pruned_supernodes;
 
   
@@ -4912,7 +5373,7 @@ long long db_graph_remove_errors_considering_covg_and_topology(
   
 
   long long number_of_pruned_supernodes  = hash_table_traverse_returning_sum(&prune_supernode_if_it_looks_like_is_induced_by_errors, db_graph);
-  hash_table_traverse(&db_node_action_unset_status_visited_or_visited_and_exists_in_reference, db_graph);
+  db_graph_unset_all_visited_status(db_graph);
 
 
   free(path_nodes);
@@ -4928,6 +5389,49 @@ long long db_graph_remove_errors_considering_covg_and_topology(
 // 1. the argument get_edge_of_interest is a function that gets the "edge" you are interested in - may be a single edge/colour from the graph, or might be a union of some edges 
 // 2 Pass apply_reset_to_specified_edges which applies reset_one_edge to whichever set of edges you care about,
 // 3 Pass apply_reset_to_specified_edges_2 which applies db_node_reset_edges to whichever set of edges you care about,
+// Rather than a low coverage node removing the edges of its neighbours to it (as
+// db_graph_db_node_prune_low_coverage does), every node with enough coverage removes
+// its own edges to low coverage neighbours - those which have an edge back to it, as
+// only those would have removed it. So each node only changes itself, and the graph
+// can be pruned by several threads at once. Low coverage nodes keep their edges until
+// the second pass, so this reads them as they were, and coverages do not change while
+// pruning, so the result is the same as pruning one node at a time
+static void db_graph_db_node_remove_edges_to_low_coverage(dBNode * node, Covg coverage,
+							  dBGraph * db_graph,
+							  Covg (*sum_of_covgs_in_desired_colours)(const Element *),
+							  Edges (*get_edge_of_interest)(const Element*),
+							  void (*apply_reset_to_specified_edges)(dBNode*, Orientation, Nucleotide))
+{
+  if (sum_of_covgs_in_desired_colours(node)<=coverage)
+    {
+      return;
+    }
+
+  void remove_edge_if_to_low_coverage(Nucleotide nucleotide, Orientation orientation)
+  {
+    Orientation next_orientation;
+    Nucleotide reverse_nucleotide;
+
+    if (db_node_edge_exist_within_specified_function_of_coloured_edges(node,nucleotide,orientation, get_edge_of_interest))
+      {
+	dBNode * next_node = db_graph_get_next_node(node,orientation,&next_orientation,nucleotide,&reverse_nucleotide,db_graph);
+	if ( (next_node!=NULL) && (sum_of_covgs_in_desired_colours(next_node)<=coverage)
+	     && db_node_edge_exist_within_specified_function_of_coloured_edges(next_node,reverse_nucleotide,opposite_orientation(next_orientation), get_edge_of_interest) )
+	  {
+	    db_node_reset_specified_edges(node, orientation, nucleotide, apply_reset_to_specified_edges);
+	  }
+      }
+  }
+
+  void nucleotide_action(Nucleotide nucleotide){
+    remove_edge_if_to_low_coverage(nucleotide, forward);
+    remove_edge_if_to_low_coverage(nucleotide, reverse);
+  }
+
+  nucleotide_iterator(&nucleotide_action);
+}
+
+
 void db_graph_remove_low_coverage_nodes(
   Covg coverage, dBGraph * db_graph,
   Covg (*sum_of_covgs_in_desired_colours)(const Element *), 
@@ -4936,33 +5440,254 @@ void db_graph_remove_low_coverage_nodes(
   void (*apply_reset_to_specified_edges_2)(dBNode*) )
 {
   
+  void remove_edges_to_low_coverage(dBNode * node){
+    db_graph_db_node_remove_edges_to_low_coverage(node,coverage,
+						  db_graph,
+						  sum_of_covgs_in_desired_colours, get_edge_of_interest, apply_reset_to_specified_edges
+						  );
+  }
+
   void prune_node(dBNode * node){
-    db_graph_db_node_prune_low_coverage(node,coverage,
-					&db_node_action_set_status_pruned,
-					db_graph,
-					sum_of_covgs_in_desired_colours, get_edge_of_interest, apply_reset_to_specified_edges, apply_reset_to_specified_edges_2
-					);
+    if (sum_of_covgs_in_desired_colours(node)<=coverage)
+      {
+	db_node_action_set_status_pruned(node);
+	//remove all edges from this node, in colours we care about
+	apply_reset_to_specified_edges_2(node);
+      }
   }
 
-  hash_table_traverse(&prune_node,db_graph); 
+  hash_table_traverse_multithreaded(&remove_edges_to_low_coverage,db_graph,NUM_THREADS); 
+  hash_table_traverse_multithreaded(&prune_node,db_graph,NUM_THREADS); 
 } 
 
 
 void db_graph_remove_low_coverage_nodes_ignoring_colours(Covg coverage, dBGraph * db_graph)
 {
   
-  void prune_node(dBNode * node){
-    db_graph_db_node_prune_low_coverage_ignoring_colours(node,coverage,
-							 &db_node_action_set_status_pruned,
-							 db_graph
-							 );
+  Edges get_edge_of_interest(const Element* node)
+  {
+    return get_union_of_edges(*node);
   }
 
-  hash_table_traverse(&prune_node,db_graph); 
+  void apply_reset_to_specified_edges(dBNode* node , Orientation or , Nucleotide nuc)
+  {
+    int i;
+    for (i=0; i< NUMBER_OF_COLOURS; i++)
+      {
+	reset_one_edge(node, or, nuc, i);
+      }
+  }
+
+  void apply_reset_to_specified_edges_2(dBNode* node)
+  {
+    int i;
+    for (i=0; i< NUMBER_OF_COLOURS; i++)
+      {
+	db_node_reset_edges(node, i);
+      }
+  }
+
+  db_graph_remove_low_coverage_nodes(coverage, db_graph,
+				     &element_get_covg_union_of_all_covgs,
+				     &get_edge_of_interest,
+				     &apply_reset_to_specified_edges,
+				     &apply_reset_to_specified_edges_2);
 }
 
 
 
+//
+// Dumping binaries
+//
+// The table is split into contiguous ranges of slots, and each range is
+// serialised into its own buffer (compressed blocks for version 7 and above),
+// NUM_THREADS ranges at a time. The buffers are then written in table
+// order, so the file is the same whatever the number of threads.
+
+#define DUMP_RANGE_BYTES (32 << 20) // roughly how much of a range is buffered
+
+typedef struct
+{
+  dBGraph* db_graph;
+  boolean (*condition)(dBNode * node);
+  int first_colour, num_colours;
+  boolean skip_nodes_without_info; // with no coverage or edges in these colours
+  long long first_slot, end_slot;
+  char* buf; // version 6 records
+  size_t len, capacity;
+  BinaryBlockEncoder* blocks; // or compressed blocks
+  long long count;
+} BinaryDumpRange;
+
+static void binary_dump_range_add(BinaryDumpRange* range, dBNode* node)
+{
+  Covg covg[range->num_colours];
+  Edges individual_edges[range->num_colours];
+  boolean has_info = false;
+  int i;
+
+  for (i=0; i<range->num_colours; i++)
+    {
+      covg[i]             = db_node_get_coverage(node, range->first_colour+i);
+      individual_edges[i] = get_edge_copy(*node, range->first_colour+i);
+      has_info = has_info || (covg[i]!=0) || (individual_edges[i]!=0);
+    }
+
+  if ( (range->skip_nodes_without_info==true) && (has_info==false) )
+    {
+      return;
+    }
+
+  range->count++;
+
+  if (range->blocks!=NULL)
+    {
+      binary_block_encoder_add(range->blocks, node->kmer, covg, individual_edges);
+      return;
+    }
+
+  size_t record_size = sizeof(BinaryKmer) + range->num_colours*(sizeof(Covg)+sizeof(Edges));
+  if (range->len+record_size > range->capacity)
+    {
+      range->capacity = 2*range->capacity + record_size;
+      range->buf = realloc(range->buf, range->capacity);
+      if (range->buf==NULL)
+	{
+	  die("Unable to grow the buffer for dumping a binary\n");
+	}
+    }
+
+  char* rec = range->buf + range->len;
+  memcpy(rec, node->kmer, sizeof(BinaryKmer));
+  rec += sizeof(BinaryKmer);
+  memcpy(rec, covg, range->num_colours*sizeof(Covg));
+  rec += range->num_colours*sizeof(Covg);
+  memcpy(rec, individual_edges, range->num_colours*sizeof(Edges));
+  range->len += record_size;
+}
+
+static void* binary_dump_range_serialise(void* arg)
+{
+  BinaryDumpRange* range = arg;
+  long long i;
+
+  range->len = 0;
+  range->count = 0;
+  for (i=range->first_slot; i<range->end_slot; i++)
+    {
+      dBNode* node = &range->db_graph->table[i];
+      if (!db_node_check_for_flag_ALL_OFF(node) && range->condition(node))
+	{
+	  binary_dump_range_add(range, node);
+	}
+    }
+
+  if (range->blocks!=NULL)
+    {
+      binary_block_encoder_flush(range->blocks);
+    }
+  return NULL;
+}
+
+// Writes the records after the header. Returns the number of kmers dumped
+static long long db_graph_dump_binary_records(FILE* fout, boolean (*condition)(dBNode * node),
+					      dBGraph* db_graph, int first_colour, int num_colours,
+					      boolean skip_nodes_without_info, int version)
+{
+  long long num_slots = db_graph->number_buckets * db_graph->bucket_size;
+  size_t record_size = sizeof(BinaryKmer) + num_colours*(sizeof(Covg)+sizeof(Edges));
+  long long slots_per_range = DUMP_RANGE_BYTES / record_size;
+  int num_threads = (NUM_THREADS>1 ? NUM_THREADS : 1);
+  BinaryDumpRange ranges[num_threads];
+  BinaryBlockWriter block_writer;
+  long long count=0;
+  int t;
+
+  if (version>=7)
+    {
+      binary_block_writer_init(&block_writer, fout);
+    }
+
+  for (t=0; t<num_threads; t++)
+    {
+      ranges[t].db_graph = db_graph;
+      ranges[t].condition = condition;
+      ranges[t].first_colour = first_colour;
+      ranges[t].num_colours = num_colours;
+      ranges[t].skip_nodes_without_info = skip_nodes_without_info;
+      ranges[t].buf = NULL;
+      ranges[t].len = ranges[t].capacity = 0;
+      ranges[t].blocks = (version>=7 ? binary_block_encoder_new(num_colours) : NULL);
+    }
+
+  long long next_slot = 0;
+  while (next_slot < num_slots)
+    {
+      int num_ranges = 0;
+      while ( (num_ranges<num_threads) && (next_slot<num_slots) )
+	{
+	  ranges[num_ranges].first_slot = next_slot;
+	  next_slot += slots_per_range;
+	  if (next_slot>num_slots)
+	    {
+	      next_slot = num_slots;
+	    }
+	  ranges[num_ranges].end_slot = next_slot;
+	  num_ranges++;
+	}
+
+      if (num_ranges==1)
+	{
+	  binary_dump_range_serialise(&ranges[0]);
+	}
+      else
+	{
+	  pthread_t threads[num_ranges];
+	  for (t=0; t<num_ranges; t++)
+	    {
+	      if (pthread_create(&threads[t], NULL, binary_dump_range_serialise, &ranges[t])!=0)
+		{
+		  die("Unable to create a thread to dump a binary\n");
+		}
+	    }
+	  for (t=0; t<num_ranges; t++)
+	    {
+	      pthread_join(threads[t], NULL);
+	    }
+	}
+
+      for (t=0; t<num_ranges; t++)
+	{
+	  if (version>=7)
+	    {
+	      binary_block_writer_append(&block_writer, ranges[t].blocks);
+	    }
+	  else if ( (ranges[t].len>0) && (fwrite(ranges[t].buf, 1, ranges[t].len, fout)!=ranges[t].len) )
+	    {
+	      die("Failed to write to the binary being dumped - out of disk?\n");
+	    }
+	  count += ranges[t].count;
+	}
+    }
+
+  if (version>=7)
+    {
+      binary_block_writer_finish(&block_writer);
+    }
+
+  for (t=0; t<num_threads; t++)
+    {
+      free(ranges[t].buf);
+      if (ranges[t].blocks!=NULL)
+	{
+	  binary_block_encoder_free(ranges[t].blocks);
+	}
+    }
+
+  return count;
+}
+
+
 //if you don't want to/care about graph_info, pass in NULL
 int db_graph_dump_binary(char * filename, boolean (*condition)(dBNode * node), dBGraph * db_graph, GraphInfo* db_graph_info, int version){
 
@@ -4984,20 +5709,49 @@ int db_graph_dump_binary(char * filename, boolean (*condition)(dBNode * node), d
       print_binary_signature_NEW(fout, db_graph->kmer_size, NUMBER_OF_COLOURS, db_graph_info, 0, version);
     }
 
-  long long count=0;
-  //routine to dump graph
-  void print_node_multicolour_binary(dBNode * node){   
-    if (condition(node)){
-      count++;
-      db_node_print_multicolour_binary(fout,node);
+  long long count = db_graph_dump_binary_records(fout, condition, db_graph, 0, NUMBER_OF_COLOURS,
+						 false, version);
+  fclose(fout);
+
+  printf("%qd kmers dumped to file %s\n",count, filename);
+  return count;
+}
+
+
+void db_graph_dump_image(char * filename, dBGraph * db_graph, GraphInfo* db_graph_info){
+
+  FILE* fout= fopen(filename, "w"); 
+  if (fout==NULL)
+    {
+      die("Unable to dump the graph image %s, as cannot open it with write-access.Permissions issue? Directory does not exist? Out of disk?\n",
+	  filename);
     }
+
+  //the header only describes the colours with anything in them, so that a colour list
+  //loaded on top of the image goes into the colours after them, as with a binary
+  int num_cols = 1;
+  void find_last_colour(dBNode* node)
+  {
+    int col;
+    for (col=NUMBER_OF_COLOURS-1; col>=num_cols; col--)
+      {
+	if ( (db_node_get_coverage(node, col)>0) || (get_edge_copy(*node, col)!=0) )
+	  {
+	    num_cols = col+1;
+	    break;
+	  }
+      }
   }
+  hash_table_traverse(&find_last_colour, db_graph);
 
-  hash_table_traverse(&print_node_multicolour_binary,db_graph); 
+  print_binary_signature_NEW(fout, db_graph->kmer_size, num_cols, db_graph_info, 0, BINVERSION);
+  if (hash_table_write_image(db_graph, fout)==false)
+    {
+      die("Unable to write all of the graph image %s. Out of disk?\n", filename);
+    }
   fclose(fout);
 
-  printf("%qd kmers dumped to file %s\n",count, filename);
-  return count;
+  printf("Image of %qd kmers in %d colours dumped to file %s\n", hash_table_get_unique_kmers(db_graph), num_cols, filename);
 }
 
 
@@ -5023,16 +5777,7 @@ void db_graph_dump_single_colour_binary_of_colour0(char * filename, boolean (*co
     }
 
 
-  long long count=0;
-  //routine to dump graph
-  void print_node_single_colour_binary_of_colour0(dBNode * node){   
-    if (condition(node) ){
-      count++;
-      db_node_print_single_colour_binary_of_colour0(fout,node);
-    }
-  }
-
-  hash_table_traverse(&print_node_single_colour_binary_of_colour0,db_graph); 
+  db_graph_dump_binary_records(fout, condition, db_graph, 0, 1, false, version);
   fclose(fout);
 
   //printf("%qd kmers dumped\n",count);
@@ -5070,25 +5815,8 @@ void db_graph_dump_single_colour_binary_of_specified_colour(char * filename, boo
       print_binary_signature_NEW(fout, db_graph->kmer_size, 1, db_graph_info, colour, version);
     }
 
-
-  long long count=0;
-  //routine to dump graph
-  void print_node_single_colour_binary_of_specified_colour(dBNode * node){   
-
-    //no need to dump a node which has no coverage or edge - no information
-    boolean flag=true;
-    if ((node->coverage[colour]==0) && (node->individual_edges[colour]==0))
-      {
-	flag=false;
-      }
-
-    if (condition(node) && (flag==true)){
-      count++;
-      db_node_print_single_colour_binary_of_specified_colour(fout,node, colour);
-    }
-  }
-
-  hash_table_traverse(&print_node_single_colour_binary_of_specified_colour,db_graph); 
+  //no need to dump a node which has no coverage or edge - no information
+  db_graph_dump_binary_records(fout, condition, db_graph, colour, 1, true, version);
   fclose(fout);
 
   //printf("%qd kmers dumped\n",count);
@@ -5235,18 +5963,30 @@ void db_graph_get_covg_distribution(char* filename, dBGraph* db_graph,
   for(i = 0; i < covgs_len; i++)
     covgs[i] = 0;
 
-  void bin_covg_and_add_to_array(HashTable* htable, Element *e,
-                                 uint64_t* arr, uint32_t len, int colour)
+  // each thread counts into its own histogram
+  int num_threads = NUM_THREADS < 1 ? 1 : NUM_THREADS;
+  uint64_t* thread_covgs = calloc((size_t)num_threads * covgs_len, sizeof(uint64_t));
+
+  if(thread_covgs == NULL)
+    die("Could not alloc arrays to hold covg distrib\n");
+
+  void bin_covg_and_add_to_array(Element *e, int thread_index)
   {
     if(condition(e)==true)
     {
-      uint64_t bin = MIN(e->coverage[colour], len-1);
-      arr[bin]++;
+      uint64_t bin = MIN(db_node_get_coverage(e, index), covgs_len-1);
+      thread_covgs[(size_t)thread_index * covgs_len + bin]++;
     }
   }
   
-  db_graph_traverse_with_array_of_uint64(&bin_covg_and_add_to_array, db_graph,
-					 covgs, covgs_len, index);
+  hash_table_traverse_multithreaded_with_thread_index(&bin_covg_and_add_to_array, db_graph,
+						      num_threads);
+
+  int t;
+  for(t = 0; t < num_threads; t++)
+    for(i = 0; i < covgs_len; i++)
+      covgs[i] += thread_covgs[(size_t)t * covgs_len + i];
+  free(thread_covgs);
 
   fprintf(fout, "KMER_COVG\tFREQUENCY\n");
     for(i = 0; i < covgs_len; i++)
@@ -5264,18 +6004,12 @@ void db_graph_get_covg_distribution(char* filename, dBGraph* db_graph,
 long long  db_graph_count_covg1_kmers_in_func_of_colours(dBGraph* db_graph, Covg (*get_covg)(const dBNode*) )
 {
 
-  long long count = 0;
-
-  void count_unique(Element * e)
+  long long count_unique(Element * e)
   {
-    if (get_covg(e)==1)
-      {
-	count++;
-      }
+    return (get_covg(e)==1) ? 1 : 0;
   }
   
-  hash_table_traverse(&count_unique, db_graph);
-  return count;
+  return hash_table_traverse_returning_sum_multithreaded(&count_unique, db_graph, NUM_THREADS);
 }
 
 
@@ -5283,18 +6017,12 @@ long long  db_graph_count_covg1_kmers_in_func_of_colours(dBGraph* db_graph, Covg
 long long  db_graph_count_covg2_kmers_in_func_of_colours(dBGraph* db_graph, Covg (*get_covg)(const dBNode*) )
 {
 
-  long long count = 0;
-
-  void count_unique(Element * e)
+  long long count_unique(Element * e)
   {
-    if (get_covg(e)==2)
-      {
-	count++;
-      }
+    return (get_covg(e)==2) ? 1 : 0;
   }
   
-  hash_table_traverse(&count_unique, db_graph);
-  return count;
+  return hash_table_traverse_returning_sum_multithreaded(&count_unique, db_graph, NUM_THREADS);
 }
 
 
@@ -8058,6 +8786,30 @@ boolean make_reference_path_based_sv_calls_condition_always_true_in_subgraph_def
   return true;
 }
 
+// Marks of the nodes visited while calling one chromosome. The path divergence
+// caller marks them in the status of the nodes unless given a bitmap (one bit
+// per slot of the table) of its own, so that several chromosomes can be called at once
+static boolean pd_check_visited(dBNode* node, uint64_t* visited, dBGraph* db_graph)
+{
+  if (visited==NULL)
+    {
+      return db_node_check_status_visited(node);
+    }
+  long long slot = node - db_graph->table;
+  return (visited[slot>>6] >> (slot&63)) & 1;
+}
+
+static void pd_set_visited(dBNode* node, uint64_t* visited, dBGraph* db_graph)
+{
+  if (visited==NULL)
+    {
+      db_node_action_set_status_visited(node);
+      return;
+    }
+  long long slot = node - db_graph->table;
+  visited[slot>>6] |= ((uint64_t)1) << (slot&63);
+}
+
 // *******************************************************************************
 // New SV calling algorithm based on comparing a supernode with a "trusted path". This trusted path might be the reference, or some contig that
 // we have obtained by bootstrapping.
@@ -8074,7 +8826,7 @@ boolean make_reference_path_based_sv_calls_condition_always_true_in_subgraph_def
 // In normal use, this should be zero - we'll find far too many variants. But can be used for testing.
 // the index for the reference is purely used for checking if nodes exist in the reference at all, or are novel. The trusted path is, in general, not necessarily the reference.
 // The trusted path comes entirely from chrom_fptr, and doe not need to be the same as the reference, as specified in arguments 4,5
-int db_graph_make_reference_path_based_sv_calls_in_subgraph_defined_by_func_of_colours(FILE* chrom_fasta_fptr,
+static int db_graph_make_reference_path_based_sv_calls_marking_visited_in(FILE* chrom_fasta_fptr,
 										       Edges (*get_colour)(const dBNode*),
 										       Covg (*get_covg)(const dBNode*),
 										       int ref_colour, //int index_for_ref_in_edge_array,
@@ -8089,8 +8841,8 @@ int db_graph_make_reference_path_based_sv_calls_in_subgraph_defined_by_func_of_c
 										       void (*action_for_branches_of_called_variants)(VariantBranchesAndFlanks* var),
 										       void (*print_extra_info)(AnnotatedPutativeVariant* var, FILE* fout),
 										       GraphAndModelInfo* model_info, AssumptionsOnGraphCleaning assump,
-										       int start_variant_numbering_with_this
-										       )
+										       int start_variant_numbering_with_this,
+										       uint64_t* visited)
 {
 
 
@@ -8371,7 +9123,7 @@ int db_graph_make_reference_path_based_sv_calls_in_subgraph_defined_by_func_of_c
 	      continue;
 	    }
 
-	  if (db_node_check_status_visited(chrom_path_array[start_node_index])==true)
+	  if (pd_check_visited(chrom_path_array[start_node_index], visited, db_graph)==true)
 	  {
 	    start_node_index++;
 	    continue;
@@ -8388,11 +9140,16 @@ int db_graph_make_reference_path_based_sv_calls_in_subgraph_defined_by_func_of_c
 	  
 	  int length_curr_supernode = 
 	    db_graph_supernode_returning_query_node_posn_in_subgraph_defined_by_func_of_colours(chrom_path_array[start_node_index], 
-												max_expected_size_of_supernode, &db_node_action_set_status_visited,
+												max_expected_size_of_supernode, &db_node_action_do_nothing,
 												current_supernode, curr_sup_orientations, curr_sup_labels, supernode_string, 
 												&avg_coverage, &min_coverage, &max_coverage, &is_cycle, 
 												&index_of_query_node_in_supernode_array, 
 												db_graph, get_colour, get_covg);
+	  int v;
+	  for (v=0; v<=length_curr_supernode; v++)
+	    {
+	      pd_set_visited(current_supernode[v], visited, db_graph);
+	    }
 	  
 
 	  if (length_curr_supernode>max_anchor_span)
@@ -9628,7 +10385,37 @@ int db_graph_make_reference_path_based_sv_calls_in_subgraph_defined_by_func_of_c
 
 
 
-int db_graph_make_reference_path_based_sv_calls_given_list_of_colours_for_indiv(int* list, int len_list,
+int db_graph_make_reference_path_based_sv_calls_in_subgraph_defined_by_func_of_colours(FILE* chrom_fasta_fptr,
+										       Edges (*get_colour)(const dBNode*),
+										       Covg (*get_covg)(const dBNode*),
+										       int ref_colour,
+										       int min_fiveprime_flank_anchor, int min_threeprime_flank_anchor, 
+										       int max_anchor_span, Covg min_covg, Covg max_covg, 
+										       int max_expected_size_of_supernode, int length_of_arrays, dBGraph* db_graph, FILE* output_file,
+										       int max_desired_returns,
+										       char** return_flank5p_array, char** return_trusted_branch_array, char** return_variant_branch_array, 
+										       char** return_flank3p_array, int** return_variant_start_coord,
+										       boolean (*condition)(VariantBranchesAndFlanks* var,  int colour_of_ref,  
+													    Edges (*get_colour)(const dBNode*), Covg (*get_covg)(const dBNode*)),
+										       void (*action_for_branches_of_called_variants)(VariantBranchesAndFlanks* var),
+										       void (*print_extra_info)(AnnotatedPutativeVariant* var, FILE* fout),
+										       GraphAndModelInfo* model_info, AssumptionsOnGraphCleaning assump,
+										       int start_variant_numbering_with_this
+										       )
+{
+  return db_graph_make_reference_path_based_sv_calls_marking_visited_in(chrom_fasta_fptr, get_colour, get_covg, ref_colour,
+									 min_fiveprime_flank_anchor, min_threeprime_flank_anchor,
+									 max_anchor_span, min_covg, max_covg,
+									 max_expected_size_of_supernode, length_of_arrays, db_graph, output_file,
+									 max_desired_returns,
+									 return_flank5p_array, return_trusted_branch_array, return_variant_branch_array,
+									 return_flank3p_array, return_variant_start_coord,
+									 condition, action_for_branches_of_called_variants, print_extra_info,
+									 model_info, assump, start_variant_numbering_with_this, NULL);
+}
+
+
+static int db_graph_make_reference_path_based_sv_calls_given_list_of_colours_marking_visited_in(int* list, int len_list,
 										 FILE* chrom_fasta_fptr, int ref_colour,
 										 int min_fiveprime_flank_anchor, int min_threeprime_flank_anchor, 
 										 int max_anchor_span, Covg min_covg, Covg max_covg, 
@@ -9641,7 +10428,8 @@ int db_graph_make_reference_path_based_sv_calls_given_list_of_colours_for_indiv(
 										 void (*action_for_branches_of_called_variants)(VariantBranchesAndFlanks* var),
 										 void (*print_extra_info)(AnnotatedPutativeVariant* annovar, FILE* fout),
 										GraphAndModelInfo* model_info, AssumptionsOnGraphCleaning assump,
-										int start_numbering_vars_from_this_number
+										int start_numbering_vars_from_this_number,
+										uint64_t* visited
 										)
 {
 
@@ -9664,17 +10452,17 @@ int db_graph_make_reference_path_based_sv_calls_given_list_of_colours_for_indiv(
   }
 
   printf("ZAM - max exp size of sup is %d\n", max_expected_size_of_supernode);
-  int num_vars_called=db_graph_make_reference_path_based_sv_calls_in_subgraph_defined_by_func_of_colours(chrom_fasta_fptr,
-													 &get_union_list_colours, &get_covg_of_union_first_list_colours,
-													 ref_colour,
-													 min_fiveprime_flank_anchor, min_threeprime_flank_anchor,
-													 max_anchor_span, min_covg, max_covg,
-													 max_expected_size_of_supernode, length_of_arrays, db_graph, output_file,
-													 max_desired_returns,
-													 return_flank5p_array, return_trusted_branch_array, return_variant_branch_array,
-													 return_flank3p_array, return_variant_start_coord,
-													 condition, action_for_branches_of_called_variants, print_extra_info, 
-													 model_info, assump, start_numbering_vars_from_this_number);
+  int num_vars_called=db_graph_make_reference_path_based_sv_calls_marking_visited_in(chrom_fasta_fptr,
+										  &get_union_list_colours, &get_covg_of_union_first_list_colours,
+										  ref_colour,
+										  min_fiveprime_flank_anchor, min_threeprime_flank_anchor,
+										  max_anchor_span, min_covg, max_covg,
+										  max_expected_size_of_supernode, length_of_arrays, db_graph, output_file,
+										  max_desired_returns,
+										  return_flank5p_array, return_trusted_branch_array, return_variant_branch_array,
+										  return_flank3p_array, return_variant_start_coord,
+										  condition, action_for_branches_of_called_variants, print_extra_info, 
+										  model_info, assump, start_numbering_vars_from_this_number, visited);
 										     
 
   return num_vars_called;
@@ -9682,6 +10470,249 @@ int db_graph_make_reference_path_based_sv_calls_given_list_of_colours_for_indiv(
 }
 
 
+int db_graph_make_reference_path_based_sv_calls_given_list_of_colours_for_indiv(int* list, int len_list,
+										 FILE* chrom_fasta_fptr, int ref_colour,
+										 int min_fiveprime_flank_anchor, int min_threeprime_flank_anchor, 
+										 int max_anchor_span, Covg min_covg, Covg max_covg, 
+										 int max_expected_size_of_supernode, int length_of_arrays, dBGraph* db_graph, FILE* output_file,
+										 int max_desired_returns,
+										 char** return_flank5p_array, char** return_trusted_branch_array, char** return_variant_branch_array, 
+										 char** return_flank3p_array, int** return_variant_start_coord,
+										 boolean (*condition)(VariantBranchesAndFlanks* var,  int colour_of_ref,  
+												      Edges (*get_colour)(const dBNode*), Covg (*get_covg)(const dBNode*)),
+										 void (*action_for_branches_of_called_variants)(VariantBranchesAndFlanks* var),
+										 void (*print_extra_info)(AnnotatedPutativeVariant* annovar, FILE* fout),
+										GraphAndModelInfo* model_info, AssumptionsOnGraphCleaning assump,
+										int start_numbering_vars_from_this_number
+										)
+{
+  return db_graph_make_reference_path_based_sv_calls_given_list_of_colours_marking_visited_in(list, len_list,
+											    chrom_fasta_fptr, ref_colour,
+											    min_fiveprime_flank_anchor, min_threeprime_flank_anchor,
+											    max_anchor_span, min_covg, max_covg,
+											    max_expected_size_of_supernode, length_of_arrays, db_graph, output_file,
+											    max_desired_returns,
+											    return_flank5p_array, return_trusted_branch_array, return_variant_branch_array,
+											    return_flank3p_array, return_variant_start_coord,
+											    condition, action_for_branches_of_called_variants, print_extra_info,
+											    model_info, assump, start_numbering_vars_from_this_number, NULL);
+}
+
+
+// The chromosomes are shared out between the threads, each calling its
+// chromosomes into a temporary file of its own, numbering the variants from 1.
+// On one thread the visited marks go in the node status as they always did, so
+// when calling the union of the colours a supernode visited on one chromosome
+// is not called again on a later one. Several threads keep a bitmap each, cleared
+// for every chromosome, so there a supernode may be called on more than one chromosome
+typedef struct
+{
+  char** ref_chroms;
+  int num_ref_chroms;
+  int next_chrom;
+  int* list;
+  int len_list;
+  boolean each_colour_separately;
+  boolean mark_node_status;
+  int ref_colour;
+  int min_fiveprime_flank_anchor, min_threeprime_flank_anchor;
+  int max_anchor_span;
+  Covg min_covg, max_covg;
+  int max_expected_size_of_supernode, length_of_arrays;
+  dBGraph* db_graph;
+  boolean (*condition)(VariantBranchesAndFlanks* var, int colour_of_ref,
+		       Edges (*get_colour)(const dBNode*), Covg (*get_covg)(const dBNode*));
+  void (*action_for_branches_of_called_variants)(VariantBranchesAndFlanks* var);
+  void (*print_extra_info)(AnnotatedPutativeVariant* annovar, FILE* fout);
+  pthread_mutex_t print_lock;
+  GraphAndModelInfo* model_info;
+  AssumptionsOnGraphCleaning assump;
+  FILE** shards;
+  int* num_vars;
+} PdCallsJob;
+
+static void* pd_calls_call_chromosomes(void* arg)
+{
+  PdCallsJob* job = arg;
+  dBGraph* db_graph = job->db_graph;
+  long long num_slots = (long long)db_graph->number_buckets * db_graph->bucket_size;
+  size_t visited_size = ((num_slots+63)/64)*sizeof(uint64_t);
+  uint64_t* visited = NULL;
+  if (job->mark_node_status==false)
+    {
+      visited = malloc(visited_size);
+      if (visited==NULL)
+	{
+	  die("Unable to malloc the visited marks of a thread calling chromosomes - out of memory\n");
+	}
+    }
+
+  //the caller's function may use some shared working space
+  void print_extra_info_locked(AnnotatedPutativeVariant* annovar, FILE* fout)
+  {
+    pthread_mutex_lock(&job->print_lock);
+    job->print_extra_info(annovar, fout);
+    pthread_mutex_unlock(&job->print_lock);
+  }
+
+  int c;
+  while ( (c = __atomic_fetch_add(&job->next_chrom, 1, __ATOMIC_RELAXED)) < job->num_ref_chroms )
+    {
+      job->shards[c] = tmpfile();
+      if (job->shards[c]==NULL)
+	{
+	  die("Cannot open a temporary file for the calls on %s\n", job->ref_chroms[c]);
+	}
+
+      //one pass through the chromosome for the union of the colours, or one per colour
+      int num_passes = job->each_colour_separately ? job->len_list : 1;
+      int p;
+      for (p=0; p<num_passes; p++)
+	{
+	  FILE* chrom_fptr = fopen(job->ref_chroms[c], "r");
+	  if (chrom_fptr==NULL)
+	    {
+	      die("Cannot open %s \n", job->ref_chroms[c]);
+	    }
+	  if (visited!=NULL)
+	    {
+	      memset(visited, 0, visited_size);
+	    }
+
+	  job->num_vars[c] +=
+	    db_graph_make_reference_path_based_sv_calls_given_list_of_colours_marking_visited_in(
+		 job->each_colour_separately ? &job->list[p] : job->list,
+		 job->each_colour_separately ? 1 : job->len_list,
+		 chrom_fptr, job->ref_colour,
+		 job->min_fiveprime_flank_anchor, job->min_threeprime_flank_anchor,
+		 job->max_anchor_span, job->min_covg, job->max_covg,
+		 job->max_expected_size_of_supernode, job->length_of_arrays, db_graph, job->shards[c],
+		 0, NULL, NULL, NULL, NULL, NULL,
+		 job->condition, job->action_for_branches_of_called_variants, &print_extra_info_locked,
+		 job->model_info, job->assump, job->num_vars[c]+1, visited);
+	  fclose(chrom_fptr);
+
+	  //each colour is called against the whole graph
+	  if ( (visited==NULL) && (job->each_colour_separately==true) )
+	    {
+	      hash_table_traverse(&db_node_action_unset_status_visited_or_visited_and_exists_in_reference, db_graph);
+	    }
+	}
+    }
+
+  free(visited);
+  return NULL;
+}
+
+// Appends the calls in shard to fout, adding offset to the variant numbers
+static void pd_calls_append_shard(FILE* fout, FILE* shard, int offset)
+{
+  char* line = NULL;
+  size_t line_capacity = 0;
+  ssize_t len;
+
+  rewind(shard);
+  while ( (len = getline(&line, &line_capacity, shard)) > 0 )
+    {
+      char* rest;
+      long num;
+      if ( (strncmp(line, ">var_", 5)==0) && ((num = strtol(line+5, &rest, 10)) > 0) && (*rest=='_') )
+	{
+	  fprintf(fout, ">var_%ld%s", num+offset, rest);
+	}
+      else
+	{
+	  fwrite(line, 1, len, fout);
+	}
+    }
+  free(line);
+}
+
+int db_graph_make_reference_path_based_sv_calls_for_list_of_chroms(char** ref_chroms, int num_ref_chroms,
+								   int* list, int len_list, boolean each_colour_separately,
+								   int ref_colour,
+								   int min_fiveprime_flank_anchor, int min_threeprime_flank_anchor,
+								   int max_anchor_span, Covg min_covg, Covg max_covg,
+								   int max_expected_size_of_supernode, int length_of_arrays, dBGraph* db_graph, FILE* output_file,
+								   boolean (*condition)(VariantBranchesAndFlanks* var,  int colour_of_ref,
+											Edges (*get_colour)(const dBNode*), Covg (*get_covg)(const dBNode*)),
+								   void (*action_for_branches_of_called_variants)(VariantBranchesAndFlanks* var),
+								   void (*print_extra_info)(AnnotatedPutativeVariant* annovar, FILE* fout),
+								   GraphAndModelInfo* model_info, AssumptionsOnGraphCleaning assump)
+{
+  if (num_ref_chroms==0)
+    {
+      return 0;
+    }
+
+  PdCallsJob job;
+  job.ref_chroms = ref_chroms;
+  job.num_ref_chroms = num_ref_chroms;
+  job.next_chrom = 0;
+  job.list = list;
+  job.len_list = len_list;
+  job.each_colour_separately = each_colour_separately;
+  job.ref_colour = ref_colour;
+  job.min_fiveprime_flank_anchor = min_fiveprime_flank_anchor;
+  job.min_threeprime_flank_anchor = min_threeprime_flank_anchor;
+  job.max_anchor_span = max_anchor_span;
+  job.min_covg = min_covg;
+  job.max_covg = max_covg;
+  job.max_expected_size_of_supernode = max_expected_size_of_supernode;
+  job.length_of_arrays = length_of_arrays;
+  job.db_graph = db_graph;
+  job.condition = condition;
+  job.action_for_branches_of_called_variants = action_for_branches_of_called_variants;
+  job.print_extra_info = print_extra_info;
+  pthread_mutex_init(&job.print_lock, NULL);
+  job.model_info = model_info;
+  job.assump = assump;
+  job.shards = calloc(num_ref_chroms, sizeof(FILE*));
+  job.num_vars = calloc(num_ref_chroms, sizeof(int));
+  if ( (job.shards==NULL) || (job.num_vars==NULL) )
+    {
+      die("Unable to malloc the list of calls on each chromosome\n");
+    }
+
+  int num_threads = NUM_THREADS < num_ref_chroms ? NUM_THREADS : num_ref_chroms;
+  if (num_threads<1)
+    {
+      num_threads = 1;
+    }
+
+  job.mark_node_status = (num_threads==1);
+
+  pthread_t threads[num_threads];
+  int t;
+  for (t=0; t<num_threads; t++)
+    {
+      if (pthread_create(&threads[t], NULL, pd_calls_call_chromosomes, &job)!=0)
+	{
+	  die("Unable to create a thread to call variants\n");
+	}
+    }
+  for (t=0; t<num_threads; t++)
+    {
+      pthread_join(threads[t], NULL);
+    }
+
+  //the calls in reference order, numbered as if made one chromosome after another
+  int num_vars_called = 0;
+  int c;
+  for (c=0; c<num_ref_chroms; c++)
+    {
+      pd_calls_append_shard(output_file, job.shards[c], num_vars_called);
+      fclose(job.shards[c]);
+      num_vars_called += job.num_vars[c];
+    }
+
+  pthread_mutex_destroy(&job.print_lock);
+  free(job.shards);
+  free(job.num_vars);
+  return num_vars_called;
+}
+
+
 
 
 
@@ -9716,7 +10747,7 @@ int db_graph_make_reference_path_based_sv_calls_after_marking_vars_in_ref_to_be_
 
   printf("Masked %d false variants by calling in ref colour\n", num_false_vars_masked);
   //unset visited, but leaving nodes marked as to_be_ignored if they were in variants in the ref colour
-  hash_table_traverse(&db_node_action_unset_status_visited_or_visited_and_exists_in_reference, db_graph);
+  db_graph_unset_all_visited_status(db_graph);
 
 
   fptr = fopen(chrom_fasta, "r");
@@ -10854,7 +11885,7 @@ void db_graph_wipe_colour(int colour, dBGraph* db_graph)
     node->individual_edges[colour]=0;
     node->coverage[colour]=0;
   }
-  hash_table_traverse(&wipe_node, db_graph);
+  hash_table_traverse_multithreaded(&wipe_node, db_graph, NUM_THREADS);
 }
 
 
@@ -10870,7 +11901,98 @@ void db_graph_wipe_two_colours_in_one_traversal(int colour1, int colour2, dBGrap
     node->individual_edges[colour2]=0;
     node->coverage[colour2]=0;
   }
-  hash_table_traverse(&wipe_node, db_graph);
+  hash_table_traverse_multithreaded(&wipe_node, db_graph, NUM_THREADS);
+}
+
+// Adds one to the overlap of every pair of colours (one from each list) which the
+// node is in. Each list is a bitmask of the colours the node is in, and only
+// the set bits are visited, so for a node in few colours this is quick
+static void add_node_to_colour_overlaps(dBNode* node,
+					int* first_col_list, int num1,
+					int* second_col_list, int num2,
+					uint64_t* first_mask, uint64_t* second_mask,
+					long long* overlaps)
+{
+  int num_words1 = (num1+63)/64;
+  int num_words2 = (num2+63)/64;
+  int i, j, w1, w2;
+
+  memset(first_mask, 0, num_words1*sizeof(uint64_t));
+  memset(second_mask, 0, num_words2*sizeof(uint64_t));
+  for (i=0; i<num1; i++)
+    {
+      if (db_node_is_this_node_in_this_person_or_populations_graph(node, first_col_list[i])==true)
+	{
+	  first_mask[i/64] |= ((uint64_t)1) << (i%64);
+	}
+    }
+  for (j=0; j<num2; j++)
+    {
+      if (db_node_is_this_node_in_this_person_or_populations_graph(node, second_col_list[j])==true)
+	{
+	  second_mask[j/64] |= ((uint64_t)1) << (j%64);
+	}
+    }
+
+  for (w2=0; w2<num_words2; w2++)
+    {
+      uint64_t bits2 = second_mask[w2];
+      while (bits2 != 0)
+	{
+	  j = w2*64 + __builtin_ctzll(bits2);
+	  bits2 &= bits2-1;
+	  long long* row = overlaps + (long long)j*num1;
+	  for (w1=0; w1<num_words1; w1++)
+	    {
+	      uint64_t bits1 = first_mask[w1];
+	      while (bits1 != 0)
+		{
+		  row[w1*64 + __builtin_ctzll(bits1)]++;
+		  bits1 &= bits1-1;
+		}
+	    }
+	}
+    }
+}
+
+void db_graph_get_colour_overlap_matrix(int* first_col_list, int num1,
+					int* second_col_list, int num2,
+					long long* overlaps, dBGraph* db_graph)
+{
+  int num_threads = NUM_THREADS < 1 ? 1 : NUM_THREADS;
+  long long matrix_size = (long long)num1*num2;
+  int num_words1 = (num1+63)/64;
+  int num_words2 = (num2+63)/64;
+
+  // each thread has a matrix, and masks, of its own
+  long long* thread_overlaps = calloc(num_threads*matrix_size, sizeof(long long));
+  uint64_t* masks = malloc(num_threads*(num_words1+num_words2)*sizeof(uint64_t));
+  if ( (thread_overlaps==NULL) || (masks==NULL) )
+    {
+      die("Unable to malloc the colour overlap matrices - out of memory\n");
+    }
+
+  void add_node(Element* node, int thread_index)
+  {
+    uint64_t* first_mask = masks + (long long)thread_index*(num_words1+num_words2);
+    add_node_to_colour_overlaps(node, first_col_list, num1, second_col_list, num2,
+				first_mask, first_mask+num_words1,
+				thread_overlaps + thread_index*matrix_size);
+  }
+  hash_table_traverse_multithreaded_with_thread_index(&add_node, db_graph, num_threads);
+
+  long long k;
+  int t;
+  for (k=0; k<matrix_size; k++)
+    {
+      overlaps[k] = 0;
+      for (t=0; t<num_threads; t++)
+	{
+	  overlaps[k] += thread_overlaps[t*matrix_size+k];
+	}
+    }
+  free(thread_overlaps);
+  free(masks);
 }
 
 void db_graph_print_colour_overlap_matrix(int* first_col_list, int num1,
@@ -10879,6 +12001,14 @@ void db_graph_print_colour_overlap_matrix(int* first_col_list, int num1,
 {
   int i;
   int j;
+
+  long long* overlaps = malloc((long long)num1*num2*sizeof(long long));
+  if (overlaps==NULL)
+    {
+      die("Unable to malloc the colour overlap matrix - out of memory\n");
+    }
+  db_graph_get_colour_overlap_matrix(first_col_list, num1, second_col_list, num2,
+				     overlaps, db_graph);
   
   printf("\t");
   for (i=0; i<num1; i++)
@@ -10898,29 +12028,7 @@ void db_graph_print_colour_overlap_matrix(int* first_col_list, int num1,
       printf("%d\t", second_col_list[j]);
       for (i=0; i<num1; i++)
 	{
-	  //local function
-	  long long overlap_cols_i_and_j(Element* node)
-	  {
-      //char str[db_graph->kmer_size+1];
-	    //str[db_graph->kmer_size]='\0';
-
-	    if ( 
-		(db_node_is_this_node_in_this_person_or_populations_graph(node, first_col_list[i])==true)
-		&&
-		(db_node_is_this_node_in_this_person_or_populations_graph(node, second_col_list[j])==true)
-		 )
-	      {
-
-		return 1;
-	      }
-	    else
-	      {
-		return 0;
-	      }
-	  }
-
-	  long long  overlap = hash_table_traverse_returning_sum(&overlap_cols_i_and_j, db_graph);
-	  printf("%qd", overlap);
+	  printf("%qd", overlaps[(long long)j*num1+i]);
 	  if (i<num1-1)
 	    {
 	      printf("\t");
@@ -10931,6 +12039,7 @@ void db_graph_print_colour_overlap_matrix(int* first_col_list, int num1,
 	    }
 	}
     }
+  free(overlaps);
 }
 
 
@@ -11060,6 +12169,355 @@ void print_call_given_var_and_modelinfo(VariantBranchesAndFlanks* var, FILE* fou
 }
 
 
+// Working space of one thread genotyping a callfile
+typedef struct
+{
+  char* raw;       // the text of the site being genotyped, as in the callfile
+  size_t raw_capacity;
+  Sequence* seq;
+  Sequence* seq_inc_prev_kmer;
+  KmerSlidingWindow* kmer_window;
+  VariantBranchesAndFlanks* var;
+  CovgArray* working_ca;
+} GenotypeWorker;
+
+// A batch of sites being genotyped. The threads take it in turns to copy the
+// next site out of the callfile, then parse and genotype it into outputs[site].
+// The threads are started once, and run one batch per generation
+typedef struct
+{
+  FILE* fp;
+  pthread_mutex_t read_lock;
+  boolean end_of_file;
+  int num_sites; // read in this batch
+  int max_read_length;
+  DiscoveryMethod which_caller;
+  dBGraph* db_graph;
+  void (*print_extra_info)(AnnotatedPutativeVariant*, FILE*);
+  pthread_mutex_t print_lock;
+  GraphAndModelInfo* model_info;
+  char* outputs[GENOTYPE_BATCH_SITES];
+  size_t output_lens[GENOTYPE_BATCH_SITES];
+
+  int num_threads; // not counting the main thread, which also genotypes
+  pthread_t* threads;
+  int generation, num_running;
+  boolean finished;
+  pthread_mutex_t lock;
+  pthread_cond_t cond_start, cond_done;
+} GenotypeBatch;
+
+typedef struct
+{
+  GenotypeBatch* batch;
+  GenotypeWorker* worker;
+} GenotypeThread;
+
+static int genotype_callfile_reader(FILE* fp, Sequence* seq, int max_read_length, boolean new_entry, boolean* full_entry)
+{
+  if (new_entry!= true)
+    {
+      die("new_entry has to be true for read_next_variant_from_full_flank_file\n");
+    }
+  return read_sequence_from_fasta(fp, seq, max_read_length, new_entry, full_entry, 0);
+}
+
+static void genotype_worker_init(GenotypeWorker* worker, int max_read_length, int max_var_len, dBGraph* db_graph)
+{
+  worker->raw_capacity = 4*(max_read_length+LINE_MAX);
+  worker->raw = malloc(worker->raw_capacity);
+  worker->seq = malloc(sizeof(Sequence));
+  worker->seq_inc_prev_kmer = malloc(sizeof(Sequence));
+  worker->kmer_window = malloc(sizeof(KmerSlidingWindow));
+  if ( (worker->raw==NULL) || (worker->seq==NULL) || (worker->seq_inc_prev_kmer==NULL) || (worker->kmer_window==NULL) )
+    {
+      die("Out of memory trying to allocate Sequence for genotyping");
+    }
+  alloc_sequence(worker->seq, max_read_length+db_graph->kmer_size, LINE_MAX);
+  alloc_sequence(worker->seq_inc_prev_kmer, max_read_length+db_graph->kmer_size, LINE_MAX);
+
+  //We are going to load all the bases into a single sliding window 
+  worker->kmer_window->kmer = (BinaryKmer*) malloc(sizeof(BinaryKmer)*(max_read_length+db_graph->kmer_size));
+  if (worker->kmer_window->kmer==NULL)
+    {
+      die("Failed to malloc kmer_window->kmer for genotyping. Tried to alloc\n"
+	  "an array of %d binary kmers. Max read len:%d, kmer size %d. Exit.\n", 
+	  max_read_length+db_graph->kmer_size, max_read_length, db_graph->kmer_size);
+    }
+  worker->kmer_window->nkmers=0;
+
+  int lim = max_read_length+db_graph->kmer_size;
+  if (lim < max_var_len)
+    {
+      lim = max_var_len+db_graph->kmer_size;
+    }
+  worker->working_ca = alloc_and_init_covg_array(lim+1);
+  if (worker->working_ca==NULL)
+    {
+      die("Unable to alloc an array of coverages for genotyping - abort. Your server must have run out of memory.\n");
+    }
+  worker->var = alloc_VariantBranchesAndFlanks_object(lim+1, lim+1, lim+1, lim+1, db_graph->kmer_size);
+  if (worker->var==NULL)
+    {
+      die("Abort - unable to allocate memory for buffers for reading callfile - \n"
+	  "either severe oom conditions or you have specified very very large max_read_len or max_var_len\n");
+    }
+}
+
+static void genotype_worker_free(GenotypeWorker* worker)
+{
+  free_VariantBranchesAndFlanks_object(worker->var);
+  free_covg_array(worker->working_ca);
+  free_sequence(&worker->seq);
+  free_sequence(&worker->seq_inc_prev_kmer);
+  free(worker->kmer_window->kmer);
+  free(worker->kmer_window);
+  free(worker->raw);
+}
+
+// Copy the text of the next site - its 5p flank, two branches and 3p flank
+// fasta records - from fp into worker->raw, without parsing it.
+// Returns the number of chars copied, 0 at the end of the file
+static size_t genotype_copy_raw_site(FILE* fp, GenotypeWorker* worker)
+{
+  size_t len = 0;
+  int num_records = 0;
+  boolean line_start = true;
+  int c;
+
+  while ( (c=getc(fp))!=EOF )
+    {
+      //a record starts at each '>' line. Anything else at the start is kept
+      //as a record too, so the parser complains about it
+      if ( (line_start==true) && ( (c=='>') || (len==0) ) )
+	{
+	  if (num_records==4)
+	    {
+	      ungetc(c, fp);
+	      break;
+	    }
+	  num_records++;
+	}
+      if (len==worker->raw_capacity)
+	{
+	  worker->raw_capacity *= 2;
+	  worker->raw = realloc(worker->raw, worker->raw_capacity);
+	  if (worker->raw==NULL)
+	    {
+	      die("Out of memory copying a site from the callfile to genotype\n");
+	    }
+	}
+      worker->raw[len++] = (char) c;
+      line_start = (c=='\n');
+    }
+  return len;
+}
+
+static void genotype_batch_run(GenotypeBatch* batch, GenotypeWorker* worker)
+{
+  //the caller's function may use some shared working space
+  void print_extra_info_locked(AnnotatedPutativeVariant* annovar, FILE* fout)
+  {
+    pthread_mutex_lock(&batch->print_lock);
+    batch->print_extra_info(annovar, fout);
+    pthread_mutex_unlock(&batch->print_lock);
+  }
+
+  while (true)
+    {
+      //only copying the site out of the callfile is done under the lock
+      pthread_mutex_lock(&batch->read_lock);
+      if ( (batch->end_of_file==true) || (batch->num_sites==GENOTYPE_BATCH_SITES) )
+	{
+	  pthread_mutex_unlock(&batch->read_lock);
+	  break;
+	}
+      size_t raw_len = genotype_copy_raw_site(batch->fp, worker);
+      if (raw_len==0)
+	{
+	  batch->end_of_file = true;
+	  pthread_mutex_unlock(&batch->read_lock);
+	  break;
+	}
+      int site = batch->num_sites++;
+      pthread_mutex_unlock(&batch->read_lock);
+
+      FILE* raw_fp = fmemopen(worker->raw, raw_len, "r");
+      if (raw_fp==NULL)
+	{
+	  die("Unable to open the buffer holding a site of the callfile\n");
+	}
+      //note you are reading a bunch of variants that may have been called on another sample,
+      //and potentially are genotyping them on a different sample. So these reads can contain kmers
+      // that are not in our graph. These become NULL points in our array of dBNode* 's.
+      int ret = read_next_variant_from_full_flank_file(raw_fp, batch->max_read_length+batch->db_graph->kmer_size+1,
+						       worker->var, batch->db_graph, &genotype_callfile_reader,
+						       worker->seq, worker->seq_inc_prev_kmer, worker->kmer_window);
+      fclose(raw_fp);
+
+      batch->outputs[site] = NULL;
+      batch->output_lens[site] = 0;
+      if (ret==1)
+	{
+	  FILE* fout = open_memstream(&batch->outputs[site], &batch->output_lens[site]);
+	  if (fout==NULL)
+	    {
+	      die("Unable to open a buffer for the output of genotyping\n");
+	    }
+	  print_call_given_var_and_modelinfo(worker->var, fout, batch->model_info, batch->which_caller, batch->db_graph,
+					     &print_extra_info_locked, AssumeUncleaned, worker->working_ca);
+	  fclose(fout);
+	}
+    }
+}
+
+static void* genotype_batch_thread(void* arg)
+{
+  GenotypeBatch* batch = ((GenotypeThread*) arg)->batch;
+  GenotypeWorker* worker = ((GenotypeThread*) arg)->worker;
+  int generation = 0;
+
+  while (true)
+    {
+      pthread_mutex_lock(&batch->lock);
+      while (batch->generation==generation)
+	{
+	  pthread_cond_wait(&batch->cond_start, &batch->lock);
+	}
+      generation = batch->generation;
+      boolean finished = batch->finished;
+      pthread_mutex_unlock(&batch->lock);
+
+      if (finished==true)
+	{
+	  return NULL;
+	}
+
+      genotype_batch_run(batch, worker);
+
+      pthread_mutex_lock(&batch->lock);
+      if (--batch->num_running==0)
+	{
+	  pthread_cond_signal(&batch->cond_done);
+	}
+      pthread_mutex_unlock(&batch->lock);
+    }
+}
+
+// Start the threads on the next generation - a batch of sites, or finishing
+static void genotype_batch_start(GenotypeBatch* batch, boolean finished)
+{
+  pthread_mutex_lock(&batch->lock);
+  batch->num_sites = 0;
+  batch->finished = finished;
+  batch->num_running = batch->num_threads;
+  batch->generation++;
+  pthread_cond_broadcast(&batch->cond_start);
+  pthread_mutex_unlock(&batch->lock);
+}
+
+long long db_graph_genotype_callfile(FILE* fp, FILE* fout, int max_read_length, int max_var_len,
+				     DiscoveryMethod which_caller, dBGraph* db_graph,
+				     void (*print_extra_info)(AnnotatedPutativeVariant*, FILE*),
+				     GraphAndModelInfo* model_info)
+{
+  int num_workers = NUM_THREADS < 1 ? 1 : NUM_THREADS;
+
+  GenotypeBatch* batch = malloc(sizeof(GenotypeBatch));
+  GenotypeWorker* workers = malloc(sizeof(GenotypeWorker) * num_workers);
+  GenotypeThread* args = malloc(sizeof(GenotypeThread) * num_workers);
+  pthread_t* threads = malloc(sizeof(pthread_t) * num_workers);
+  if ( (batch==NULL) || (workers==NULL) || (args==NULL) || (threads==NULL) )
+    {
+      die("Unable to malloc working space to genotype a callfile\n");
+    }
+  batch->fp = fp;
+  pthread_mutex_init(&batch->read_lock, NULL);
+  batch->end_of_file = false;
+  batch->max_read_length = max_read_length;
+  batch->which_caller = which_caller;
+  batch->db_graph = db_graph;
+  batch->print_extra_info = print_extra_info;
+  pthread_mutex_init(&batch->print_lock, NULL);
+  batch->model_info = model_info;
+  batch->num_threads = num_workers-1;
+  batch->threads = threads;
+  batch->generation = 0;
+  batch->finished = false;
+  pthread_mutex_init(&batch->lock, NULL);
+  pthread_cond_init(&batch->cond_start, NULL);
+  pthread_cond_init(&batch->cond_done, NULL);
+
+  int t;
+  for (t=0; t<num_workers; t++)
+    {
+      genotype_worker_init(&workers[t], max_read_length, max_var_len, db_graph);
+      if (which_caller==SimplePathDivergenceCaller)
+	{
+	  workers[t].var->which=first;
+	}
+      args[t].batch = batch;
+      args[t].worker = &workers[t];
+    }
+
+  //workers[0] is the main thread's
+  for (t=0; t<batch->num_threads; t++)
+    {
+      if (pthread_create(&threads[t], NULL, genotype_batch_thread, &args[t+1])!=0)
+	{
+	  die("Unable to create a thread to genotype sites\n");
+	}
+    }
+
+  long long num_sites = 0;
+  while (batch->end_of_file==false)
+    {
+      genotype_batch_start(batch, false);
+      genotype_batch_run(batch, &workers[0]);
+
+      pthread_mutex_lock(&batch->lock);
+      while (batch->num_running > 0)
+	{
+	  pthread_cond_wait(&batch->cond_done, &batch->lock);
+	}
+      pthread_mutex_unlock(&batch->lock);
+
+      //in the order the sites are in the callfile
+      int i;
+      for (i=0; i<batch->num_sites; i++)
+	{
+	  if (batch->outputs[i]!=NULL)
+	    {
+	      fwrite(batch->outputs[i], 1, batch->output_lens[i], fout);
+	      free(batch->outputs[i]);
+	    }
+	}
+      num_sites += batch->num_sites;
+    }
+
+  genotype_batch_start(batch, true);
+  for (t=0; t<batch->num_threads; t++)
+    {
+      pthread_join(threads[t], NULL);
+    }
+
+  for (t=0; t<num_workers; t++)
+    {
+      genotype_worker_free(&workers[t]);
+    }
+  pthread_mutex_destroy(&batch->read_lock);
+  pthread_mutex_destroy(&batch->print_lock);
+  pthread_mutex_destroy(&batch->lock);
+  pthread_cond_destroy(&batch->cond_start);
+  pthread_cond_destroy(&batch->cond_done);
+  free(threads);
+  free(args);
+  free(workers);
+  free(batch);
+  return num_sites;
+}
+
+
 
 
 
@@ -11112,7 +12570,7 @@ void calculate_statistics_of_some_function_of_supernodes(
   
 
   long long number_of_pruned_supernodes  = hash_table_traverse_returning_sum(&prune_supernode_if_it_looks_like_is_induced_by_singlebase_errors, db_graph);
-  hash_table_traverse(&db_node_action_unset_status_visited_or_visited_and_exists_in_reference, db_graph);
+  db_graph_unset_all_visited_status(db_graph);
 
 
   free(path_nodes);
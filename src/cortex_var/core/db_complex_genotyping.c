@@ -380,6 +380,216 @@ void improved_initialise_multiplicities_of_allele_genotyping_nodes_wrt_both_alle
 
 
 
+ComplexSiteNeighbourhood* alloc_complex_site_neighbourhood()
+{
+  ComplexSiteNeighbourhood* nbhd = (ComplexSiteNeighbourhood*) malloc(sizeof(ComplexSiteNeighbourhood));
+  if (nbhd==NULL)
+    {
+      die("Unable to malloc the neighbourhood of a complex site\n");
+    }
+  nbhd->colour=-1;
+  nbhd->colour_ref_minus_site=-1;
+  nbhd->num_supernodes=0;
+  nbhd->supernodes_capacity=0;
+  nbhd->first_node=NULL;
+  nbhd->lengths=NULL;
+  nbhd->start_nodes=NULL;
+  nbhd->num_reads=NULL;
+  nbhd->too_short=NULL;
+  nbhd->nodes=NULL;
+  nbhd->num_nodes=0;
+  nbhd->nodes_capacity=0;
+  return nbhd;
+}
+
+void dealloc_complex_site_neighbourhood(ComplexSiteNeighbourhood* nbhd)
+{
+  free(nbhd->first_node);
+  free(nbhd->lengths);
+  free(nbhd->start_nodes);
+  free(nbhd->num_reads);
+  free(nbhd->too_short);
+  free(nbhd->nodes);
+  free(nbhd);
+}
+
+static void complex_site_neighbourhood_add_supernode(ComplexSiteNeighbourhood* nbhd,
+						     dBNode** sup, int length, dBNode* start,
+						     Covg num_reads, boolean too_short)
+{
+  if (nbhd->num_supernodes==nbhd->supernodes_capacity)
+    {
+      nbhd->supernodes_capacity = (nbhd->supernodes_capacity==0) ? 64 : 2*nbhd->supernodes_capacity;
+      nbhd->first_node  = realloc(nbhd->first_node,  nbhd->supernodes_capacity*sizeof(int));
+      nbhd->lengths     = realloc(nbhd->lengths,     nbhd->supernodes_capacity*sizeof(int));
+      nbhd->start_nodes = realloc(nbhd->start_nodes, nbhd->supernodes_capacity*sizeof(dBNode*));
+      nbhd->num_reads   = realloc(nbhd->num_reads,   nbhd->supernodes_capacity*sizeof(Covg));
+      nbhd->too_short   = realloc(nbhd->too_short,   nbhd->supernodes_capacity*sizeof(boolean));
+      if ( (nbhd->first_node==NULL) || (nbhd->lengths==NULL) || (nbhd->start_nodes==NULL)
+	   || (nbhd->num_reads==NULL) || (nbhd->too_short==NULL) )
+	{
+	  die("Unable to grow the neighbourhood of a complex site - out of memory\n");
+	}
+    }
+  while (nbhd->num_nodes+length+1 > nbhd->nodes_capacity)
+    {
+      nbhd->nodes_capacity = (nbhd->nodes_capacity==0) ? 1024 : 2*nbhd->nodes_capacity;
+      nbhd->nodes = realloc(nbhd->nodes, nbhd->nodes_capacity*sizeof(dBNode*));
+      if (nbhd->nodes==NULL)
+	{
+	  die("Unable to grow the neighbourhood of a complex site - out of memory\n");
+	}
+    }
+
+  int s = nbhd->num_supernodes++;
+  nbhd->first_node[s]=nbhd->num_nodes;
+  nbhd->lengths[s]=length;
+  nbhd->start_nodes[s]=start;
+  nbhd->num_reads[s]=num_reads;
+  nbhd->too_short[s]=too_short;
+  memcpy(nbhd->nodes+nbhd->num_nodes, sup, (length+1)*sizeof(dBNode*));
+  nbhd->num_nodes += length+1;
+}
+
+// A whole graph traversal counts a supernode as an error when it comes to a node
+// in it which has covg in the sample but not in the reference-minus-site (and is
+// not in the genotype). Those supernodes which matter to this site are found by
+// walking out from the alleles, only through such nodes. Each is walked from the
+// node the traversal would reach first, so counts the same.
+void get_complex_site_neighbourhood(ComplexSiteNeighbourhood* nbhd,
+				    dBNode*** alleles, int* allele_lens, int num_alleles,
+				    int colour_indiv, int colour_ref_minus_site,
+				    dBNode** p_nodes, Orientation* p_orientations,
+				    Nucleotide* p_labels, char* p_string, int max_sup_len,
+				    dBGraph* db_graph)
+{
+  nbhd->colour=colour_indiv;
+  nbhd->colour_ref_minus_site=colour_ref_minus_site;
+  nbhd->num_supernodes=0;
+  nbhd->num_nodes=0;
+
+  boolean is_error_candidate(dBNode* n)
+  {
+    return (db_node_get_coverage(n, colour_indiv)>0)
+      && ( (colour_ref_minus_site==-1) || (db_node_get_coverage(n, colour_ref_minus_site)==0) );
+  }
+
+  //nodes whose neighbours are still to be looked at
+  int queue_capacity=1024;
+  int queue_len=0;
+  dBNode** queue = (dBNode**) malloc(queue_capacity*sizeof(dBNode*));
+  if (queue==NULL)
+    {
+      die("Unable to malloc the queue for finding the neighbourhood of a complex site\n");
+    }
+
+  void push(dBNode* n)
+  {
+    if (queue_len==queue_capacity)
+      {
+	queue_capacity*=2;
+	queue = realloc(queue, queue_capacity*sizeof(dBNode*));
+	if (queue==NULL)
+	  {
+	    die("Unable to grow the queue for finding the neighbourhood of a complex site\n");
+	  }
+      }
+    queue[queue_len++]=n;
+  }
+
+  void add_supernode_of(dBNode* n)
+  {
+    double avg_coverage=0;
+    Covg min = 0, max=0;
+    boolean is_cycle=false;
+    int length = db_graph_supernode_for_specific_person_or_pop(n,max_sup_len,&db_node_action_set_status_visited,
+							       p_nodes,p_orientations,p_labels, p_string,
+							       &avg_coverage,&min,&max,&is_cycle,
+							       db_graph, colour_indiv);
+    //the traversal comes to the nodes in table order
+    dBNode* start=n;
+    int k;
+    for (k=0; k<=length; k++)
+      {
+	if ( is_error_candidate(p_nodes[k]) && (p_nodes[k]<start) )
+	  {
+	    start=p_nodes[k];
+	  }
+      }
+    if (start!=n)
+      {
+	length = db_graph_supernode_for_specific_person_or_pop(start,max_sup_len,&db_node_action_set_status_visited,
+							       p_nodes,p_orientations,p_labels, p_string,
+							       &avg_coverage,&min,&max,&is_cycle,
+							       db_graph, colour_indiv);
+      }
+
+    boolean too_short=false;
+    Covg ct = count_reads_on_allele_in_specific_colour(p_nodes, length, colour_indiv, &too_short);
+    complex_site_neighbourhood_add_supernode(nbhd, p_nodes, length, start, ct, too_short);
+
+    for (k=0; k<=length; k++)
+      {
+	if (is_error_candidate(p_nodes[k]))
+	  {
+	    push(p_nodes[k]);
+	  }
+      }
+  }
+
+  int a, i;
+  for (a=0; a<num_alleles; a++)
+    {
+      for (i=0; i<allele_lens[a]; i++)
+	{
+	  dBNode* n = alleles[a][i];
+	  if ( (n==NULL) || (db_node_check_status(n, visited)==true) )
+	    {
+	      continue;
+	    }
+	  if (is_error_candidate(n))
+	    {
+	      add_supernode_of(n);
+	    }
+	  else
+	    {
+	      db_node_set_status(n, visited);
+	      push(n);
+	    }
+	}
+    }
+
+  while (queue_len>0)
+    {
+      dBNode* n = queue[--queue_len];
+      Orientation o;
+      Nucleotide nuc;
+      for (o=forward; o<=reverse; o++)
+	{
+	  for (nuc=Adenine; nuc<=Thymine; nuc++)
+	    {
+	      if (db_node_edge_exist(n, nuc, o, colour_indiv)==false)
+		{
+		  continue;
+		}
+	      Orientation next_orientation;
+	      Nucleotide reverse_nuc;
+	      dBNode* next = db_graph_get_next_node(n, o, &next_orientation, nuc, &reverse_nuc, db_graph);
+	      if ( (next!=NULL) && (db_node_check_status(next, visited)==false) && is_error_candidate(next) )
+		{
+		  add_supernode_of(next);
+		}
+	    }
+	}
+    }
+
+  free(queue);
+  db_graph_unset_all_visited_status(db_graph);
+}
+
+
+
+
 // WARNING - the implicit assumption here is that the graph/hash table ONLY
 //           contains nodes in the union of all known alleles for 
 //           the site in question.
@@ -403,8 +613,9 @@ double calc_log_likelihood_of_genotype_with_complex_alleles(
   Nucleotide* p_labels, char* p_string, int max_allele_length,
   boolean using_1net, Covg (*get_covg_in_1net_of_genotype)(dBNode*), 
   boolean using_2net, Covg (*get_covg_in_2net_of_genotype)(dBNode*),
-  double min_acceptable_llk)
+  double min_acceptable_llk, ComplexSiteNeighbourhood* neighbourhood)
 //assume the  2 working arrays have length = max read length
+//if neighbourhood is NULL, errors are counted by traversing the whole graph
 {
     
   // *********************************************************************************************************************************************************
@@ -457,119 +668,126 @@ double calc_log_likelihood_of_genotype_with_complex_alleles(
   }
   
 
-   // the three ints you return are basically levels of badness of error. 
-  void count_reads_in_1net_2net_and_beyond(dBNode* e, int* total_1net, int* total_2net, int* total_3net,
-					   dBNode** p_nodes, Orientation* p_or, Nucleotide* p_lab, char* p_str, int max_len)
+  //add one supernode, which is an error, to the count for how far it is from the genotype
+  void add_error_supernode_to_counts(dBNode** p_nodes, int length, Covg ct, boolean too_short,
+				     int* total_1net, int* total_2net, int* total_3net)
   {
+    int i;
+    typedef enum
+    {
+      worst_is_1net=0,
+      worst_is_2net=1,
+      worst_is_beyond_2net=2,
+    } WorstNodeInSup;
 
-    if ( (db_node_check_status(e, in_desired_genotype)==true) || (db_node_check_status(e, visited)==true) )
+    WorstNodeInSup wor =worst_is_1net;
+    for (i=1; (i<length) && (using_1net==true); i++)//if not using_1net, then don't bother - assume everything in this supernode is bad, there is only 1 category of bad, 
       {
+	if (get_covg_in_1net_of_genotype(p_nodes[i])>0) 
+	  {
+	  }
+	else if ( (using_2net==true) && (get_covg_in_2net_of_genotype(p_nodes[i])>0) )
+	  {
+	    if (wor !=worst_is_beyond_2net )
+	      {
+		wor=worst_is_2net;
+	      }
+	  }
+	else if (using_2net==true)
+	  {
+	    wor=worst_is_beyond_2net;
+	    i=length+1;
+	  }
+	else 
+	  {
+	    wor=worst_is_2net;
+	  }
       }
-    else if ( (db_node_get_coverage(e,colour_indiv)>0) && (check_covg_in_ref_with_site_excised(e)==0) )
-      {
-	double avg_coverage=0;
-	Covg min = 0, max=0;
-	boolean is_cycle=false;
-	//get the whole supernode. If any of them are in_desired, then is 1bp away, else not
-	int length = db_graph_supernode_for_specific_person_or_pop(e,max_len,&db_node_action_set_status_visited,
-								   p_nodes,p_or,p_lab, p_str,
-								   &avg_coverage,&min,&max,&is_cycle,
-								   db_graph, colour_indiv);
-	int i;
-	typedef enum
-	{
-	  worst_is_1net=0,
-	  worst_is_2net=1,
-	  worst_is_beyond_2net=2,
-	} WorstNodeInSup;
 
-	WorstNodeInSup wor =worst_is_1net;
-	for (i=1; (i<length) && (using_1net==true); i++)//if not using_1net, then don't bother - assume everything in this supernode is bad, there is only 1 category of bad, 
+    int extra=0;
+    if (too_short==false)
+      {
+	if (length>db_graph->kmer_size)
 	  {
-	    if (get_covg_in_1net_of_genotype(p_nodes[i])>0) 
+	    extra=length-db_graph->kmer_size;
+	  }//tells us if >1 SNP
+	if (wor==worst_is_1net)
+	  {
+	    /*
+	      if (too_short==false)
 	      {
+	      *total_1net = (*total_1net) + ct;
 	      }
-	    else if ( (using_2net==true) && (get_covg_in_2net_of_genotype(p_nodes[i])>0) )
+	      else
 	      {
-		if (wor !=worst_is_beyond_2net )
-		  {
-		    wor=worst_is_2net;
-		  }
+	      *total_1net = (*total_1net) + db_node_get_coverage(e,colour_indiv);
 	      }
-	    else if (using_2net==true)
+	    */
+	    //*total_1net = (*total_1net) + 1;
+	    //*total_1net = (*total_1net) + db_node_get_coverage(e,colour_indiv) ;
+	    *total_1net = (*total_1net) + ct + extra+1;
+	    //*total_1net = (*total_1net) + extra+1;
+	    //*total_1net = (*total_1net) + length;
+	  }
+	else if (wor==worst_is_2net)
+	  {
+	    /*
+	      if (too_short==false)
 	      {
-		wor=worst_is_beyond_2net;
-		i=length+1;
+	      *total_2net = (*total_2net) + ct;     
 	      }
-	    else 
+	      else
 	      {
-		wor=worst_is_2net;
+	      *total_2net = (*total_2net) + db_node_get_coverage(e,colour_indiv) * (extra + 1);
 	      }
+	    */
+	    *total_2net = (*total_2net) + ct+extra+1;
+	    //*total_2net = (*total_2net) + 1;
+	    //*total_2net = (*total_2net) + db_node_get_coverage(e,colour_indiv);
+	    //*total_2net = (*total_2net) + length;
 	  }
-
-	boolean too_short=false;
-	Covg ct = count_reads_on_allele_in_specific_colour(p_nodes, length, colour_indiv, &too_short);
-	int extra=0;
-	if (too_short==false)
+	else
 	  {
-	    if (length>db_graph->kmer_size)
-	      {
-		extra=length-db_graph->kmer_size;
-	      }//tells us if >1 SNP
-	    if (wor==worst_is_1net)
-	      {
-		/*
-		  if (too_short==false)
-		  {
-		  *total_1net = (*total_1net) + ct;
-		  }
-		  else
-		  {
-		  *total_1net = (*total_1net) + db_node_get_coverage(e,colour_indiv);
-		  }
-		*/
-		//*total_1net = (*total_1net) + 1;
-		//*total_1net = (*total_1net) + db_node_get_coverage(e,colour_indiv) ;
-		*total_1net = (*total_1net) + ct + extra+1;
-		//*total_1net = (*total_1net) + extra+1;
-		//*total_1net = (*total_1net) + length;
-	      }
-	    else if (wor==worst_is_2net)
+	    /*
+	      if (too_short==false)
 	      {
-		/*
-		  if (too_short==false)
-		  {
-		  *total_2net = (*total_2net) + ct;	
-		  }
-		  else
-		  {
-		  *total_2net = (*total_2net) + db_node_get_coverage(e,colour_indiv) * (extra + 1);
-		  }
-		*/
-		*total_2net = (*total_2net) + ct+extra+1;
-		//*total_2net = (*total_2net) + 1;
-		//*total_2net = (*total_2net) + db_node_get_coverage(e,colour_indiv);
-		//*total_2net = (*total_2net) + length;
+	      *total_3net = (*total_3net) + ct;     
 	      }
-	    else
+	      else
 	      {
-		/*
-		  if (too_short==false)
-		  {
-		  *total_3net = (*total_3net) + ct;	
-		  }
-		  else
-		  {
-		  *total_3net = (*total_3net) + db_node_get_coverage(e,colour_indiv) * (extra + 1);
-		  }
-		*/
-		*total_3net = (*total_3net) + ct+extra+1;
-		//*total_3net = (*total_3net) + 1;
-		//*total_3net = (*total_3net) + db_node_get_coverage(e,colour_indiv);
-		//*total_3net = (*total_3net) + length;
+	      *total_3net = (*total_3net) + db_node_get_coverage(e,colour_indiv) * (extra + 1);
 	      }
+	    */
+	    *total_3net = (*total_3net) + ct+extra+1;
+	    //*total_3net = (*total_3net) + 1;
+	    //*total_3net = (*total_3net) + db_node_get_coverage(e,colour_indiv);
+	    //*total_3net = (*total_3net) + length;
 	  }
       }
+  }
+
+   // the three ints you return are basically levels of badness of error. 
+  void count_reads_in_1net_2net_and_beyond(dBNode* e, int* total_1net, int* total_2net, int* total_3net,
+					   dBNode** p_nodes, Orientation* p_or, Nucleotide* p_lab, char* p_str, int max_len)
+  {
+
+    if ( (db_node_check_status(e, in_desired_genotype)==true) || (db_node_check_status(e, visited)==true) )
+      {
+      }
+    else if ( (db_node_get_coverage(e,colour_indiv)>0) && (check_covg_in_ref_with_site_excised(e)==0) )
+      {
+	double avg_coverage=0;
+	Covg min = 0, max=0;
+	boolean is_cycle=false;
+	//get the whole supernode. If any of them are in_desired, then is 1bp away, else not
+	int length = db_graph_supernode_for_specific_person_or_pop(e,max_len,&db_node_action_set_status_visited,
+								   p_nodes,p_or,p_lab, p_str,
+								   &avg_coverage,&min,&max,&is_cycle,
+								   db_graph, colour_indiv);
+	boolean too_short=false;
+	Covg ct = count_reads_on_allele_in_specific_colour(p_nodes, length, colour_indiv, &too_short);
+	add_error_supernode_to_counts(p_nodes, length, ct, too_short, total_1net, total_2net, total_3net);
+      }
     
     return;
   }
@@ -711,10 +929,59 @@ double calc_log_likelihood_of_genotype_with_complex_alleles(
   // hash_table_traverse_passing_ints_and_path(&count_errors_in_1net_of_desired_genotype_or_worse  ,db_graph, &number_errors, &number_bad_errors,
   //					    p_nodes, p_orientations, p_labels, p_string, max_allele_length);
 
-  hash_table_traverse_passing_3ints_and_path(&count_reads_in_1net_2net_and_beyond, db_graph, &num_1net_errors, &num_2net_errors, &num_3net_errors,
-					     p_nodes, p_orientations, p_labels, p_string, max_allele_length);
-  hash_table_traverse(&db_node_action_set_status_none, db_graph); 
-  set_status_of_nodes_in_branches(var, in_desired_genotype);
+  if (neighbourhood==NULL)
+    {
+      hash_table_traverse_passing_3ints_and_path(&count_reads_in_1net_2net_and_beyond, db_graph, &num_1net_errors, &num_2net_errors, &num_3net_errors,
+						 p_nodes, p_orientations, p_labels, p_string, max_allele_length);
+      hash_table_traverse(&db_node_action_set_status_none, db_graph); 
+      set_status_of_nodes_in_branches(var, in_desired_genotype);
+    }
+  else
+    {
+      //the same supernodes the traversal above would count, walked from the same node
+      int s;
+      for (s=0; s<neighbourhood->num_supernodes; s++)
+	{
+	  dBNode** sup = neighbourhood->nodes + neighbourhood->first_node[s];
+	  int length = neighbourhood->lengths[s];
+	  dBNode* start = NULL;
+	  int k;
+	  for (k=0; k<=length; k++)
+	    {
+	      if ( (db_node_check_status(sup[k], in_desired_genotype)==false)
+		   && (db_node_get_coverage(sup[k],colour_indiv)>0) && (check_covg_in_ref_with_site_excised(sup[k])==0)
+		   && ( (start==NULL) || (sup[k]<start) ) )
+		{
+		  start=sup[k];
+		}
+	    }
+
+	  if (start==NULL)
+	    {
+	      //all of this supernode is in the genotype, or the rest of the genome
+	    }
+	  else if (start==neighbourhood->start_nodes[s])
+	    {
+	      add_error_supernode_to_counts(sup, length, neighbourhood->num_reads[s], neighbourhood->too_short[s],
+					    &num_1net_errors, &num_2net_errors, &num_3net_errors);
+	    }
+	  else
+	    {
+	      //this genotype covers the node it was walked from
+	      double avg_coverage=0;
+	      Covg min = 0, max=0;
+	      boolean is_cycle=false;
+	      length = db_graph_supernode_for_specific_person_or_pop(start,max_allele_length,&db_node_action_do_nothing,
+								     p_nodes,p_orientations,p_labels, p_string,
+								     &avg_coverage,&min,&max,&is_cycle,
+								     db_graph, colour_indiv);
+	      boolean too_short=false;
+	      Covg ct = count_reads_on_allele_in_specific_colour(p_nodes, length, colour_indiv, &too_short);
+	      add_error_supernode_to_counts(p_nodes, length, ct, too_short,
+					    &num_1net_errors, &num_2net_errors, &num_3net_errors);
+	    }
+	}
+    }
   
   //number_errors=number_errors/db_graph->kmer_size;
   
@@ -1840,6 +2107,24 @@ void calculate_max_and_max_but_one_llks_of_specified_set_of_genotypes_of_complex
 
   int genotype_count=0;
 
+  //find the errors near the site in each sample once, rather than traversing
+  //the whole graph for every genotype
+  ComplexSiteNeighbourhood** neighbourhoods = (ComplexSiteNeighbourhood**) malloc(sizeof(ComplexSiteNeighbourhood*) * num_colours_to_genotype);
+  if (neighbourhoods==NULL)
+    {
+      die("Cannot alloc the neighbourhoods of the site in "
+          "calculate_max_and_max_but_one_llks_of_specified_set_of_genotypes_of_complex_site");
+    }
+  int z;
+  for (z=0; z<num_colours_to_genotype; z++)
+    {
+      neighbourhoods[z] = alloc_complex_site_neighbourhood();
+      get_complex_site_neighbourhood(neighbourhoods[z], array_of_node_arrays, lengths_of_alleles, number_alleles,
+				     colours_to_genotype[z], colour_ref_minus_site,
+				     path_nodes, path_orientations, path_labels, path_string, max_allele_length,
+				     db_graph);
+    }
+
 
   for (i=0; i<number_alleles; i++)
     {
@@ -1915,7 +2200,6 @@ void calculate_max_and_max_but_one_llks_of_specified_set_of_genotypes_of_complex
 	  set_status_of_nodes_in_branches(&var, in_desired_genotype);
 	  reset_MultiplicitiesAndOverlapsOfBiallelicVariant(mobv);
 	  improved_initialise_multiplicities_of_allele_nodes_wrt_both_alleles(&var, mobv, working_colour1, working_colour2);
-	  int z;
 	  for (z=0; z<num_colours_to_genotype; z++)
 	    {
 	      //printf("Start next sample - this time z is %d", z);
@@ -1937,7 +2221,8 @@ void calculate_max_and_max_but_one_llks_of_specified_set_of_genotypes_of_complex
 									       &(current_max_lik_array[z]), &(current_max_but_one_lik_array[z]),
 									       name_current_max_lik_array[z], name_current_max_but_one_lik_array[z],
 									       assump, path_nodes, path_orientations, path_labels, path_string, max_allele_length,
-									       using_1net, get_covg_in_1net_errors_from_genotype, using_2net, get_covg_in_2net_errors_from_genotype, min_acceptable_llk);
+									       using_1net, get_covg_in_1net_errors_from_genotype, using_2net, get_covg_in_2net_errors_from_genotype, min_acceptable_llk,
+									       neighbourhoods[z]);
 	      
 	      
 
@@ -1954,7 +2239,6 @@ void calculate_max_and_max_but_one_llks_of_specified_set_of_genotypes_of_complex
   
   //finished this set
   printf("Finished calculating likelihoods of genotypes %d to %d\n", first_gt, last_gt);
-  int z;
   for (z=0; z<num_colours_to_genotype; z++)
     {
            printf("Colour %d, MAX_LIKELIHOOD GENOTYPE %s : LLK=%f\n", colours_to_genotype[z], name_current_max_lik_array[z], current_max_lik_array[z]);
@@ -1962,6 +2246,11 @@ void calculate_max_and_max_but_one_llks_of_specified_set_of_genotypes_of_complex
     }
 
   dealloc_MultiplicitiesAndOverlapsOfBiallelicVariant(mobv);
+  for (z=0; z<num_colours_to_genotype; z++)
+    {
+      dealloc_complex_site_neighbourhood(neighbourhoods[z]);
+    }
+  free(neighbourhoods);
   //many other things you should free here.
   free_sequence(&seq);
   free(kmer_window->kmer);
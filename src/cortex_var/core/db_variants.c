@@ -27,6 +27,8 @@
   db_variants.c
 */
 
+// system headers
+#include <string.h>
 
 // third party includes
 
@@ -848,8 +850,67 @@ boolean get_num_effective_reads_on_branch(Covg* array, dBNode** allele, int how_
   return too_short;
 }
 
+// room for num_nodes nodes, none of them marked
+static AlleleMarks* alloc_allele_marks(int num_nodes)
+{
+  AlleleMarks* marks = malloc(sizeof(AlleleMarks));
+  if (marks==NULL)
+    {
+      die("Out of memory allocating space to mark the alleles of a site\n");
+    }
+  marks->size = 16;
+  while (marks->size < 2*num_nodes)
+    {
+      marks->size *= 2;
+    }
+  marks->nodes = calloc(marks->size, sizeof(dBNode*));
+  marks->status = malloc(marks->size);
+  if ( (marks->nodes==NULL) || (marks->status==NULL) )
+    {
+      die("Out of memory allocating space to mark the alleles of a site\n");
+    }
+  memset(marks->status, neither, marks->size);
+  return marks;
+}
+
+static void free_allele_marks(AlleleMarks* marks)
+{
+  free(marks->nodes);
+  free(marks->status);
+  free(marks);
+}
+
+// The status of node, adding it (as neither) if it is not there and add is true.
+// Returns NULL if it is not there and add is false
+static char* allele_marks_find(AlleleMarks* marks, dBNode* node, boolean add)
+{
+  uint64_t h = (uint64_t) (uintptr_t) node * 0x9E3779B97F4A7C15ULL;
+  int pos = (int) (h >> 32) & (marks->size-1);
+
+  while (marks->nodes[pos]!=NULL)
+    {
+      if (marks->nodes[pos]==node)
+	{
+	  return &marks->status[pos];
+	}
+      pos = (pos+1) & (marks->size-1);
+    }
+  if (add==false)
+    {
+      return NULL;
+    }
+  marks->nodes[pos] = node;
+  return &marks->status[pos];
+}
+
+static boolean allele_marks_check(AlleleMarks* marks, dBNode* node, AlleleStatus status)
+{
+  char* st = allele_marks_find(marks, node, false);
+  return (st==NULL ? neither : *st) == (char)status;
+}
+
 //ref-allele is either 1 (first allele) or 2 (second allele)
-void mark_first_allele(dBNode** allele1, int len1, boolean use_ref_allele_info, int ref_colour, int ref_allele)
+void mark_first_allele(AlleleMarks* marks, dBNode** allele1, int len1, boolean use_ref_allele_info, int ref_colour, int ref_allele)
 {
   int i;
   if ( (use_ref_allele_info==false) || (ref_allele !=1) )
@@ -858,7 +919,7 @@ void mark_first_allele(dBNode** allele1, int len1, boolean use_ref_allele_info,
 	{
 	  if (allele1[i]!=NULL)
 	    {
-	      db_node_set_allele_status(allele1[i], one);
+	      *allele_marks_find(marks, allele1[i], true) = one;
 	    }
 	}
     }
@@ -868,14 +929,27 @@ void mark_first_allele(dBNode** allele1, int len1, boolean use_ref_allele_info,
 	{
 	  if ( (allele1[i]!=NULL) && (db_node_get_coverage(allele1[i], ref_colour)<=1) )
 	    {
-	      db_node_set_allele_status(allele1[i], one);
+	      *allele_marks_find(marks, allele1[i], true) = one;
 	    }
 	}
       
     }
 }
 
-void mark_second_allele(dBNode** allele2, int len2,boolean use_ref_allele_info, int ref_colour, int ref_allele)
+static void mark_node_of_second_allele(AlleleMarks* marks, dBNode* node)
+{
+  char* st = allele_marks_find(marks, node, true);
+  if (*st!=(char)one)
+    {
+      *st = two;
+    }
+  else
+    {
+      *st = both;
+    }
+}
+
+void mark_second_allele(AlleleMarks* marks, dBNode** allele2, int len2,boolean use_ref_allele_info, int ref_colour, int ref_allele)
 {
   int i;
   if ( (use_ref_allele_info==false) || (ref_allele !=2))
@@ -884,14 +958,7 @@ void mark_second_allele(dBNode** allele2, int len2,boolean use_ref_allele_info,
 	{
 	  if (allele2[i]!=NULL)
 	    {
-	      if (db_node_check_allele_status(allele2[i], one)==false)
-		{
-		  db_node_set_allele_status(allele2[i], two);
-		}
-	      else
-		{
-		  db_node_set_allele_status(allele2[i], both);
-		}
+	      mark_node_of_second_allele(marks, allele2[i]);
 	    }
 	}
     }
@@ -901,32 +968,13 @@ void mark_second_allele(dBNode** allele2, int len2,boolean use_ref_allele_info,
 	{
 	  if ( (allele2[i]!=NULL) && (db_node_get_coverage(allele2[i], ref_colour)<=1) )
 	    {
-	      if (db_node_check_allele_status(allele2[i], one)==false)
-		{
-		  db_node_set_allele_status(allele2[i], two);
-		}
-	      else
-		{
-		  db_node_set_allele_status(allele2[i], both);
-		}
+	      mark_node_of_second_allele(marks, allele2[i]);
 	    }
 	}
       
     }
 }
 
-void reset_allele_status(dBNode** allele, int len)
-{
-  int i;
-  for (i=0; i<=len;i++)
-    {
-      if (allele[i]!=NULL)
-	{
-	  db_node_set_allele_status(allele[i], neither);
-	}
-    }
-}
-
 //also ignoring things that look like repeats....
 //use_ref_allele_info=true if you KNOW one of the two alleles is the ref allele and you know which one
 //  and you want to ignore nodes that occur >1 time on the ref
@@ -935,8 +983,10 @@ boolean get_num_effective_reads_on_unique_part_of_branch(Covg* array1, dBNode**
 							 CovgArray* working_ca, GraphInfo* ginfo, int kmer,
 							 boolean use_ref_allele_info, int ref_colour, int ref_allele)
 {
-  mark_first_allele(allele1, len1, use_ref_allele_info, ref_colour, ref_allele);
-  mark_second_allele(allele2, len2, use_ref_allele_info, ref_colour, ref_allele);
+  //the marks are not put on the nodes, which other sites may share
+  AlleleMarks* marks = alloc_allele_marks(len1+len2+2);
+  mark_first_allele(marks, allele1, len1, use_ref_allele_info, ref_colour, ref_allele);
+  mark_second_allele(marks, allele2, len2, use_ref_allele_info, ref_colour, ref_allele);
   
   int i;
   boolean too_short=false;
@@ -954,24 +1004,23 @@ boolean get_num_effective_reads_on_unique_part_of_branch(Covg* array1, dBNode**
       if (len1>eff_read_len)
 	{
 	  array1[i] = ((len1 + 0.5*eff_read_len)/eff_read_len) *  
-	    median_covg_on_allele_in_specific_colour_with_allele_presence_constraint(allele1, len1, working_ca, i, &too_short, one, eff_depth);
+	    median_covg_on_allele_in_specific_colour_with_allele_presence_constraint(allele1, len1, working_ca, i, &too_short, one, marks, eff_depth);
 	}
       else
 	{
-	  array1[i] = median_covg_on_allele_in_specific_colour_with_allele_presence_constraint(allele1, len1, working_ca, i, &too_short, one, eff_depth);
+	  array1[i] = median_covg_on_allele_in_specific_colour_with_allele_presence_constraint(allele1, len1, working_ca, i, &too_short, one, marks, eff_depth);
 	}
       if (len2>eff_read_len)
 	{
 	  array2[i] = ((len2 + 0.5*eff_read_len)/eff_read_len) *  
-	    median_covg_on_allele_in_specific_colour_with_allele_presence_constraint(allele2, len2, working_ca, i, &too_short, two, eff_depth);
+	    median_covg_on_allele_in_specific_colour_with_allele_presence_constraint(allele2, len2, working_ca, i, &too_short, two, marks, eff_depth);
 	}
       else
 	{
-	  array2[i] = median_covg_on_allele_in_specific_colour_with_allele_presence_constraint(allele2, len2, working_ca, i, &too_short, two, eff_depth);
+	  array2[i] = median_covg_on_allele_in_specific_colour_with_allele_presence_constraint(allele2, len2, working_ca, i, &too_short, two, marks, eff_depth);
 	}
     }
-  reset_allele_status(allele1, len1);
-  reset_allele_status(allele2, len2);
+  free_allele_marks(marks);
 
   return too_short;
 }
@@ -1250,10 +1299,10 @@ Covg min_covg_on_allele_in_specific_colour(dBNode** allele, int len, int colour,
 }
 
 
-//only count nodes which have the desired allele status
+//only count nodes which have the desired allele status in marks
 Covg median_covg_on_allele_in_specific_colour_with_allele_presence_constraint(dBNode** allele, int len, CovgArray* working_ca,
 									      int colour, boolean* too_short, AlleleStatus st,
-									      float eff_depth)
+									      AlleleMarks* marks, float eff_depth)
 {
 
   if ((len==0)|| (len==1))
@@ -1271,7 +1320,7 @@ Covg median_covg_on_allele_in_specific_colour_with_allele_presence_constraint(dB
     {
       if (allele[i]!=NULL)
 	{
-	  if (db_node_check_allele_status(allele[i], st)==true)
+	  if (allele_marks_check(marks, allele[i], st)==true)
 	    {
 	      Covg cov = db_node_get_coverage_tolerate_null(allele[i], colour);
 	      if (cov < 2* eff_depth)
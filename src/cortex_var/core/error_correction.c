@@ -32,11 +32,13 @@
 #include "string_buffer.h"
 #include "seq_file.h"
 #include <libgen.h> // basename
+#include <pthread.h>
 
 // cortex_var headers
 #include "error_correction.h"
 #include "global.h"
 #include "dB_graph_population.h"
+#include "file_reader.h"
 
 
 void error_correct_list_of_files(StrBuf* list_fastq,char quality_cutoff, char ascii_qual_offset,
@@ -100,6 +102,571 @@ void error_correct_list_of_files(StrBuf* list_fastq,char quality_cutoff, char as
   free(distrib_position_bases_corrected);
 }
 
+// What every read of a file is corrected with
+typedef struct
+{
+  char quality_cutoff; //including the ascii offset
+  dBGraph* db_graph;
+  int bases_modified_count_array_size;
+  HandleLowQualUncorrectable policy;
+  boolean add_greedy_bases_for_better_bwt_compression;
+  int num_greedy_bases;
+  boolean rev_comp_read_if_on_reverse_strand;
+} ErrorCorrectionSettings;
+
+// A read, and what became of it
+typedef struct
+{
+  StrBuf* name;
+  StrBuf* seq;
+  StrBuf* qual;
+  int read_len;
+  ReadCorrectionDecison dec;
+} ReadToCorrect;
+
+// The working space and stats of one thread. The stats of all threads are
+// summed at the end of the file
+typedef struct
+{
+  StrBuf* working_buf;
+  uint64_t* bases_modified_count_array;
+  uint64_t* posn_modified_count_array;
+  int num_original_reads, num_final_reads, num_corrected_reads, num_discarded_reads;
+} ErrorCorrectionWorker;
+
+static void read_to_correct_init(ReadToCorrect* read)
+{
+  read->name = strbuf_new();
+  read->seq  = strbuf_new();
+  read->qual = strbuf_new();
+}
+
+static void read_to_correct_free(ReadToCorrect* read)
+{
+  strbuf_free(read->name);
+  strbuf_free(read->seq);
+  strbuf_free(read->qual);
+}
+
+static void error_correction_worker_init(ErrorCorrectionWorker* worker, int array_size)
+{
+  worker->working_buf = strbuf_new();
+  worker->bases_modified_count_array = (uint64_t*) calloc(array_size, sizeof(uint64_t));
+  worker->posn_modified_count_array  = (uint64_t*) calloc(array_size, sizeof(uint64_t));
+  if ( (worker->bases_modified_count_array==NULL) || (worker->posn_modified_count_array==NULL) )
+    {
+      die("Unable to alloc arrays for keeping stats. Your machine must have hardly any spare memory\n");
+    }
+  worker->num_original_reads=0;
+  worker->num_final_reads=0;
+  worker->num_corrected_reads=0;
+  worker->num_discarded_reads=0;
+}
+
+// adds the stats of worker to those of total, and frees it
+static void error_correction_worker_add_to_and_free(ErrorCorrectionWorker* worker, ErrorCorrectionWorker* total,
+						    int array_size)
+{
+  int i;
+  for (i=0; i<array_size; i++)
+    {
+      total->bases_modified_count_array[i] += worker->bases_modified_count_array[i];
+      total->posn_modified_count_array[i]  += worker->posn_modified_count_array[i];
+    }
+  total->num_original_reads  += worker->num_original_reads;
+  total->num_final_reads     += worker->num_final_reads;
+  total->num_corrected_reads += worker->num_corrected_reads;
+  total->num_discarded_reads += worker->num_discarded_reads;
+  strbuf_free(worker->working_buf);
+  free(worker->bases_modified_count_array);
+  free(worker->posn_modified_count_array);
+}
+
+// Corrects read->seq and read->qual in place (reverse complementing them if
+// they are to be printed on the forward strand), and sets read->dec.
+// Only looks things up in the graph
+static void error_correct_read(ReadToCorrect* read, ErrorCorrectionWorker* worker,
+			       const ErrorCorrectionSettings* settings)
+{
+  dBGraph* db_graph = settings->db_graph;
+  short kmer_size = db_graph->kmer_size;
+  char quality_cutoff = settings->quality_cutoff;
+  HandleLowQualUncorrectable policy = settings->policy;
+  int bases_modified_count_array_size = settings->bases_modified_count_array_size;
+  uint64_t* posn_modified_count_array = worker->posn_modified_count_array;
+  StrBuf* buf_seq = read->seq;
+  StrBuf* buf_qual = read->qual;
+  StrBuf* working_buf = worker->working_buf;
+
+  int count_corrected_bases=0;
+  int read_len = read->read_len;
+  int num_kmers = read_len-kmer_size+1;
+  int quality_good[read_len];
+  set_int_array(quality_good, read_len, 1);
+
+  int first_good=0;//index of first kmer in graph
+
+  //populate the qual array showing which bases have qual >threshold
+  //if all quals are high, will Print uncorrected
+  //else, if all kmers NOT in graph, will discard or print uncorrected depending on policy
+  //else print corrected.
+  Orientation strand_first_good_kmer;
+  ReadCorrectionDecison dec = 
+    get_first_good_kmer_and_populate_qual_array(read->name->buff, buf_seq, buf_qual, num_kmers, read_len,
+						quality_good, quality_cutoff, 
+						&first_good, &strand_first_good_kmer,
+						db_graph, policy, settings->rev_comp_read_if_on_reverse_strand);
+      
+
+  //*** start of local functions
+
+  //if going right, keep going to right hand end. if going left, keep going to left hand end
+  boolean condition(WhichEndOfKmer direction, int pos)
+  {
+    if ((direction==Right) && (pos<num_kmers))
+      {
+	return true;
+      }
+    if ((direction==Left) && (pos>=0))
+      {
+	return true;
+      }
+    return false;
+  }
+  boolean kmer_is_in_graph(char* kmer, dBGraph* db_g)
+  {
+    BinaryKmer curr_kmer;
+    if (seq_to_binary_kmer(kmer, kmer_size, &curr_kmer)==NULL)
+      {
+	//is an N
+	return false;
+      }
+
+    BinaryKmer temp_key;
+    element_get_key(&curr_kmer, kmer_size, &temp_key);
+    dBNode* node = hash_table_find(&temp_key, db_g);
+    if (node==NULL)
+      {
+	return false;
+      }
+    else
+      {
+	return true;
+      }
+  }
+  int increment(int i, WhichEndOfKmer direction)
+  {
+    if (direction==Right)
+      {
+	return i+1;
+      }
+    else
+      {
+	return i-1;
+      }
+  }
+  char working_str[kmer_size+1];
+
+  // start_pos is in kmer units
+  boolean check_bases_to_end_of_read(int start_pos, ReadCorrectionDecison* decision, 
+				     WhichEndOfKmer direction, 
+				     int* num_corrected_bases_in_this_read_debug)
+
+  {
+    boolean any_correction_done=false;
+    if ((start_pos<0) || (start_pos>=num_kmers))
+      {
+	return any_correction_done;
+      }
+    int pos=start_pos;
+    int offset=0;
+    if (direction==Right)
+      {
+	offset= kmer_size-1;
+      }
+    char local_kmer[kmer_size+1];
+    local_kmer[kmer_size]='\0';	
+
+    while ( (*decision==PrintCorrected) && (condition(direction,pos)==true) )
+      {
+	strncpy(local_kmer, buf_seq->buff+pos, kmer_size);	  
+
+	if (quality_good[pos+offset]==1) 
+	  {
+	    //nothing to do
+	  }
+	else if (kmer_is_in_graph(local_kmer, db_graph)==true)
+	  {
+	    //nothing to do - don't correct if kmer is in graph
+	  }
+	else//kmer not in graph and quality bad
+	  {
+	    boolean fixed = fix_end_if_unambiguous(direction, buf_seq, buf_qual, quality_cutoff, pos, 
+						   working_buf, working_str, db_graph);
+	    if ( (policy==DiscardReadIfLowQualBaseUnCorrectable) 
+		 &&  
+		 (fixed==false) )
+	      {
+		*decision=Discard;
+	      }
+	    else if (fixed==true)
+	      {
+		any_correction_done=true;
+		count_corrected_bases++;
+		*num_corrected_bases_in_this_read_debug=*num_corrected_bases_in_this_read_debug+1;
+		if (offset+pos<bases_modified_count_array_size)
+		  {
+		    posn_modified_count_array[offset+pos]++;
+		  }
+		else
+		  {
+		    posn_modified_count_array[bases_modified_count_array_size-1]++;
+		  }
+	      }
+	  }
+	pos = increment(pos, direction);
+      }
+    return any_correction_done;
+  }			      
+  //end of local functions
+
+
+  worker->num_original_reads++;
+
+  boolean any_fixing_done=false;//remember you can do some fixing but then decide later to discard
+
+  if (dec==PrintCorrected)//this means will try and correct, but might not be able to
+    {
+      int num_corrections_to_this_read_for_debug=0;
+      boolean any_fix_right = check_bases_to_end_of_read(first_good+1, &dec, Right, &num_corrections_to_this_read_for_debug);
+      boolean any_fix_left  = check_bases_to_end_of_read(first_good-1, &dec, Left, &num_corrections_to_this_read_for_debug);
+      if (any_fix_right||any_fix_left)
+	{
+	  //then it really was able to correct at least one base somewhere
+	  any_fixing_done=true;
+	}
+    }
+
+  read->dec = dec;
+  if (dec==Discard)
+    {
+      worker->num_discarded_reads++;
+    }
+  else
+    {
+      if ( (settings->rev_comp_read_if_on_reverse_strand==true)
+	   && (strand_first_good_kmer==reverse) )
+	{
+	  strbuf_rev_comp(buf_seq);
+	  strbuf_reverse(buf_qual);
+	}
+      if (count_corrected_bases<bases_modified_count_array_size)
+	{
+	  worker->bases_modified_count_array[count_corrected_bases]++;
+	}
+      else
+	{
+	  worker->bases_modified_count_array[bases_modified_count_array_size-1]++;
+	}
+      worker->num_final_reads++;
+      if (any_fixing_done==true)
+	{
+	  worker->num_corrected_reads++;
+	}
+    }
+}
+
+// The greedy bases are random, so reads are printed (and the random walks taken)
+// in the order they are in the file
+static void error_correction_print_read(ReadToCorrect* read, FILE* out_fp, const ErrorCorrectionSettings* settings)
+{
+  if (read->dec==Discard)
+    {
+      return;
+    }
+  dBGraph* db_graph = settings->db_graph;
+  short kmer_size = db_graph->kmer_size;
+  StrBuf* buf_seq = read->seq;
+
+  if (settings->add_greedy_bases_for_better_bwt_compression==false)
+    {
+      fprintf(out_fp, "@");
+    }
+  else
+    {
+      fprintf(out_fp, ">");
+    }
+  fprintf(out_fp, "%s\n", read->name->buff);
+
+  if (settings->add_greedy_bases_for_better_bwt_compression==true)
+    {
+      //get the final kmer (after reverse complementing if that is happening)
+      char last_kmer_str[kmer_size+1];
+      strbuf_substr_prealloced(buf_seq, buf_seq->len-kmer_size-1, kmer_size, last_kmer_str);
+
+      BinaryKmer last_kmer;
+      if (seq_to_binary_kmer(last_kmer_str, kmer_size, &last_kmer)==NULL)
+	{
+	  //contains an N
+	  pad_to_N_with_Adenine(buf_seq, buf_seq->len+settings->num_greedy_bases);
+	}
+	
+      BinaryKmer temp_key;
+      element_get_key(&last_kmer, kmer_size, &temp_key);
+      dBNode* last_node_in_read = hash_table_find(&temp_key, db_graph);
+      if (last_node_in_read==NULL)
+	{
+	  pad_to_N_with_Adenine(buf_seq, buf_seq->len+settings->num_greedy_bases);
+	}
+      else
+	{
+	  Orientation last_or_in_read = db_node_get_orientation(&last_kmer,last_node_in_read, kmer_size);
+	  take_n_greedy_random_steps(last_node_in_read, last_or_in_read,
+				     db_graph, settings->num_greedy_bases, buf_seq);
+	}
+    }
+	  
+  fprintf(out_fp, "%s\n", buf_seq->buff );
+  if (settings->add_greedy_bases_for_better_bwt_compression==false)
+    {
+      fprintf(out_fp, "+\n%s\n", read->qual->buff);
+    }
+}
+
+//
+// With NUM_THREADS > 1, the calling thread reads batches of reads from
+// the file, NUM_THREADS workers correct them, and a writer thread prints
+// the batches in the order they were read.
+//
+
+#define ERROR_CORRECTION_BATCH_READS 4096
+
+typedef struct
+{
+  ReadToCorrect reads[ERROR_CORRECTION_BATCH_READS];
+  int num_reads;
+  long long batch_num;
+} ReadBatch;
+
+typedef struct
+{
+  const ErrorCorrectionSettings* settings;
+  FILE* out_fp;
+
+  int num_batches;
+  ReadBatch* batches;
+  ReadBatch** to_correct; // queue of batches read, in order
+  int to_correct_start, num_to_correct;
+  ReadBatch** empty;      // batches the reader may fill
+  int num_empty;
+  ReadBatch** to_print;   // corrected, indexed by batch_num % num_batches
+  long long next_to_print;
+  boolean finished;       // the reader has read the whole file
+
+  pthread_mutex_t lock;
+  pthread_cond_t cond_to_correct, cond_to_print, cond_empty;
+} ErrorCorrectionPipeline;
+
+typedef struct
+{
+  ErrorCorrectionPipeline* pipeline;
+  ErrorCorrectionWorker worker;
+} ErrorCorrectionThread;
+
+static void* error_correction_worker_thread(void* arg)
+{
+  ErrorCorrectionThread* thread = (ErrorCorrectionThread*) arg;
+  ErrorCorrectionPipeline* pipeline = thread->pipeline;
+
+  while (true)
+    {
+      pthread_mutex_lock(&pipeline->lock);
+      while ( (pipeline->num_to_correct==0) && (pipeline->finished==false) )
+	{
+	  pthread_cond_wait(&pipeline->cond_to_correct, &pipeline->lock);
+	}
+      if (pipeline->num_to_correct==0)
+	{
+	  pthread_mutex_unlock(&pipeline->lock);
+	  return NULL;
+	}
+      ReadBatch* batch = pipeline->to_correct[pipeline->to_correct_start];
+      pipeline->to_correct_start = (pipeline->to_correct_start+1) % pipeline->num_batches;
+      pipeline->num_to_correct--;
+      pthread_mutex_unlock(&pipeline->lock);
+
+      int i;
+      for (i=0; i<batch->num_reads; i++)
+	{
+	  error_correct_read(&batch->reads[i], &thread->worker, pipeline->settings);
+	}
+
+      pthread_mutex_lock(&pipeline->lock);
+      pipeline->to_print[batch->batch_num % pipeline->num_batches] = batch;
+      pthread_cond_broadcast(&pipeline->cond_to_print);
+      pthread_mutex_unlock(&pipeline->lock);
+    }
+}
+
+static void* error_correction_writer_thread(void* arg)
+{
+  ErrorCorrectionPipeline* pipeline = (ErrorCorrectionPipeline*) arg;
+
+  while (true)
+    {
+      pthread_mutex_lock(&pipeline->lock);
+      ReadBatch* batch;
+      while ( ((batch = pipeline->to_print[pipeline->next_to_print % pipeline->num_batches])==NULL)
+	      && ( (pipeline->finished==false) || (pipeline->num_empty<pipeline->num_batches) ) )
+	{
+	  pthread_cond_wait(&pipeline->cond_to_print, &pipeline->lock);
+	}
+      if (batch==NULL)
+	{
+	  //every batch has been printed and the file is finished
+	  pthread_mutex_unlock(&pipeline->lock);
+	  return NULL;
+	}
+      pipeline->to_print[pipeline->next_to_print % pipeline->num_batches] = NULL;
+      pipeline->next_to_print++;
+      pthread_mutex_unlock(&pipeline->lock);
+
+      int i;
+      for (i=0; i<batch->num_reads; i++)
+	{
+	  error_correction_print_read(&batch->reads[i], pipeline->out_fp, pipeline->settings);
+	}
+
+      pthread_mutex_lock(&pipeline->lock);
+      pipeline->empty[pipeline->num_empty++] = batch;
+      pthread_cond_signal(&pipeline->cond_empty);
+      pthread_cond_broadcast(&pipeline->cond_to_print);
+      pthread_mutex_unlock(&pipeline->lock);
+    }
+}
+
+static void error_correct_seq_file_multithreaded(SeqFile* sf, FILE* out_fp, int num_threads,
+						 const ErrorCorrectionSettings* settings,
+						 ErrorCorrectionWorker* total)
+{
+  ErrorCorrectionPipeline pipeline;
+  pipeline.settings = settings;
+  pipeline.out_fp = out_fp;
+  pipeline.num_batches = 2*num_threads+2;
+  pipeline.batches    = malloc(pipeline.num_batches * sizeof(ReadBatch));
+  pipeline.to_correct = malloc(pipeline.num_batches * sizeof(ReadBatch*));
+  pipeline.empty      = malloc(pipeline.num_batches * sizeof(ReadBatch*));
+  pipeline.to_print   = calloc(pipeline.num_batches, sizeof(ReadBatch*));
+  if ( (pipeline.batches==NULL) || (pipeline.to_correct==NULL) || (pipeline.empty==NULL) || (pipeline.to_print==NULL) )
+    {
+      die("Unable to malloc batches of reads for error correction threads\n");
+    }
+  int i, j;
+  for (i=0; i<pipeline.num_batches; i++)
+    {
+      for (j=0; j<ERROR_CORRECTION_BATCH_READS; j++)
+	{
+	  read_to_correct_init(&pipeline.batches[i].reads[j]);
+	}
+      pipeline.empty[i] = &pipeline.batches[i];
+    }
+  pipeline.num_empty = pipeline.num_batches;
+  pipeline.to_correct_start = 0;
+  pipeline.num_to_correct = 0;
+  pipeline.next_to_print = 0;
+  pipeline.finished = false;
+  pthread_mutex_init(&pipeline.lock, NULL);
+  pthread_cond_init(&pipeline.cond_to_correct, NULL);
+  pthread_cond_init(&pipeline.cond_to_print, NULL);
+  pthread_cond_init(&pipeline.cond_empty, NULL);
+
+  ErrorCorrectionThread threads[num_threads];
+  pthread_t workers[num_threads];
+  pthread_t writer;
+  for (i=0; i<num_threads; i++)
+    {
+      threads[i].pipeline = &pipeline;
+      error_correction_worker_init(&threads[i].worker, settings->bases_modified_count_array_size);
+      if (pthread_create(&workers[i], NULL, error_correction_worker_thread, &threads[i])!=0)
+	{
+	  die("Unable to create a thread to correct reads\n");
+	}
+    }
+  if (pthread_create(&writer, NULL, error_correction_writer_thread, &pipeline)!=0)
+    {
+      die("Unable to create a thread to print corrected reads\n");
+    }
+
+  long long batch_num = 0;
+  boolean more_reads = true;
+  while (more_reads)
+    {
+      pthread_mutex_lock(&pipeline.lock);
+      while (pipeline.num_empty==0)
+	{
+	  pthread_cond_wait(&pipeline.cond_empty, &pipeline.lock);
+	}
+      ReadBatch* batch = pipeline.empty[--pipeline.num_empty];
+      pthread_mutex_unlock(&pipeline.lock);
+
+      batch->num_reads = 0;
+      while ( (batch->num_reads<ERROR_CORRECTION_BATCH_READS) && (more_reads = seq_next_read(sf)) )
+	{
+	  ReadToCorrect* read = &batch->reads[batch->num_reads++];
+	  //NOTE - uses modified version fo Isaacs code - new func
+	  seq_read_all_bases_and_quals(sf, read->seq, read->qual);
+	  strbuf_set(read->name, seq_get_read_name(sf));
+	  read->read_len = seq_get_length(sf);
+	}
+
+      pthread_mutex_lock(&pipeline.lock);
+      if (batch->num_reads>0)
+	{
+	  batch->batch_num = batch_num++;
+	  pipeline.to_correct[(pipeline.to_correct_start+pipeline.num_to_correct) % pipeline.num_batches] = batch;
+	  pipeline.num_to_correct++;
+	  pthread_cond_signal(&pipeline.cond_to_correct);
+	}
+      else
+	{
+	  pipeline.empty[pipeline.num_empty++] = batch;
+	}
+      if (more_reads==false)
+	{
+	  pipeline.finished = true;
+	  pthread_cond_broadcast(&pipeline.cond_to_correct);
+	  pthread_cond_broadcast(&pipeline.cond_to_print);
+	}
+      pthread_mutex_unlock(&pipeline.lock);
+    }
+
+  for (i=0; i<num_threads; i++)
+    {
+      pthread_join(workers[i], NULL);
+    }
+  pthread_join(writer, NULL);
+
+  for (i=0; i<num_threads; i++)
+    {
+      error_correction_worker_add_to_and_free(&threads[i].worker, total, settings->bases_modified_count_array_size);
+    }
+  for (i=0; i<pipeline.num_batches; i++)
+    {
+      for (j=0; j<ERROR_CORRECTION_BATCH_READS; j++)
+	{
+	  read_to_correct_free(&pipeline.batches[i].reads[j]);
+	}
+    }
+  pthread_mutex_destroy(&pipeline.lock);
+  pthread_cond_destroy(&pipeline.cond_to_correct);
+  pthread_cond_destroy(&pipeline.cond_to_print);
+  pthread_cond_destroy(&pipeline.cond_empty);
+  free(pipeline.batches);
+  free(pipeline.to_correct);
+  free(pipeline.empty);
+  free(pipeline.to_print);
+}
+
 //outputs fastQ unless add_greedy_bases_for_better_bwt_compression==true, in which case is for 1000genomes, and they want fastA
 void error_correct_file_against_graph(char* fastq_file, char quality_cutoff, char ascii_qual_offset,
 					     dBGraph *db_graph, char* outfile,
@@ -117,8 +684,14 @@ void error_correct_file_against_graph(char* fastq_file, char quality_cutoff, cha
 
 
   //set some variables, quality etc
-  quality_cutoff+=ascii_qual_offset;
-  short kmer_size = db_graph->kmer_size;
+  ErrorCorrectionSettings settings;
+  settings.quality_cutoff = quality_cutoff+ascii_qual_offset;
+  settings.db_graph = db_graph;
+  settings.bases_modified_count_array_size = bases_modified_count_array_size;
+  settings.policy = policy;
+  settings.add_greedy_bases_for_better_bwt_compression = add_greedy_bases_for_better_bwt_compression;
+  settings.num_greedy_bases = num_greedy_bases;
+  settings.rev_comp_read_if_on_reverse_strand = rev_comp_read_if_on_reverse_strand;
 
   //setup output file for corrected reads, plus two stats files
   FILE* out_fp = fopen(outfile, "w");
@@ -167,237 +740,36 @@ void error_correct_file_against_graph(char* fastq_file, char quality_cutoff, cha
     {
       die("Error correction is only meant to work on FASTQ and this file: %s is not\n", fastq_file);
     }
-  
-  StrBuf* buf_seq  = strbuf_new();
-  StrBuf* buf_qual = strbuf_new();
-  StrBuf* working_buf=strbuf_new();
-  dBNode* last_node_in_read;
-  Orientation last_or_in_read;
-  int num_original_reads=0, num_final_reads=0, num_corrected_reads=0, num_discarded_reads=0;
-  while(seq_next_read(sf))
-    {
-      int count_corrected_bases=0;
-      //NOTE - uses modified version fo Isaacs code - new func
-      seq_read_all_bases_and_quals(sf, buf_seq, buf_qual);
-      StrBuf* buf_seq_debug  = strbuf_clone(buf_seq);
-      
-      int read_len = seq_get_length(sf);
-      int num_kmers = read_len-kmer_size+1;
-      int quality_good[read_len];
-      set_int_array(quality_good, read_len, 1);
-
-      int first_good=0;//index of first kmer in graph
-
-      //populate the qual array showing which bases have qual >threshold
-      //if all quals are high, will Print uncorrected
-      //else, if all kmers NOT in graph, will discard or print uncorrected depending on policy
-      //else print corrected.
-      Orientation strand_first_good_kmer;
-      ReadCorrectionDecison dec = 
-	get_first_good_kmer_and_populate_qual_array(seq_get_read_name(sf), buf_seq, buf_qual, num_kmers, read_len,
-						    quality_good, quality_cutoff, 
-						    &first_good, &strand_first_good_kmer,
-						    db_graph, policy, rev_comp_read_if_on_reverse_strand);
-      
-
-      //*** start of local functions
-
-      //if going right, keep going to right hand end. if going left, keep going to left hand end
-      boolean condition(WhichEndOfKmer direction, int pos)
-      {
-	if ((direction==Right) && (pos<num_kmers))
-	  {
-	    return true;
-	  }
-	if ((direction==Left) && (pos>=0))
-	  {
-	    return true;
-	  }
-	return false;
-      }
-      boolean kmer_is_in_graph(char* kmer, dBGraph* db_g)
-      {
-	BinaryKmer curr_kmer;
-	if (seq_to_binary_kmer(kmer, kmer_size, &curr_kmer)==NULL)
-	  {
-	    //is an N
-	    return false;
-	  }
-
-	BinaryKmer temp_key;
-	element_get_key(&curr_kmer, kmer_size, &temp_key);
-	dBNode* node = hash_table_find(&temp_key, db_g);
-	if (node==NULL)
-	  {
-	    return false;
-	  }
-	else
-	  {
-	    return true;
-	  }
-      }
-      int increment(int i, WhichEndOfKmer direction)
-      {
-	if (direction==Right)
-	  {
-	    return i+1;
-	  }
-	else
-	  {
-	    return i-1;
-	  }
-      }
-      char working_str[kmer_size+1];
 
-      // start_pos is in kmer units
-      boolean check_bases_to_end_of_read(int start_pos, ReadCorrectionDecison* decision, 
-					 WhichEndOfKmer direction, 
-					 int* num_corrected_bases_in_this_read_debug)
+  //the stats of all threads are added up in total
+  ErrorCorrectionWorker total;
+  total.bases_modified_count_array = bases_modified_count_array;
+  total.posn_modified_count_array = posn_modified_count_array;
+  total.num_original_reads=0;
+  total.num_final_reads=0;
+  total.num_corrected_reads=0;
+  total.num_discarded_reads=0;
 
-      {
-	boolean any_correction_done=false;
-	if ((start_pos<0) || (start_pos>=num_kmers))
-	  {
-	    return any_correction_done;
-	  }
-	int pos=start_pos;
-	int offset=0;
-	if (direction==Right)
-	  {
-	    offset= kmer_size-1;
-	  }
-	char local_kmer[kmer_size+1];
-	local_kmer[kmer_size]='\0';	
-
-	while ( (*decision==PrintCorrected) && (condition(direction,pos)==true) )
-	  {
-	    strncpy(local_kmer, buf_seq->buff+pos, kmer_size);	  
-
-	    if (quality_good[pos+offset]==1) 
-	      {
-		//nothing to do
-	      }
-	    else if (kmer_is_in_graph(local_kmer, db_graph)==true)
-	      {
-		//nothing to do - don't correct if kmer is in graph
-	      }
-	    else//kmer not in graph and quality bad
-	      {
-		boolean fixed = fix_end_if_unambiguous(direction, buf_seq, buf_qual, quality_cutoff, pos, 
-						       working_buf, working_str, db_graph);
-		if ( (policy==DiscardReadIfLowQualBaseUnCorrectable) 
-		     &&  
-		     (fixed==false) )
-		  {
-		    *decision=Discard;
-		  }
-		else if (fixed==true)
-		  {
-		    any_correction_done=true;
-		    count_corrected_bases++;
-		    *num_corrected_bases_in_this_read_debug=*num_corrected_bases_in_this_read_debug+1;
-		    if (offset+pos<bases_modified_count_array_size)
-		      {
-			posn_modified_count_array[offset+pos]++;
-		      }
-		    else
-		      {
-			posn_modified_count_array[bases_modified_count_array_size-1]++;
-		      }
-		  }
-	      }
-	    pos = increment(pos, direction);
-	  }
-	return any_correction_done;
-      }			      
-      //end of local functions
-
-
-      num_original_reads++;
-
-      boolean any_fixing_done=false;//remember you can do some fixing but then decide later to discard
-
-      if (dec==PrintCorrected)//this means will try and correct, but might not be able to
-	{
-	  int num_corrections_to_this_read_for_debug=0;
-	  boolean any_fix_right = check_bases_to_end_of_read(first_good+1, &dec, Right, &num_corrections_to_this_read_for_debug);
-	  boolean any_fix_left  = check_bases_to_end_of_read(first_good-1, &dec, Left, &num_corrections_to_this_read_for_debug);
-	  if (any_fix_right||any_fix_left)
-	    {
-	      //then it really was able to correct at least one base somewhere
-	      any_fixing_done=true;
-	    }
-	}
-
-      if (dec==Discard)
-	{
-	  num_discarded_reads++;
-	}
-      else
+  if (NUM_THREADS>1)
+    {
+      error_correct_seq_file_multithreaded(sf, out_fp, NUM_THREADS, &settings, &total);
+    }
+  else
+    {
+      ReadToCorrect read;
+      read_to_correct_init(&read);
+      total.working_buf = strbuf_new();
+      while(seq_next_read(sf))
 	{
-	  if (add_greedy_bases_for_better_bwt_compression==false)
-	    {
-	      fprintf(out_fp, "@");
-	    }
-	  else
-	    {
-	      fprintf(out_fp, ">");
-	    }
-	  fprintf(out_fp, "%s\n", seq_get_read_name(sf));
-	  char last_kmer_str[db_graph->kmer_size];
-	  if ( (rev_comp_read_if_on_reverse_strand==true)
-	       && (strand_first_good_kmer==reverse) )
-	    {
-	      strbuf_rev_comp(buf_seq);
-	      strbuf_reverse(buf_qual);
-	    }
-	  //get the final kmer (after reverse complementing if that is happening)
-	  strbuf_substr_prealloced(buf_seq, buf_seq->len-db_graph->kmer_size-1, db_graph->kmer_size, last_kmer_str);
-
-	  if (add_greedy_bases_for_better_bwt_compression==true)
-	    {
-	      BinaryKmer last_kmer;
-	      if (seq_to_binary_kmer(last_kmer_str, kmer_size, &last_kmer)==NULL)
-		{
-		  //contains an N
-		  pad_to_N_with_Adenine(buf_seq, buf_seq->len+num_greedy_bases);
-		}
-	
-	      BinaryKmer temp_key;
-	      element_get_key(&last_kmer, kmer_size, &temp_key);
-	      last_node_in_read = hash_table_find(&temp_key, db_graph);
-	      if (last_node_in_read==NULL)
-		{
-		  pad_to_N_with_Adenine(buf_seq, buf_seq->len+num_greedy_bases);
-		}
-	      else
-		{
-		  last_or_in_read = db_node_get_orientation(&last_kmer,last_node_in_read, db_graph->kmer_size);
-		  take_n_greedy_random_steps(last_node_in_read, last_or_in_read,
-					     db_graph, num_greedy_bases, buf_seq);
-		}
-	    }
-	  
-	  fprintf(out_fp, "%s\n", buf_seq->buff );
-	  if (add_greedy_bases_for_better_bwt_compression==false)
-	    {
-	      fprintf(out_fp, "+\n%s\n", buf_qual->buff);
-	    }
-	  if (count_corrected_bases<bases_modified_count_array_size)
-	    {
-	      bases_modified_count_array[count_corrected_bases]++;
-	    }
-	  else
-	    {
-	      bases_modified_count_array[bases_modified_count_array_size-1]++;
-	    }
-	  num_final_reads++;
-	  if (any_fixing_done==true)
-	    {
-	      num_corrected_reads++;
-	    }
+	  //NOTE - uses modified version fo Isaacs code - new func
+	  seq_read_all_bases_and_quals(sf, read.seq, read.qual);
+	  strbuf_set(read.name, seq_get_read_name(sf));
+	  read.read_len = seq_get_length(sf);
+	  error_correct_read(&read, &total, &settings);
+	  error_correction_print_read(&read, out_fp, &settings);
 	}
-      strbuf_free(buf_seq_debug);
+      read_to_correct_free(&read);
+      strbuf_free(total.working_buf);
     }
 
     seq_file_close(sf);
@@ -412,14 +784,11 @@ void error_correct_file_against_graph(char* fastq_file, char quality_cutoff, cha
       }
     fclose(out_stat1);
     fclose(out_stat2);
-    fprintf(out_stat3, "Original reads:\t%d\n", num_original_reads);
-    fprintf(out_stat3, "Final reads:\t%d\n", num_final_reads);
-    fprintf(out_stat3, "Corrected reads:\t%d\n", num_corrected_reads);
-    fprintf(out_stat3, "Discarded reads:\t%d\n", num_discarded_reads);
+    fprintf(out_stat3, "Original reads:\t%d\n", total.num_original_reads);
+    fprintf(out_stat3, "Final reads:\t%d\n", total.num_final_reads);
+    fprintf(out_stat3, "Corrected reads:\t%d\n", total.num_corrected_reads);
+    fprintf(out_stat3, "Discarded reads:\t%d\n", total.num_discarded_reads);
     fclose(out_stat3);
-    strbuf_free(buf_seq);
-    strbuf_free(buf_qual);
-    strbuf_free(working_buf);
     free(stat1);
     free(stat2);
     free(stat3);
@@ -37,8 +37,12 @@
 #include <libgen.h> // dirname
 #include <errno.h>
 #include <ctype.h> // tolower
+#include <time.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <dirent.h>
+#include <pthread.h>
 
 // third party libraries
 #include <seq_file.h>
@@ -49,6 +53,8 @@
 #include "dB_graph.h"
 #include "seq.h"
 #include "file_reader.h"
+#include "binary_blocks.h"
+#include "kmer_sketch.h"
 #include "dB_graph_supernode.h"
 #include "dB_graph_population.h"
 
@@ -367,20 +373,424 @@ char _read_first_kmer(SeqFile *sf, char *kmer_str, char* qual_str,
   return 1;
 }
 
-inline void _process_read(SeqFile *sf, char* kmer_str, char* qual_str,
-                          char quality_cutoff, int homopolymer_cutoff,
-                          dBGraph *db_graph, int colour_index,
-                          BinaryKmer curr_kmer, Element *curr_node,
-                          Orientation curr_orient,
-                          unsigned long long *bases_loaded,
-                          unsigned long *readlen_count_array,
-                          unsigned long readlen_count_array_size)
+//
+// Multi-threaded loading of sequence data
+//
+// With NUM_THREADS > 1 the thread that parses the sequence file applies
+// all the read filters (quality, homopolymers, Ns, subsampling) and passes the
+// surviving contigs on to worker threads in batches. The workers do the hash
+// table inserts, coverage updates and edges. These are all commutative, so the
+// graph is the same as when loading with a single thread.
+// With a single thread the same batches are loaded by the reader itself, which
+// lets the hash table lookups be batched and prefetched (see KmerWindow below).
+// PCR duplicate removal depends on the order reads are seen, so is always done
+// with a single thread, a read at a time.
+
+#define CONTIG_BATCH_BASES (1<<20)
+
+typedef struct
+{
+  unsigned long len;
+  boolean add_covg; // false for first kmers of subsampled-out reads
+} ContigInfo;
+
+typedef struct
+{
+  char *seq; // all contigs in this batch, concatenated
+  unsigned long seq_len, seq_capacity;
+  ContigInfo *contigs;
+  unsigned long num_contigs, contigs_capacity;
+} ContigBatch;
+
+typedef struct
+{
+  dBGraph *db_graph;
+  int colour;
+  int num_threads;
+  pthread_t *threads;
+
+  int num_batches;
+  ContigBatch *batches;
+  ContigBatch **full;  // queue of batches ready to load
+  int full_start, num_full;
+  ContigBatch **empty; // batches the reader may fill
+  int num_empty;
+  boolean finished;
+
+  pthread_mutex_t lock;
+  pthread_cond_t cond_full, cond_empty;
+} SeqLoader;
+
+static void _contig_batch_ensure_capacity(ContigBatch *batch, unsigned long extra)
+{
+  if(batch->seq_len + extra > batch->seq_capacity)
+  {
+    batch->seq_capacity = MAX(2*batch->seq_capacity, batch->seq_len + extra);
+    batch->seq = realloc(batch->seq, batch->seq_capacity);
+    if(batch->seq == NULL)
+      die("Out of memory allocating sequence batch for loading threads\n");
+  }
+}
+
+static inline void _contig_batch_start_contig(ContigBatch *batch, char *kmer_str,
+                                              short kmer_size, boolean add_covg)
+{
+  if(batch->num_contigs == batch->contigs_capacity)
+  {
+    batch->contigs_capacity *= 2;
+    batch->contigs = realloc(batch->contigs,
+                             batch->contigs_capacity * sizeof(ContigInfo));
+    if(batch->contigs == NULL)
+      die("Out of memory allocating sequence batch for loading threads\n");
+  }
+
+  _contig_batch_ensure_capacity(batch, kmer_size);
+  memcpy(batch->seq + batch->seq_len, kmer_str, kmer_size);
+  batch->seq_len += kmer_size;
+
+  batch->contigs[batch->num_contigs].len = kmer_size;
+  batch->contigs[batch->num_contigs].add_covg = add_covg;
+  batch->num_contigs++;
+}
+
+static inline void _contig_batch_add_base(ContigBatch *batch, char base)
+{
+  _contig_batch_ensure_capacity(batch, 1);
+  batch->seq[batch->seq_len++] = base;
+  batch->contigs[batch->num_contigs-1].len++;
+}
+
+// Kmers are looked up KMER_WINDOW at a time with the batched hash table
+// functions, which prefetch their buckets before searching them
+#define KMER_WINDOW 64
+
+typedef struct
+{
+  BinaryKmer keys[KMER_WINDOW];
+  Orientation orients[KMER_WINDOW]; // of each kmer relative to its key
+  Element *nodes[KMER_WINDOW];
+  boolean found[KMER_WINDOW];
+  boolean starts_contig[KMER_WINDOW], add_covg[KMER_WINDOW];
+  int num_kmers;
+
+  // last node of the previous window, to join an edge to
+  Element *prev_node;
+  Orientation prev_orient;
+  BinaryKmer prev_key;
+  long long generation; // of the table when prev_node was looked up
+} KmerWindow;
+
+static void _kmer_window_flush(KmerWindow *win, dBGraph *db_graph, int colour,
+                               boolean concurrent)
+{
+  short kmer_size = db_graph->kmer_size;
+  Orientation curr_orient;
+  int i;
+
+  if(concurrent)
+  {
+    hash_table_begin_concurrent_inserts(db_graph);
+    hash_table_find_or_insert_batch_concurrent(win->keys, win->num_kmers,
+                                               win->nodes, win->found, db_graph);
+  }
+  else
+    hash_table_find_or_insert_batch(win->keys, win->num_kmers,
+                                    win->nodes, win->found, db_graph);
+
+  // if the table has grown since the last window, its last node has moved
+  if(win->generation != db_graph->generation)
+  {
+    if(!win->starts_contig[0])
+      win->prev_node = hash_table_find(&win->prev_key, db_graph);
+    win->generation = db_graph->generation;
+  }
+
+  for(i = 0; i < win->num_kmers; i++)
+  {
+    curr_orient = win->orients[i];
+
+    if(win->add_covg[i])
+    {
+      if(concurrent)
+        db_node_update_coverage_atomic(win->nodes[i], colour, 1);
+      else
+        db_node_update_coverage(win->nodes[i], colour, 1);
+    }
+
+    if(!win->starts_contig[i])
+    {
+      if(concurrent)
+        db_node_add_edge_atomic(win->prev_node, win->nodes[i], win->prev_orient,
+                                curr_orient, kmer_size, colour);
+      else
+        db_node_add_edge(win->prev_node, win->nodes[i], win->prev_orient,
+                         curr_orient, kmer_size, colour);
+    }
+
+    win->prev_node = win->nodes[i];
+    win->prev_orient = curr_orient;
+  }
+
+  binary_kmer_assignment_operator(win->prev_key, win->keys[win->num_kmers-1]);
+
+  if(concurrent)
+    hash_table_end_concurrent_inserts(db_graph);
+
+  win->num_kmers = 0;
+}
+
+static inline void _kmer_window_add(KmerWindow *win, RollingBinaryKmer *kmer,
+                                    boolean starts_contig, boolean add_covg,
+                                    dBGraph *db_graph, int colour,
+                                    boolean concurrent)
+{
+  int i = win->num_kmers++;
+  BinaryKmer *key = binary_kmer_rolling_get_key(kmer, db_graph->kmer_size,
+                                                &win->orients[i]);
+  binary_kmer_assignment_operator(win->keys[i], *key);
+  win->starts_contig[i] = starts_contig;
+  win->add_covg[i] = add_covg;
+
+  if(win->num_kmers == KMER_WINDOW)
+    _kmer_window_flush(win, db_graph, colour, concurrent);
+}
+
+// Load one batch of contigs into the graph. If concurrent, other loading
+// threads may be updating the graph at the same time
+static void _contig_batch_load(ContigBatch *batch, dBGraph *db_graph, int colour,
+                               boolean concurrent)
+{
+  short kmer_size = db_graph->kmer_size;
+  BinaryKmer curr_kmer;
+  RollingBinaryKmer rolling;
+  KmerWindow win;
+  win.num_kmers = 0;
+  win.generation = 0;
+
+  char *seq = batch->seq;
+  unsigned long c, i;
+
+  for(c = 0; c < batch->num_contigs; c++)
+  {
+    ContigInfo *contig = batch->contigs + c;
+
+    // contigs are not null-terminated, so can't use seq_to_binary_kmer
+    binary_kmer_initialise_to_zero(&curr_kmer);
+    for(i = 0; i < (unsigned long)kmer_size; i++)
+    {
+      binary_kmer_left_shift_one_base_and_insert_new_base_at_right_end(&curr_kmer,
+        char_to_binary_nucleotide(seq[i]), kmer_size);
+    }
+
+    binary_kmer_rolling_set(&rolling, &curr_kmer, kmer_size);
+    _kmer_window_add(&win, &rolling, true, contig->add_covg,
+                     db_graph, colour, concurrent);
+
+    for(i = kmer_size; i < contig->len; i++)
+    {
+      Nucleotide nuc = char_to_binary_nucleotide(seq[i]);
+      binary_kmer_rolling_add_base(&rolling, nuc, kmer_size);
+
+      _kmer_window_add(&win, &rolling, false, true,
+                       db_graph, colour, concurrent);
+    }
+
+    seq += contig->len;
+  }
+
+  if(win.num_kmers > 0)
+    _kmer_window_flush(&win, db_graph, colour, concurrent);
+
+  batch->seq_len = 0;
+  batch->num_contigs = 0;
+}
+
+static void* _seq_loader_thread(void *arg)
+{
+  SeqLoader *loader = (SeqLoader*)arg;
+  ContigBatch *batch;
+
+  while(1)
+  {
+    pthread_mutex_lock(&loader->lock);
+
+    while(loader->num_full == 0 && !loader->finished)
+      pthread_cond_wait(&loader->cond_full, &loader->lock);
+
+    if(loader->num_full == 0)
+    {
+      // finished and nothing left to load
+      pthread_mutex_unlock(&loader->lock);
+      return NULL;
+    }
+
+    batch = loader->full[loader->full_start];
+    loader->full_start = (loader->full_start + 1) % loader->num_batches;
+    loader->num_full--;
+    pthread_mutex_unlock(&loader->lock);
+
+    _contig_batch_load(batch, loader->db_graph, loader->colour, true);
+
+    pthread_mutex_lock(&loader->lock);
+    loader->empty[loader->num_empty++] = batch;
+    pthread_cond_signal(&loader->cond_empty);
+    pthread_mutex_unlock(&loader->lock);
+  }
+}
+
+static SeqLoader* _seq_loader_start(dBGraph *db_graph, int colour,
+                                    int num_threads)
+{
+  SeqLoader *loader = malloc(sizeof(SeqLoader));
+  if(loader == NULL)
+    die("Out of memory allocating loading threads\n");
+
+  loader->db_graph = db_graph;
+  loader->colour = colour;
+  loader->num_threads = num_threads;
+  loader->num_batches = MAX(2 * num_threads, 1);
+  // no worker threads means no thread handles - don't rely on malloc(0)
+  loader->threads = num_threads > 0 ? malloc(num_threads * sizeof(pthread_t))
+                                    : NULL;
+  loader->batches = malloc(loader->num_batches * sizeof(ContigBatch));
+  loader->full = malloc(loader->num_batches * sizeof(ContigBatch*));
+  loader->empty = malloc(loader->num_batches * sizeof(ContigBatch*));
+
+  if((num_threads > 0 && loader->threads == NULL) || loader->batches == NULL ||
+     loader->full == NULL || loader->empty == NULL)
+  {
+    die("Out of memory allocating loading threads\n");
+  }
+
+  int i;
+  for(i = 0; i < loader->num_batches; i++)
+  {
+    ContigBatch *batch = loader->batches + i;
+    batch->seq_capacity = CONTIG_BATCH_BASES;
+    batch->seq = malloc(batch->seq_capacity);
+    batch->seq_len = 0;
+    batch->contigs_capacity = 1024;
+    batch->contigs = malloc(batch->contigs_capacity * sizeof(ContigInfo));
+    batch->num_contigs = 0;
+
+    if(batch->seq == NULL || batch->contigs == NULL)
+      die("Out of memory allocating sequence batch for loading threads\n");
+
+    loader->empty[i] = batch;
+  }
+
+  loader->num_empty = loader->num_batches;
+  loader->full_start = 0;
+  loader->num_full = 0;
+  loader->finished = false;
+
+  pthread_mutex_init(&loader->lock, NULL);
+  pthread_cond_init(&loader->cond_full, NULL);
+  pthread_cond_init(&loader->cond_empty, NULL);
+
+  for(i = 0; i < num_threads; i++)
+  {
+    if(pthread_create(loader->threads + i, NULL, _seq_loader_thread, loader) != 0)
+      die("Unable to create loading thread\n");
+  }
+
+  return loader;
+}
+
+// Wait for an empty batch for the reader to fill
+static ContigBatch* _seq_loader_get_empty_batch(SeqLoader *loader)
+{
+  pthread_mutex_lock(&loader->lock);
+
+  while(loader->num_empty == 0)
+    pthread_cond_wait(&loader->cond_empty, &loader->lock);
+
+  ContigBatch *batch = loader->empty[--loader->num_empty];
+  pthread_mutex_unlock(&loader->lock);
+
+  return batch;
+}
+
+static void _seq_loader_submit_batch(SeqLoader *loader, ContigBatch *batch)
+{
+  if(loader->num_threads == 0)
+  {
+    // no worker threads - load it ourselves
+    _contig_batch_load(batch, loader->db_graph, loader->colour, false);
+    loader->empty[loader->num_empty++] = batch;
+    return;
+  }
+
+  pthread_mutex_lock(&loader->lock);
+  int pos = (loader->full_start + loader->num_full) % loader->num_batches;
+  loader->full[pos] = batch;
+  loader->num_full++;
+  pthread_cond_signal(&loader->cond_full);
+  pthread_mutex_unlock(&loader->lock);
+}
+
+// If the current batch is big enough, hand it to the workers
+static ContigBatch* _seq_loader_maybe_submit_batch(SeqLoader *loader,
+                                                   ContigBatch *batch)
+{
+  if(batch->seq_len < CONTIG_BATCH_BASES)
+    return batch;
+
+  _seq_loader_submit_batch(loader, batch);
+  return _seq_loader_get_empty_batch(loader);
+}
+
+// Submit the last batch, wait for all threads to finish, and free
+static void _seq_loader_finish(SeqLoader *loader, ContigBatch *batch)
+{
+  _seq_loader_submit_batch(loader, batch);
+
+  pthread_mutex_lock(&loader->lock);
+  loader->finished = true;
+  pthread_cond_broadcast(&loader->cond_full);
+  pthread_mutex_unlock(&loader->lock);
+
+  int i;
+  for(i = 0; i < loader->num_threads; i++)
+    pthread_join(loader->threads[i], NULL);
+
+  for(i = 0; i < loader->num_batches; i++)
+  {
+    free(loader->batches[i].seq);
+    free(loader->batches[i].contigs);
+  }
+
+  pthread_mutex_destroy(&loader->lock);
+  pthread_cond_destroy(&loader->cond_full);
+  pthread_cond_destroy(&loader->cond_empty);
+
+  free(loader->threads);
+  free(loader->batches);
+  free(loader->full);
+  free(loader->empty);
+  free(loader);
+}
+
+// If batch is not NULL, the accepted contigs are added to it instead of
+// being loaded into the graph
+static inline void _process_read(SeqFile *sf, char* kmer_str, char* qual_str,
+                                 char quality_cutoff, int homopolymer_cutoff,
+                                 dBGraph *db_graph, int colour_index,
+                                 BinaryKmer curr_kmer, Element *curr_node,
+                                 Orientation curr_orient,
+                                 unsigned long long *bases_loaded,
+                                 unsigned long *readlen_count_array,
+                                 unsigned long readlen_count_array_size,
+                                 ContigBatch *batch)
 {
   // Hash table stuff
   Element *prev_node = NULL; // Element is a hash table entry
   Orientation prev_orient = forward;
   boolean curr_found;
-  BinaryKmer tmp_key;
+  BinaryKmer tmp_key, prev_key;
+  RollingBinaryKmer rolling;
+  BinaryKmer *curr_key;
+  long long generation;
 
   short kmer_size = db_graph->kmer_size;
   char read_qual = seq_has_quality_scores(sf);
@@ -399,7 +809,12 @@ inline void _process_read(SeqFile *sf, char* kmer_str, char* qual_str,
 
   while(keep_reading)
   {
-    if(!is_first_kmer)
+    if(batch != NULL)
+    {
+      // first kmer of read is not yet loaded either
+      _contig_batch_start_contig(batch, kmer_str, kmer_size, true);
+    }
+    else if(!is_first_kmer)
     {
       seq_to_binary_kmer(kmer_str, kmer_size, (BinaryKmer*)curr_kmer);
 
@@ -412,6 +827,9 @@ inline void _process_read(SeqFile *sf, char* kmer_str, char* qual_str,
       db_node_update_coverage(curr_node, colour_index, 1);
     }
 
+    if(batch == NULL)
+      binary_kmer_rolling_set(&rolling, (BinaryKmer*)curr_kmer, kmer_size);
+
     #ifdef DEBUG_CONTIGS
     _print_kmer(curr_kmer, kmer_size);
     #endif
@@ -480,21 +898,31 @@ inline void _process_read(SeqFile *sf, char* kmer_str, char* qual_str,
       prev_orient = curr_orient;
       prev_base = base;
 
-      // Construct new kmer
-      //binary_kmer_assignment_operator(curr_kmer, prev_kmer);
+      if(batch != NULL)
+      {
+        _contig_batch_add_base(batch, base);
+        continue;
+      }
+
+      // Construct new kmer, along with its reverse complement
+      binary_kmer_assignment_operator(prev_key, prev_node->kmer);
       Nucleotide nuc = char_to_binary_nucleotide(base);
-      binary_kmer_left_shift_one_base_and_insert_new_base_at_right_end((BinaryKmer*)curr_kmer,
-                                                                       nuc,
-                                                                       kmer_size);
+      binary_kmer_rolling_add_base(&rolling, nuc, kmer_size);
 
       #ifdef DEBUG_CONTIGS
       printf("%c", base);
       #endif
 
       // Lookup in db
-      element_get_key((BinaryKmer*)curr_kmer, kmer_size, &tmp_key);
-      curr_node = hash_table_find_or_insert(&tmp_key, &curr_found, db_graph);
-      curr_orient = db_node_get_orientation((BinaryKmer*)curr_kmer, curr_node, kmer_size);
+      curr_key = binary_kmer_rolling_get_key(&rolling, kmer_size, &curr_orient);
+      generation = db_graph->generation;
+      curr_node = hash_table_find_or_insert(curr_key, &curr_found, db_graph);
+
+      // the table grew to fit this kmer, so the previous one has moved
+      if(db_graph->generation != generation)
+      {
+        prev_node = hash_table_find(&prev_key, db_graph);
+      }
 
       // Update covg
       db_node_update_coverage(curr_node, colour_index, 1);
@@ -573,6 +1001,17 @@ void load_se_seq_data_into_graph_colour(
   BinaryKmer tmp_key;
   boolean curr_found;
 
+  SeqLoader *loader = NULL;
+  ContigBatch *batch = NULL;
+
+  if(remove_dups_se == false)
+  {
+    // with one thread, batches are loaded by this thread as they fill up
+    loader = _seq_loader_start(db_graph, colour_index,
+                               NUM_THREADS > 1 ? NUM_THREADS : 0);
+    batch = _seq_loader_get_empty_batch(loader);
+  }
+
   while(seq_next_read(sf))
   {
     //printf("Started seq read: %s\n", seq_get_read_name(sf));
@@ -580,6 +1019,28 @@ void load_se_seq_data_into_graph_colour(
     if(_read_first_kmer(sf, kmer_str, qual_str, kmer_size, read_qual,
                         quality_cutoff, homopolymer_cutoff, 0, 0))
     {
+      if(batch != NULL)
+      {
+        // first kmer goes into the graph even if the read is subsampled out
+        if(subsample_func()==true)
+        {
+          _process_read(sf, kmer_str, qual_str,
+                        quality_cutoff, homopolymer_cutoff,
+                        db_graph, colour_index,
+                        curr_kmer, NULL, curr_orient,
+                        bases_loaded,
+                        readlen_count_array, readlen_count_array_size,
+                        batch);
+        }
+        else
+        {
+          _contig_batch_start_contig(batch, kmer_str, kmer_size, false);
+        }
+
+        batch = _seq_loader_maybe_submit_batch(loader, batch);
+        continue;
+      }
+
       // Check if we want this read
       char is_dupe = 0;
 
@@ -628,7 +1089,8 @@ void load_se_seq_data_into_graph_colour(
 			  db_graph, colour_index,
 			  curr_kmer, curr_node, curr_orient,
 			  bases_loaded,
-			  readlen_count_array, readlen_count_array_size);
+			  readlen_count_array, readlen_count_array_size,
+			  NULL);
 	  }
       }
     }
@@ -639,6 +1101,11 @@ void load_se_seq_data_into_graph_colour(
     }
   }
 
+  if(loader != NULL)
+  {
+    _seq_loader_finish(loader, batch);
+  }
+
   // Update with bases read in
   (*bases_read) += seq_total_bases_passed(sf) + seq_total_bases_skipped(sf);
 
@@ -693,6 +1160,18 @@ void load_pe_seq_data_into_graph_colour(
   Orientation curr_orient1 = forward, curr_orient2 = forward;
   BinaryKmer tmp_key;
   boolean curr_found1, curr_found2;
+  long long generation;
+
+  SeqLoader *loader = NULL;
+  ContigBatch *batch = NULL;
+
+  if(remove_dups_pe == false)
+  {
+    // with one thread, batches are loaded by this thread as they fill up
+    loader = _seq_loader_start(db_graph, colour_index,
+                               NUM_THREADS > 1 ? NUM_THREADS : 0);
+    batch = _seq_loader_get_empty_batch(loader);
+  }
 
   while(1)
   {
@@ -718,6 +1197,53 @@ void load_pe_seq_data_into_graph_colour(
     read2 = _read_first_kmer(sf2, kmer_str2, qual_str2, kmer_size, read_qual2,
                              quality_cutoff, homopolymer_cutoff, 0, 0);
 
+    if(batch != NULL)
+    {
+      // Couldn't get a single kmer from read
+      if(!read1)
+        (*bad_reads)++;
+      if(!read2)
+        (*bad_reads)++;
+
+      // first kmers go into the graph even if the pair is subsampled out
+      boolean load_pair = subsample_func();
+
+      if(read1 && load_pair)
+      {
+        _process_read(sf1, kmer_str1, qual_str1,
+                      quality_cutoff, homopolymer_cutoff,
+                      db_graph, colour_index,
+                      curr_kmer1, NULL, curr_orient1,
+                      bases_loaded,
+                      readlen_count_array, readlen_count_array_size,
+                      batch);
+      }
+      else if(read1)
+      {
+        _contig_batch_start_contig(batch, kmer_str1, kmer_size, false);
+      }
+
+      if(read2 && load_pair)
+      {
+        _process_read(sf2, kmer_str2, qual_str2,
+                      quality_cutoff, homopolymer_cutoff,
+                      db_graph, colour_index,
+                      curr_kmer2, NULL, curr_orient2,
+                      bases_loaded,
+                      readlen_count_array, readlen_count_array_size,
+                      batch);
+      }
+      else if(read2)
+      {
+        _contig_batch_start_contig(batch, kmer_str2, kmer_size, false);
+      }
+
+      batch = _seq_loader_maybe_submit_batch(loader, batch);
+      continue;
+    }
+
+    generation = db_graph->generation;
+
     if(read1)
     {
       curr_found1 = false;
@@ -747,6 +1273,13 @@ void load_pe_seq_data_into_graph_colour(
       element_get_key(&curr_kmer2, kmer_size, &tmp_key);
       curr_node2 = hash_table_find_or_insert(&tmp_key, &curr_found2, db_graph);
       curr_orient2 = db_node_get_orientation(&curr_kmer2, curr_node2, kmer_size);
+
+      // the table grew to fit the second kmer, so the first has moved
+      if(read1 && db_graph->generation != generation)
+      {
+        curr_node1 = hash_table_find(element_get_key(&curr_kmer1, kmer_size, &tmp_key),
+                                     db_graph);
+      }
     }
     else
     {
@@ -809,11 +1342,19 @@ void load_pe_seq_data_into_graph_colour(
 			    db_graph, colour_index,
 			    curr_kmer1, curr_node1, curr_orient1,
 			    bases_loaded,
-			    readlen_count_array, readlen_count_array_size);
+			    readlen_count_array, readlen_count_array_size,
+			    NULL);
 	    }
 	  
 	  if(read2)
 	    {
+	      // loading the first read may have grown the table
+	      if(db_graph->generation != generation)
+		{
+		  curr_node2 = hash_table_find(element_get_key(&curr_kmer2, kmer_size, &tmp_key),
+					       db_graph);
+		}
+
 	      // Update coverage
 	      db_node_update_coverage(curr_node2, colour_index, 1);
 	      
@@ -822,13 +1363,19 @@ void load_pe_seq_data_into_graph_colour(
 			    db_graph, colour_index,
 			    curr_kmer2, curr_node2, curr_orient2,
 			    bases_loaded,
-			    readlen_count_array, readlen_count_array_size);
+			    readlen_count_array, readlen_count_array_size,
+			    NULL);
 	    }
 	}
 
     }
   }
 
+  if(loader != NULL)
+  {
+    _seq_loader_finish(loader, batch);
+  }
+
   // Update with bases read in
   (*bases_read) += seq_total_bases_passed(sf1) + seq_total_bases_skipped(sf1) +
                    seq_total_bases_passed(sf2) + seq_total_bases_skipped(sf2);
@@ -1148,45 +1695,254 @@ void load_pe_filelists_into_graph_colour(
 
 
 //
-// End of loading sequence data
+// Estimating the number of distinct kmers in sequence data, to size the hash
+// table before loading it. Reads go through exactly the filters loading uses
+// (_process_read into a ContigBatch), and the kmers of the accepted contigs are
+// added to a sketch. Every read is used: the kmers of sequencing errors grow
+// with the amount of data, so a sample from the start of the data would not
+// extrapolate. Files are sketched in parallel, and the sketches merged.
 //
 
+typedef struct
+{
+  char **paths;
+  int num_paths, next_path;
+  int next_thread;
+  short kmer_size;
+  char quality_cutoff;
+  int homopolymer_cutoff;
+  KmerSketch *sketches; // one per thread
+} SketchFiles;
+
+static void _contig_batch_add_to_sketch(ContigBatch *batch, short kmer_size,
+                                        KmerSketch *sketch)
+{
+  BinaryKmer curr_kmer, key;
+  char *seq = batch->seq;
+  unsigned long c, i;
 
-void initialise_binary_header_info(BinaryHeaderInfo* binfo, GraphInfo* ginfo)
+  for(c = 0; c < batch->num_contigs; c++)
+  {
+    binary_kmer_initialise_to_zero(&curr_kmer);
+
+    for(i = 0; i < batch->contigs[c].len; i++)
+    {
+      binary_kmer_left_shift_one_base_and_insert_new_base_at_right_end(&curr_kmer,
+        char_to_binary_nucleotide(seq[i]), kmer_size);
+
+      if(i+1 >= (unsigned long)kmer_size)
+        kmer_sketch_add(sketch, element_get_key(&curr_kmer, kmer_size, &key));
+    }
+
+    seq += batch->contigs[c].len;
+  }
+
+  batch->seq_len = 0;
+  batch->num_contigs = 0;
+}
+
+static void _add_seq_file_to_sketch(const char *path, short kmer_size,
+                                    char quality_cutoff, int homopolymer_cutoff,
+                                    KmerSketch *sketch)
 {
-  binfo->version=0;
-  binfo->kmer_size=0;
-  binfo->number_of_bitfields=0;
-  binfo->number_of_colours=0;
-  binfo->ginfo=ginfo;
+  SeqFile *sf = seq_file_open(path);
+
+  if(sf == NULL)
+    die("Couldn't open sequence file '%s'\n", path);
+
+  char read_qual = seq_has_quality_scores(sf);
+  char kmer_str[kmer_size+1], qual_str[kmer_size+1];
+  BinaryKmer curr_kmer;
+  unsigned long long bases_loaded = 0;
+
+  // reads are only put in the batch, for which _process_read just needs the kmer size
+  dBGraph no_graph;
+  no_graph.kmer_size = kmer_size;
+
+  ContigBatch batch;
+  batch.seq_capacity = CONTIG_BATCH_BASES;
+  batch.seq = malloc(batch.seq_capacity);
+  batch.seq_len = 0;
+  batch.contigs_capacity = 1024;
+  batch.contigs = malloc(batch.contigs_capacity * sizeof(ContigInfo));
+  batch.num_contigs = 0;
+
+  if(batch.seq == NULL || batch.contigs == NULL)
+    die("Out of memory allocating sequence batch to estimate kmers\n");
+
+  while(seq_next_read(sf))
+  {
+    if(_read_first_kmer(sf, kmer_str, qual_str, kmer_size, read_qual,
+                        quality_cutoff, homopolymer_cutoff, 0, 0))
+    {
+      _process_read(sf, kmer_str, qual_str,
+                    quality_cutoff, homopolymer_cutoff,
+                    &no_graph, 0,
+                    curr_kmer, NULL, forward,
+                    &bases_loaded, NULL, 0,
+                    &batch);
+
+      if(batch.seq_len >= CONTIG_BATCH_BASES)
+        _contig_batch_add_to_sketch(&batch, kmer_size, sketch);
+    }
+  }
+
+  _contig_batch_add_to_sketch(&batch, kmer_size, sketch);
+
+  free(batch.seq);
+  free(batch.contigs);
+  seq_file_close(sf);
 }
 
+static void* _sketch_files_thread(void *arg)
+{
+  SketchFiles *files = (SketchFiles*)arg;
+  int thread = __atomic_fetch_add(&files->next_thread, 1, __ATOMIC_RELAXED);
+  KmerSketch *sketch = files->sketches + thread;
+  int i;
 
-//do not export the folloiwing internal function
-// this is called repeatedly in a loop.  read_len_count_array is used to collect
-// statistics on the length of reads, and needs to allow for the fact that we
-// CUT reads at N's, low quality bases
-void  load_kmers_from_sliding_window_into_graph_marking_read_starts_of_specific_person_or_pop(
-  KmerSlidingWindowSet * windows, boolean* prev_full_ent, //boolean* full_ent,
-  long long* bases_loaded, boolean mark_read_starts, dBGraph* db_graph,
-  int index, long long** read_len_count_array)
+  while((i = __atomic_fetch_add(&files->next_path, 1, __ATOMIC_RELAXED)) < files->num_paths)
+  {
+    _add_seq_file_to_sketch(files->paths[i], files->kmer_size, files->quality_cutoff,
+                            files->homopolymer_cutoff, sketch);
+  }
+
+  return NULL;
+}
+
+// filelists is a NULL-terminated list of lists of sequence files
+long long estimate_distinct_kmers_in_filelists(char **filelists, short kmer_size,
+                                               int qual_thresh, int homopol_limit,
+                                               char ascii_fq_offset)
 {
-  long long total_bases_loaded=0;
+  char absolute_path[PATH_MAX+1];
+  SketchFiles files;
+  int capacity = 16, i;
 
-  Element * current_node  = NULL;
-  Element * previous_node  = NULL;
-  Orientation current_orientation=forward;
-  Orientation previous_orientation=forward;
-  BinaryKmer tmp_kmer;
-  int i,j;
+  files.num_paths = 0;
+  files.paths = malloc(capacity * sizeof(char*));
+  files.kmer_size = kmer_size;
+  files.quality_cutoff = qual_thresh + ascii_fq_offset;
+  files.homopolymer_cutoff = homopol_limit;
 
-      for(i=0;i<windows->nwindows;i++){ //for each window
-	KmerSlidingWindow * current_window = &(windows->window[i]);
-	
-	//update total bases loaded
-	long long length_this_window = (long long) (current_window->nkmers+db_graph->kmer_size-1);
-	total_bases_loaded+=length_this_window;
-	
+  for(; *filelists != NULL; filelists++)
+  {
+    char *list_path = realpath(*filelists, absolute_path);
+    FILE *list_file = list_path == NULL ? NULL : fopen(list_path, "r");
+
+    if(list_file == NULL)
+      die("Cannot open filelist of sequence files: %s\n", *filelists);
+
+    StrBuf *dir = file_reader_get_strbuf_of_dir_path(list_path);
+    StrBuf *line = strbuf_new();
+
+    while(strbuf_reset_readline(line, list_file))
+    {
+      strbuf_chomp(line);
+
+      if(strbuf_len(line) == 0)
+        continue;
+
+      // Get paths relative to filelist dir
+      if(strbuf_get_char(line, 0) != '/')
+        strbuf_insert(line, 0, dir, 0, strbuf_len(dir));
+
+      if(realpath(line->buff, absolute_path) == NULL)
+        die("Cannot find sequence file: %s\n", line->buff);
+
+      if(files.num_paths == capacity)
+      {
+        capacity *= 2;
+        files.paths = realloc(files.paths, capacity * sizeof(char*));
+      }
+      if(files.paths == NULL)
+        die("Out of memory reading filelist %s\n", *filelists);
+
+      files.paths[files.num_paths++] = strdup(absolute_path);
+    }
+
+    strbuf_free(line);
+    strbuf_free(dir);
+    fclose(list_file);
+  }
+
+  int num_threads = MAX(MIN(NUM_THREADS, files.num_paths), 1);
+  pthread_t threads[num_threads];
+
+  files.next_path = 0;
+  files.next_thread = 0;
+  files.sketches = malloc(num_threads * sizeof(KmerSketch));
+
+  if(files.sketches == NULL)
+    die("Out of memory allocating kmer sketches\n");
+
+  for(i = 0; i < num_threads; i++)
+    kmer_sketch_initialise(files.sketches + i);
+
+  for(i = 1; i < num_threads; i++)
+  {
+    if(pthread_create(threads + i, NULL, _sketch_files_thread, &files) != 0)
+      die("Unable to create thread to estimate kmers\n");
+  }
+
+  _sketch_files_thread(&files);
+
+  for(i = 1; i < num_threads; i++)
+  {
+    pthread_join(threads[i], NULL);
+    kmer_sketch_merge(files.sketches, files.sketches + i);
+  }
+
+  long long estimate = kmer_sketch_estimate(files.sketches);
+
+  for(i = 0; i < files.num_paths; i++)
+    free(files.paths[i]);
+  free(files.paths);
+  free(files.sketches);
+
+  return estimate;
+}
+
+//
+// End of loading sequence data
+//
+
+
+void initialise_binary_header_info(BinaryHeaderInfo* binfo, GraphInfo* ginfo)
+{
+  binfo->version=0;
+  binfo->kmer_size=0;
+  binfo->number_of_bitfields=0;
+  binfo->number_of_colours=0;
+  binfo->ginfo=ginfo;
+}
+
+
+//do not export the folloiwing internal function
+// this is called repeatedly in a loop.  read_len_count_array is used to collect
+// statistics on the length of reads, and needs to allow for the fact that we
+// CUT reads at N's, low quality bases
+void  load_kmers_from_sliding_window_into_graph_marking_read_starts_of_specific_person_or_pop(
+  KmerSlidingWindowSet * windows, boolean* prev_full_ent, //boolean* full_ent,
+  long long* bases_loaded, boolean mark_read_starts, dBGraph* db_graph,
+  int index, long long** read_len_count_array)
+{
+  long long total_bases_loaded=0;
+
+  Element * current_node  = NULL;
+  Element * previous_node  = NULL;
+  Orientation current_orientation=forward;
+  Orientation previous_orientation=forward;
+  BinaryKmer tmp_kmer;
+  int i,j;
+
+      for(i=0;i<windows->nwindows;i++){ //for each window
+	KmerSlidingWindow * current_window = &(windows->window[i]);
+	
+	//update total bases loaded
+	long long length_this_window = (long long) (current_window->nkmers+db_graph->kmer_size-1);
+	total_bases_loaded+=length_this_window;
+	
 	if (read_len_count_array !=NULL)
 	  {
 	    //log that we have loaded a "read" of this length, provided it is not the last window - the last window length we will return, so  it can be cumulated, in case this is a long read
@@ -1717,6 +2473,166 @@ int load_seq_into_array(FILE* chrom_fptr, int number_of_nodes_to_load, int lengt
 }
 
 
+//
+// Memory-mapped reading of binaries
+//
+// Once the header has been parsed (with the FILE*), the records are all the same
+// size, so we map the file and walk them in place instead of doing three freads
+// per record. Falls back to fread if the file can't be mapped (eg a pipe).
+// Version 7 binaries are compressed blocks, which are decoded (in parallel, if
+// there are threads to spare) into version 6 records and walked the same way.
+
+typedef struct
+{
+  char *map;
+  size_t map_len;
+  const char *next, *end;
+  size_t record_size;
+  int num_colours;
+  BinaryBlockReader *blocks; // NULL unless version 7
+  BinaryBlockReader block_reader;
+} BinaryRecordMap;
+
+// Map the rest of fp, which must be positioned just after the binary header
+static boolean _binary_map_open(BinaryRecordMap *bmap, FILE *fp, char *filename,
+                                int num_colours_in_binary, int version, int num_threads)
+{
+  struct stat st;
+  long data_start = ftell(fp);
+
+  bmap->map = NULL;
+  bmap->blocks = NULL;
+  bmap->num_colours = num_colours_in_binary;
+  bmap->record_size = sizeof(bitfield_of_64bits)*NUMBER_OF_BITFIELDS_IN_BINARY_KMER
+                      + num_colours_in_binary * (sizeof(uint32_t) + sizeof(Edges));
+
+  if(data_start < 0 || fstat(fileno(fp), &st) != 0 || !S_ISREG(st.st_mode))
+  {
+    if(version >= 7)
+      die("Binary %s is compressed (version %d) and can only be read from a regular file\n",
+          filename, version);
+    return false;
+  }
+
+  if(version >= 7)
+  {
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    if(map == MAP_FAILED)
+      die("Unable to map compressed binary %s\n", filename);
+
+    bmap->map = map;
+    bmap->map_len = st.st_size;
+    bmap->next = bmap->end = NULL;
+    bmap->blocks = &bmap->block_reader;
+    binary_block_reader_open(bmap->blocks, bmap->map, bmap->map_len, data_start,
+                             num_colours_in_binary, num_threads, filename);
+    return true;
+  }
+
+  if((st.st_size - data_start) % bmap->record_size != 0)
+  {
+    die("Binary %s is truncated or corrupt - the data after the header is not a whole number of records\n",
+        filename);
+  }
+
+  bmap->map_len = st.st_size;
+
+  if(st.st_size == data_start)
+  {
+    // no records
+    bmap->next = bmap->end = NULL;
+    return true;
+  }
+
+  void *map = mmap(NULL, bmap->map_len, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+  if(map == MAP_FAILED)
+    return false;
+
+  madvise(map, bmap->map_len, MADV_SEQUENTIAL);
+
+  bmap->map = map;
+  bmap->next = bmap->map + data_start;
+  bmap->end = bmap->map + bmap->map_len;
+  return true;
+}
+
+static void _binary_map_close(BinaryRecordMap *bmap)
+{
+  if(bmap->blocks != NULL)
+    binary_block_reader_close(bmap->blocks);
+  bmap->blocks = NULL;
+  if(bmap->map != NULL)
+    munmap(bmap->map, bmap->map_len);
+  bmap->map = NULL;
+}
+
+// Records are packed, so fields are generally unaligned - memcpy them out
+static inline const char* _binary_map_next_record(BinaryRecordMap *bmap, BinaryKmer *kmer)
+{
+  if(bmap->next == bmap->end)
+  {
+    if(bmap->blocks == NULL)
+      return NULL;
+
+    // decode the next block(s)
+    size_t len = binary_block_reader_next(bmap->blocks, &bmap->next);
+    if(len == 0)
+      return NULL;
+    bmap->end = bmap->next + len;
+  }
+
+  const char *rec = bmap->next;
+  bmap->next += bmap->record_size;
+  memcpy(kmer, rec, sizeof(bitfield_of_64bits)*NUMBER_OF_BITFIELDS_IN_BINARY_KMER);
+  return rec + sizeof(bitfield_of_64bits)*NUMBER_OF_BITFIELDS_IN_BINARY_KMER;
+}
+
+// As db_node_read_multicolour_binary
+static boolean _binary_map_read_multicolour(BinaryRecordMap *bmap, short kmer_size,
+                                            dBNode *node)
+{
+  BinaryKmer kmer;
+  const char *covgs = _binary_map_next_record(bmap, &kmer);
+
+  if(covgs == NULL)
+    return false;
+
+  const char *edges = covgs + bmap->num_colours * sizeof(uint32_t);
+  element_set_kmer(node, &kmer, kmer_size);
+
+  int i;
+  for(i = 0; i < bmap->num_colours; i++)
+  {
+    uint32_t covg;
+    memcpy(&covg, covgs + i*sizeof(uint32_t), sizeof(uint32_t));
+    db_node_set_coverage(node, i, covg);
+    node->individual_edges[i] = edges[i];
+  }
+
+  return true;
+}
+
+// As db_node_read_single_colour_binary
+static boolean _binary_map_read_single_colour(BinaryRecordMap *bmap, short kmer_size,
+                                              dBNode *node, int colour)
+{
+  BinaryKmer kmer;
+  const char *covg_ptr = _binary_map_next_record(bmap, &kmer);
+
+  if(covg_ptr == NULL)
+    return false;
+
+  uint32_t covg;
+  memcpy(&covg, covg_ptr, sizeof(uint32_t));
+
+  element_set_kmer(node, &kmer, kmer_size);
+  db_node_set_coverage(node, colour, covg);
+  node->individual_edges[colour] = covg_ptr[sizeof(uint32_t)];
+  db_node_action_set_status_none(node);
+
+  return true;
+}
+
 //returns number of kmers loaded*kmer_length
  //array_mean_readlens and array_total_seqs are arrays of length NUMBER_OF_COLOURS, so they can hold the mean read length+total seq in every colour
 long long load_multicolour_binary_from_filename_into_graph(char* filename,  dBGraph* db_graph, GraphInfo* ginfo, int* num_cols_in_loaded_binary) 
@@ -1752,8 +2668,13 @@ long long load_multicolour_binary_from_filename_into_graph(char* filename,  dBGr
       *num_cols_in_loaded_binary = binfo.number_of_colours;
     }
 
+  BinaryRecordMap bmap;
+  boolean mapped = _binary_map_open(&bmap, fp_bin, filename, *num_cols_in_loaded_binary,
+				    binfo.version, NUM_THREADS);
+
   //always reads the multicol binary into successive colours starting from 0 - assumes the hash table is empty prior to this
-  while (db_node_read_multicolour_binary(fp_bin,db_graph->kmer_size,&node_from_file, *num_cols_in_loaded_binary, binfo.version)){
+  while (mapped ? _binary_map_read_multicolour(&bmap, db_graph->kmer_size, &node_from_file)
+	 : db_node_read_multicolour_binary(fp_bin,db_graph->kmer_size,&node_from_file, *num_cols_in_loaded_binary, binfo.version)){
     count++;
     
     dBNode * current_node  = NULL;
@@ -1772,40 +2693,53 @@ long long load_multicolour_binary_from_filename_into_graph(char* filename,  dBGr
 
   }
   
+  _binary_map_close(&bmap);
   fclose(fp_bin);
   return seq_length;
 }
 
 
 
-// this is not a special case of load_multicolour..!
-// In some special cases (eg if you have pooled individuals and cleaned the graph, dumped a binary, and then reloaded  that in colour 0,
-// and now want to load binaries into colour 1 only if the kmer is in the (cleaned) colour 0),
-// then we set only_load_kmers_already_in_hash==true. In this case, we only load edges in that overlap with the cleaned graph, in colour_clean
-long long load_single_colour_binary_data_from_filename_into_graph(char* filename,  dBGraph* db_graph, 
-								  GraphInfo* ginfo,
-								  boolean all_entries_are_unique, int colour_loading_into,
-								  boolean only_load_kmers_already_in_hash, int colour_clean,
-								  boolean load_all_kmers_but_only_increment_covg_on_new_ones)
-								  //last arg is to load the "union" of two graphs.)
+dBGraph* load_graph_image(char* filename, short kmer_size, GraphInfo* ginfo, int* num_cols_in_loaded_binary)
 {
+  FILE* fp = fopen(filename, "r");
+  if (fp == NULL){
+    die("load_graph_image cannot open file:%s\n",filename); 
+  }
 
-  if ( (only_load_kmers_already_in_hash==true) && (colour_clean>=NUMBER_OF_COLOURS) )
+  BinaryHeaderErrorCode ecode = EValid;
+  BinaryHeaderInfo binfo;
+  initialise_binary_header_info(&binfo, ginfo);
+
+  if (!(check_binary_signature_NEW(fp, kmer_size, &binfo, &ecode, 0)))
     {
-      die("Called load_single_colour_binary_data_from_filename_into_graph and specified as clean-colour, colour %d, when this executable is compiled for %d colours only. Exit.\n", colour_clean, NUMBER_OF_COLOURS);
+      die("Cannot load this graph image(%s) - signature check fails. Wrong max kmer, "
+          "number of colours, or binary version. Exiting, error code %d\n", 
+	  filename, ecode);
     }
+  *num_cols_in_loaded_binary = binfo.number_of_colours;
+  long long offset = ftell(fp);
+  fclose(fp);
 
-  /* COMMENT_OUT_DURING_TESTS 
-  printf("Open single colour binary: %s\n", filename);
-    */
+  dBGraph* db_graph = hash_table_open_image(filename, offset);
+  if (db_graph == NULL)
+    {
+      die("Unable to open the graph image %s - dump it again from a binary with this executable\n", filename);
+    }
+  if (db_graph->kmer_size != kmer_size)
+    {
+      die("The graph image %s has kmer size %d, not %d\n", filename, db_graph->kmer_size, kmer_size);
+    }
+  return db_graph;
+}
 
-  FILE* fp_bin = fopen(filename, "r");
-  long long  seq_length = 0;
-  dBNode tmp_node;
-  element_initialise_kmer_covgs_edges_and_status_to_zero(&tmp_node);
+#define BINARY_NODE_BATCH 1024
 
-  boolean found;
-  int count=0;
+// Open a single colour binary and check its header, leaving fp just after the header
+static FILE* open_single_colour_binary(char* filename, dBGraph* db_graph, GraphInfo* ginfo,
+				       BinaryHeaderInfo* binfo, int colour_loading_into)
+{
+  FILE* fp_bin = fopen(filename, "r");
 
   if (fp_bin == NULL)
     {
@@ -1814,70 +2748,193 @@ long long load_single_colour_binary_data_from_filename_into_graph(char* filename
     }
 
   BinaryHeaderErrorCode ecode=EValid;
-  BinaryHeaderInfo binfo;
-  initialise_binary_header_info(&binfo, ginfo);
+  initialise_binary_header_info(binfo, ginfo);
 
   //this function call gets the binary header info, and puts it into the binf
-  if (!(check_binary_signature_NEW(fp_bin, db_graph->kmer_size, &binfo, &ecode, colour_loading_into)))
+  if (!(check_binary_signature_NEW(fp_bin, db_graph->kmer_size, binfo, &ecode, colour_loading_into)))
     {
       die("Cannot load this binary - fails signature check with error code %d. Exiting.\n", ecode);
     }
 
-  if (binfo.number_of_colours!=1)
+  if (binfo->number_of_colours!=1)
+    {
+      die("Expecting a single colour binary, but instead this one has %d colours\n. Exiting.\n", binfo->number_of_colours);
+    }
+
+  return fp_bin;
+}
+
+static void print_binary_load_time(char* filename, int colour, long long num_records,
+				   struct timespec* start, struct timespec* end)
+{
+  double secs = (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+  printf("Loaded %s into colour %d: %qd records in %.2f seconds (%.0f records/sec)\n",
+	 filename, colour, num_records, secs, secs > 0 ? num_records / secs : 0);
+}
+
+// this is not a special case of load_multicolour..!
+// In some special cases (eg if you have pooled individuals and cleaned the graph, dumped a binary, and then reloaded  that in colour 0,
+// and now want to load binaries into colour 1 only if the kmer is in the (cleaned) colour 0),
+// then we set only_load_kmers_already_in_hash==true. In this case, we only load edges in that overlap with the cleaned graph, in colour_clean
+static long long _load_single_colour_binary_data_from_filename_into_graph(char* filename,  dBGraph* db_graph, 
+									 GraphInfo* ginfo,
+									 boolean all_entries_are_unique, int colour_loading_into,
+									 boolean only_load_kmers_already_in_hash, int colour_clean,
+									 boolean load_all_kmers_but_only_increment_covg_on_new_ones,
+									 long long* num_records)
+{
+
+  if ( (only_load_kmers_already_in_hash==true) && (colour_clean>=NUMBER_OF_COLOURS) )
     {
-      die("Expecting a single colour binary, but instead this one has %d colours\n. Exiting.\n", binfo.number_of_colours);
+      die("Called load_single_colour_binary_data_from_filename_into_graph and specified as clean-colour, colour %d, when this executable is compiled for %d colours only. Exit.\n", colour_clean, NUMBER_OF_COLOURS);
     }
+
+  /* COMMENT_OUT_DURING_TESTS 
+  printf("Open single colour binary: %s\n", filename);
+    */
+
+  long long  seq_length = 0;
+  BinaryHeaderInfo binfo;
+  FILE* fp_bin = open_single_colour_binary(filename, db_graph, ginfo, &binfo, colour_loading_into);
   
   //Go through all the entries in the binary file
   // each time you load the info into a temporary node, and load them *** into colour number colour_loading_into ***
-  while (db_node_read_single_colour_binary(fp_bin,db_graph->kmer_size,&tmp_node, colour_loading_into, binfo.version))
+  // Nodes are read BINARY_NODE_BATCH at a time, so the hash table lookups can be batched
+  dBNode* tmp_nodes = malloc(BINARY_NODE_BATCH * sizeof(dBNode));
+  BinaryKmer* keys = malloc(BINARY_NODE_BATCH * sizeof(BinaryKmer));
+  dBNode** current_nodes = malloc(BINARY_NODE_BATCH * sizeof(dBNode*));
+  boolean* found = malloc(BINARY_NODE_BATCH * sizeof(boolean));
+
+  if ( (tmp_nodes==NULL) || (keys==NULL) || (current_nodes==NULL) || (found==NULL) )
     {
-      count++;
-      found=false;//zam just added this
-      dBNode * current_node  = NULL;
-      BinaryKmer tmp_kmer;
+      die("Unable to malloc buffers for loading binary %s\n", filename);
+    }
+
+  int i;
+  for (i=0; i<BINARY_NODE_BATCH; i++)
+    {
+      element_initialise_kmer_covgs_edges_and_status_to_zero(&tmp_nodes[i]);
+    }
+
+  BinaryRecordMap bmap;
+  boolean mapped = _binary_map_open(&bmap, fp_bin, filename, 1, binfo.version, NUM_THREADS);
+
+  int num_nodes;
+  do
+    {
+      num_nodes=0;
+      while ( (num_nodes<BINARY_NODE_BATCH) && 
+	      (mapped ? _binary_map_read_single_colour(&bmap, db_graph->kmer_size, &tmp_nodes[num_nodes], colour_loading_into)
+	       : db_node_read_single_colour_binary(fp_bin,db_graph->kmer_size,&tmp_nodes[num_nodes], colour_loading_into, binfo.version)) )
+	{
+	  element_get_key(element_get_kmer(&tmp_nodes[num_nodes]),db_graph->kmer_size, &keys[num_nodes]);
+	  found[num_nodes]=false;
+	  num_nodes++;
+	}
+      *num_records += num_nodes;
+
       if (only_load_kmers_already_in_hash==false) //normal case
 	{
 	  if (!all_entries_are_unique)
 	    {
-	      current_node = hash_table_find_or_insert(element_get_key(element_get_kmer(&tmp_node),db_graph->kmer_size, &tmp_kmer),&found,db_graph);
+	      hash_table_find_or_insert_batch(keys, num_nodes, current_nodes, found, db_graph);
 	    }
 	  else
 	    {
-	      current_node = hash_table_insert(element_get_key(element_get_kmer(&tmp_node),db_graph->kmer_size, &tmp_kmer), db_graph);
-	    }
-	  seq_length+=db_graph->kmer_size;
-	  add_edges(current_node, colour_loading_into, get_edge_copy(tmp_node, colour_loading_into));
-	  if ( (load_all_kmers_but_only_increment_covg_on_new_ones==false)//usual case
-	       ||
-	       ( (load_all_kmers_but_only_increment_covg_on_new_ones==true) && (found==false)) //loading union, and this is new
-	       
-	       )
-	    {
-	      db_node_update_coverage(current_node, colour_loading_into, db_node_get_coverage(&tmp_node,colour_loading_into) );
+	      hash_table_insert_batch(keys, num_nodes, current_nodes, db_graph);
 	    }
 	}
       else
-	{//check if node exists in hash already. If yes, then load edge and covg info into the appropriate colour
-	  current_node = hash_table_find(element_get_key(element_get_kmer(&tmp_node),db_graph->kmer_size, &tmp_kmer), db_graph);
-	  if (current_node !=NULL)
+	{
+	  hash_table_find_batch(keys, num_nodes, current_nodes, db_graph);
+	}
+
+      for (i=0; i<num_nodes; i++)
+	{
+	  dBNode * current_node = current_nodes[i];
+
+	  if (only_load_kmers_already_in_hash==false) //normal case
 	    {
-	      Edges pre_existing_edge = get_edge_copy(*current_node, colour_clean);
-	      Edges edge_from_binary  = get_edge_copy(tmp_node, colour_loading_into);
-	      Edges edge_to_load = pre_existing_edge & edge_from_binary; //only load edge from binary if is in the cleaned colour also.
-	      add_edges(current_node, colour_loading_into,edge_to_load);
-	      db_node_update_coverage(current_node, colour_loading_into, db_node_get_coverage(&tmp_node,colour_loading_into));
+	      seq_length+=db_graph->kmer_size;
+	      add_edges(current_node, colour_loading_into, get_edge_copy(tmp_nodes[i], colour_loading_into));
+	      if ( (load_all_kmers_but_only_increment_covg_on_new_ones==false)//usual case
+		   ||
+		   ( (load_all_kmers_but_only_increment_covg_on_new_ones==true) && (found[i]==false)) //loading union, and this is new
+		   
+		   )
+		{
+		  db_node_update_coverage(current_node, colour_loading_into, db_node_get_coverage(&tmp_nodes[i],colour_loading_into) );
+		}
+	    }
+	  else
+	    {//check if node exists in hash already. If yes, then load edge and covg info into the appropriate colour
+	      if (current_node !=NULL)
+		{
+		  Edges pre_existing_edge = get_edge_copy(*current_node, colour_clean);
+		  Edges edge_from_binary  = get_edge_copy(tmp_nodes[i], colour_loading_into);
+		  Edges edge_to_load = pre_existing_edge & edge_from_binary; //only load edge from binary if is in the cleaned colour also.
+		  add_edges(current_node, colour_loading_into,edge_to_load);
+		  db_node_update_coverage(current_node, colour_loading_into, db_node_get_coverage(&tmp_nodes[i],colour_loading_into));
+		}
 	    }
 	}
+    } while (num_nodes==BINARY_NODE_BATCH);
 
-    }
+  _binary_map_close(&bmap);
+  free(tmp_nodes);
+  free(keys);
+  free(current_nodes);
+  free(found);
 
   fclose(fp_bin);
   return seq_length;
 
 }
 
+long long load_single_colour_binary_data_from_filename_into_graph(char* filename,  dBGraph* db_graph, 
+								  GraphInfo* ginfo,
+								  boolean all_entries_are_unique, int colour_loading_into,
+								  boolean only_load_kmers_already_in_hash, int colour_clean,
+								  boolean load_all_kmers_but_only_increment_covg_on_new_ones)
+								  //last arg is to load the "union" of two graphs.)
+{
+  long long num_records = 0;
+  return _load_single_colour_binary_data_from_filename_into_graph(filename, db_graph, ginfo, all_entries_are_unique,
+								  colour_loading_into, only_load_kmers_already_in_hash,
+								  colour_clean, load_all_kmers_but_only_increment_covg_on_new_ones,
+								  &num_records);
+}
+
+
+
+// Returns the absolute path of the next binary listed in a ctxlist, or NULL at the end.
+// Relative paths are relative to the ctxlist's directory, dir
+static char* next_binary_in_ctxlist(FILE* fptr, StrBuf* dir, StrBuf* line, char* absolute_path)
+{
+  while(strbuf_reset_readline(line, fptr))
+  {
+    strbuf_chomp(line);
+
+    if(strbuf_len(line) > 0)
+    {
+      // Get paths relative to filelist dir
+      if(strbuf_get_char(line, 0) != '/')
+        strbuf_insert(line, 0, dir, 0, strbuf_len(dir));
+
+      // Get absolute paths
+      char* path_ptr = realpath(line->buff, absolute_path);
+      
+      if(path_ptr == NULL)
+      {
+        die("Cannot find .ctx binary: %s\n", line->buff);
+      }
+
+      return path_ptr;
+    }
+  }
 
+  return NULL;
+}
 
 //ordinarily, only_load_kmers_already_in_hash==false, and colour_clean is ignored.
 // If you have a clean graph in colour 0, and you only want to load nodes from the binaries that overlap with this,
@@ -1919,54 +2976,41 @@ long long load_all_binaries_for_given_person_given_filename_of_file_listing_thei
   //file contains a list of .ctx filenames
   StrBuf *line = strbuf_new();
 
-  int total_seq_loaded = 0;
+  long long total_seq_loaded = 0;
   GraphInfo* local_ginfo = graph_info_alloc_and_init();
 
-  while(strbuf_reset_readline(line, fptr))
-  {
-    strbuf_chomp(line);
-
-    if(strbuf_len(line) > 0)
-    {
-      // Get paths relative to filelist dir
-      if(strbuf_get_char(line, 0) != '/')
-        strbuf_insert(line, 0, dir, 0, strbuf_len(dir));
-
-      // Get absolute paths
-      char* path_ptr = realpath(line->buff, absolute_path);
-      
-      if(path_ptr == NULL)
-      {
-        die("Cannot find .ctx binary: %s\n", line->buff);
-      }
+  char* path_ptr;
 
-      //printf("Load this binary: %s, into this colour : %d\n", line->buff, colour_loading_into);
-      
-      BinaryHeaderErrorCode ecode=EValid;
-      BinaryHeaderInfo binfo;
-      initialise_binary_header_info(&binfo, local_ginfo);
-      total_seq_loaded += 
-        load_single_colour_binary_data_from_filename_into_graph(path_ptr, db_graph,
-								local_ginfo,
-								all_entries_are_unique, colour_loading_into,
-								only_load_kmers_already_in_hash, colour_clean,
-								load_all_kmers_but_only_increment_covg_on_new_ones);
-      
-      all_entries_are_unique = false;
+  while((path_ptr = next_binary_in_ctxlist(fptr, dir, line, absolute_path)) != NULL)
+  {
+    //printf("Load this binary: %s, into this colour : %d\n", line->buff, colour_loading_into);
+    
+    struct timespec start, end;
+    long long num_records = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    total_seq_loaded += 
+      _load_single_colour_binary_data_from_filename_into_graph(path_ptr, db_graph,
+								 local_ginfo,
+								 all_entries_are_unique, colour_loading_into,
+								 only_load_kmers_already_in_hash, colour_clean,
+								 load_all_kmers_but_only_increment_covg_on_new_ones,
+								 &num_records);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    print_binary_load_time(path_ptr, colour_loading_into, num_records, &start, &end);
+    
+    all_entries_are_unique = false;
 
-      /* COMMENT_OUT_DURING_TESTS 
-      printf("Loaded next binary; total kmers in graph is now %qd\n",
-             hash_table_get_unique_kmers(db_graph));
-      */
+    /* COMMENT_OUT_DURING_TESTS 
+    printf("Loaded next binary; total kmers in graph is now %qd\n",
+           hash_table_get_unique_kmers(db_graph));
+    */
 
-      //Now get metadata.
-      boolean do_not_copy_poolcleaning_metadata_from_local_ginfo =only_load_kmers_already_in_hash;
-      graph_info_set_all_metadata(db_graph_info, local_ginfo, 
+    //Now get metadata.
+    boolean do_not_copy_poolcleaning_metadata_from_local_ginfo =only_load_kmers_already_in_hash;
+    graph_info_set_all_metadata(db_graph_info, local_ginfo, 
 				  colour_loading_into,
 				  do_not_copy_poolcleaning_metadata_from_local_ginfo );
-      graph_info_initialise(local_ginfo);
-      
-    }
+    graph_info_initialise(local_ginfo);
   }
 
   strbuf_free(line);
@@ -1984,6 +3028,407 @@ long long load_all_binaries_for_given_person_given_filename_of_file_listing_thei
 
 
 
+//
+// Parallel loading of a colour list
+//
+// With NUM_THREADS > 1, all the colours in a colour list are loaded at
+// once, in rounds. In each round every colour with data left reads up to
+// COLOUR_LOAD_CHUNK records from its current binary, then
+//  1. in parallel, each colour decodes its records and looks the kmers up
+//  2. the kmers that were not found are inserted by one thread, colour by colour
+//  3. in parallel, each colour adds its coverage and edges to the nodes. Each
+//     colour has its own coverage[] and individual_edges[] slots, so no locking.
+// The hash table is only changed in step 2, in an order fixed by the data, so
+// the graph (including where each kmer sits in the table) is the same every run
+// and for any number of threads.
+
+#define COLOUR_LOAD_CHUNK 4096
+
+typedef struct
+{
+  int colour;
+
+  // binaries listed in this colour's ctxlist
+  char** binaries;
+  int num_binaries, next_binary;
+
+  // the one being read
+  boolean reading;
+  FILE* fp_bin; // NULL once mapped
+  BinaryHeaderInfo binfo;
+  BinaryRecordMap bmap;
+  GraphInfo* local_ginfo;
+  long long file_records;
+  struct timespec file_start, file_end;
+  boolean file_done; // finished this round - log it and take its metadata
+
+  // this round's records
+  dBNode tmp_node;
+  BinaryKmer* keys;
+  Covg* covgs;
+  Edges* edges;
+  dBNode** nodes;
+  int num_records;
+
+  long long seq_loaded;
+} ColourLoader;
+
+typedef enum
+{
+  ColourLoadRead, ColourLoadApply, ColourLoadDone
+} ColourLoadPhase;
+
+typedef struct
+{
+  ColourLoader* loaders;
+  int num_loaders;
+  dBGraph* db_graph;
+  boolean only_load_kmers_already_in_hash;
+  int colour_clean;
+
+  ColourLoadPhase phase;
+  int next_loader;
+
+  int num_threads; // not counting the main thread, which also works
+  pthread_t* threads;
+  int generation, num_running;
+  pthread_mutex_t lock;
+  pthread_cond_t cond_start, cond_done;
+} ParallelColourLoad;
+
+static void colour_loader_init(ColourLoader* cl, int colour, char* ctxlist)
+{
+  char absolute_path[PATH_MAX+1];
+  char* path_ptr;
+
+  FILE* fptr = fopen(ctxlist, "r");
+  if (fptr == NULL)
+  {
+    die("cannot open %s which is supposed to list all .ctx files for person "
+        "with colour_loading_into %d\n", ctxlist, colour);
+  }
+
+  StrBuf *dir = file_reader_get_strbuf_of_dir_path(ctxlist);
+  StrBuf *line = strbuf_new();
+  int capacity = 16;
+
+  cl->colour = colour;
+  cl->num_binaries = 0;
+  cl->next_binary = 0;
+  cl->binaries = malloc(capacity * sizeof(char*));
+
+  while((path_ptr = next_binary_in_ctxlist(fptr, dir, line, absolute_path)) != NULL)
+  {
+    if(cl->num_binaries == capacity)
+    {
+      capacity *= 2;
+      cl->binaries = realloc(cl->binaries, capacity * sizeof(char*));
+    }
+    if(cl->binaries == NULL)
+      die("Out of memory reading ctxlist %s\n", ctxlist);
+
+    cl->binaries[cl->num_binaries++] = strdup(path_ptr);
+  }
+
+  strbuf_free(line);
+  strbuf_free(dir);
+  fclose(fptr);
+
+  cl->reading = false;
+  cl->fp_bin = NULL;
+  cl->file_done = false;
+  cl->local_ginfo = graph_info_alloc_and_init();
+  element_initialise_kmer_covgs_edges_and_status_to_zero(&cl->tmp_node);
+
+  cl->keys = malloc(COLOUR_LOAD_CHUNK * sizeof(BinaryKmer));
+  cl->covgs = malloc(COLOUR_LOAD_CHUNK * sizeof(Covg));
+  cl->edges = malloc(COLOUR_LOAD_CHUNK * sizeof(Edges));
+  cl->nodes = malloc(COLOUR_LOAD_CHUNK * sizeof(dBNode*));
+  cl->num_records = 0;
+  cl->seq_loaded = 0;
+
+  if(cl->keys == NULL || cl->covgs == NULL || cl->edges == NULL || cl->nodes == NULL)
+    die("Out of memory allocating buffers to load colour %d\n", colour);
+}
+
+static void colour_loader_free(ColourLoader* cl)
+{
+  int i;
+  for(i = 0; i < cl->num_binaries; i++)
+    free(cl->binaries[i]);
+  free(cl->binaries);
+  graph_info_free(cl->local_ginfo);
+  free(cl->keys);
+  free(cl->covgs);
+  free(cl->edges);
+  free(cl->nodes);
+}
+
+// Step 1: read this round's records and look them up
+static void colour_loader_read(ColourLoader* cl, ParallelColourLoad* pl)
+{
+  short kmer_size = pl->db_graph->kmer_size;
+  cl->num_records = 0;
+
+  if(!cl->reading)
+  {
+    if(cl->next_binary == cl->num_binaries)
+      return;
+
+    char* path = cl->binaries[cl->next_binary];
+    clock_gettime(CLOCK_MONOTONIC, &cl->file_start);
+    cl->fp_bin = open_single_colour_binary(path, pl->db_graph, cl->local_ginfo,
+                                           &cl->binfo, cl->colour);
+    cl->file_records = 0;
+    cl->reading = true;
+
+    // the mapping outlives the file, which saves file descriptors
+    if(_binary_map_open(&cl->bmap, cl->fp_bin, path, 1, cl->binfo.version, 1))
+    {
+      fclose(cl->fp_bin);
+      cl->fp_bin = NULL;
+    }
+  }
+
+  while(cl->num_records < COLOUR_LOAD_CHUNK &&
+        (cl->fp_bin == NULL ? _binary_map_read_single_colour(&cl->bmap, kmer_size, &cl->tmp_node, cl->colour)
+         : db_node_read_single_colour_binary(cl->fp_bin, kmer_size, &cl->tmp_node, cl->colour, cl->binfo.version)))
+  {
+    int i = cl->num_records++;
+    element_get_key(element_get_kmer(&cl->tmp_node), kmer_size, &cl->keys[i]);
+    cl->covgs[i] = db_node_get_coverage(&cl->tmp_node, cl->colour);
+    cl->edges[i] = get_edge_copy(cl->tmp_node, cl->colour);
+  }
+
+  cl->file_records += cl->num_records;
+
+  if(cl->num_records < COLOUR_LOAD_CHUNK)
+  {
+    if(cl->fp_bin == NULL)
+      _binary_map_close(&cl->bmap);
+    else
+      fclose(cl->fp_bin);
+
+    clock_gettime(CLOCK_MONOTONIC, &cl->file_end);
+    cl->reading = false;
+    cl->file_done = true;
+  }
+
+  // nothing is inserted during this step, so lookups are safe
+  hash_table_find_batch(cl->keys, cl->num_records, cl->nodes, pl->db_graph);
+}
+
+// Step 3: add coverage and edges
+static void colour_loader_apply(ColourLoader* cl, ParallelColourLoad* pl)
+{
+  int i;
+  for(i = 0; i < cl->num_records; i++)
+  {
+    dBNode* node = cl->nodes[i];
+
+    if(pl->only_load_kmers_already_in_hash == false)
+    {
+      cl->seq_loaded += pl->db_graph->kmer_size;
+      add_edges(node, cl->colour, cl->edges[i]);
+      db_node_update_coverage(node, cl->colour, cl->covgs[i]);
+    }
+    else if(node != NULL)
+    {
+      //only load edge from binary if is in the cleaned colour also.
+      //Read just that colour's edges - copying the whole node would race with
+      //the threads applying the other colours
+      add_edges(node, cl->colour, node->individual_edges[pl->colour_clean] & cl->edges[i]);
+      db_node_update_coverage(node, cl->colour, cl->covgs[i]);
+    }
+  }
+}
+
+static void parallel_colour_load_run_phase(ParallelColourLoad* pl, ColourLoadPhase phase)
+{
+  int i;
+  while((i = __atomic_fetch_add(&pl->next_loader, 1, __ATOMIC_RELAXED)) < pl->num_loaders)
+  {
+    if(phase == ColourLoadRead)
+      colour_loader_read(pl->loaders + i, pl);
+    else
+      colour_loader_apply(pl->loaders + i, pl);
+  }
+}
+
+static void* parallel_colour_load_thread(void* arg)
+{
+  ParallelColourLoad* pl = (ParallelColourLoad*) arg;
+  int generation = 0;
+
+  while(1)
+  {
+    pthread_mutex_lock(&pl->lock);
+    while(pl->generation == generation)
+      pthread_cond_wait(&pl->cond_start, &pl->lock);
+    generation = pl->generation;
+    ColourLoadPhase phase = pl->phase;
+    pthread_mutex_unlock(&pl->lock);
+
+    if(phase == ColourLoadDone)
+      return NULL;
+
+    parallel_colour_load_run_phase(pl, phase);
+
+    pthread_mutex_lock(&pl->lock);
+    if(--pl->num_running == 0)
+      pthread_cond_signal(&pl->cond_done);
+    pthread_mutex_unlock(&pl->lock);
+  }
+}
+
+// Run a step on all the threads, and wait for it to finish
+static void parallel_colour_load_phase(ParallelColourLoad* pl, ColourLoadPhase phase)
+{
+  pthread_mutex_lock(&pl->lock);
+  pl->phase = phase;
+  pl->next_loader = 0;
+  pl->num_running = pl->num_threads;
+  pl->generation++;
+  pthread_cond_broadcast(&pl->cond_start);
+  pthread_mutex_unlock(&pl->lock);
+
+  if(phase == ColourLoadDone)
+    return;
+
+  parallel_colour_load_run_phase(pl, phase);
+
+  pthread_mutex_lock(&pl->lock);
+  while(pl->num_running > 0)
+    pthread_cond_wait(&pl->cond_done, &pl->lock);
+  pthread_mutex_unlock(&pl->lock);
+}
+
+// Load ctxlists[i] into colour first_colour+i, for all i, with NUM_THREADS threads
+static long long load_colour_lists_in_parallel(char** ctxlists, int num_colours, int first_colour,
+                                               dBGraph* db_graph, GraphInfo* db_graph_info,
+                                               boolean only_load_kmers_already_in_hash, int colour_clean)
+{
+  if(num_colours == 0)
+    return 0;
+
+  ParallelColourLoad pl;
+  pl.loaders = malloc(num_colours * sizeof(ColourLoader));
+  pl.num_loaders = num_colours;
+  pl.db_graph = db_graph;
+  pl.only_load_kmers_already_in_hash = only_load_kmers_already_in_hash;
+  pl.colour_clean = colour_clean;
+  pl.num_threads = MIN(NUM_THREADS, num_colours) - 1;
+  pl.threads = malloc(MAX(pl.num_threads, 1) * sizeof(pthread_t));
+  pl.generation = 0;
+
+  if(pl.loaders == NULL || pl.threads == NULL)
+    die("Out of memory allocating threads to load colours\n");
+
+  int i, j;
+  for(i = 0; i < num_colours; i++)
+    colour_loader_init(pl.loaders + i, first_colour + i, ctxlists[i]);
+
+  pthread_mutex_init(&pl.lock, NULL);
+  pthread_cond_init(&pl.cond_start, NULL);
+  pthread_cond_init(&pl.cond_done, NULL);
+
+  for(i = 0; i < pl.num_threads; i++)
+  {
+    if(pthread_create(pl.threads + i, NULL, parallel_colour_load_thread, &pl) != 0)
+      die("Unable to create loading thread\n");
+  }
+
+  BinaryKmer* missing_keys = malloc(COLOUR_LOAD_CHUNK * sizeof(BinaryKmer));
+  int* missing = malloc(COLOUR_LOAD_CHUNK * sizeof(int));
+  dBNode** inserted = malloc(COLOUR_LOAD_CHUNK * sizeof(dBNode*));
+  boolean* found = malloc(COLOUR_LOAD_CHUNK * sizeof(boolean));
+
+  if(missing_keys == NULL || missing == NULL || inserted == NULL || found == NULL)
+    die("Out of memory allocating buffers to load colours\n");
+
+  boolean data_left = true;
+
+  while(data_left)
+  {
+    parallel_colour_load_phase(&pl, ColourLoadRead);
+
+    // Step 2: insert new kmers, and finish off binaries which are done
+    long long generation = db_graph->generation;
+    data_left = false;
+    for(i = 0; i < num_colours; i++)
+    {
+      ColourLoader* cl = pl.loaders + i;
+
+      if(only_load_kmers_already_in_hash == false)
+      {
+        int num_missing = 0;
+        for(j = 0; j < cl->num_records; j++)
+        {
+          if(cl->nodes[j] == NULL)
+          {
+            binary_kmer_assignment_operator(missing_keys[num_missing], cl->keys[j]);
+            missing[num_missing++] = j;
+          }
+        }
+
+        hash_table_find_or_insert_batch(missing_keys, num_missing, inserted, found, db_graph);
+
+        for(j = 0; j < num_missing; j++)
+          cl->nodes[missing[j]] = inserted[j];
+      }
+
+      if(cl->file_done)
+      {
+        print_binary_load_time(cl->binaries[cl->next_binary], cl->colour, cl->file_records,
+                               &cl->file_start, &cl->file_end);
+        graph_info_set_all_metadata(db_graph_info, cl->local_ginfo, cl->colour,
+                                    only_load_kmers_already_in_hash);
+        graph_info_initialise(cl->local_ginfo);
+        cl->file_done = false;
+        cl->next_binary++;
+      }
+
+      if(cl->reading || cl->next_binary < cl->num_binaries)
+        data_left = true;
+    }
+
+    // the table grew, so everything found in step 1 has moved
+    if(db_graph->generation != generation)
+    {
+      for(i = 0; i < num_colours; i++)
+        hash_table_find_batch(pl.loaders[i].keys, pl.loaders[i].num_records,
+                              pl.loaders[i].nodes, db_graph);
+    }
+
+    parallel_colour_load_phase(&pl, ColourLoadApply);
+  }
+
+  parallel_colour_load_phase(&pl, ColourLoadDone);
+
+  for(i = 0; i < pl.num_threads; i++)
+    pthread_join(pl.threads[i], NULL);
+
+  long long total_seq_loaded = 0;
+  for(i = 0; i < num_colours; i++)
+  {
+    total_seq_loaded += pl.loaders[i].seq_loaded;
+    colour_loader_free(pl.loaders + i);
+  }
+
+  pthread_mutex_destroy(&pl.lock);
+  pthread_cond_destroy(&pl.cond_start);
+  pthread_cond_destroy(&pl.cond_done);
+  free(pl.loaders);
+  free(pl.threads);
+  free(missing_keys);
+  free(missing);
+  free(inserted);
+  free(found);
+
+  return total_seq_loaded;
+}
+
+
 //takes a filename 
 // this file contains a list of filenames, each of these represents an individual (and contains a list of binaries for that individual).
 // these go into successive colours, starting with first_colour
@@ -2023,9 +3468,17 @@ long long load_population_as_binaries_from_graph(char* filename, int first_colou
 
   StrBuf *line = strbuf_new();
 
-  int total_seq_loaded = 0;
+  long long total_seq_loaded = 0;
   int which_colour = first_colour;
 
+  // Colours can be loaded in parallel, except when loading the union of binaries,
+  // where whether a kmer is new depends on what order they are loaded, or when
+  // the clean colour might itself be being loaded
+  boolean in_parallel = (NUM_THREADS > 1)
+    && (load_all_kmers_but_only_increment_covg_on_new_ones == false)
+    && ( (only_load_kmers_already_in_hash == false) || (colour_clean < first_colour) );
+  char* ctxlists[NUMBER_OF_COLOURS];
+
   while(strbuf_reset_readline(line, fp))
   {
     strbuf_chomp(line);
@@ -2057,6 +3510,13 @@ long long load_population_as_binaries_from_graph(char* filename, int first_colou
       //printf("Open this filelist of binaries, %s,  all corresponding to the same colour:%d\n",
       //	     line, which_colour-1);
 
+      if(in_parallel)
+      {
+        ctxlists[which_colour - first_colour] = strdup(path_ptr);
+        which_colour++;
+        continue;
+      }
+
       total_seq_loaded = total_seq_loaded + 
         load_all_binaries_for_given_person_given_filename_of_file_listing_their_binaries(
           path_ptr, db_graph,db_graph_info, 
@@ -2073,6 +3533,16 @@ long long load_population_as_binaries_from_graph(char* filename, int first_colou
     }
   }
 
+  if(in_parallel)
+  {
+    total_seq_loaded = load_colour_lists_in_parallel(ctxlists, which_colour - first_colour, first_colour,
+                                                     db_graph, db_graph_info,
+                                                     only_load_kmers_already_in_hash, colour_clean);
+    int i;
+    for(i = 0; i < which_colour - first_colour; i++)
+      free(ctxlists[i]);
+  }
+
   strbuf_free(line);
   strbuf_free(dir);
 
@@ -2087,9 +3557,10 @@ long long load_population_as_binaries_from_graph(char* filename, int first_colou
 // Also takes two colour numbers. clean_colour is the clean colour, and in_colour is the colour ALL of these individuals are loaded into, thus:
 // First take person 0's list of binaries and load them all into colour in_colour, BUT only load nodes that are already in the hash,
 //  and only load those edges that are in the clean colour. Then dump a single-colour binary of colour in_colour,
-// with filename = colour name PLUS a suffix added on the end.
+// with filename = colour name PLUS a suffix added on the end, as binary version binary_version.
 void dump_successive_cleaned_binaries(char* filename, int in_colour,
-				      int clean_colour, char* suffix, dBGraph* db_graph, GraphInfo* db_graph_info)
+				      int clean_colour, char* suffix, dBGraph* db_graph, GraphInfo* db_graph_info,
+				      int binary_version)
 {
   if(in_colour == clean_colour)
   {
@@ -2114,7 +3585,7 @@ void dump_successive_cleaned_binaries(char* filename, int in_colour,
     die("dump_successive_cleaned_binaries cannot open file:%s\n", filename);
   }
 
-  int total_seq_loaded = 0;
+  long long total_seq_loaded = 0;
 
   // Get directory path
   StrBuf *dir = file_reader_get_strbuf_of_dir_path(filename_abs_path);
@@ -2183,7 +3654,7 @@ void dump_successive_cleaned_binaries(char* filename, int in_colour,
 							     db_graph, 
 							     db_graph_info,
 							     in_colour, 
-							     BINVERSION);
+							     binary_version);
 
       //reset that colour:
       db_graph_wipe_colour(in_colour, db_graph);
@@ -3138,7 +4609,7 @@ boolean query_binary_NEW(FILE * fp, BinaryHeaderInfo* binfo, BinaryHeaderErrorCo
 	  read = fread(&(binfo->version),sizeof(int),1,fp);
 	  if (read>0)
 	    {//can read version
-	      if ((binfo->version >=4) && (binfo->version<=BINVERSION) )
+	      if ((binfo->version >=4) && (binfo->version<=BINVERSION_MAX) )
 		{//version is good
 		  read = fread(&(binfo->kmer_size),sizeof(int),1,fp);
 		  if (read>0)
@@ -3232,7 +4703,7 @@ boolean get_extra_data_from_header(FILE * fp, BinaryHeaderInfo* binfo, BinaryHea
     {
       no_problem = get_read_lengths_and_total_seqs_from_header(fp, binfo, ecode, first_colour_loading_into);
     }
-  else if (binfo->version==6)
+  else if ( (binfo->version==6) || (binfo->version==7) )//7 has the same header as 6
     {
       no_problem = get_read_lengths_and_total_seqs_from_header(fp, binfo, ecode, first_colour_loading_into);
       if (no_problem==true)
@@ -0,0 +1,103 @@
+/*
+ * Copyright 2009-2011 Zamin Iqbal and Mario Caccamo
+ *
+ * CORTEX project contacts:
+ * 		M. Caccamo (mario.caccamo@bbsrc.ac.uk) and
+ * 		Z. Iqbal (zam@well.ox.ac.uk)
+ *
+ * **********************************************************************
+ *
+ * This file is part of CORTEX.
+ *
+ * CORTEX is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CORTEX is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CORTEX.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * **********************************************************************
+ */
+/*
+  kmer_sketch.c - HyperLogLog estimate of the number of distinct kmers
+  (Flajolet et al. 2007, with the small-range correction of Heule et al. 2013)
+*/
+
+#include <string.h>
+#include <math.h>
+
+#include "kmer_sketch.h"
+
+// 64 bit finaliser from MurmurHash3. The table's hash only gives us 32 bits, and
+// those are used to pick buckets, so hash the kmer again here
+static inline uint64_t kmer_sketch_mix(uint64_t x)
+{
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+void kmer_sketch_initialise(KmerSketch* sketch)
+{
+  memset(sketch->registers, 0, sizeof(sketch->registers));
+}
+
+void kmer_sketch_add(KmerSketch* sketch, BinaryKmer* key)
+{
+  uint64_t hash = 0;
+  int i;
+
+  for(i = 0; i < NUMBER_OF_BITFIELDS_IN_BINARY_KMER; i++)
+    hash = kmer_sketch_mix(hash ^ (*key)[i]);
+
+  // top bits pick the register, which keeps the longest run of leading zeros
+  // seen in the rest. The sentinel bit stops the run at 64-KMER_SKETCH_BITS
+  uint32_t reg = hash >> (64 - KMER_SKETCH_BITS);
+  uint64_t rest = (hash << KMER_SKETCH_BITS) | ((uint64_t)1 << (KMER_SKETCH_BITS - 1));
+  uint8_t rank = __builtin_clzll(rest) + 1;
+
+  if(rank > sketch->registers[reg])
+    sketch->registers[reg] = rank;
+}
+
+void kmer_sketch_merge(KmerSketch* into, KmerSketch* from)
+{
+  int i;
+  for(i = 0; i < KMER_SKETCH_REGISTERS; i++)
+  {
+    if(from->registers[i] > into->registers[i])
+      into->registers[i] = from->registers[i];
+  }
+}
+
+long long kmer_sketch_estimate(KmerSketch* sketch)
+{
+  double m = KMER_SKETCH_REGISTERS;
+  double alpha = 0.7213 / (1 + 1.079 / m);
+  double sum = 0;
+  int i, num_zero = 0;
+
+  for(i = 0; i < KMER_SKETCH_REGISTERS; i++)
+  {
+    sum += ldexp(1.0, -sketch->registers[i]);
+    if(sketch->registers[i] == 0)
+      num_zero++;
+  }
+
+  double estimate = alpha * m * m / sum;
+
+  // few kmers - count empty registers instead (linear counting)
+  if(estimate <= 2.5 * m && num_zero > 0)
+    estimate = m * log(m / num_zero);
+
+  return (long long)(estimate + 0.5);
+}
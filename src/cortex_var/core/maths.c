@@ -29,43 +29,51 @@
 
 #include <stdlib.h>
 #include <math.h>
+#include <pthread.h>
 
 // cortex_var headers
 #include "maths.h"
 
 
-// log(n!)= sum from i=1 to n, of  (log(i))                                                                                                                                                                          
-double log_factorial(int number)
+// log(n!) for n below LOG_FACTORIAL_TABLE_SIZE, filled in once and then shared
+// by all threads. Each entry is summed as log_factorial always has, so the
+// values are exactly as before
+static double log_factorial_table[LOG_FACTORIAL_TABLE_SIZE];
+static pthread_once_t log_factorial_table_once = PTHREAD_ONCE_INIT;
+
+static void log_factorial_table_init()
 {
-  if (number<0)
-    {
-      die("Do not call log_factorial with negative argument %d\n", number);
-    }
   int i;
-  double ret=0;
-  for (i=1; i<=number; i++)
+  log_factorial_table[0] = 0;
+  for (i=1; i<LOG_FACTORIAL_TABLE_SIZE; i++)
     {
-      ret+=log(i);
+      log_factorial_table[i] = log_factorial_table[i-1] + log(i);
     }
-  return ret;
 }
 
-
+// log(n!)= sum from i=1 to n, of  (log(i)) = lgamma(n+1)
 double log_factorial_uint64_t(uint64_t number)
 {
-  if (number<0)
+  if (number<LOG_FACTORIAL_TABLE_SIZE)
     {
-      die("Do not call log_factorial with negative argument %" PRIu64 "\n", number);
+      pthread_once(&log_factorial_table_once, &log_factorial_table_init);
+      return log_factorial_table[number];
     }
-  uint64_t i;
-  double ret=0;
-  for (i=1; i<=number; i++)
+  // lgamma_r, as lgamma sets the global signgam
+  int sign;
+  return lgamma_r((double)number + 1, &sign);
+}
+
+double log_factorial(int number)
+{
+  if (number<0)
     {
-      ret+=log(i);
+      die("Do not call log_factorial with negative argument %d\n", number);
     }
-  return ret;
+  return log_factorial_uint64_t((uint64_t)number);
 }
 
+
 int min_of_ints(int a, int b)
 {
   if (a<b)    
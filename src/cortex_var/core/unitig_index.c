@@ -0,0 +1,335 @@
+/*
+ * Copyright 2009-2011 Zamin Iqbal and Mario Caccamo
+ *
+ * CORTEX project contacts:
+ * 		M. Caccamo (mario.caccamo@bbsrc.ac.uk) and
+ * 		Z. Iqbal (zam@well.ox.ac.uk)
+ *
+ * **********************************************************************
+ *
+ * This file is part of CORTEX.
+ *
+ * CORTEX is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CORTEX is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CORTEX.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * **********************************************************************
+ */
+/*
+  unitig_index.c - index of the unitigs of a graph, for walking along them
+  without hashing
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "unitig_index.h"
+#include "dB_graph_population.h"
+
+static void unitig_index_free(UnitigIndex * index)
+{
+  if (index==NULL)
+    {
+      return;
+    }
+  free(index->positions);
+  free(index->unitigs);
+  free(index->slot_to_position);
+  free(index);
+}
+
+// true if the unitig through node carries on (in orientation) to next_node. This
+// needs node to have one edge out, and next_node one edge back in
+static boolean unitig_index_extends(dBNode * node, Orientation orientation,
+				    dBNode ** next_node, Orientation * next_orientation,
+				    Nucleotide * edge, Nucleotide * reverse_edge, dBGraph * db_graph)
+{
+  Nucleotide back;
+
+  if (db_node_has_precisely_one_edge_in_union_graph_over_all_people(node, orientation, edge)==false)
+    {
+      return false;
+    }
+  *next_node = db_graph_find_next_node(node, orientation, next_orientation, *edge, reverse_edge, db_graph);
+
+  if ( (*next_node==NULL) || (*next_node==node) )
+    {
+      return false;
+    }
+  return db_node_has_precisely_one_edge_in_union_graph_over_all_people(*next_node, opposite_orientation(*next_orientation), &back);
+}
+
+// a node passed on the way back to the start of a unitig
+typedef struct
+{
+  dBNode * node;
+  Orientation orientation;
+  Nucleotide edge;
+  Nucleotide reverse_edge;
+} UnitigStep;
+
+static void unitig_index_set_position(UnitigIndex * index, UnitigPosition * position, dBNode * node,
+				      Orientation orientation, dBGraph * db_graph)
+{
+  BinaryKmer tmp_kmer;
+
+  if (position - index->positions >= index->unique_kmers)
+    {
+      die("Found more kmers in the hash table than it has counted - cannot index the supernodes");
+    }
+  position->node         = node;
+  position->unitig       = index->num_unitigs;
+  position->orientation  = orientation;
+  position->reverse_edge = binary_kmer_get_last_nucleotide(binary_kmer_reverse_complement(&node->kmer, db_graph->kmer_size, &tmp_kmer));
+  index->slot_to_position[node - db_graph->table] = position - index->positions;
+}
+
+static void unitig_index_set_end(UnitigEnd * end, dBNode * node, Orientation orientation, dBGraph * db_graph)
+{
+  Nucleotide n;
+  Nucleotide reverse_edge;
+
+  for (n=Adenine; n<=Thymine; n++)
+    {
+      end->orientation[n] = forward;
+      end->node[n] = db_graph_find_next_node(node, orientation, &end->orientation[n], n, &reverse_edge, db_graph);
+    }
+}
+
+boolean db_graph_build_unitig_index(dBGraph * db_graph)
+{
+  db_graph_free_unitig_index(db_graph);
+
+  UnitigIndex * index = calloc(1, sizeof(UnitigIndex));
+  if (index==NULL)
+    {
+      return false;
+    }
+
+  index->generation   = db_graph->generation;
+  index->unique_kmers = db_graph->unique_kmers;
+  index->num_slots    = db_graph->number_buckets * db_graph->bucket_size;
+
+  long long i;
+  long long num_nodes = db_graph->unique_kmers;
+
+  long long unitigs_capacity = 1024;
+  long long walk_capacity    = 1024;
+  UnitigStep * walk          = malloc(walk_capacity * sizeof(UnitigStep));
+  index->slot_to_position    = malloc(index->num_slots * sizeof(long long));
+  index->positions           = malloc((num_nodes>0 ? num_nodes : 1) * sizeof(UnitigPosition));
+  index->unitigs             = malloc(unitigs_capacity * sizeof(Unitig));
+
+  if ( (walk==NULL) || (index->slot_to_position==NULL) || (index->positions==NULL) || (index->unitigs==NULL) )
+    {
+      free(walk);
+      unitig_index_free(index);
+      return false;
+    }
+
+  for (i=0; i<index->num_slots; i++)
+    {
+      index->slot_to_position[i] = -1;
+    }
+
+  dBNode * next_node;
+  Orientation next_orientation;
+  Nucleotide edge, reverse_edge;
+
+  for (i=0; i<index->num_slots; i++)
+    {
+      dBNode * node = &db_graph->table[i];
+
+      if ( db_node_check_for_flag_ALL_OFF(node) || (index->slot_to_position[i]!=-1) )
+	{
+	  continue;
+	}
+
+      if (index->num_unitigs==unitigs_capacity)
+	{
+	  unitigs_capacity *= 2;
+	  Unitig * new_unitigs = realloc(index->unitigs, unitigs_capacity * sizeof(Unitig));
+	  if (new_unitigs==NULL)
+	    {
+	      free(walk);
+	      unitig_index_free(index);
+	      return false;
+	    }
+	  index->unitigs = new_unitigs;
+	}
+      if (index->num_unitigs==UINT32_MAX)
+	{
+	  die("Too many supernodes in the graph to index them");
+	}
+
+      //walk back to the start of the unitig. Nodes passed are marked -2, so that
+      //we stop if we go round a cycle (or a hairpin) back onto them
+      Orientation orientation = reverse;
+      long long walk_len = 0;
+      index->slot_to_position[i] = -2;
+
+      while ( unitig_index_extends(node, orientation, &next_node, &next_orientation, &edge, &reverse_edge, db_graph)
+	      && (index->slot_to_position[next_node - db_graph->table]==-1) )
+	{
+	  if (walk_len==walk_capacity)
+	    {
+	      walk_capacity *= 2;
+	      UnitigStep * new_walk = realloc(walk, walk_capacity * sizeof(UnitigStep));
+	      if (new_walk==NULL)
+		{
+		  free(walk);
+		  unitig_index_free(index);
+		  return false;
+		}
+	      walk = new_walk;
+	    }
+	  walk[walk_len].node         = next_node;
+	  walk[walk_len].orientation  = next_orientation;
+	  walk[walk_len].edge         = edge;
+	  walk[walk_len].reverse_edge = reverse_edge;
+	  walk_len++;
+	  index->slot_to_position[next_node - db_graph->table] = -2;
+	  node        = next_node;
+	  orientation = next_orientation;
+	}
+
+      //add the nodes walked back over, from the start of the unitig. Stepping back from
+      //a to b with some edge and reverse_edge, reverse_edge steps on from b to a, and
+      //edge steps back again
+      Unitig * unitig = &index->unitigs[index->num_unitigs];
+      unitig->start = index->num_positions;
+
+      long long j;
+      for (j=walk_len-1; j>=-1; j--)
+	{
+	  dBNode * walked_node = (j>=0) ? walk[j].node : &db_graph->table[i];
+	  UnitigPosition * position = &index->positions[index->num_positions];
+	  unitig_index_set_position(index, position, walked_node,
+				    (j>=0) ? opposite_orientation(walk[j].orientation) : forward, db_graph);
+	  position->forward_edge  = (j>=0) ? walk[j].reverse_edge : UNITIG_END;
+	  position->backward_edge = (j<walk_len-1) ? walk[j+1].edge : UNITIG_END;
+	  index->num_positions++;
+	}
+
+      //then carry on forwards from where we started
+      node        = &db_graph->table[i];
+      orientation = forward;
+      while ( unitig_index_extends(node, orientation, &next_node, &next_orientation, &edge, &reverse_edge, db_graph)
+	      && (index->slot_to_position[next_node - db_graph->table]==-1) )
+	{
+	  index->positions[index->num_positions-1].forward_edge = edge;
+	  UnitigPosition * position = &index->positions[index->num_positions];
+	  unitig_index_set_position(index, position, next_node, next_orientation, db_graph);
+	  position->forward_edge  = UNITIG_END;
+	  position->backward_edge = reverse_edge;
+	  index->num_positions++;
+	  node        = next_node;
+	  orientation = next_orientation;
+	}
+
+      unitig->length = index->num_positions - unitig->start;
+      UnitigPosition * first = &index->positions[unitig->start];
+      UnitigPosition * last  = &index->positions[index->num_positions-1];
+      unitig_index_set_end(&unitig->ends[0], first->node, opposite_orientation(first->orientation), db_graph);
+      unitig_index_set_end(&unitig->ends[1], last->node, last->orientation, db_graph);
+      index->num_unitigs++;
+    }
+
+  free(walk);
+  db_graph->unitig_index = index;
+  return true;
+}
+
+void db_graph_free_unitig_index(dBGraph * db_graph)
+{
+  unitig_index_free(db_graph->unitig_index);
+  db_graph->unitig_index = NULL;
+}
+
+// Where the last step of this thread ended. Walks mostly go along unitigs, so the
+// node we are asked to step from is usually the one we just stepped to, and then
+// we need not look up its position
+static __thread UnitigIndex * cursor_index = NULL;
+static __thread long long cursor = 0;
+
+boolean unitig_index_get_next_node(UnitigIndex * index, dBNode * current_node, Orientation current_orientation,
+				   Nucleotide edge, dBNode ** next_node, Orientation * next_orientation,
+				   Nucleotide * reverse_edge, dBGraph * db_graph)
+{
+  //new kmers, or a bigger table, and the index no longer covers the graph
+  if ( (index->generation!=db_graph->generation) || (index->unique_kmers!=db_graph->unique_kmers) )
+    {
+      return false;
+    }
+
+  long long p = cursor;
+  if ( (cursor_index!=index) || (p>=index->num_positions) || (index->positions[p].node!=current_node) )
+    {
+      long long slot = current_node - db_graph->table;
+      if ( (slot<0) || (slot>=index->num_slots) || (index->slot_to_position[slot]<0) )
+	{
+	  return false;
+	}
+      p = index->slot_to_position[slot];
+    }
+
+  UnitigPosition * position = &index->positions[p];
+
+  if (current_orientation==reverse)
+    {
+      *reverse_edge = binary_kmer_get_last_nucleotide(&current_node->kmer);
+    }
+  else
+    {
+      *reverse_edge = position->reverse_edge;
+    }
+
+  UnitigEnd * end;
+  if (current_orientation==position->orientation)
+    {
+      if (position->forward_edge!=UNITIG_END)
+	{
+	  //inside the unitig there is only one way on - anything else gets hashed
+	  if (edge!=position->forward_edge)
+	    {
+	      return false;
+	    }
+	  *next_node        = position[1].node;
+	  *next_orientation = position[1].orientation;
+	  cursor_index = index;
+	  cursor       = p+1;
+	  return true;
+	}
+      end = &index->unitigs[position->unitig].ends[1];
+    }
+  else
+    {
+      if (position->backward_edge!=UNITIG_END)
+	{
+	  if (edge!=position->backward_edge)
+	    {
+	      return false;
+	    }
+	  *next_node        = position[-1].node;
+	  *next_orientation = opposite_orientation(position[-1].orientation);
+	  cursor_index = index;
+	  cursor       = p-1;
+	  return true;
+	}
+      end = &index->unitigs[position->unitig].ends[0];
+    }
+
+  *next_node        = end->node[edge];
+  *next_orientation = end->orientation[edge];
+  return true;
+}
@@ -209,20 +209,36 @@ const char* usage=
 " \n ** DATA LOADING ** \n\n"\
 "   [--colour_list FILENAME] \t\t\t\t\t=\t File of filenames, one per colour. n-th file is a list of\n\t\t\t\t\t\t\t\t\t single-colour binaries to be loaded into colour n.\n\t\t\t\t\t\t\t\t\t Cannot be used with --se_list or --pe_list \n\t\t\t\t\t\t\t\t\t Optionally, this can contain a second column, containing a sample identifier/name for each colour\n" \
 "   [--multicolour_bin FILENAME] \t\t\t\t=\t Filename of a multicolour binary, will be loaded first, into colours 0..n.\n\t\t\t\t\t\t\t\t\t If using --colour_list also, those will be loaded into subsequent colours, after this.\n" \
+  // --graph_image
+"   [--graph_image FILENAME] \t\t\t\t\t=\t Instead of --multicolour_bin, map a graph image written by --dump_graph_image. Starts in seconds\n\t\t\t\t\t\t\t\t\t whatever the size of the graph, and ignores --mem_height and --mem_width. Processes mapping the same\n\t\t\t\t\t\t\t\t\t image share its memory until they change it. Needs an executable with the same MAXK and NUM_COLS\n" \
 "   [--se_list FILENAME] \t\t\t\t\t=\t List of single-end fasta/q to be loaded into a single-colour graph.\n\t\t\t\t\t\t\t\t\t Cannot be used with --colour_list\n\t\t\t\t\t\t\t\t\t Optionally, the first line is allowed to have, after the filename, a tab, and then a sample identifier\n" \
 "   [--pe_list FILENAME] \t\t\t\t\t=\t Two filenames, comma-separated: each is a list of paired-end fasta/q to be \n\t\t\t\t\t\t\t\t\t loaded into a single-colour graph. Lists are assumed to ordered so that \n\t\t\t\t\t\t\t\t\t corresponding paired-end fasta/q files are at the same positions in their lists.\n\t\t\t\t\t\t\t\t\t Currently Cortex only use paired-end information to remove\n\t\t\t\t\t\t\t\t\t PCR duplicate reads (if that flag is set).\n\t\t\t\t\t\t\t\t\t Cannot be used with --colour_list\n\t\t\t\t\t\t\t\t\t  Optionally, the first line is allowed to have, after the filename, a tab, and then a sample identifier\n" \
 "   [--kmer_size INT] \t\t\t\t\t\t=\t Kmer size. Must be an odd number.\n" \
 "   [--mem_width INT] \t\t\t\t\t\t=\t Size of hash table buckets (default 100).\n" \
   //-g 
 "   [--mem_height INT] \t\t\t\t\t\t=\t Number of buckets in hash table in bits (default 10). \n\t\t\t\t\t\t\t\t\t Actual number of buckets will be 2^(the number you enter)\n" \
+  // -X
+"   [--mem_grow] \t\t\t\t\t\t=\t If the hash table fills up while loading, double it instead of giving up.\n\t\t\t\t\t\t\t\t\t While it grows, 1.5 times the memory of the new table is needed\n" \
+  // -Y
+"   [--mem_auto] \t\t\t\t\t\t=\t Only with --se_list/--pe_list. Estimate the number of distinct kmers in the data, with an\n\t\t\t\t\t\t\t\t\t extra pass through it, and choose --mem_height (and if need be a deeper --mem_width) to fit.\n\t\t\t\t\t\t\t\t\t Implies --mem_grow, in case the estimate is short\n" \
+  // --freeze_graph
+"   [--freeze_graph] \t\t\t\t\t\t=\t After cleaning (and dumping any binary), pack the graph into an array of exactly as many kmers\n\t\t\t\t\t\t\t\t\t as it has, found with a minimal perfect hash of them. Uses less memory for calling and genotyping,\n\t\t\t\t\t\t\t\t\t and a kmer is found with one look, whatever --mem_height and --mem_width were.\n\t\t\t\t\t\t\t\t\t No kmers can be added afterwards. The calls are the same, but bubble calls come out in another order\n" \
+  // -Z
+"   [--unitig_index] \t\t\t\t\t\t=\t After cleaning, index the supernodes of the graph so that walks along them step through arrays\n\t\t\t\t\t\t\t\t\t rather than looking up every kmer in the hash table. Speeds up --detect_bubbles1, --path_divergence_caller,\n\t\t\t\t\t\t\t\t\t --print_supernode_fasta and --gt, at a cost of 16 bytes per kmer and 8 per hash table entry. The results are unchanged\n" \
   // -n 
 "   [--fastq_offset INT] \t\t\t\t\t=\t Default 33, for standard fastq.\n\t\t\t\t\t\t\t\t\t Some fastq directly from different versions of Illumina machines require different offsets.\n" \
   // -o
 "   [--sample_id STRING] \t\t\t\t\t=\t (Only) if losding fasta/q, you can use this option to set the sample-identifier.\n\t\t\t\t\t\t\t\t\t This will be saved in any binary file you dump.\n" \
   // -p
 "   [--dump_binary FILENAME] \t\t\t\t\t=\t Dump a binary file, with this name (after applying error-cleaning, if specified).\n" \
+  // --dump_binary_version
+"   [--dump_binary_version INT] \t\t\t\t=\t Version of any binaries dumped: 6 (default), or 7 for compressed, block-indexed binaries,\n\t\t\t\t\t\t\t\t\t which are several times smaller. Version 7 binaries can only be loaded by this or later versions of Cortex\n" \
+  // --dump_graph_image
+"   [--dump_graph_image FILENAME] \t\t\t\t=\t Dump an image of the graph in memory (after error-cleaning and --freeze_graph, if specified),\n\t\t\t\t\t\t\t\t\t for later runs to open with --graph_image. Only for this executable (MAXK and NUM_COLS) and machine\n" \
   // -T
 "   [--subsample FRAC] \t\t\t\t\t=\t Subsample input data, taking fraction FRAC of data. If you want to dump a binary after having done this, use --dump_binary\n" \
+  // -W
+"   [--threads INT] \t\t\t\t\t\t=\t Number of threads used to load fasta/q/bam (inflating bgzip'd files and bams) and the colours of a --colour_list,\n\t\t\t\t\t\t\t\t\t to dump binaries, to call bubbles, to make path divergence calls on several chromosomes at once,\n\t\t\t\t\t\t\t\t\t to genotype a --gt callfile, to error correct reads and to remove low coverage kmers (default 1).\n\t\t\t\t\t\t\t\t\t The graph, any binary dumped, the calls, genotypes and corrected reads are the same whatever the number of threads, except for\n\t\t\t\t\t\t\t\t\t path divergence calls on the union of the --path_divergence_caller colours: on one thread a supernode is called at most once,\n\t\t\t\t\t\t\t\t\t on several it may be called on each chromosome it touches. Loading is single-threaded\n\t\t\t\t\t\t\t\t\t if using --remove_pcr_duplicates or --load_colours_as_union\n" \
   // -w
 "   [--max_read_len] \t\t\t\t\t\t=\t (Unlike previous versions of Cortex) now required only if using --gt or --dump_filtered_readlen_distribution.\n" \
 " \n**** FILTERING AND ERROR CORRECTION/CLEANING OPTIONS ****\n\n"\
@@ -408,6 +424,12 @@ int default_opts(CmdLine * c)
   c->node_coverage_threshold=0;
   c->quality_score_offset = 33;//standard fastq, not illumina v-whatever fastq  
   c->max_read_length = 0;
+  c->num_threads = 1;
+  c->mem_grow = false;
+  c->mem_auto = false;
+  c->unitig_index = false;
+  c->freeze_graph = false;
+  c->dump_binary_version = BINVERSION;
   c->max_var_len = 10000;
   c->specified_max_var_len = false;
   c->remv_low_covg_sups_threshold=-1;
@@ -445,6 +467,7 @@ int default_opts(CmdLine * c)
   set_string_to_null(c->pe_list_lh_mates,MAX_FILENAME_LEN);
   set_string_to_null(c->pe_list_rh_mates,MAX_FILENAME_LEN);
   set_string_to_null(c->output_binary_filename,MAX_FILENAME_LEN);
+  set_string_to_null(c->output_graph_image,MAX_FILENAME_LEN);
   set_string_to_null(c->output_supernodes,MAX_FILENAME_LEN);
   set_string_to_null(c->output_detect_bubbles1,MAX_FILENAME_LEN);
   set_string_to_null(c->output_detect_bubbles2,MAX_FILENAME_LEN);
@@ -472,6 +495,8 @@ int default_opts(CmdLine * c)
   c->print_colour_coverages=false;
   c->print_median_covg_only=false;
   c->dump_binary=false;
+  c->dump_graph_image=false;
+  c->multicol_bin_is_image=false;
   c->print_supernode_fasta=false;
   c->remove_low_coverage_nodes=false;
   c->detect_bubbles1=false;
@@ -611,6 +636,14 @@ int parse_cmdline_inner_loop(int argc, char* argv[], int unit_size, CmdLine* cmd
     {"subsample", required_argument, NULL, 'T'},
     {"print_median_covg_only", no_argument, NULL, 'U'},
     {"print_novel_contigs", required_argument, NULL, 'V'},
+    {"threads", required_argument, NULL, 'W'},
+    {"mem_grow", no_argument, NULL, 'X'},
+    {"mem_auto", no_argument, NULL, 'Y'},
+    {"unitig_index", no_argument, NULL, 'Z'},
+    {"freeze_graph", no_argument, NULL, '1'},//no letters left
+    {"graph_image", required_argument, NULL, '2'},
+    {"dump_graph_image", required_argument, NULL, '3'},
+    {"dump_binary_version", required_argument, NULL, '4'},
     {0,0,0,0}	
   };
   
@@ -621,7 +654,7 @@ int parse_cmdline_inner_loop(int argc, char* argv[], int unit_size, CmdLine* cmd
   optind=1;
   
  
-  opt = getopt_long(argc, argv, "ha:b:c:d:e:f:g:i:jk:l:m:n:o:p:q:r:s:t:u:vw:xy:z:A:B:CD:E:F:G:H:I:J:K:L:MN:O:P:Q:R:S:T:UV:", long_options, &longopt_index);
+  opt = getopt_long(argc, argv, "ha:b:c:d:e:f:g:i:jk:l:m:n:o:p:q:r:s:t:u:vw:xy:z:A:B:CD:E:F:G:H:I:J:K:L:MN:O:P:Q:R:S:T:UV:W:XYZ", long_options, &longopt_index);
 
   while ((opt) > 0) {
 	       
@@ -724,6 +757,9 @@ int parse_cmdline_inner_loop(int argc, char* argv[], int unit_size, CmdLine* cmd
 	if (access(optarg,R_OK)==-1){
 	  errx(1,"[--multicolour_bin] filename [%s] cannot be accessed",optarg);
 	}
+	if (cmdline_ptr->multicol_bin_is_image==true){
+	  errx(1,"[--multicolour_bin] cannot be used with --graph_image");
+	}
 	cmdline_ptr->input_multicol_bin = true;
 	//we set num_colours_in_multicol_bin later on - need to open the file and check signature, and cant do that til we know what kmer, and cant be sure in this case 
 	//that we have already parsed the --kmer_size case already
@@ -1527,13 +1563,101 @@ int parse_cmdline_inner_loop(int argc, char* argv[], int unit_size, CmdLine* cmd
 
 	  break;
 	}
+    case 'W'://threads
+      {
+	if (optarg==NULL)
+	  errx(1,"[--threads] option requires (positive) integer argument");
+	if (atoi(optarg)<=0)
+	  {
+	    errx(1,"[--threads] option requires (positive) integer argument. Either you have entered 0 or such an enormous number it has overflowed\n");
+	  }
+	cmdline_ptr->num_threads = atoi(optarg);
+
+	break ;
+      }
+    case 'X'://mem_grow
+      {
+	cmdline_ptr->mem_grow = true;
+	break;
+      }
+    case 'Y'://mem_auto
+      {
+	cmdline_ptr->mem_auto = true;
+	cmdline_ptr->mem_grow = true;
+	break;
+      }
+    case 'Z'://unitig_index
+      {
+	cmdline_ptr->unitig_index = true;
+	break;
+      }
+    case '1'://freeze_graph
+      {
+	cmdline_ptr->freeze_graph = true;
+	break;
+      }
+    case '2'://graph_image - loaded as the multicolour binary, but mapped rather than read
+      {
+	if (optarg==NULL)
+	  errx(1,"[--graph_image] option requires a filename (of a graph image)");
+	
+	if (strlen(optarg)<MAX_FILENAME_LEN)
+	  {
+	    strcpy(cmdline_ptr->multicolour_bin,optarg);
+	  }
+	else
+	  {
+	    errx(1,"[--graph_image] filename too long [%s]",optarg);
+	  }
+	
+	if (access(optarg,R_OK)==-1){
+	  errx(1,"[--graph_image] filename [%s] cannot be accessed",optarg);
+	}
+	if ( (cmdline_ptr->input_multicol_bin==true) && (cmdline_ptr->multicol_bin_is_image==false) ){
+	  errx(1,"[--graph_image] cannot be used with --multicolour_bin");
+	}
+	cmdline_ptr->input_multicol_bin = true;
+	cmdline_ptr->multicol_bin_is_image = true;
+	break; 
+      }
+    case '3'://dump_graph_image
+      {
+	if (optarg==NULL)
+	  errx(1,"[--dump_graph_image] option requires a filename");
+	
+	if (strlen(optarg)<MAX_FILENAME_LEN)
+	  {
+	    strcpy(cmdline_ptr->output_graph_image,optarg);
+	    cmdline_ptr->dump_graph_image=true;
+	  }
+	else
+	  {
+	    errx(1,"[--dump_graph_image] filename too long [%s]",optarg);
+	  }
+	
+	if (access(optarg,F_OK)==0){
+	  errx(1,"[--dump_graph_image] filename [%s] exists!",optarg);
+	}
+	break; 
+      }
+    case '4'://dump_binary_version
+      {
+	if (optarg==NULL)
+	  errx(1,"[--dump_binary_version] option requires an integer argument");
+	cmdline_ptr->dump_binary_version = atoi(optarg);
+	if ( (cmdline_ptr->dump_binary_version!=6) && (cmdline_ptr->dump_binary_version!=BINVERSION_MAX) )
+	  {
+	    errx(1,"[--dump_binary_version] can only dump binaries of version 6 or %d, not [%s]", BINVERSION_MAX, optarg);
+	  }
+	break;
+      }
     default:
       {
 	die("Unknown option %c", opt);
       }      
 
     }
-    opt = getopt_long(argc, argv, "ha:b:c:d:e:f:g:i:jk:l:m:n:o:p:q:r:s:t:u:vw:xy:z:A:B:CD:E:F:G:H:I:J:K:L:MN:O:P:Q:R:S:T:UV:", long_options, &longopt_index);
+    opt = getopt_long(argc, argv, "ha:b:c:d:e:f:g:i:jk:l:m:n:o:p:q:r:s:t:u:vw:xy:z:A:B:CD:E:F:G:H:I:J:K:L:MN:O:P:Q:R:S:T:UV:W:XYZ", long_options, &longopt_index);
     
   }   
   
@@ -1564,6 +1688,11 @@ int check_cmdline(CmdLine* cmd_ptr, char* error_string)
       strcpy(error_string, tmp);
       return -1;
     }
+  if ( (cmd_ptr->mem_auto==true) && (cmd_ptr->input_seq==false) )
+    {
+      die("If you specify --mem_auto, you must be entering sequence data as fasta or fastq or bam - use --mem_grow when loading binaries\n");
+    }
+
   if ( (cmd_ptr->subsample==true) && (cmd_ptr->input_seq==false) )
     {
       die("If you specify --subsample, you must be entering sequence data as fasta or fastq or bam\n");
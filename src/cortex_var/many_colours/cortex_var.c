@@ -34,6 +34,7 @@
 #include <math.h>
 #include <inttypes.h>
 #include <string_buffer.h>
+#include <seq_file.h>
 
 // cortex_var headers
 #include "element.h"
@@ -49,8 +50,10 @@
 #include "genome_complexity.h"
 #include "maths.h"
 #include "seq_error_rate_estimation.h"
+#include "unitig_index.h"
 
 void timestamp();
+double records_per_sec(long long num_records, struct timespec* start, struct timespec* end);
 
 
 
@@ -68,141 +71,20 @@ void run_genotyping(CmdLine* cmd_line, dBGraph* db_graph,
     }
   else
     {
-      int gt_file_reader(FILE * fp, Sequence * seq, int max_read_length, boolean new_entry, boolean * full_entry){
-	long long ret;
-	int offset = 0;
-	if (new_entry!= true){
-	  die("new_entry has to be true for read_next_variant_from_full_flank_file\n");
-	}	
-	ret =  read_sequence_from_fasta(fp,seq,max_read_length,new_entry,full_entry,offset);
-	return ret;
-      }
-
-
-      //----------------------------------
-      // allocate the memory used to read the sequences
-      //----------------------------------
-      Sequence * seq = malloc(sizeof(Sequence));
-      if (seq == NULL){
-	die("Out of memory trying to allocate Sequence");
-      }
-      alloc_sequence(seq,cmd_line->max_read_length+db_graph->kmer_size,LINE_MAX);
-
-      Sequence * seq_inc_prev_kmer = malloc(sizeof(Sequence));
-      if (seq == NULL){
-	die("Out of memory trying to allocate Sequence");
-      }
-      alloc_sequence(seq_inc_prev_kmer,cmd_line->max_read_length+db_graph->kmer_size,LINE_MAX);
-
-      
-      
-      //We are going to load all the bases into a single sliding window 
-      KmerSlidingWindow* kmer_window = malloc(sizeof(KmerSlidingWindow));
-      if (kmer_window==NULL)
-	{
-	  die("Failed to malloc kmer sliding window for genotyping. Exit.\n");
-	}
-      kmer_window->kmer = (BinaryKmer*) malloc(sizeof(BinaryKmer)*(cmd_line->max_read_length+db_graph->kmer_size));
-      if (kmer_window->kmer==NULL)
-	{
-	  die("Failed to malloc kmer_window->kmer for genotyping. Tried to alloc\n"
-	      "an array of %d binary kmers. Max read len:%d, kmer size %d. Exit.\n", 
-	      cmd_line->max_read_length-db_graph->kmer_size-1,
-	      cmd_line->max_read_length,
-	      db_graph->kmer_size);
-	}
-      kmer_window->nkmers=0;
-      
-      int lim = cmd_line->max_read_length+db_graph->kmer_size;
-      if (lim < cmd_line->max_var_len)
-	{
-	  lim = cmd_line->max_var_len+db_graph->kmer_size;
-	}
-
-      CovgArray* working_ca = alloc_and_init_covg_array(lim+1);
-      if (working_ca==NULL)
-	{
-	  die("Unable to alloc an array of coverages for genotyping - abort. Your server must have run out of memory.\n");
-	}
-      VariantBranchesAndFlanks* var = alloc_VariantBranchesAndFlanks_object(lim+1, lim+1, lim+1, lim+1, db_graph->kmer_size);
-
-      if (var==NULL)
-	{
-	  die("Abort - unable to allocate memory for buffers for reading callfile - \n"
-	      "either severe oom conditions or you have specified very very large max_read_len or max_var_len\n");
-	}
-      GenotypingWorkingPackage* gwp=NULL;
-      LittleHashTable* little_dbg=NULL;
-      if (cmd_line->which_caller_was_used_for_calls_to_be_genotyped==SimplePathDivergenceCaller)
-	{
-	  int max = cmd_line->max_read_length+db_graph->kmer_size;
-	  if (cmd_line->max_var_len > max)
-	    {
-	      max = cmd_line->max_var_len+db_graph->kmer_size;
-	    }
-	  gwp = alloc_genotyping_work_package(max,max,
-					      NUMBER_OF_COLOURS, 
-					      NUMBER_OF_COLOURS+1);
-	  if (gwp==NULL)
-	    {
-	      die("Unable to alloc resources for genotyping prior to starting. Abort\n");
-	    }
-	  int little_width=100;
-	  int little_height=(int) log((cmd_line->max_read_length) *4)+1;
-	  int little_retries=20;
-	  printf("Building little hash for genotyping: height %d and width %d\n", little_height, little_width);
-	  little_dbg = little_hash_table_new(little_height, little_width, little_retries, db_graph->kmer_size);
-	  if (little_dbg==NULL)
-	    {
-	      die("Out of memory - failed to alloc tiny auxiliary hash table\n");
-	    }
-	  var->which=first;
-	}
-      //end of initialisation 
-      
       FILE* fout = fopen(cmd_line->output_genotyping, "w");
       if (fout==NULL)
 	{
 	  die("Unable to open output file %s - abort.\n", cmd_line->output_genotyping);
 	}
-      
-      int ret=1;
-
-      while (ret)
-	{
 
-	  //note you are reading a bunch of variants that may have been called on another sample,
-	  //and potentially are genotyping them on a different sample. So these reads can contain kmers
-	  // that are not in our graph. These become NULL points in our array of dBNode* 's.
-	  ret = read_next_variant_from_full_flank_file(fp, cmd_line->max_read_length+db_graph->kmer_size+1,
-						       var, db_graph, &gt_file_reader, seq, seq_inc_prev_kmer, kmer_window);
-	  if (ret==1)
-	    {
-	      AssumptionsOnGraphCleaning assump=AssumeUncleaned; 
-	      print_call_given_var_and_modelinfo(var, fout, model_info, cmd_line->which_caller_was_used_for_calls_to_be_genotyped, db_graph,
-						 print_whatever_extra_variant_info,
-						 assump, working_ca);
-	    }
-	  else
-	    {
-
-	    }
-	}
+      //each thread has its own buffers for reading and genotyping sites
+      db_graph_genotype_callfile(fp, fout, cmd_line->max_read_length, cmd_line->max_var_len,
+				 cmd_line->which_caller_was_used_for_calls_to_be_genotyped, db_graph,
+				 print_whatever_extra_variant_info, model_info);
 
       //cleanup
       fclose(fout);
       fclose(fp);
-      free_VariantBranchesAndFlanks_object(var);
-      free_covg_array(working_ca);
-      if (cmd_line->which_caller_was_used_for_calls_to_be_genotyped==SimplePathDivergenceCaller)
-	{
-	  free_genotyping_work_package(gwp); 
-	  little_hash_table_free(&little_dbg);
-	}
-      free_sequence(&seq);
-      free_sequence(&seq_inc_prev_kmer);
-      free(kmer_window->kmer);
-      free(kmer_window);
     }
 }
 
@@ -283,76 +165,17 @@ void run_pd_calls(CmdLine* cmd_line, dBGraph* db_graph,
   int max_expected_size_of_supernode=cmd_line -> max_var_len;
 	int i;
       
-  if (cmd_line->pd_calls_against_each_listed_colour_consecutively==false)
-    {
-      int global_var_counter=0;
-      for (i=0; i<num_ref_chroms; i++) 
-	{
-	  printf("Call SV comparing individual/sample  with chromosome %s\n", ref_chroms[i]);
-	  
-	  FILE* chrom_fptr = fopen(ref_chroms[i], "r");
-	  if (chrom_fptr==NULL)
-	    {
-	      die("Cannot open %s \n", ref_chroms[i]);
-	    }
-	  
-	  
-	  
-	  global_var_counter +=
-	    db_graph_make_reference_path_based_sv_calls_given_list_of_colours_for_indiv(cmd_line->pd_colour_list, cmd_line->num_colours_in_pd_colour_list,
-											chrom_fptr, cmd_line->ref_colour,
-											min_fiveprime_flank_anchor, min_threeprime_flank_anchor, 
-											max_anchor_span, min_covg, max_covg, 
-											max_expected_size_of_supernode, length_of_arrays, db_graph, out_fptr,
-											0, NULL, NULL, NULL, NULL, NULL, 
-											&make_reference_path_based_sv_calls_condition_always_true_in_subgraph_defined_by_func_of_colours, 
-											&db_variant_action_do_nothing,
-											print_some_extra_var_info, model_info,  AssumeUncleaned, global_var_counter+1);
-	  
-	  
-	  fclose(chrom_fptr);
-	}      
-    }
-  else
-    {
-      int global_var_counter=0;
-      for (i=0; i<num_ref_chroms; i++) 
-	{
-	  printf("Call SVs by comparing each colour in turn  with chromosome %s\n", ref_chroms[i]);
+  db_graph_make_reference_path_based_sv_calls_for_list_of_chroms(ref_chroms, num_ref_chroms,
+								 cmd_line->pd_colour_list, cmd_line->num_colours_in_pd_colour_list,
+								 cmd_line->pd_calls_against_each_listed_colour_consecutively,
+								 cmd_line->ref_colour,
+								 min_fiveprime_flank_anchor, min_threeprime_flank_anchor,
+								 max_anchor_span, min_covg, max_covg,
+								 max_expected_size_of_supernode, length_of_arrays, db_graph, out_fptr,
+								 &make_reference_path_based_sv_calls_condition_always_true_in_subgraph_defined_by_func_of_colours,
+								 &db_variant_action_do_nothing,
+								 print_some_extra_var_info, model_info, AssumeUncleaned);
 
-	  int p;
-	  for (p=0; p<cmd_line->num_colours_in_pd_colour_list; p++)
-	    {
-	      FILE* chrom_fptr = fopen(ref_chroms[i], "r");
-	      if (chrom_fptr==NULL)
-		{
-		  die("Cannot open %s \n", ref_chroms[i]);
-		}
-	      
-	      
-	      int list_one_col[1];
-	      list_one_col[0]=cmd_line->pd_colour_list[p];
-	      
-	      global_var_counter += db_graph_make_reference_path_based_sv_calls_given_list_of_colours_for_indiv(list_one_col, 1,
-														chrom_fptr, cmd_line->ref_colour,
-														min_fiveprime_flank_anchor, min_threeprime_flank_anchor, 
-														max_anchor_span, min_covg, max_covg, 
-														max_expected_size_of_supernode, length_of_arrays, db_graph, out_fptr,
-														0, NULL, NULL, NULL, NULL, NULL, 
-														&make_reference_path_based_sv_calls_condition_always_true_in_subgraph_defined_by_func_of_colours, //just always returns true
-														&db_variant_action_do_nothing,
-														//print_some_extra_var_info, model_info, AssumeAnyErrorSeenMustHaveOccurredAtLeastTwice,
-														print_some_extra_var_info, model_info, AssumeUncleaned,
-														global_var_counter+1);
-	  
-	  
-	      fclose(chrom_fptr);
-	      hash_table_traverse(&db_node_action_unset_status_visited_or_visited_and_exists_in_reference, db_graph);	
-	    }
-
-	}
-      
-    }
   //cleanup
   fclose(out_fptr);
 
@@ -568,6 +391,9 @@ int main(int argc, char **argv)
     }
   
   parse_cmdline(cmd_line, argc,argv,sizeof(Element));
+  NUM_THREADS = cmd_line->num_threads;
+  // bgzip'd fasta/q and bams are inflated on the same number of threads
+  seq_file_set_threads(NUM_THREADS);
 
   int hash_key_bits, bucket_size;
   dBGraph * db_graph = NULL;
@@ -723,19 +549,64 @@ int main(int argc, char **argv)
 
   printf("Actual K-mer size: %d\n", cmd_line->kmer_size);
 
-  //Create the de Bruijn graph/hash table
-  int max_retries=15;
-  db_graph = hash_table_new(hash_key_bits,bucket_size, max_retries, kmer_size);
-  if (db_graph==NULL)
+  if (cmd_line->mem_auto==true)
     {
-      die("Giving up - unable to allocate memory for the hash table\n");
-    }
-  printf("Hash table created, number of buckets: %d\n",1 << hash_key_bits);
+      char* filelists[4];
+      int num_filelists=0;
 
+      if (strcmp(cmd_line->se_list, "")!=0)
+	{
+	  filelists[num_filelists++] = cmd_line->se_list;
+	}
+      if (strcmp(cmd_line->pe_list_lh_mates, "")!=0)
+	{
+	  filelists[num_filelists++] = cmd_line->pe_list_lh_mates;
+	  filelists[num_filelists++] = cmd_line->pe_list_rh_mates;
+	}
+      filelists[num_filelists] = NULL;
 
+      timestamp();
+      printf("Estimating the number of distinct kmers in the sequence data, to size the hash table\n");
+      long long estimated_kmers = estimate_distinct_kmers_in_filelists(filelists, kmer_size,
+								       cmd_line->quality_score_threshold,
+								       cmd_line->cut_homopolymers ? cmd_line->homopolymer_limit : 0,
+								       cmd_line->quality_score_offset);
+      hash_table_size_for_kmers(estimated_kmers, bucket_size, &hash_key_bits, &bucket_size);
+      timestamp();
+      printf("Estimated %qd distinct kmers, so using --mem_height %d --mem_width %d\n",
+	     estimated_kmers, hash_key_bits, bucket_size);
+    }
 
   GraphInfo* db_graph_info=graph_info_alloc_and_init();//will exit it fails to alloc.
 
+  //Create the de Bruijn graph/hash table - or map an image of one, which comes with its metadata
+  int max_retries=15;
+  int num_cols_in_graph_image=0;
+  if (cmd_line->multicol_bin_is_image==true)
+    {
+      struct timespec map_start, map_end;
+      timestamp();
+      clock_gettime(CLOCK_MONOTONIC, &map_start);
+      db_graph = load_graph_image(cmd_line->multicolour_bin, kmer_size, db_graph_info, &num_cols_in_graph_image);
+      clock_gettime(CLOCK_MONOTONIC, &map_end);
+      printf("Mapped the graph image %s, of %qd kmers in %qd buckets of %d, in %.3f secs\n", cmd_line->multicolour_bin,
+	     hash_table_get_unique_kmers(db_graph), db_graph->number_buckets, db_graph->bucket_size,
+	     (map_end.tv_sec - map_start.tv_sec) + (map_end.tv_nsec - map_start.tv_nsec) / 1e9);
+    }
+  else
+    {
+      db_graph = hash_table_new(hash_key_bits,bucket_size, max_retries, kmer_size);
+      if (db_graph==NULL)
+	{
+	  die("Giving up - unable to allocate memory for the hash table\n");
+	}
+      printf("Hash table created, number of buckets: %d\n",1 << hash_key_bits);
+    }
+
+  //only while loading - the rest of the code holds on to nodes while adding more
+  hash_table_set_grow_when_full(db_graph, cmd_line->mem_grow);
+
+
   // input data:
   if (cmd_line->input_seq==true)
     {
@@ -930,15 +801,25 @@ int main(int argc, char **argv)
     {
       //if there is a multicolour binary, load that in first
       timestamp();      
+      struct timespec load_start, load_end;
       int first_colour_data_starts_going_into=0;
       boolean graph_has_had_no_other_binaries_loaded=true;
       
-      if (cmd_line->input_multicol_bin==true)
+      if (cmd_line->multicol_bin_is_image==true)
 	{
+	  //already mapped, when the graph was created
+	  first_colour_data_starts_going_into = num_cols_in_graph_image;
+	  graph_has_had_no_other_binaries_loaded=false;
+	}
+      else if (cmd_line->input_multicol_bin==true)
+	{
+	  clock_gettime(CLOCK_MONOTONIC, &load_start);
 	  long long  bp_loaded = load_multicolour_binary_from_filename_into_graph(cmd_line->multicolour_bin,db_graph, 
 										  db_graph_info, &first_colour_data_starts_going_into);
+	  clock_gettime(CLOCK_MONOTONIC, &load_end);
 	  timestamp();
-	  printf("Loaded the multicolour binary %s, and got %qd kmers\n", cmd_line->multicolour_bin, bp_loaded/db_graph->kmer_size);
+	  printf("Loaded the multicolour binary %s, and got %qd kmers (%.0f records/sec)\n", cmd_line->multicolour_bin, bp_loaded/db_graph->kmer_size,
+		 records_per_sec(bp_loaded/db_graph->kmer_size, &load_start, &load_end));
 	  graph_has_had_no_other_binaries_loaded=false;
 	  timestamp();
 	  
@@ -961,10 +842,12 @@ int main(int argc, char **argv)
 			 cmd_line->colour_list, cmd_line->clean_colour);
 		}
 	      
-	      load_population_as_binaries_from_graph(cmd_line->colour_list, first_colour_data_starts_going_into, 
-						     graph_has_had_no_other_binaries_loaded, db_graph, db_graph_info,
-						     cmd_line->load_colours_only_where_overlap_clean_colour, cmd_line->clean_colour,
-						     cmd_line->for_each_colour_load_union_of_binaries);
+	      clock_gettime(CLOCK_MONOTONIC, &load_start);
+	      long long bp_loaded = load_population_as_binaries_from_graph(cmd_line->colour_list, first_colour_data_starts_going_into, 
+									   graph_has_had_no_other_binaries_loaded, db_graph, db_graph_info,
+									   cmd_line->load_colours_only_where_overlap_clean_colour, cmd_line->clean_colour,
+									   cmd_line->for_each_colour_load_union_of_binaries);
+	      clock_gettime(CLOCK_MONOTONIC, &load_end);
 	      
 	      //if the colour_list contained sample_ids, add them to the GraphInfo object
 	      // these will override the sample-id in the binary
@@ -974,7 +857,8 @@ int main(int argc, char **argv)
 					    db_graph_info, first_colour_data_starts_going_into);
 		}
 	      timestamp();
-	      printf("Finished loading single_colour binaries\n");
+	      printf("Finished loading single_colour binaries (%qd records, %.0f records/sec)\n", bp_loaded/db_graph->kmer_size,
+		     records_per_sec(bp_loaded/db_graph->kmer_size, &load_start, &load_end));
 	    }
 	  else//we are going to clean a list of binaries against one of the colours in the multicolir bin
 	    {
@@ -996,7 +880,8 @@ int main(int argc, char **argv)
 	      
 	      db_graph_info->cleaning[first_colour_data_starts_going_into]->cleaned_against_another_graph=true;
 	      dump_successive_cleaned_binaries(cmd_line->colour_list, first_colour_data_starts_going_into,cmd_line->clean_colour,
-					       cmd_line->successively_dump_cleaned_colours_suffix, db_graph, db_graph_info);
+					       cmd_line->successively_dump_cleaned_colours_suffix, db_graph, db_graph_info,
+					       cmd_line->dump_binary_version);
 	      
 	      graph_info_unset_specific_colour_from_cleaned_against_pool(db_graph_info, first_colour_data_starts_going_into);
 	      db_graph_info->cleaning[first_colour_data_starts_going_into]->cleaned_against_another_graph=false;
@@ -1014,6 +899,8 @@ int main(int argc, char **argv)
   
   
   
+  hash_table_set_grow_when_full(db_graph, false);
+
   GraphAndModelInfo model_info;
   float repeat_geometric_param_mu = 0.8;
   // float seq_err_rate_per_base;
@@ -1227,7 +1114,7 @@ int main(int argc, char **argv)
 	  timestamp();
 	  printf("Input data was fasta/q, so dump single colour binary file: %s\n", cmd_line->output_binary_filename);
 	  db_graph_dump_single_colour_binary_of_colour0(cmd_line->output_binary_filename, &db_node_check_status_not_pruned,
-							db_graph, db_graph_info, BINVERSION);
+							db_graph, db_graph_info, cmd_line->dump_binary_version);
 	  timestamp();
 	  printf("Binary dumped\n");
 	  
@@ -1236,12 +1123,46 @@ int main(int argc, char **argv)
 	{
 	  timestamp();
 	  printf("Dump multicolour binary with %d colours (compile-time setting)\n", NUMBER_OF_COLOURS);
-	  db_graph_dump_binary(cmd_line->output_binary_filename, &db_node_check_status_not_pruned,db_graph, db_graph_info, BINVERSION);
+	  db_graph_dump_binary(cmd_line->output_binary_filename, &db_node_check_status_not_pruned,db_graph, db_graph_info, cmd_line->dump_binary_version);
 	  timestamp();
 	  printf("Binary dumped\n");
 	}
     }
 
+  if (cmd_line->freeze_graph==true)
+    {
+      timestamp();
+      printf("Freeze the cleaned graph\n");
+      long long slots_before = hash_table_get_capacity(db_graph);
+      if (hash_table_freeze(db_graph)==false)
+	{
+	  die("Not enough memory to freeze the graph - run again without --freeze_graph\n");
+	}
+      printf("Packed %qd kmers from a table of %qd, with a perfect hash of %qd bytes\n",
+	     hash_table_get_unique_kmers(db_graph), slots_before, perfect_hash_get_bytes(db_graph->perfect_hash));
+      timestamp();
+    }
+
+  if (cmd_line->dump_graph_image==true)
+    {
+      timestamp();
+      printf("Dump an image of the cleaned graph\n");
+      db_graph_dump_image(cmd_line->output_graph_image, db_graph, db_graph_info);
+      timestamp();
+    }
+
+  if (cmd_line->unitig_index==true)
+    {
+      timestamp();
+      printf("Index the supernodes of the cleaned graph\n");
+      if (db_graph_build_unitig_index(db_graph)==false)
+	{
+	  die("Not enough memory to index the supernodes - run again without --unitig_index\n");
+	}
+      printf("Indexed %qd kmers in %qd supernodes\n", db_graph->unitig_index->num_positions, db_graph->unitig_index->num_unitigs);
+      timestamp();
+    }
+
   if (cmd_line->do_err_correction==true)
     {
       timestamp();
@@ -1294,7 +1215,7 @@ int main(int argc, char **argv)
 							   &print_appropriate_extra_supernode_info);
 
 
-      hash_table_traverse(&db_node_action_unset_status_visited_or_visited_and_exists_in_reference, db_graph);	
+      db_graph_unset_all_visited_status(db_graph);	
       timestamp();
       printf("Supernodes dumped\n");
     }
@@ -1323,7 +1244,7 @@ int main(int argc, char **argv)
                        &get_colour_ref, &get_covg_ref, &model_info);
 
       //unset the nodes marked as visited, but not those marked as to be ignored
-      hash_table_traverse(&db_node_action_unset_status_visited_or_visited_and_exists_in_reference, db_graph);	
+      db_graph_unset_all_visited_status(db_graph);	
       timestamp();
       printf("Detect Bubbles 1, completed\n");
     }
@@ -1390,7 +1311,7 @@ int main(int argc, char **argv)
 
       //num_kmers_dumped_after_alignment = db_graph_dump_binary(tmp_dump, &db_node_check_status_to_be_dumped, db_graph, db_graph_info, BINVERSION);
       db_graph_dump_binary(tmp_dump, &db_node_check_status_to_be_dumped,
-                           db_graph, db_graph_info, BINVERSION);
+                           db_graph, db_graph_info, cmd_line->dump_binary_version);
 
       hash_table_traverse(&db_node_action_set_status_of_unpruned_to_none, db_graph);
     }
@@ -1511,6 +1432,7 @@ int main(int argc, char **argv)
     }
 
   
+  db_graph_free_unitig_index(db_graph);
   hash_table_free(&db_graph);
   if (cmd_line->print_median_covg_only==true)
     {
@@ -1545,7 +1467,7 @@ int main(int argc, char **argv)
       db_graph_clean_orphan_edges(db_graph2);
       db_graph_dump_binary(cmd_line->output_aligned_overlap_binname, 
 			   &db_node_condition_always_true,
-			   db_graph2, db_graph_info, BINVERSION);//deliberately using original graph info - we want the same info
+			   db_graph2, db_graph_info, cmd_line->dump_binary_version);//deliberately using original graph info - we want the same info
       hash_table_free(&db_graph2);
       graph_info_free(temp_info);
     }
@@ -1566,3 +1488,8 @@ void timestamp(){
  printf("\n-----\n%s",asctime(localtime(&ltime)));
  fflush(stdout);
 }
+
+double records_per_sec(long long num_records, struct timespec* start, struct timespec* end){
+ double secs = (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+ return secs > 0 ? num_records / secs : 0;
+}
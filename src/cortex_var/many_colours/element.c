@@ -40,6 +40,7 @@
 #include <stdint.h>
 #include <assert.h>
 #include <string.h>
+#include <sched.h>
 
 // cortex_var headers
 #include "element.h"
@@ -72,6 +73,7 @@ Element* new_element()
 
   e->status = (char)none;
   e->allele_status = (char) neither;
+  e->visited_epoch = 0;
   return e;
 }
 
@@ -95,6 +97,7 @@ void element_assign(Element* e1, Element* e2)
 
   e1->status = e2->status;
   e1->allele_status = e2->allele_status;
+  e1->visited_epoch = e2->visited_epoch;
 }
 
 
@@ -253,6 +256,14 @@ void add_edges(Element* e, int colour, Edges edge_char)
 }
 
 
+void add_edges_atomic(Element* e, int colour, Edges edge_char)
+{
+  assert(colour < NUMBER_OF_COLOURS);
+
+  __atomic_fetch_or(&e->individual_edges[colour], edge_char, __ATOMIC_RELAXED);
+}
+
+
 void set_edges(Element* e, int colour, Edges edge_char)
 {
   assert(colour < NUMBER_OF_COLOURS);
@@ -404,6 +415,44 @@ void element_initialise_kmer_covgs_edges_and_status_to_zero(Element * e)
 }
 
 
+// Concurrent insertion into the hash table. A thread claims an empty slot by
+// atomically switching its status from unassigned to being_inserted, writes the
+// kmer, then publishes the element by setting the status to none. Other threads
+// must wait for an element to be published before comparing its kmer.
+boolean element_claim_if_unassigned(Element * e)
+{
+  char status = __atomic_load_n(&e->status, __ATOMIC_ACQUIRE);
+
+  return status == unassigned &&
+         __atomic_compare_exchange_n(&e->status, &status, (char)being_inserted,
+                                     false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE);
+}
+
+void element_initialise_and_publish(Element * e, Key kmer, short kmer_size)
+{
+  binary_kmer_assignment_operator(e->kmer, *kmer);
+
+  int i;
+  for (i=0; i<NUMBER_OF_COLOURS; i++)
+    {
+      e->individual_edges[i]=0;
+      e->coverage[i]=0;
+    }
+  e->allele_status = neither;
+  e->visited_epoch = 0;
+
+  __atomic_store_n(&e->status, (char)none, __ATOMIC_RELEASE);
+}
+
+void element_wait_until_published(Element * e)
+{
+  while(__atomic_load_n(&e->status, __ATOMIC_ACQUIRE) == being_inserted)
+    {
+      sched_yield();
+    }
+}
+
+
 void element_set_kmer(Element * e, Key kmer, short kmer_size)
 {
   BinaryKmer tmp_kmer;
@@ -422,13 +471,13 @@ void db_node_update_coverage(dBNode* e, int colour, long update)
 {
   assert(colour < NUMBER_OF_COLOURS);
 
-  if(COVG_MAX - update >= e->coverage[colour])
+  if((long) NODE_COVG_MAX - update >= (long) e->coverage[colour])
   {
     e->coverage[colour] += update;
   }
   else
   {
-    e->coverage[colour] = COVG_MAX;
+    e->coverage[colour] = NODE_COVG_MAX;
 
     if(!overflow_warning_printed)
     {
@@ -442,6 +491,38 @@ void db_node_update_coverage(dBNode* e, int colour, long update)
   }
 }
 
+// as db_node_update_coverage, but safe when several threads update the same node
+void db_node_update_coverage_atomic(dBNode* e, int colour, long update)
+{
+  assert(colour < NUMBER_OF_COLOURS);
+
+  NodeCovg old_covg = __atomic_load_n(&e->coverage[colour], __ATOMIC_RELAXED);
+  NodeCovg new_covg;
+
+  do
+  {
+    if((long) NODE_COVG_MAX - update >= (long) old_covg)
+    {
+      new_covg = old_covg + update;
+    }
+    else
+    {
+      new_covg = NODE_COVG_MAX;
+
+      if(!overflow_warning_printed)
+      {
+        warn("%s:%i: caught integer overflow\n"
+             "kmer coverages which overflow are capped at a ceiling, and therefore\n"
+             " some kmer coverages may be underestimates)\n",
+             __FILE__, __LINE__);
+
+        overflow_warning_printed = 1;
+      }
+    }
+  } while(!__atomic_compare_exchange_n(&e->coverage[colour], &old_covg, new_covg,
+                                       true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
 
 // Apparently some code calls to db_node_get_coverage pass
 // dBNode e == NULL and so we need to test for NULL *sometimes*.
@@ -467,7 +548,7 @@ Covg db_node_get_coverage(const dBNode* const e, int colour)
 
 void db_node_set_coverage(dBNode* e, int colour, Covg covg)
 {
-  e->coverage[colour] = covg;
+  e->coverage[colour] = covg > NODE_COVG_MAX ? NODE_COVG_MAX : covg;
 }
 
 
@@ -524,7 +605,8 @@ Orientation db_node_get_orientation(BinaryKmer* k, dBNode * e, short kmer_size){
 // After specifying which individual or population you are talking about, this
 // function adds one edge ("arrow") to the appropriate edge in the appropriate
 // array in the element -- basically sets a bit in the correct edges char
-void db_node_add_labeled_edge(dBNode * e, Orientation o, Nucleotide base, int edge_index)
+static void _db_node_add_labeled_edge(dBNode * e, Orientation o, Nucleotide base, int edge_index,
+                                      void (*add)(Element*, int, Edges))
 {
   // set edge
   // A (0) -> 0001, C (1) -> 0010, G (2) -> 0100, T (3) -> 1000
@@ -535,16 +617,22 @@ void db_node_add_labeled_edge(dBNode * e, Orientation o, Nucleotide base, int ed
   }
 
   //update node
-  add_edges(e, edge_index, edge);
+  add(e, edge_index, edge);
+}
+
+void db_node_add_labeled_edge(dBNode * e, Orientation o, Nucleotide base, int edge_index)
+{
+  _db_node_add_labeled_edge(e, o, base, edge_index, &add_edges);
 }
 
 
 //adding an edge between two nodes implies adding two labeled edges (one in each direction)
 //be aware that in the case of self-loops in palindromes the two labeled edges collapse in one
 // DEV: improve this!
-boolean db_node_add_edge(dBNode * src_e, dBNode * tgt_e,
-                         Orientation src_o, Orientation tgt_o,
-                         short kmer_size, int colour)
+static boolean _db_node_add_edge(dBNode * src_e, dBNode * tgt_e,
+                                 Orientation src_o, Orientation tgt_o,
+                                 short kmer_size, int colour,
+                                 void (*add)(Element*, int, Edges))
 {
   BinaryKmer src_k, tgt_k, tmp_kmer; 
   char seq1[kmer_size+1];
@@ -569,7 +657,7 @@ boolean db_node_add_edge(dBNode * src_e, dBNode * tgt_e,
 	   binary_kmer_to_seq(&tgt_k,kmer_size, seq2), 0, colour);
   }
 
-  db_node_add_labeled_edge(src_e, src_o, binary_kmer_get_last_nucleotide(&tgt_k), colour);
+  _db_node_add_labeled_edge(src_e, src_o, binary_kmer_get_last_nucleotide(&tgt_k), colour, add);
 
   if (DEBUG){
 
@@ -580,11 +668,26 @@ boolean db_node_add_edge(dBNode * src_e, dBNode * tgt_e,
   }
 
   Nucleotide base = binary_kmer_get_last_nucleotide(binary_kmer_reverse_complement(&src_k,kmer_size, &tmp_kmer));
-  db_node_add_labeled_edge(tgt_e, opposite_orientation(tgt_o), base, colour);
+  _db_node_add_labeled_edge(tgt_e, opposite_orientation(tgt_o), base, colour, add);
 
   return true;
 }
 
+boolean db_node_add_edge(dBNode * src_e, dBNode * tgt_e,
+                         Orientation src_o, Orientation tgt_o,
+                         short kmer_size, int colour)
+{
+  return _db_node_add_edge(src_e, tgt_e, src_o, tgt_o, kmer_size, colour, &add_edges);
+}
+
+// as db_node_add_edge, but safe when other threads are adding edges to the same nodes
+boolean db_node_add_edge_atomic(dBNode * src_e, dBNode * tgt_e,
+                                Orientation src_o, Orientation tgt_o,
+                                short kmer_size, int colour)
+{
+  return _db_node_add_edge(src_e, tgt_e, src_o, tgt_o, kmer_size, colour, &add_edges_atomic);
+}
+
 
 
 boolean db_node_edge_exist(dBNode * element, Nucleotide base,
@@ -801,9 +904,23 @@ boolean db_node_is_blunt_end_in_subgraph_given_by_func_of_colours(
 
 
 
+unsigned char db_node_visited_epoch = 0;
+
+// The status, with visited marks from earlier epochs unset
+static inline char db_node_get_status(dBNode * node)
+{
+  char status = node->status;
+  if ( (node->visited_epoch != db_node_visited_epoch)
+       && ((status == (char)visited) || (status == (char)visited_and_exists_in_reference)) )
+    {
+      return (status == (char)visited) ? (char)none : (char)exists_in_reference;
+    }
+  return status;
+}
+
 boolean db_node_check_status(dBNode * node, NodeStatus status)
 {
-  return (node->status == (char)status);
+  return (db_node_get_status(node) == (char)status);
 }
 boolean db_node_check_allele_status(dBNode * node, AlleleStatus status)
 {
@@ -850,6 +967,7 @@ boolean db_node_check_status_not_pruned_or_visited(dBNode * node)
 void db_node_set_status(dBNode *node, NodeStatus status)
 {
   node->status = (char)status;
+  node->visited_epoch = db_node_visited_epoch;
 }
 
 void db_node_set_allele_status(dBNode *node, AlleleStatus status)
@@ -1000,7 +1118,7 @@ boolean db_node_read_multicolour_binary(FILE * fp, short kmer_size, dBNode * nod
   int i;
   for (i=0; i< NUMBER_OF_COLOURS; i++)
     {
-      node->coverage[i]         = covg[i];
+      db_node_set_coverage(node, i, covg[i]);
       node->individual_edges[i] = individual_edges[i];
     }
 
@@ -1057,7 +1175,7 @@ boolean db_node_read_multicolour_binary(FILE * fp, short kmer_size, dBNode * nod
       int i;
       for (i=0; i< num_colours_in_binary; i++)
 	{
-	  node->coverage[i]         = covg_reading_from_binary[i];
+	  db_node_set_coverage(node, i, covg_reading_from_binary[i]);
 	  node->individual_edges[i] = individual_edges_reading_from_binary[i];
 	}
     }
@@ -1093,7 +1211,7 @@ boolean db_node_read_multicolour_binary(FILE * fp, short kmer_size, dBNode * nod
       int i;
       for (i=0; i< num_colours_in_binary; i++)
 	{
-	  node->coverage[i]         = covg_reading_from_binary[i];
+	  db_node_set_coverage(node, i, covg_reading_from_binary[i]);
 	  node->individual_edges[i] = individual_edges_reading_from_binary[i];
 	}
     }
@@ -1139,7 +1257,7 @@ boolean db_node_read_single_colour_binary(FILE *fp, short kmer_size, dBNode *nod
       element_set_kmer(node,&kmer,kmer_size);
       //element_initialise(node,&kmer,kmer_size);
       node->individual_edges[index]    = edges;
-      node->coverage[index]            = coverage;
+      db_node_set_coverage(node, index, coverage);
       db_node_action_set_status_none(node);
       
     }
@@ -1169,7 +1287,7 @@ boolean db_node_read_single_colour_binary(FILE *fp, short kmer_size, dBNode *nod
       element_set_kmer(node,&kmer,kmer_size);
       //element_initialise(node,&kmer,kmer_size);
       node->individual_edges[index]    = edges;
-      node->coverage[index]            = coverage;
+      db_node_set_coverage(node, index, coverage);
       db_node_action_set_status_none(node);
       
     }
@@ -1314,6 +1432,17 @@ void db_node_action_unset_status_visited_or_visited_and_exists_in_reference(dBNo
       
 }
 
+void db_node_action_unset_status_visited_of_any_epoch(dBNode * node){
+  if (node->status == (char)visited_and_exists_in_reference)
+  {
+    db_node_set_status(node, exists_in_reference);
+  }
+  else if (node->status == (char)visited)
+  {
+    db_node_set_status(node, none);
+  }
+}
+
 void db_node_action_unset_status_visited_or_visited_and_exists_in_reference_or_ignore_this_node(dBNode * node){
   if (db_node_check_status_visited_and_exists_in_reference(node))
   {
@@ -766,8 +766,131 @@ uint32_t hashbig( const void *key, size_t length, uint32_t initval)
 
 uint32_t hash_value(Key key, int number_buckets){
 
-  int hashval = hashlittle( key,    NUMBER_OF_BITFIELDS_IN_BINARY_KMER*sizeof(bitfield_of_64bits),10);
+  return hash_value_with_rehash(key, 0, number_buckets);
+
+}
+
+
+// The hash tables rehash by adding the rehash count to the last bitfield of the key.
+// The functions below do that in a register as they go, instead of on a copy of the key.
+
+// i-th 32 bit word of the key, with rehash added to the last bitfield
+static inline uint32_t key_word(Key key, int i, bitfield_of_64bits last_bitfield){
+  bitfield_of_64bits b = (i/2 == NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1) ? last_bitfield : (*key)[i/2];
+  return (uint32_t) (b >> (32*(i&1)));
+}
+
+// Same value as hashlittle() on the key (with the rehash added), taking the
+// key a word at a time. On little-endian machines hashlittle() reads aligned
+// keys as 32 bit words, which is exactly what hashword() does, so we can mix
+// the words in directly.
+uint32_t hash_value_bob_jenkins(Key key, int rehash, int number_buckets){
+
+#if HASH_LITTLE_ENDIAN == 1
+  bitfield_of_64bits last = (*key)[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1] + (bitfield_of_64bits) rehash;
+  int length = 2*NUMBER_OF_BITFIELDS_IN_BINARY_KMER;
+  int i = 0;
+  uint32_t a,b,c;
+
+  a = b = c = 0xdeadbeef + (((uint32_t)length)<<2) + 10;
+
+  while (length > 3)
+  {
+    a += key_word(key, i, last);
+    b += key_word(key, i+1, last);
+    c += key_word(key, i+2, last);
+    mix(a,b,c);
+    length -= 3;
+    i += 3;
+  }
+
+  switch(length)
+  {
+  case 3 : c+=key_word(key, i+2, last);
+  case 2 : b+=key_word(key, i+1, last);
+  case 1 : a+=key_word(key, i, last);
+    final(a,b,c);
+  case 0:
+    break;
+  }
+
+  return (c & (number_buckets-1));
+#else
+  BinaryKmer bkmer_with_rehash_added;
+  binary_kmer_assignment_operator(bkmer_with_rehash_added, *key);
+  bkmer_with_rehash_added[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1] += (bitfield_of_64bits) rehash;
+
+  uint32_t hashval = hashlittle( &bkmer_with_rehash_added, NUMBER_OF_BITFIELDS_IN_BINARY_KMER*sizeof(bitfield_of_64bits),10);
   return (hashval & (number_buckets-1));
+#endif
+}
+
 
+#define MIX64_MULT 0x87c37b91114253d5ULL
 
+static inline uint64_t fmix64(uint64_t k){
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+// multiply-xorshift over whole 64 bit words, finished with the murmur3 mixer
+uint32_t hash_value_mix64(Key key, int rehash, int number_buckets){
+
+  uint64_t h = 0x9E3779B97F4A7C15ULL;
+  int i;
+
+  for (i=0; i<NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1; i++)
+    {
+      h ^= (*key)[i] * MIX64_MULT;
+      h = (h << 27) | (h >> 37);
+      h = h*5 + 0x52dce729;
+    }
+  h ^= ((*key)[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1] + (bitfield_of_64bits) rehash) * MIX64_MULT;
+
+  return (uint32_t) (fmix64(h) & (number_buckets-1));
+}
+
+
+#ifdef HASH_VALUE_HAVE_CRC32C
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#define crc32c_u64(crc, v) _mm_crc32_u64(crc, v)
+#else
+#include <arm_acle.h>
+#define crc32c_u64(crc, v) __crc32cd(crc, v)
+#endif
+
+// hardware CRC32C of the words. CRC is linear, so keys which collide would
+// collide for every rehash if it were only used as a seed - it's added to the
+// last word instead. The final multiply spreads the CRC into the low bits we use
+uint32_t hash_value_crc32c(Key key, int rehash, int number_buckets){
+
+  uint64_t crc = 0xFFFFFFFF;
+  int i;
+
+  for (i=0; i<NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1; i++)
+    {
+      crc = crc32c_u64(crc, (*key)[i]);
+    }
+  crc = crc32c_u64(crc, (*key)[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1] + (bitfield_of_64bits) rehash);
+
+  return (uint32_t) (((crc * 0x9E3779B97F4A7C15ULL) >> 32) & (number_buckets-1));
+}
+
+#endif
+
+
+uint32_t hash_value_with_rehash(Key key, int rehash, int number_buckets){
+#if defined(HASH_CRC32C)
+  return hash_value_crc32c(key, rehash, number_buckets);
+#elif defined(HASH_MIX64)
+  return hash_value_mix64(key, rehash, number_buckets);
+#else
+  return hash_value_bob_jenkins(key, rehash, number_buckets);
+#endif
 }
@@ -30,12 +30,20 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "open_hash/hash_table.h"
 #include "hash_value.h"
 
 
+static void hash_table_init(HashTable * hash_table);
+
 HashTable * hash_table_new(int number_bits, int bucket_size, int max_rehash_tries, short kmer_size){ 
   
   HashTable *hash_table = malloc(sizeof(HashTable));
@@ -46,7 +54,7 @@ HashTable * hash_table_new(int number_bits, int bucket_size, int max_rehash_trie
     //exit(EXIT_FAILURE);
   }
   
-  hash_table->collisions = calloc(max_rehash_tries, sizeof(long long));
+  hash_table->collisions = calloc(max_rehash_tries+1, sizeof(long long)); //tries 0..max_rehash_tries
   if (hash_table->collisions == NULL) {
     fprintf(stderr,"could not allocate memory\n");
     return NULL;
@@ -75,34 +83,64 @@ HashTable * hash_table_new(int number_bits, int bucket_size, int max_rehash_trie
   }
 
   hash_table->kmer_size      = kmer_size;
+  hash_table_init(hash_table);
+
   return hash_table;
 }
 
+// the fields which start the same however the table was made
+static void hash_table_init(HashTable * hash_table)
+{
+  hash_table->grow_when_full = false;
+  hash_table->generation     = 0;
+  hash_table->unitig_index   = NULL;
+  hash_table->perfect_hash   = NULL;
+  hash_table->image          = NULL;
+  hash_table->image_size     = 0;
+
+  //writers (growing) go first, else threads taking turns to read could starve them
+  pthread_rwlockattr_t attr;
+  pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+  pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+  pthread_rwlock_init(&hash_table->grow_lock, &attr);
+  pthread_rwlockattr_destroy(&attr);
+}
+
+// frees table and next_element, or unmaps the image they are in
+static void hash_table_free_arrays(HashTable * hash_table)
+{
+  if (hash_table->image != NULL)
+    {
+      munmap(hash_table->image, hash_table->image_size);
+      hash_table->image = NULL;
+      hash_table->image_size = 0;
+    }
+  else
+    {
+      free(hash_table->table);
+      free(hash_table->next_element);
+    }
+}
+
 void hash_table_free(HashTable ** hash_table)
 { 
-  free((*hash_table)->table);
-  free((*hash_table)->next_element);
+  pthread_rwlock_destroy(&(*hash_table)->grow_lock);
+  perfect_hash_free((*hash_table)->perfect_hash);
+  hash_table_free_arrays(*hash_table);
   free((*hash_table)->collisions);
   free(*hash_table);
   *hash_table = NULL;
 }
 
 
-// Lookup for key in bucket defined by the hash value. 
-// If key is in bucket, returns true and the position of the key/element in current_pos.
-// If key is not in bucket, and bucket is not full, returns the next available position in current_pos (and overflow is returned as false)
-// If key is not in bucket, and bucket is full, returns overflow=true
-boolean hash_table_find_in_bucket(Key key, long long * current_pos, boolean * overflow, HashTable * hash_table, int rehash){
-
-
-  //add the rehash to the final bitfield in the BinaryKmer
-  BinaryKmer bkmer_with_rehash_added;
-  binary_kmer_initialise_to_zero(&bkmer_with_rehash_added);
-  binary_kmer_assignment_operator(bkmer_with_rehash_added, *key);
-  bkmer_with_rehash_added[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1] =   bkmer_with_rehash_added[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1]+ (bitfield_of_64bits) rehash;
-
-  uint32_t hashval = hash_value(&bkmer_with_rehash_added,hash_table->number_buckets);
+static inline uint32_t hash_table_get_bucket(Key key, HashTable * hash_table, int rehash){
+  return hash_value_with_rehash(key, rehash, hash_table->number_buckets);
+}
 
+// as hash_table_find_in_bucket, but the bucket has already been computed
+static boolean hash_table_find_in_given_bucket(Key key, uint32_t hashval, long long * current_pos, boolean * overflow, HashTable * hash_table){
 
   boolean found = false;
   int i=0;                     //position in bucket
@@ -148,54 +186,61 @@ boolean hash_table_find_in_bucket(Key key, long long * current_pos, boolean * ov
 }
 
 
+// Lookup for key in bucket defined by the hash value. 
+// If key is in bucket, returns true and the position of the key/element in current_pos.
+// If key is not in bucket, and bucket is not full, returns the next available position in current_pos (and overflow is returned as false)
+// If key is not in bucket, and bucket is full, returns overflow=true
+boolean hash_table_find_in_bucket(Key key, long long * current_pos, boolean * overflow, HashTable * hash_table, int rehash){
+
+  uint32_t hashval = hash_table_get_bucket(key, hash_table, rehash);
+
+  return hash_table_find_in_given_bucket(key, hashval, current_pos, overflow, hash_table);
+}
+
+
+
+
+// In a frozen table, a key is either at the place the perfect hash gives it, or not there at all
+static Element * hash_table_find_frozen(Key key, HashTable * hash_table){
+  long long pos = perfect_hash_lookup(key, hash_table->perfect_hash);
+
+  if ( (pos<0) || (pos>=hash_table->unique_kmers) || !element_is_key(key, hash_table->table[pos]) )
+    {
+      return NULL;
+    }
+  return &hash_table->table[pos];
+}
 
+static Element * hash_table_find_frozen_or_die(Key key, boolean * found, HashTable * hash_table){
+  Element * e = hash_table_find_frozen(key, hash_table);
+
+  if (e == NULL)
+    {
+      die("Cannot add new kmers to the graph once it has been frozen\n");
+    }
+  *found = true;
+  return e;
+}
 
 boolean hash_table_apply_or_insert(Key key, void (*f)(Element *), HashTable * hash_table){
   if (hash_table == NULL) {
     die("NULL table!");
   }
-  
-  long long current_pos;
-  Element element;
-  boolean overflow;
-  int rehash=0;
-  boolean found;
-  do
-    {
-      found = hash_table_find_in_bucket(key,&current_pos,&overflow, hash_table,rehash);
-      
-      if (!found)
-	{
-	  if (!overflow)
-	    {
-	      //sanity check
-	      if (!db_node_check_for_flag_ALL_OFF(&hash_table->table[current_pos])){
-		die("Out of bounds - trying to insert new node beyond end of bucket\n");
-	      }
-
-	      element_initialise(&element,key, hash_table->kmer_size);
-	      element_assign( &(hash_table->table[current_pos]),  &element); 
-	      hash_table->unique_kmers++;
-	    }
-	  else//overflow
-	    {
-	      rehash++;
-	      if (rehash>hash_table->max_rehash_tries)
-		{
- 		  die("Dear user - you have not allocated enough memory to contain your sequence data. \n"
-          "Either allocate more memory (have you done your calculations right?\n"
-          "Have you allowed for sequencing errors?), or threshold more harshly on\n"
-          "quality score, and try again. Aborting mission.\n");
-		}
-	    }
-	}
-      else
-	{
-	  f(&hash_table->table[current_pos]);
-	}
 
+  if (hash_table->perfect_hash != NULL)
+    {
+      boolean found;
+      f(hash_table_find_frozen_or_die(key, &found, hash_table));
+      return true;
+    }
 
-    }while(overflow);
+  //inserts the same way as find_or_insert, so the table grows if it may
+  boolean found;
+  Element * e = hash_table_find_or_insert(key, &found, hash_table);
+  if (found)
+    {
+      f(e);
+    }
 
   return found;
      
@@ -214,6 +259,108 @@ void hash_table_traverse(void (*f)(Element *),HashTable * hash_table){
   }
 }
 
+// Threads take TRAVERSE_CHUNK_SLOTS slots at a time until the table is done, so
+// a thread given a chunk of expensive elements does not hold the others up
+#define TRAVERSE_CHUNK_SLOTS (1 << 16)
+
+typedef struct
+{
+  HashTable * hash_table;
+  void (*f)(Element *, int);
+  long long (*sum_f)(Element *);
+  long long next_slot;
+  long long * sums; // one per thread
+} TraverseJob;
+
+typedef struct
+{
+  TraverseJob * job;
+  int thread_index;
+} TraverseThread;
+
+static void * hash_table_traverse_chunks(void * arg)
+{
+  TraverseThread * thread = arg;
+  TraverseJob * job = thread->job;
+  HashTable * hash_table = job->hash_table;
+  long long num_slots = (long long) hash_table->number_buckets * hash_table->bucket_size;
+  long long sum = 0;
+  long long start;
+
+  while( (start = __atomic_fetch_add(&job->next_slot, TRAVERSE_CHUNK_SLOTS, __ATOMIC_RELAXED)) < num_slots ){
+    long long end = start + TRAVERSE_CHUNK_SLOTS < num_slots ? start + TRAVERSE_CHUNK_SLOTS : num_slots;
+    long long i;
+    for(i=start;i<end;i++){
+      if (!db_node_check_for_flag_ALL_OFF(&hash_table->table[i])){
+	if (job->sum_f != NULL){
+	  sum += job->sum_f(&hash_table->table[i]);
+	}
+	else{
+	  job->f(&hash_table->table[i], thread->thread_index);
+	}
+      }
+    }
+  }
+  job->sums[thread->thread_index] = sum;
+  return NULL;
+}
+
+static long long hash_table_traverse_with_threads(TraverseJob * job, int num_threads)
+{
+  if (num_threads < 1){
+    num_threads = 1;
+  }
+  long long sums[num_threads];
+  TraverseThread threads[num_threads];
+  pthread_t thread_ids[num_threads];
+  int t;
+
+  job->next_slot = 0;
+  job->sums = sums;
+  for(t=0;t<num_threads;t++){
+    threads[t].job = job;
+    threads[t].thread_index = t;
+  }
+
+  //the calling thread takes chunks too
+  for(t=1;t<num_threads;t++){
+    if (pthread_create(&thread_ids[t], NULL, hash_table_traverse_chunks, &threads[t]) != 0){
+      die("Unable to create a thread to traverse the hash table\n");
+    }
+  }
+  hash_table_traverse_chunks(&threads[0]);
+
+  long long ret = sums[0];
+  for(t=1;t<num_threads;t++){
+    pthread_join(thread_ids[t], NULL);
+    ret += sums[t];
+  }
+  return ret;
+}
+
+void hash_table_traverse_multithreaded(void (*f)(Element *), HashTable * hash_table, int num_threads)
+{
+  void apply_f(Element * e, int thread_index)
+  {
+    f(e);
+  }
+
+  TraverseJob job = {hash_table, &apply_f, NULL, 0, NULL};
+  hash_table_traverse_with_threads(&job, num_threads);
+}
+
+void hash_table_traverse_multithreaded_with_thread_index(void (*f)(Element *, int), HashTable * hash_table, int num_threads)
+{
+  TraverseJob job = {hash_table, f, NULL, 0, NULL};
+  hash_table_traverse_with_threads(&job, num_threads);
+}
+
+long long hash_table_traverse_returning_sum_multithreaded(long long (*f)(Element *), HashTable * hash_table, int num_threads)
+{
+  TraverseJob job = {hash_table, NULL, f, 0, NULL};
+  return hash_table_traverse_with_threads(&job, num_threads);
+}
+
 long long hash_table_traverse_returning_sum(long long (*f)(Element *),HashTable * hash_table){
   long long i;
   long long ret=0;
@@ -259,12 +406,10 @@ void hash_table_traverse_passing_3ints_and_path(
 }
 
 
-Element * hash_table_find(Key key, HashTable * hash_table)
+// The single-key and batched lookups share these, with the bucket for the first
+// try (rehash=0) passed in - the batched versions compute and prefetch it in advance.
+static Element * hash_table_find_starting_at(Key key, uint32_t first_bucket, HashTable * hash_table)
 {
-  if (hash_table == NULL) 
-    {
-      die("hash_table_find has been called with a NULL table! Exiting");
-    }
 
   Element * ret = NULL;
   long long current_pos;
@@ -274,7 +419,8 @@ Element * hash_table_find(Key key, HashTable * hash_table)
 
   do
     {
-      found = hash_table_find_in_bucket(key,&current_pos, &overflow, hash_table,rehash);
+      found = hash_table_find_in_given_bucket(key, rehash==0 ? first_bucket : hash_table_get_bucket(key, hash_table, rehash),
+					      &current_pos, &overflow, hash_table);
       
       if (found) //then we know overflow is false - this is checked in find_in_bucket
 	{
@@ -295,11 +441,7 @@ Element * hash_table_find(Key key, HashTable * hash_table)
 }
 
 
-Element * hash_table_find_or_insert(Key key, boolean * found,  HashTable * hash_table){
-  
-  if (hash_table == NULL) {
-    die("NULL table!");
-  }
+static Element * hash_table_find_or_insert_starting_at(Key key, uint32_t first_bucket, boolean * found,  HashTable * hash_table){
   
   Element element;
   Element * ret = NULL;
@@ -310,7 +452,8 @@ Element * hash_table_find_or_insert(Key key, boolean * found,  HashTable * hash_
 
   do{
 
-    *found = hash_table_find_in_bucket(key,&current_pos,&overflow,hash_table,rehash);
+    *found = hash_table_find_in_given_bucket(key, rehash==0 ? first_bucket : hash_table_get_bucket(key, hash_table, rehash),
+					     &current_pos, &overflow, hash_table);
 
     if (! *found)
       {
@@ -339,6 +482,10 @@ Element * hash_table_find_or_insert(Key key, boolean * found,  HashTable * hash_
 	    rehash++;
 	    if (rehash>hash_table->max_rehash_tries)
 	      {
+		if (hash_table->grow_when_full)
+		  {
+		    return NULL; //caller grows the table
+		  }
 		//fprintf(stderr,"too much rehashing!! Reserve more memory. Rehash=%d\n", rehash);
  		  die("Dear user - you have not allocated enough memory to contain your sequence data. Either allocate more memory (have you done your calculations right? have you allowed for sequencing errors?), or threshold more harshly on quality score, and try again. Aborting mission.\n");
 	      }
@@ -355,27 +502,14 @@ Element * hash_table_find_or_insert(Key key, boolean * found,  HashTable * hash_
 }
 
 
-//this methods inserts an element in the next available bucket
-//it doesn't check whether another element with the same key is present in the table
-//used for fast loading when it is known that all the elements in the input have different key
-Element * hash_table_insert(Key key, HashTable * hash_table){
-  
-  if (hash_table == NULL) {
-    die("NULL table!");
-  }
+static Element * hash_table_insert_starting_at(Key key, uint32_t first_bucket, HashTable * hash_table){
   
   Element element;
   Element * ret = NULL;
   int rehash = 0;
   boolean inserted = false;
   do{
-    //add the rehash to the final bitfield in the BinaryKmer
-    BinaryKmer bkmer_with_rehash_added;
-    binary_kmer_initialise_to_zero(&bkmer_with_rehash_added);
-    binary_kmer_assignment_operator(bkmer_with_rehash_added, *key);
-    bkmer_with_rehash_added[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1] =   bkmer_with_rehash_added[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1]+ (bitfield_of_64bits) rehash;
-
-    uint32_t hashval = hash_value(&bkmer_with_rehash_added,hash_table->number_buckets);
+    uint32_t hashval = rehash==0 ? first_bucket : hash_table_get_bucket(key, hash_table, rehash);
     
     if (hash_table->next_element[hashval] < hash_table->bucket_size)
       { //can insert element
@@ -399,6 +533,10 @@ Element * hash_table_insert(Key key, HashTable * hash_table){
 	rehash++;
 	if (rehash>hash_table->max_rehash_tries)
 	  {
+	    if (hash_table->grow_when_full)
+	      {
+		return NULL; //caller grows the table
+	      }
 	    //fprintf(stderr,"too much rehashing!! Reserve more memory.  Rehash=%d\n", rehash);
 	    die("Dear user - you have not allocated enough memory to contain your sequence data. Either allocate more memory (have you done your calculations right? have you allowed for sequencing errors?), or threshold more harshly on quality score, and try again. Aborting mission.\n");
 	  }
@@ -409,6 +547,445 @@ Element * hash_table_insert(Key key, HashTable * hash_table){
   return ret;
 }
 
+// Look for key in the given bucket, inserting it in the first free slot if it
+// is not there. Safe for many threads to call at once, see element_claim_if_unassigned.
+// Returns NULL if the bucket is full and does not contain the key.
+static Element * hash_table_find_or_insert_in_bucket_concurrent(Key key, uint32_t hashval, boolean * found, HashTable * hash_table){
+
+  Element * e = &hash_table->table[(long long) hashval * hash_table->bucket_size];
+  Element * end = e + hash_table->bucket_size;
+
+  for (; e < end; e++)
+    {
+      if (element_claim_if_unassigned(e))
+	{
+	  element_initialise_and_publish(e, key, hash_table->kmer_size);
+	  __atomic_fetch_add(&hash_table->unique_kmers, 1, __ATOMIC_RELAXED);
+	  *found = false;
+	  return e;
+	}
+
+      //slot is taken, possibly by a thread inserting this same key right now
+      element_wait_until_published(e);
+
+      if (binary_kmer_comparison_operator(e->kmer, *key))
+	{
+	  *found = true;
+	  return e;
+	}
+    }
+
+  return NULL;
+}
+
+
+//thread-safe version of hash_table_find_or_insert. Nothing is ever removed from the
+//table while loading, so a full bucket which does not contain the key never will,
+//and we can safely move on to the next rehash.
+static Element * hash_table_find_or_insert_concurrent_starting_at(Key key, uint32_t first_bucket, boolean * found,  HashTable * hash_table){
+  
+  Element * ret = NULL;
+  int rehash = 0;
+
+  while ((ret = hash_table_find_or_insert_in_bucket_concurrent(key, rehash==0 ? first_bucket : hash_table_get_bucket(key, hash_table, rehash), found, hash_table)) == NULL)
+    {
+      rehash++;
+      if (rehash>hash_table->max_rehash_tries)
+	{
+	  if (hash_table->grow_when_full)
+	    {
+	      return NULL; //caller grows the table
+	    }
+	  die("Dear user - you have not allocated enough memory to contain your sequence data. Either allocate more memory (have you done your calculations right? have you allowed for sequencing errors?), or threshold more harshly on quality score, and try again. Aborting mission.\n");
+	}
+    }
+  
+  __atomic_fetch_add(&hash_table->collisions[rehash], 1, __ATOMIC_RELAXED);
+  return ret;
+}
+
+
+
+// Growing the table. Every element is moved into a table with twice as many
+// buckets. Elements are packed into the first free slot of the first bucket with
+// room, as hash_table_insert does, so they are found by the usual lookups.
+// Bucket numbers are ints (see hash_value_with_rehash), which limits the size.
+#define HASH_TABLE_MAX_BUCKETS ((long long) 1 << 30)
+
+//tables sized for an estimated number of kmers are filled this far
+#define HASH_TABLE_AUTO_LOAD 0.8
+
+void hash_table_size_for_kmers(long long num_kmers, int min_bucket_size, int * number_bits, int * bucket_size)
+{
+  long long capacity = (long long) (num_kmers / HASH_TABLE_AUTO_LOAD) + 1;
+  int bits = 10;
+
+  //as many buckets as we can, then make them deep enough, up to twice min_bucket_size
+  while ((long long) min_bucket_size << (bits+1) <= capacity && ((long long) 1 << (bits+1)) <= HASH_TABLE_MAX_BUCKETS)
+    {
+      bits++;
+    }
+
+  long long size = (capacity + ((long long) 1 << bits) - 1) >> bits;
+
+  *number_bits = bits;
+  *bucket_size = size < min_bucket_size ? min_bucket_size : (size > SHRT_MAX ? SHRT_MAX : size);
+}
+
+void hash_table_set_grow_when_full(HashTable * hash_table, boolean grow_when_full)
+{
+  hash_table->grow_when_full = grow_when_full;
+}
+
+static boolean hash_table_move_elements(HashTable * hash_table, long long number_buckets, Element * table, short * next_element)
+{
+  long long i;
+  long long capacity = hash_table_get_capacity(hash_table);
+  int rehash;
+
+  for (i=0; i<capacity; i++)
+    {
+      Element * e = &hash_table->table[i];
+
+      if (db_node_check_for_flag_ALL_OFF(e))
+	{
+	  continue;
+	}
+
+      for (rehash=0; rehash<=hash_table->max_rehash_tries; rehash++)
+	{
+	  uint32_t hashval = hash_value_with_rehash(&e->kmer, rehash, number_buckets);
+
+	  if (next_element[hashval] < hash_table->bucket_size)
+	    {
+	      element_assign(&table[(long long) hashval * hash_table->bucket_size + next_element[hashval]], e);
+	      next_element[hashval]++;
+	      break;
+	    }
+	}
+
+      if (rehash>hash_table->max_rehash_tries)
+	{
+	  return false;
+	}
+    }
+
+  return true;
+}
+
+boolean hash_table_grow(HashTable * hash_table)
+{
+  long long number_buckets = hash_table->number_buckets;
+
+  if (hash_table->perfect_hash != NULL)
+    {
+      return false;
+    }
+
+  //doubling is nearly always enough, as the new table starts half full
+  while ((number_buckets *= 2) <= HASH_TABLE_MAX_BUCKETS)
+    {
+      Element * table = calloc(number_buckets * hash_table->bucket_size, sizeof(Element));
+      short * next_element = calloc(number_buckets, sizeof(short));
+
+      if (table == NULL || next_element == NULL)
+	{
+	  free(table);
+	  free(next_element);
+	  return false;
+	}
+
+      if (hash_table_move_elements(hash_table, number_buckets, table, next_element))
+	{
+	  hash_table_free_arrays(hash_table);
+	  hash_table->table = table;
+	  hash_table->next_element = next_element;
+	  hash_table->number_buckets = number_buckets;
+	  hash_table->generation++;
+
+	  printf("Hash table full - grew it to %qd buckets of %d\n", number_buckets, hash_table->bucket_size);
+	  return true;
+	}
+
+      free(table);
+      free(next_element);
+    }
+
+  return false;
+}
+
+static void hash_table_grow_or_die(HashTable * hash_table)
+{
+  if (!hash_table_grow(hash_table))
+    {
+      die("Unable to grow the hash table - not enough memory, or it is as big as it can be. "
+	  "Either allocate more memory, or threshold more harshly on quality score, and try again.\n");
+    }
+}
+
+void hash_table_begin_concurrent_inserts(HashTable * hash_table)
+{
+  pthread_rwlock_rdlock(&hash_table->grow_lock);
+}
+
+void hash_table_end_concurrent_inserts(HashTable * hash_table)
+{
+  pthread_rwlock_unlock(&hash_table->grow_lock);
+}
+
+// Called by a thread between hash_table_begin/end_concurrent_inserts, whose insert
+// failed. Waits for all the other threads to leave, and grows the table unless
+// one of them already has.
+static void hash_table_grow_concurrent(HashTable * hash_table)
+{
+  long long generation = hash_table->generation;
+
+  pthread_rwlock_unlock(&hash_table->grow_lock);
+  pthread_rwlock_wrlock(&hash_table->grow_lock);
+
+  if (hash_table->generation == generation)
+    {
+      hash_table_grow_or_die(hash_table);
+    }
+
+  pthread_rwlock_unlock(&hash_table->grow_lock);
+  pthread_rwlock_rdlock(&hash_table->grow_lock);
+}
+
+
+
+
+Element * hash_table_find(Key key, HashTable * hash_table)
+{
+  if (hash_table == NULL) 
+    {
+      die("hash_table_find has been called with a NULL table! Exiting");
+    }
+
+  if (hash_table->perfect_hash != NULL)
+    {
+      return hash_table_find_frozen(key, hash_table);
+    }
+
+  return hash_table_find_starting_at(key, hash_table_get_bucket(key, hash_table, 0), hash_table);
+}
+
+Element * hash_table_find_or_insert(Key key, boolean * found,  HashTable * hash_table){
+  
+  if (hash_table == NULL) {
+    die("NULL table!");
+  }
+
+  if (hash_table->perfect_hash != NULL)
+    {
+      return hash_table_find_frozen_or_die(key, found, hash_table);
+    }
+
+  Element * e;
+
+  while ((e = hash_table_find_or_insert_starting_at(key, hash_table_get_bucket(key, hash_table, 0), found, hash_table)) == NULL)
+    {
+      hash_table_grow_or_die(hash_table);
+    }
+
+  return e;
+}
+
+//this methods inserts an element in the next available bucket
+//it doesn't check whether another element with the same key is present in the table
+//used for fast loading when it is known that all the elements in the input have different key
+Element * hash_table_insert(Key key, HashTable * hash_table){
+  
+  if (hash_table == NULL) {
+    die("NULL table!");
+  }
+
+  if (hash_table->perfect_hash != NULL)
+    {
+      die("Cannot add new kmers to the graph once it has been frozen\n");
+    }
+
+  Element * e;
+
+  while ((e = hash_table_insert_starting_at(key, hash_table_get_bucket(key, hash_table, 0), hash_table)) == NULL)
+    {
+      hash_table_grow_or_die(hash_table);
+    }
+
+  return e;
+}
+
+Element * hash_table_find_or_insert_concurrent(Key key, boolean * found,  HashTable * hash_table){
+  
+  if (hash_table == NULL) {
+    die("NULL table!");
+  }
+
+  if (hash_table->perfect_hash != NULL)
+    {
+      return hash_table_find_frozen_or_die(key, found, hash_table);
+    }
+
+  Element * e;
+
+  //only NULL if the table may grow, in which case we are between
+  //hash_table_begin/end_concurrent_inserts
+  while ((e = hash_table_find_or_insert_concurrent_starting_at(key, hash_table_get_bucket(key, hash_table, 0), found, hash_table)) == NULL)
+    {
+      hash_table_grow_concurrent(hash_table);
+    }
+
+  return e;
+}
+
+
+// Batched lookups. Random accesses into a big table are dominated by cache/TLB
+// misses, so hash a chunk of keys and prefetch all their buckets before searching
+// any of them, and the misses overlap instead of happening one after another.
+// Keys are resolved in order, so repeated keys within a batch behave exactly as
+// with the single-key functions.
+#define HASH_TABLE_PREFETCH_CHUNK 32
+
+static inline void hash_table_prefetch_chunk(BinaryKmer * keys, int num_keys, uint32_t * buckets, HashTable * hash_table){
+  int i;
+  for (i=0; i<num_keys; i++)
+    {
+      buckets[i] = hash_table_get_bucket(&keys[i], hash_table, 0);
+      Element * first = &hash_table->table[(long long) buckets[i] * hash_table->bucket_size];
+      __builtin_prefetch(first, 1, 1);
+      __builtin_prefetch(first+1, 1, 1);
+    }
+}
+
+void hash_table_find_or_insert_batch(BinaryKmer * keys, int num_keys, Element ** elements, boolean * found, HashTable * hash_table){
+  uint32_t buckets[HASH_TABLE_PREFETCH_CHUNK];
+  int i, j, n;
+
+  if (hash_table->perfect_hash != NULL)
+    {
+      for (i=0; i<num_keys; i++)
+	{
+	  elements[i] = hash_table_find_frozen_or_die(&keys[i], &found[i], hash_table);
+	}
+      return;
+    }
+
+  for (i=0; i<num_keys; i+=n)
+    {
+      n = num_keys-i < HASH_TABLE_PREFETCH_CHUNK ? num_keys-i : HASH_TABLE_PREFETCH_CHUNK;
+      hash_table_prefetch_chunk(keys+i, n, buckets, hash_table);
+      for (j=0; j<n; j++)
+	{
+	  if ((elements[i+j] = hash_table_find_or_insert_starting_at(&keys[i+j], buckets[j], &found[i+j], hash_table)) == NULL)
+	    {
+	      //grow, and carry on from this key with the buckets of the new table
+	      hash_table_grow_or_die(hash_table);
+	      hash_table_find_batch(keys, i+j, elements, hash_table);
+	      n = j;
+	      break;
+	    }
+	}
+    }
+}
+
+void hash_table_find_or_insert_batch_concurrent(BinaryKmer * keys, int num_keys, Element ** elements, boolean * found, HashTable * hash_table){
+  uint32_t buckets[HASH_TABLE_PREFETCH_CHUNK];
+  int i, j, n;
+
+  if (hash_table->perfect_hash != NULL)
+    {
+      for (i=0; i<num_keys; i++)
+	{
+	  elements[i] = hash_table_find_frozen_or_die(&keys[i], &found[i], hash_table);
+	}
+      return;
+    }
+
+  for (i=0; i<num_keys; i+=n)
+    {
+      n = num_keys-i < HASH_TABLE_PREFETCH_CHUNK ? num_keys-i : HASH_TABLE_PREFETCH_CHUNK;
+      hash_table_prefetch_chunk(keys+i, n, buckets, hash_table);
+      for (j=0; j<n; j++)
+	{
+	  if ((elements[i+j] = hash_table_find_or_insert_concurrent_starting_at(&keys[i+j], buckets[j], &found[i+j], hash_table)) == NULL)
+	    {
+	      //grow, and carry on from this key with the buckets of the new table
+	      hash_table_grow_concurrent(hash_table);
+	      hash_table_find_batch(keys, i+j, elements, hash_table);
+	      n = j;
+	      break;
+	    }
+	}
+    }
+}
+
+void hash_table_insert_batch(BinaryKmer * keys, int num_keys, Element ** elements, HashTable * hash_table){
+  uint32_t buckets[HASH_TABLE_PREFETCH_CHUNK];
+  int i, j, n;
+
+  if (hash_table->perfect_hash != NULL)
+    {
+      die("Cannot add new kmers to the graph once it has been frozen\n");
+    }
+
+  for (i=0; i<num_keys; i+=n)
+    {
+      n = num_keys-i < HASH_TABLE_PREFETCH_CHUNK ? num_keys-i : HASH_TABLE_PREFETCH_CHUNK;
+      hash_table_prefetch_chunk(keys+i, n, buckets, hash_table);
+      for (j=0; j<n; j++)
+	{
+	  if ((elements[i+j] = hash_table_insert_starting_at(&keys[i+j], buckets[j], hash_table)) == NULL)
+	    {
+	      //grow, and carry on from this key with the buckets of the new table
+	      hash_table_grow_or_die(hash_table);
+	      hash_table_find_batch(keys, i+j, elements, hash_table);
+	      n = j;
+	      break;
+	    }
+	}
+    }
+}
+
+void hash_table_find_batch(BinaryKmer * keys, int num_keys, Element ** elements, HashTable * hash_table){
+  uint32_t buckets[HASH_TABLE_PREFETCH_CHUNK];
+  int i, j, n;
+
+  if (hash_table->perfect_hash != NULL)
+    {
+      for (i=0; i<num_keys; i++)
+	{
+	  elements[i] = hash_table_find_frozen(&keys[i], hash_table);
+	}
+      return;
+    }
+
+  for (i=0; i<num_keys; i+=HASH_TABLE_PREFETCH_CHUNK)
+    {
+      n = num_keys-i < HASH_TABLE_PREFETCH_CHUNK ? num_keys-i : HASH_TABLE_PREFETCH_CHUNK;
+      hash_table_prefetch_chunk(keys+i, n, buckets, hash_table);
+      for (j=0; j<n; j++)
+	{
+	  elements[i+j] = hash_table_find_starting_at(&keys[i+j], buckets[j], hash_table);
+	}
+    }
+}
+
+
+//thread-safe version of hash_table_apply_or_insert - f must itself be thread-safe,
+//eg use db_node_update_coverage_atomic
+boolean hash_table_apply_or_insert_concurrent(Key key, void (*f)(Element *), HashTable * hash_table){
+
+  boolean found;
+  Element * e = hash_table_find_or_insert_concurrent(key, &found, hash_table);
+
+  if (found)
+    {
+      f(e);
+    }
+
+  return found;
+}
+
 void hash_table_print_stats(HashTable * hash_table)
 {
   int k;
@@ -429,6 +1006,333 @@ long long hash_table_get_unique_kmers(HashTable * hash_table)
 }
 
 
+boolean hash_table_freeze(HashTable * hash_table)
+{
+  if (hash_table->perfect_hash != NULL)
+    {
+      return true;
+    }
+
+  long long num_slots = hash_table->number_buckets * hash_table->bucket_size;
+  PerfectHash * perfect_hash = perfect_hash_new(hash_table->table, num_slots);
+  if (perfect_hash == NULL)
+    {
+      return false;
+    }
+
+  //pack the kmers at the front of the table, then swap each into its place. Every
+  //swap puts one kmer where it belongs, so this needs no second table
+  long long n = 0;
+  long long i;
+  for (i=0; i<num_slots; i++)
+    {
+      if (!db_node_check_for_flag_ALL_OFF(&hash_table->table[i]))
+	{
+	  if (i != n)
+	    {
+	      element_assign(&hash_table->table[n], &hash_table->table[i]);
+	    }
+	  n++;
+	}
+    }
+
+  Element tmp;
+  for (i=0; i<n; i++)
+    {
+      long long pos;
+      while ((pos = perfect_hash_lookup(&hash_table->table[i].kmer, perfect_hash)) != i)
+	{
+	  element_assign(&tmp, &hash_table->table[pos]);
+	  element_assign(&hash_table->table[pos], &hash_table->table[i]);
+	  element_assign(&hash_table->table[i], &tmp);
+	}
+    }
+
+  //giving back the empty slots cannot fail, but keep the old pointer if it does. A
+  //table in an image is copied out of it, if there is room
+  Element * table;
+  if (hash_table->image == NULL)
+    {
+      table = realloc(hash_table->table, (n > 0 ? n : 1) * sizeof(Element));
+      free(hash_table->next_element);
+    }
+  else
+    {
+      table = malloc((n > 0 ? n : 1) * sizeof(Element));
+      if (table != NULL)
+	{
+	  memcpy(table, hash_table->table, n * sizeof(Element));
+	  hash_table_free_arrays(hash_table);
+	}
+    }
+  if (table == NULL)
+    {
+      table = hash_table->table;
+    }
+
+  hash_table->table          = table;
+  hash_table->next_element   = NULL;
+  hash_table->number_buckets = perfect_hash->num_keys;
+  hash_table->bucket_size    = 1;
+  hash_table->unique_kmers   = perfect_hash->num_keys;
+  hash_table->grow_when_full = false;
+  hash_table->perfect_hash   = perfect_hash;
+  hash_table->generation++;
+
+  return true;
+}
+
+boolean hash_table_is_frozen(HashTable * hash_table)
+{
+  return hash_table->perfect_hash != NULL;
+}
+
+
+#define HASH_TABLE_IMAGE_MAGIC "CTXIMAGE"
+//2 - visited marks are cleared on writing
+#define HASH_TABLE_IMAGE_VERSION 2
+//offsets of the arrays in the file are multiples of this, so they are page aligned when mapped
+#define HASH_TABLE_IMAGE_ALIGN 4096
+//elements copied at a time when writing the table
+#define HASH_TABLE_IMAGE_CHUNK 4096
+
+typedef struct
+{
+  char magic[8];
+  int32_t version;
+  //what the executable was built with
+  int32_t element_size;
+  int32_t number_of_bitfields;
+  int32_t number_of_colours;
+  uint32_t hash_check;
+  int32_t kmer_size;
+  int32_t bucket_size;
+  int32_t max_rehash_tries;
+  int64_t number_buckets;
+  int64_t unique_kmers;
+  //from the start of the file, and 0 if there is no such array
+  int64_t table_offset;
+  int64_t next_element_offset;
+  int64_t perfect_hash_offset;
+  int64_t end_offset;
+} HashTableImageHeader;
+
+// hashes of a few kmers, so an image is not opened by an executable which hashes differently
+static uint32_t hash_table_image_hash_check()
+{
+  BinaryKmer kmer;
+  uint32_t check = 0;
+  int i, rehash;
+
+  for (i=0; i<NUMBER_OF_BITFIELDS_IN_BINARY_KMER; i++)
+    {
+      kmer[i] = 0x0123456789ABCDEFULL * (i+1);
+    }
+  for (rehash=0; rehash<4; rehash++)
+    {
+      check = check * 31 + hash_value_with_rehash(&kmer, rehash, 1 << 30);
+    }
+  return check;
+}
+
+// writes zeros up to the next multiple of HASH_TABLE_IMAGE_ALIGN, and returns the offset there
+static long long hash_table_image_pad(FILE * fp)
+{
+  long long pos = ftell(fp);
+  if (pos < 0)
+    {
+      return -1;
+    }
+  while (pos % HASH_TABLE_IMAGE_ALIGN != 0)
+    {
+      if (fputc(0, fp) == EOF)
+	{
+	  return -1;
+	}
+      pos++;
+    }
+  return pos;
+}
+
+// writes the elements with their visited marks unset. A mark is only visited next to the
+// db_node_visited_epoch of this process, so left in, it could read as visited again in
+// the process which maps the image
+static boolean hash_table_image_write_elements(Element * table, long long num_elements, FILE * fp)
+{
+  Element * chunk = malloc(HASH_TABLE_IMAGE_CHUNK * sizeof(Element));
+  if (chunk == NULL)
+    {
+      return false;
+    }
+
+  long long i, j;
+  for (i=0; i<num_elements; i+=HASH_TABLE_IMAGE_CHUNK)
+    {
+      long long n = num_elements - i < HASH_TABLE_IMAGE_CHUNK ? num_elements - i : HASH_TABLE_IMAGE_CHUNK;
+      memcpy(chunk, table + i, n * sizeof(Element));
+      for (j=0; j<n; j++)
+	{
+	  db_node_action_unset_status_visited_of_any_epoch(&chunk[j]);
+	}
+      if (fwrite(chunk, sizeof(Element), n, fp) != n)
+	{
+	  free(chunk);
+	  return false;
+	}
+    }
+  free(chunk);
+  return true;
+}
+
+boolean hash_table_write_image(HashTable * hash_table, FILE * fp)
+{
+  HashTableImageHeader header;
+  long long capacity = hash_table_get_capacity(hash_table);
+  long long header_offset = ftell(fp);
+
+  memset(&header, 0, sizeof(HashTableImageHeader));
+  memcpy(header.magic, HASH_TABLE_IMAGE_MAGIC, sizeof(header.magic));
+  header.version             = HASH_TABLE_IMAGE_VERSION;
+  header.element_size        = sizeof(Element);
+  header.number_of_bitfields = NUMBER_OF_BITFIELDS_IN_BINARY_KMER;
+  header.number_of_colours   = NUMBER_OF_COLOURS;
+  header.hash_check          = hash_table_image_hash_check();
+  header.kmer_size           = hash_table->kmer_size;
+  header.bucket_size         = hash_table->bucket_size;
+  header.max_rehash_tries    = hash_table->max_rehash_tries;
+  header.number_buckets      = hash_table->number_buckets;
+  header.unique_kmers        = hash_table->unique_kmers;
+
+  //the header goes in twice - first to make room, then again with the offsets filled in
+  if ( (header_offset < 0) || (fwrite(&header, sizeof(HashTableImageHeader), 1, fp) != 1) )
+    {
+      return false;
+    }
+
+  header.table_offset = hash_table_image_pad(fp);
+  if ( (header.table_offset < 0) || !hash_table_image_write_elements(hash_table->table, capacity, fp) )
+    {
+      return false;
+    }
+  if (hash_table->next_element != NULL)
+    {
+      header.next_element_offset = hash_table_image_pad(fp);
+      if ( (header.next_element_offset < 0)
+	   || (fwrite(hash_table->next_element, sizeof(short), hash_table->number_buckets, fp) != hash_table->number_buckets) )
+	{
+	  return false;
+	}
+    }
+  if (hash_table->perfect_hash != NULL)
+    {
+      header.perfect_hash_offset = hash_table_image_pad(fp);
+      if ( (header.perfect_hash_offset < 0) || !perfect_hash_write(hash_table->perfect_hash, fp) )
+	{
+	  return false;
+	}
+    }
+  header.end_offset = ftell(fp);
+
+  return (fseek(fp, header_offset, SEEK_SET) == 0)
+    && (fwrite(&header, sizeof(HashTableImageHeader), 1, fp) == 1)
+    && (fseek(fp, header.end_offset, SEEK_SET) == 0);
+}
+
+HashTable * hash_table_open_image(char * filename, long long offset)
+{
+  int fd = open(filename, O_RDONLY);
+  struct stat st;
+
+  if ( (fd < 0) || (fstat(fd, &st) != 0) )
+    {
+      warn("Cannot open the graph image %s\n", filename);
+      if (fd >= 0)
+	{
+	  close(fd);
+	}
+      return NULL;
+    }
+  if ( (offset < 0) || (st.st_size < offset + (long long) sizeof(HashTableImageHeader)) )
+    {
+      warn("%s is too short to be a graph image\n", filename);
+      close(fd);
+      return NULL;
+    }
+
+  //private and writable - pages are shared until a process writes to one, and then it gets its own copy
+  char * image = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (image == MAP_FAILED)
+    {
+      warn("Cannot map the graph image %s\n", filename);
+      return NULL;
+    }
+
+  HashTableImageHeader header;
+  memcpy(&header, image + offset, sizeof(HashTableImageHeader));
+
+  char * problem = NULL;
+  if (memcmp(header.magic, HASH_TABLE_IMAGE_MAGIC, sizeof(header.magic)) != 0)
+    {
+      problem = "it is not a graph image";
+    }
+  else if (header.version != HASH_TABLE_IMAGE_VERSION)
+    {
+      problem = "it was written by another version of cortex";
+    }
+  else if ( (header.element_size != sizeof(Element)) || (header.number_of_bitfields != NUMBER_OF_BITFIELDS_IN_BINARY_KMER)
+	    || (header.number_of_colours != NUMBER_OF_COLOURS) )
+    {
+      problem = "it was written by an executable compiled with a different MAXK or NUM_COLS";
+    }
+  else if (header.hash_check != hash_table_image_hash_check())
+    {
+      problem = "it was written by an executable compiled with a different hash function (HASH=)";
+    }
+  else if (header.end_offset > st.st_size)
+    {
+      problem = "it is truncated";
+    }
+  if (problem != NULL)
+    {
+      warn("Cannot open the graph image %s, as %s\n", filename, problem);
+      munmap(image, st.st_size);
+      return NULL;
+    }
+
+  HashTable * hash_table = malloc(sizeof(HashTable));
+  long long * collisions = calloc(header.max_rehash_tries+1, sizeof(long long));
+  PerfectHash * perfect_hash = (header.perfect_hash_offset != 0) ? perfect_hash_map(image + header.perfect_hash_offset) : NULL;
+  if ( (hash_table == NULL) || (collisions == NULL) || ((header.perfect_hash_offset != 0) && (perfect_hash == NULL)) )
+    {
+      warn("Not enough memory to open the graph image %s\n", filename);
+      free(hash_table);
+      free(collisions);
+      perfect_hash_free(perfect_hash);
+      munmap(image, st.st_size);
+      return NULL;
+    }
+
+  hash_table->kmer_size        = header.kmer_size;
+  hash_table->number_buckets   = header.number_buckets;
+  hash_table->bucket_size      = header.bucket_size;
+  hash_table->max_rehash_tries = header.max_rehash_tries;
+  hash_table->unique_kmers     = header.unique_kmers;
+  hash_table->collisions       = collisions;
+  hash_table->table            = (Element *) (image + header.table_offset);
+  hash_table->next_element     = (header.next_element_offset != 0) ? (short *) (image + header.next_element_offset) : NULL;
+  hash_table_init(hash_table);
+  hash_table->perfect_hash     = perfect_hash;
+  hash_table->image            = image;
+  hash_table->image_size       = st.st_size;
+
+  //start reading the table in, if it is not already in the page cache
+  madvise(image, st.st_size, MADV_WILLNEED);
+
+  return hash_table;
+}
+
+
 long long hash_table_get_capacity(HashTable * hash_table){
   return hash_table->number_buckets*hash_table->bucket_size;
 }
@@ -96,13 +96,7 @@ void little_hash_table_free(LittleHashTable ** little_hash_table)
 boolean little_hash_table_find_in_bucket(Key key, long long * current_pos, boolean * overflow, LittleHashTable * little_hash_table, int rehash){
 
 
-  //add the rehash to the final bitfield in the BinaryKmer
-  BinaryKmer bkmer_with_rehash_added;
-  binary_kmer_initialise_to_zero(&bkmer_with_rehash_added);
-  binary_kmer_assignment_operator(bkmer_with_rehash_added, *key);
-  bkmer_with_rehash_added[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1] =   bkmer_with_rehash_added[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1]+ (bitfield_of_64bits) rehash;
-
-  int hashval = hash_value(&bkmer_with_rehash_added,little_hash_table->number_buckets);
+  int hashval = hash_value_with_rehash(key, rehash, little_hash_table->number_buckets);
 
 
   boolean found = false;
@@ -324,13 +318,7 @@ GenotypingElement * little_hash_table_insert(Key key, LittleHashTable * little_h
   int rehash = 0;
   boolean inserted = false;
   do{
-    //add the rehash to the final bitfield in the BinaryKmer
-    BinaryKmer bkmer_with_rehash_added;
-    binary_kmer_initialise_to_zero(&bkmer_with_rehash_added);
-    binary_kmer_assignment_operator(bkmer_with_rehash_added, *key);
-    bkmer_with_rehash_added[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1] =   bkmer_with_rehash_added[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1]+ (bitfield_of_64bits) rehash;
-
-    int hashval = hash_value(&bkmer_with_rehash_added,little_hash_table->number_buckets);
+    int hashval = hash_value_with_rehash(key, rehash, little_hash_table->number_buckets);
     
     if (little_hash_table->next_element[hashval] < little_hash_table->bucket_size)
       { //can insert element
@@ -0,0 +1,296 @@
+/*
+ * Copyright 2009-2011 Zamin Iqbal and Mario Caccamo
+ *
+ * CORTEX project contacts:
+ * 		M. Caccamo (mario.caccamo@bbsrc.ac.uk) and
+ * 		Z. Iqbal (zam@well.ox.ac.uk)
+ *
+ * **********************************************************************
+ *
+ * This file is part of CORTEX.
+ *
+ * CORTEX is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CORTEX is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CORTEX.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * **********************************************************************
+ */
+/*
+  open_hash/perfect_hash.c -- minimal perfect hash of the kmers of a table
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "open_hash/perfect_hash.h"
+
+#define PERFECT_HASH_BLOCK_WORDS 8
+#define PERFECT_HASH_BLOCK_BITS ((PERFECT_HASH_BLOCK_WORDS-1) * 64)
+
+// 64 bit finaliser from MurmurHash3
+static inline uint64_t perfect_hash_mix(uint64_t x)
+{
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+// the key hashed once, then rehashed differently for each level and mapped onto
+// the bits of the level
+static inline uint64_t perfect_hash_key(Key key)
+{
+  uint64_t h = 0x9E3779B97F4A7C15ULL;
+  int i;
+
+  for (i=0; i<NUMBER_OF_BITFIELDS_IN_BINARY_KMER; i++)
+    {
+      h = perfect_hash_mix(h ^ (*key)[i]);
+    }
+  return h;
+}
+
+static inline long long perfect_hash_bit(uint64_t h, int level, long long num_bits)
+{
+  h = perfect_hash_mix(h + 0x9E3779B97F4A7C15ULL * (level+1));
+  return (long long) (((unsigned __int128) h * (uint64_t) num_bits) >> 64);
+}
+
+static inline uint64_t * perfect_hash_word(uint64_t * level, long long bit)
+{
+  return &level[(bit / PERFECT_HASH_BLOCK_BITS) * PERFECT_HASH_BLOCK_WORDS + 1 + (bit % PERFECT_HASH_BLOCK_BITS) / 64];
+}
+
+static inline boolean perfect_hash_test(uint64_t * level, long long bit)
+{
+  return (*perfect_hash_word(level, bit) >> (bit % 64)) & 1;
+}
+
+static inline void perfect_hash_set(uint64_t * level, long long bit)
+{
+  *perfect_hash_word(level, bit) |= (uint64_t) 1 << (bit % 64);
+}
+
+void perfect_hash_free(PerfectHash * perfect_hash)
+{
+  if (perfect_hash==NULL)
+    {
+      return;
+    }
+  int l;
+  for (l=0; l<perfect_hash->num_levels && !perfect_hash->mapped; l++)
+    {
+      free(perfect_hash->levels[l]);
+    }
+  free(perfect_hash);
+}
+
+PerfectHash * perfect_hash_new(Element * table, long long num_slots)
+{
+  PerfectHash * perfect_hash = calloc(1, sizeof(PerfectHash));
+  if (perfect_hash==NULL)
+    {
+      return NULL;
+    }
+
+  long long i;
+  long long num_left = 0;
+  for (i=0; i<num_slots; i++)
+    {
+      if (!db_node_check_for_flag_ALL_OFF(&table[i]))
+	{
+	  num_left++;
+	}
+    }
+  perfect_hash->num_keys = num_left;
+
+  //the levels only need the hashes of the keys. Those still to place are kept at
+  //the front
+  uint64_t * hashes = malloc((num_left>0 ? num_left : 1) * sizeof(uint64_t));
+  uint64_t * collided = NULL;
+  if (hashes==NULL)
+    {
+      perfect_hash_free(perfect_hash);
+      return NULL;
+    }
+  num_left = 0;
+  for (i=0; i<num_slots; i++)
+    {
+      if (!db_node_check_for_flag_ALL_OFF(&table[i]))
+	{
+	  hashes[num_left++] = perfect_hash_key(&table[i].kmer);
+	}
+    }
+
+  long long offset = 0;
+  while (num_left>0)
+    {
+      int l = perfect_hash->num_levels;
+      if (l==PERFECT_HASH_MAX_LEVELS)
+	{
+	  die("Could not make a perfect hash of the kmers - are some of them in the table twice?");
+	}
+
+      long long num_blocks = (2*num_left + PERFECT_HASH_BLOCK_BITS-1) / PERFECT_HASH_BLOCK_BITS;
+      long long num_bits   = num_blocks * PERFECT_HASH_BLOCK_BITS;
+      uint64_t * level     = calloc(num_blocks * PERFECT_HASH_BLOCK_WORDS, sizeof(uint64_t));
+      free(collided);
+      collided = calloc(num_blocks * PERFECT_HASH_BLOCK_WORDS, sizeof(uint64_t));
+      if ( (level==NULL) || (collided==NULL) )
+	{
+	  free(level);
+	  free(collided);
+	  free(hashes);
+	  perfect_hash_free(perfect_hash);
+	  return NULL;
+	}
+      perfect_hash->levels[l]       = level;
+      perfect_hash->level_bits[l]   = num_bits;
+      perfect_hash->level_offset[l] = offset;
+      perfect_hash->num_levels++;
+
+      //which bits more than one key lands on
+      for (i=0; i<num_left; i++)
+	{
+	  long long bit = perfect_hash_bit(hashes[i], l, num_bits);
+	  if (perfect_hash_test(level, bit))
+	    {
+	      perfect_hash_set(collided, bit);
+	    }
+	  else
+	    {
+	      perfect_hash_set(level, bit);
+	    }
+	}
+
+      //keep the bits only one key landed on, and move the keys which collided to the front
+      long long w;
+      for (w=0; w<num_blocks * PERFECT_HASH_BLOCK_WORDS; w++)
+	{
+	  level[w] &= ~collided[w];
+	}
+      long long num_collided = 0;
+      for (i=0; i<num_left; i++)
+	{
+	  if (!perfect_hash_test(level, perfect_hash_bit(hashes[i], l, num_bits)))
+	    {
+	      hashes[num_collided++] = hashes[i];
+	    }
+	}
+      num_left = num_collided;
+
+      //and count the bits before each block, for ranking
+      long long b;
+      long long rank = 0;
+      for (b=0; b<num_blocks; b++)
+	{
+	  level[b * PERFECT_HASH_BLOCK_WORDS] = rank;
+	  for (w=1; w<PERFECT_HASH_BLOCK_WORDS; w++)
+	    {
+	      rank += __builtin_popcountll(level[b * PERFECT_HASH_BLOCK_WORDS + w]);
+	    }
+	}
+      offset += rank;
+    }
+
+  free(collided);
+  free(hashes);
+  return perfect_hash;
+}
+
+long long perfect_hash_lookup(Key key, PerfectHash * perfect_hash)
+{
+  uint64_t h = perfect_hash_key(key);
+  int l;
+
+  for (l=0; l<perfect_hash->num_levels; l++)
+    {
+      uint64_t * level = perfect_hash->levels[l];
+      long long bit = perfect_hash_bit(h, l, perfect_hash->level_bits[l]);
+
+      if (perfect_hash_test(level, bit))
+	{
+	  uint64_t * block = &level[(bit / PERFECT_HASH_BLOCK_BITS) * PERFECT_HASH_BLOCK_WORDS];
+	  long long bit_in_block = bit % PERFECT_HASH_BLOCK_BITS;
+	  long long rank = block[0];
+	  int w;
+
+	  for (w=0; w < bit_in_block/64; w++)
+	    {
+	      rank += __builtin_popcountll(block[1+w]);
+	    }
+	  rank += __builtin_popcountll(block[1+w] & (((uint64_t) 1 << (bit_in_block%64)) - 1));
+
+	  return perfect_hash->level_offset[l] + rank;
+	}
+    }
+  return -1;
+}
+
+static inline long long perfect_hash_level_words(PerfectHash * perfect_hash, int level)
+{
+  return perfect_hash->level_bits[level] / PERFECT_HASH_BLOCK_BITS * PERFECT_HASH_BLOCK_WORDS;
+}
+
+long long perfect_hash_get_bytes(PerfectHash * perfect_hash)
+{
+  long long bytes = sizeof(PerfectHash);
+  int l;
+
+  for (l=0; l<perfect_hash->num_levels; l++)
+    {
+      bytes += perfect_hash_level_words(perfect_hash, l) * sizeof(uint64_t);
+    }
+  return bytes;
+}
+
+// the struct (whose level pointers mean nothing once read back), then the levels one after the other
+boolean perfect_hash_write(PerfectHash * perfect_hash, FILE * fp)
+{
+  int l;
+
+  if (fwrite(perfect_hash, sizeof(PerfectHash), 1, fp) != 1)
+    {
+      return false;
+    }
+  for (l=0; l<perfect_hash->num_levels; l++)
+    {
+      long long words = perfect_hash_level_words(perfect_hash, l);
+      if (fwrite(perfect_hash->levels[l], sizeof(uint64_t), words, fp) != words)
+	{
+	  return false;
+	}
+    }
+  return true;
+}
+
+PerfectHash * perfect_hash_map(char * image)
+{
+  PerfectHash * perfect_hash = malloc(sizeof(PerfectHash));
+  if (perfect_hash==NULL)
+    {
+      return NULL;
+    }
+  memcpy(perfect_hash, image, sizeof(PerfectHash));
+  perfect_hash->mapped = true;
+
+  uint64_t * level = (uint64_t *) (image + sizeof(PerfectHash));
+  int l;
+  for (l=0; l<perfect_hash->num_levels; l++)
+    {
+      perfect_hash->levels[l] = level;
+      level += perfect_hash_level_words(perfect_hash, l);
+    }
+  return perfect_hash;
+}
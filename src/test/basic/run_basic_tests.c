@@ -125,6 +125,16 @@ int  main()
     return CU_get_error();
   }
 
+ if (NULL == CU_add_test(pSuite, "test binary kmer reverse complement of random kmers of every size, and compare speed with reversing one base at a time", test_binary_kmer_reverse_complement_of_random_kmers)) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+ if (NULL == CU_add_test(pSuite, "test rolling a kmer and its reverse complement along a read, and compare speed with reverse complementing each kmer", test_binary_kmer_rolling)) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
  if (NULL == CU_add_test(pSuite, "test seq reverse complement", test_seq_reverse_complement)) {
    CU_cleanup_registry();
    return CU_get_error();
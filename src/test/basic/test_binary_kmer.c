@@ -33,6 +33,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <time.h>
 
 // third party libraries
 #include <CUnit.h>
@@ -508,6 +509,214 @@ void test_binary_kmer_reverse_complement()
 }
 
 
+// The reverse complement as cortex used to compute it, one base at a time
+static void reverse_complement_one_base_at_a_time(BinaryKmer* kmer, short kmer_size,
+                                                  BinaryKmer* reverse)
+{
+  BinaryKmer copy;
+  binary_kmer_assignment_operator(copy, *kmer);
+  binary_kmer_initialise_to_zero(reverse);
+
+  int i;
+  for(i = 0; i < kmer_size; i++)
+  {
+    Nucleotide n = ~binary_kmer_get_last_nucleotide(&copy) & 0x3;
+    binary_kmer_right_shift_one_base(copy);
+    binary_kmer_left_shift_one_base_and_insert_new_base_at_right_end(reverse, n, kmer_size);
+  }
+}
+
+static double seconds_between(struct timespec* start, struct timespec* end)
+{
+  return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+void test_binary_kmer_reverse_complement_of_random_kmers()
+{
+  char alphabet[] = "ACGT";
+  char seq[32*NUMBER_OF_BITFIELDS_IN_BINARY_KMER];
+  char seq_rev[32*NUMBER_OF_BITFIELDS_IN_BINARY_KMER];
+  char expected[32*NUMBER_OF_BITFIELDS_IN_BINARY_KMER];
+  BinaryKmer kmer, kmer_reverse, kmer_reverse_again;
+  short kmer_size;
+  int i, j;
+
+  srand(1);
+
+  // every kmer size, not just those which need all the bitfields
+  for(kmer_size = 1; kmer_size < 32*NUMBER_OF_BITFIELDS_IN_BINARY_KMER; kmer_size += 2)
+  {
+    for(i = 0; i < 20; i++)
+    {
+      for(j = 0; j < kmer_size; j++)
+        seq[j] = alphabet[rand() % 4];
+      seq[kmer_size] = '\0';
+
+      seq_to_binary_kmer(seq, kmer_size, &kmer);
+      binary_kmer_reverse_complement(&kmer, kmer_size, &kmer_reverse);
+      seq_reverse_complement(seq, kmer_size, expected);
+      expected[kmer_size] = '\0';
+      CU_ASSERT_STRING_EQUAL(expected, binary_kmer_to_seq(&kmer_reverse, kmer_size, seq_rev));
+
+      binary_kmer_reverse_complement(&kmer_reverse, kmer_size, &kmer_reverse_again);
+      CU_ASSERT(binary_kmer_comparison_operator(kmer, kmer_reverse_again));
+    }
+  }
+
+  // compare speed with reversing one base at a time
+  kmer_size = 32*NUMBER_OF_BITFIELDS_IN_BINARY_KMER - 1;
+  int num_kmers = 1 << 20;
+  BinaryKmer* kmers = malloc(num_kmers * sizeof(BinaryKmer));
+  if(kmers == NULL)
+    die("Out of memory allocating kmers for the reverse complement benchmark\n");
+
+  for(i = 0; i < num_kmers; i++)
+  {
+    for(j = 0; j < kmer_size; j++)
+      seq[j] = alphabet[rand() % 4];
+    seq[kmer_size] = '\0';
+    seq_to_binary_kmer(seq, kmer_size, &kmers[i]);
+  }
+
+  struct timespec start, end;
+  bitfield_of_64bits checksum1 = 0, checksum2 = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 0; i < num_kmers; i++)
+  {
+    reverse_complement_one_base_at_a_time(&kmers[i], kmer_size, &kmer_reverse);
+    checksum1 += kmer_reverse[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1];
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double one_base_secs = seconds_between(&start, &end);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(i = 0; i < num_kmers; i++)
+  {
+    binary_kmer_reverse_complement(&kmers[i], kmer_size, &kmer_reverse);
+    checksum2 += kmer_reverse[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1];
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double word_secs = seconds_between(&start, &end);
+
+  CU_ASSERT(checksum1 == checksum2);
+
+  printf("\nk=%d, reverse complement one base at a time: %.2f million kmers/sec\n",
+         kmer_size, num_kmers / one_base_secs / 1e6);
+  printf("k=%d, binary_kmer_reverse_complement:         %.2f million kmers/sec\n",
+         kmer_size, num_kmers / word_secs / 1e6);
+
+  free(kmers);
+}
+
+void test_binary_kmer_rolling()
+{
+  char alphabet[] = "ACGT";
+  int read_len = 1000;
+  char read[read_len+1];
+  char seq[32*NUMBER_OF_BITFIELDS_IN_BINARY_KMER];
+  BinaryKmer kmer, kmer_reverse;
+  RollingBinaryKmer rolling;
+  Orientation orientation;
+  short kmer_size;
+  int i;
+
+  srand(2);
+  for(i = 0; i < read_len; i++)
+    read[i] = alphabet[rand() % 4];
+  read[read_len] = '\0';
+
+  // the smallest and largest kmer sizes this build supports
+  short kmer_sizes[] = {32*NUMBER_OF_BITFIELDS_IN_BINARY_KMER - 31,
+                        32*NUMBER_OF_BITFIELDS_IN_BINARY_KMER - 1};
+  int s;
+
+  for(s = 0; s < 2; s++)
+  {
+    kmer_size = kmer_sizes[s];
+    strncpy(seq, read, kmer_size);
+    seq[kmer_size] = '\0';
+    seq_to_binary_kmer(seq, kmer_size, &kmer);
+    binary_kmer_rolling_set(&rolling, &kmer, kmer_size);
+
+    for(i = kmer_size; i <= read_len; i++)
+    {
+      if(i > kmer_size)
+      {
+        binary_kmer_rolling_add_base(&rolling, char_to_binary_nucleotide(read[i-1]),
+                                     kmer_size);
+      }
+
+      // kmer ending at read[i-1]
+      strncpy(seq, read + i - kmer_size, kmer_size);
+      seq_to_binary_kmer(seq, kmer_size, &kmer);
+      binary_kmer_reverse_complement(&kmer, kmer_size, &kmer_reverse);
+      CU_ASSERT(binary_kmer_comparison_operator(rolling.forward, kmer));
+      CU_ASSERT(binary_kmer_comparison_operator(rolling.reverse, kmer_reverse));
+
+      BinaryKmer* key = binary_kmer_rolling_get_key(&rolling, kmer_size, &orientation);
+      if(binary_kmer_less_than(kmer, kmer_reverse, kmer_size))
+      {
+        CU_ASSERT(binary_kmer_comparison_operator(*key, kmer));
+        CU_ASSERT(orientation == forward);
+      }
+      else
+      {
+        CU_ASSERT(binary_kmer_comparison_operator(*key, kmer_reverse));
+        CU_ASSERT(orientation == reverse);
+      }
+    }
+  }
+
+  // compare speed with shifting in the base and reverse complementing the kmer
+  kmer_size = 32*NUMBER_OF_BITFIELDS_IN_BINARY_KMER - 1;
+  strncpy(seq, read, kmer_size);
+  seq[kmer_size] = '\0';
+  int num_passes = 1000;
+  int p;
+  struct timespec start, end;
+  bitfield_of_64bits checksum1 = 0, checksum2 = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(p = 0; p < num_passes; p++)
+  {
+    seq_to_binary_kmer(seq, kmer_size, &kmer);
+    for(i = kmer_size; i < read_len; i++)
+    {
+      binary_kmer_left_shift_one_base_and_insert_new_base_at_right_end(&kmer,
+        char_to_binary_nucleotide(read[i]), kmer_size);
+      binary_kmer_reverse_complement(&kmer, kmer_size, &kmer_reverse);
+      BinaryKmer* key = binary_kmer_less_than(kmer_reverse, kmer, kmer_size) ? &kmer_reverse : &kmer;
+      checksum1 += (*key)[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1];
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double recompute_secs = seconds_between(&start, &end);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(p = 0; p < num_passes; p++)
+  {
+    seq_to_binary_kmer(seq, kmer_size, &kmer);
+    binary_kmer_rolling_set(&rolling, &kmer, kmer_size);
+    for(i = kmer_size; i < read_len; i++)
+    {
+      binary_kmer_rolling_add_base(&rolling, char_to_binary_nucleotide(read[i]), kmer_size);
+      BinaryKmer* key = binary_kmer_rolling_get_key(&rolling, kmer_size, &orientation);
+      checksum2 += (*key)[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1];
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double rolling_secs = seconds_between(&start, &end);
+
+  CU_ASSERT(checksum1 == checksum2);
+
+  long long num_kmers = (long long)num_passes * (read_len - kmer_size);
+  printf("\nk=%d, shift and reverse complement each kmer: %.2f million kmers/sec\n",
+         kmer_size, num_kmers / recompute_secs / 1e6);
+  printf("k=%d, rolling kmer and reverse complement:    %.2f million kmers/sec\n",
+         kmer_size, num_kmers / rolling_secs / 1e6);
+}
+
 void test_seq_reverse_complement()
 {
   char out[100];
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2009-2011 Zamin Iqbal and Mario Caccamo
+ * 
+ * CORTEX project contacts:  
+ * 		M. Caccamo (mario.caccamo@bbsrc.ac.uk) and 
+ * 		Z. Iqbal (zam@well.ox.ac.uk)
+ *
+ * **********************************************************************
+ *
+ * This file is part of CORTEX.
+ *
+ * CORTEX is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CORTEX is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CORTEX.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * **********************************************************************
+ */
+/*
+  file_cmp.c
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "file_cmp.h"
+
+boolean files_are_identical(char* file1, char* file2)
+{
+  FILE* fp1 = fopen(file1, "r");
+  FILE* fp2 = fopen(file2, "r");
+  boolean same = (fp1 != NULL && fp2 != NULL);
+  int c1, c2;
+
+  while(same)
+  {
+    c1 = getc(fp1);
+    c2 = getc(fp2);
+    same = (c1 == c2);
+    if(c1 == EOF)
+      break;
+  }
+
+  if(fp1 != NULL)
+    fclose(fp1);
+  if(fp2 != NULL)
+    fclose(fp2);
+  return same;
+}
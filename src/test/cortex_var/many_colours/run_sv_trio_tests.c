@@ -82,6 +82,14 @@ int  main()
     CU_cleanup_registry();
     return CU_get_error();
   }
+  if (NULL == CU_add_test(pPopGraphSuite, "Test coverage saturates in the bits stored per node, and compare node size and speed with 32-bit coverage", test_compact_coverage_saturates)) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+  if (NULL == CU_add_test(pPopGraphSuite, "Test unsetting the visited status of all nodes by starting a new epoch", test_unset_all_visited_status)) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
 
   if (NULL == CU_add_test(pPopGraphSuite, "Test function checking number of edges to nodes with specified status",test_db_graph_db_node_has_precisely_n_edges_with_status_in_one_colour    )) {
     CU_cleanup_registry();
@@ -138,6 +146,62 @@ int  main()
     CU_cleanup_registry();
     return CU_get_error();
   }
+  if (NULL == CU_add_test(pPopGraphSuite, "Test that loading sequence with several threads gives the same graph as loading with one thread", test_multithreaded_loading_gives_same_graph_as_single_threaded)) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+  if (NULL == CU_add_test(pPopGraphSuite, "Test that loading a colour list with several threads gives the same graph as loading with one thread", test_parallel_loading_of_colour_list)) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+  if (NULL == CU_add_test(pPopGraphSuite, "Test that compressed (version 7) binaries load to the same graph as version 6 binaries", test_compressed_binary_matches_binversion6)) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+  if (NULL == CU_add_test(pPopGraphSuite, "Test that dumping a binary with several threads gives the same file as with one thread", test_dump_binary_is_the_same_with_several_threads)) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+  if (NULL == CU_add_test(pPopGraphSuite, "Test that the default binary dumped from real data is the same as written a record at a time", test_default_dump_of_real_data_is_the_same_as_the_per_record_writer)) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+  if (NULL == CU_add_test(pPopGraphSuite, "Test estimating the number of kmers in sequence data, and growing the hash table while loading", test_estimate_kmers_and_grow_table_while_loading)) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+  if (NULL == CU_add_test(pPopGraphSuite, "Test calling bubbles with several threads gives the same calls as with one", test_detect_vars_is_the_same_with_several_threads)) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+  if (NULL == CU_add_test(pPopGraphSuite, "Test path divergence calls on several chromosomes with one thread and with several", test_pd_calls_on_several_chromosomes_with_several_threads)) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+  if (NULL == CU_add_test(pPopGraphSuite, "Test walking the graph with a unitig index takes the same steps and gives the same bubble calls, and compare speed", test_unitig_index_gives_the_same_steps_and_calls)) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+  if (NULL == CU_add_test(pPopGraphSuite, "Test genotyping a callfile with several threads gives the same output as with one", test_genotyping_callfile_is_the_same_with_several_threads)) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+  if (NULL == CU_add_test(pPopGraphSuite, "Test a frozen graph gives the same genotypes and as many bubble calls as the hash table, and compare speed", test_frozen_graph_gives_the_same_genotypes_and_calls)) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+  if (NULL == CU_add_test(pPopGraphSuite, "Test a graph mapped from an image is the same as the graph dumped, and gives the same calls, and compare speed with loading a binary", test_graph_image_gives_the_same_graph_and_calls)) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+  if (NULL == CU_add_test(pPopGraphSuite, "Test pruning, wiping a colour and counting coverages with several threads give the same graph and counts as with one", test_graph_passes_are_the_same_with_several_threads)) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+  if (NULL == CU_add_test(pPopGraphSuite, "Test the colour overlap matrix, counted in one pass with one or several threads, matches counting each pair of colours", test_colour_overlap_matrix)) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
 
 
 
@@ -357,11 +421,26 @@ int  main()
 	CU_cleanup_registry();
 	return CU_get_error();
       }
+   if (NULL == CU_add_test(pPopGraphSuite, "Test the coverage on the unique part of each branch leaves the allele status of the nodes alone", test_unique_branch_covg_ignores_and_keeps_allele_status_of_nodes))
+      {
+	CU_cleanup_registry();
+	return CU_get_error();
+      }
    if (NULL == CU_add_test(pPopGraphSuite, "Test calculation of genotype likelihoods for sites called by Bubble Caller", test_get_log_likelihood_of_genotype_on_variant_called_by_bubblecaller ))
       {
 	CU_cleanup_registry();
 	return CU_get_error();
       }
+   if (NULL == CU_add_test(pPopGraphSuite, "Test the table of log factorials leaves genotype likelihoods unchanged to the precision they are printed at", test_log_factorial_table_gives_unchanged_genotype_likelihoods ))
+      {
+	CU_cleanup_registry();
+	return CU_get_error();
+      }
+   if (NULL == CU_add_test(pPopGraphSuite, "Test genotyping a complex site against the errors in its neighbourhood gives the same likelihoods as against the whole graph", test_complex_site_neighbourhood_gives_same_genotype_likelihoods_as_whole_graph ))
+      {
+	CU_cleanup_registry();
+	return CU_get_error();
+      }
 
 //   if (NULL == CU_add_test(pPopGraphSuite, "Test classification of bubble as variant or repeat, comparing Hardy-Weinberg model with a repeat model", test_get_log_bayesfactor_varmodel_over_repeatmodel ))
   //    {
@@ -518,6 +597,13 @@ int  main()
 	return CU_get_error();
       }
 
+   if (NULL == CU_add_test(pPopGraphSuite, "Test error correction gives the same reads and stats with several threads", 
+			   test_error_correct_file_is_the_same_with_several_threads))
+      {
+	CU_cleanup_registry();
+	return CU_get_error();
+      }
+
 
 
  
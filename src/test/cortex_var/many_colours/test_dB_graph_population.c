@@ -33,6 +33,8 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <string.h>
+#include <time.h>
 
 // third party libraries
 #include <CUnit.h>
@@ -45,6 +47,8 @@
 #include "file_reader.h"
 #include "test_dB_graph_population.h"
 #include "dB_graph_population.h"
+#include "unitig_index.h"
+#include "file_cmp.h"
 
 // there are "pure" hash table tests which know nothing of the graph. This on the other hand
 // is a sanity check one level up from those
@@ -4759,3 +4763,739 @@ void test_dump_covg_distribution()
   
 
 }
+
+
+// Calling bubbles with several threads gives the same calls, in the same order,
+// as with one
+void test_detect_vars_is_the_same_with_several_threads()
+{
+  int kmer_size = 31;
+  int number_of_bits = 18; // big enough that the table is split into several ranges
+  int bucket_size = 10;
+  int max_retries = 10;
+  int max_branch_len = 100;
+
+  unsigned int files_loaded = 0;
+  unsigned long long bad_reads = 0, dup_reads = 0;
+  unsigned long long seq_read = 0, seq_loaded = 0;
+
+  dBGraph* db_graph = hash_table_new(number_of_bits, bucket_size, max_retries, kmer_size);
+
+  // a diploid individual in colour 0, and one of its haplotypes in the last colour
+  load_se_filelist_into_graph_colour("../data/test/sim/sim1_diploid_indiv_SNPS_only/reads.falist",
+                                     0, 0, false, 33, 0, db_graph, 0,
+                                     &files_loaded, &bad_reads, &dup_reads, &seq_read, &seq_loaded,
+                                     NULL, 0, &subsample_null);
+  load_se_filelist_into_graph_colour("../data/test/sim/sim1_diploid_indiv_SNPS_only/haplotype_1.falist",
+                                     0, 0, false, 33, NUMBER_OF_COLOURS-1, db_graph, 0,
+                                     &files_loaded, &bad_reads, &dup_reads, &seq_read, &seq_loaded,
+                                     NULL, 0, &subsample_null);
+
+  char* union_calls[] = {"../data/tempfiles_can_be_deleted/test_bubbles_threads.t1.bubbles",
+                         "../data/tempfiles_can_be_deleted/test_bubbles_threads.t4.bubbles"};
+  char* list_calls[] = {"../data/tempfiles_can_be_deleted/test_bubbles_threads.lists.t1.bubbles",
+                        "../data/tempfiles_can_be_deleted/test_bubbles_threads.lists.t4.bubbles"};
+  int num_threads[] = {1, 4};
+  int first_list[] = {0};
+  int second_list[] = {NUMBER_OF_COLOURS-1};
+  int i;
+
+  for(i = 0; i < 2; i++)
+  {
+    NUM_THREADS = num_threads[i];
+
+    FILE* fout = fopen(union_calls[i], "w");
+    db_graph_detect_vars(fout, max_branch_len, db_graph, &detect_vars_condition_always_true,
+                         &db_node_action_set_status_visited, &db_node_action_set_status_visited,
+                         &element_get_colour_union_of_all_colours, &element_get_covg_union_of_all_covgs,
+                         &print_no_extra_info, false, NULL, NULL, &db_node_condition_always_true);
+    fclose(fout);
+    hash_table_traverse(&db_node_set_status_to_none, db_graph);
+
+    // marking the bubbles in the haplotype to be ignored first
+    fout = fopen(list_calls[i], "w");
+    db_graph_detect_vars_given_lists_of_colours(fout, max_branch_len, db_graph,
+                                                first_list, 1, second_list, 1,
+                                                &detect_vars_condition_always_true, &print_no_extra_info,
+                                                true, &element_get_last_colour, &element_get_covg_last_colour,
+                                                false, NULL, NULL);
+    fclose(fout);
+    hash_table_traverse(&db_node_set_status_to_none, db_graph);
+  }
+  NUM_THREADS = 1;
+
+  // the SNPs between the haplotypes
+  FILE* fp = fopen(union_calls[0], "r");
+  int num_calls = 0;
+  char line[LINE_MAX];
+  while(fgets(line, LINE_MAX, fp) != NULL)
+  {
+    if(strstr(line, "_5p_flank") != NULL)
+      num_calls++;
+  }
+  fclose(fp);
+  CU_ASSERT(num_calls > 10);
+
+  CU_ASSERT(files_are_identical(union_calls[0], union_calls[1]));
+  CU_ASSERT(files_are_identical(list_calls[0], list_calls[1]));
+
+  hash_table_free(&db_graph);
+}
+
+
+void test_pd_calls_on_several_chromosomes_with_several_threads()
+{
+  int kmer_size = 31;
+  int number_of_bits = 18;
+  int bucket_size = 10;
+  int max_retries = 10;
+  int max_var_len = 10000;
+
+  unsigned int files_loaded = 0;
+  unsigned long long bad_reads = 0, dup_reads = 0;
+  unsigned long long seq_read = 0, seq_loaded = 0;
+
+  dBGraph* db_graph = hash_table_new(number_of_bits, bucket_size, max_retries, kmer_size);
+  GraphInfo* ginfo = graph_info_alloc_and_init();
+
+  // a diploid individual in colour 0, and one of its haplotypes as the reference in the last colour
+  load_se_filelist_into_graph_colour("../data/test/sim/sim1_diploid_indiv_SNPS_only/reads.falist",
+                                     0, 0, false, 33, 0, db_graph, 0,
+                                     &files_loaded, &bad_reads, &dup_reads, &seq_read, &seq_loaded,
+                                     NULL, 0, &subsample_null);
+  graph_info_set_seq(ginfo, 0, seq_loaded);
+  graph_info_set_mean_readlen(ginfo, 0, 100);
+  seq_loaded = 0;
+  load_se_filelist_into_graph_colour("../data/test/sim/sim1_diploid_indiv_SNPS_only/haplotype_1.falist",
+                                     0, 0, false, 33, NUMBER_OF_COLOURS-1, db_graph, 0,
+                                     &files_loaded, &bad_reads, &dup_reads, &seq_read, &seq_loaded,
+                                     NULL, 0, &subsample_null);
+  graph_info_set_seq(ginfo, NUMBER_OF_COLOURS-1, seq_loaded);
+  graph_info_set_mean_readlen(ginfo, NUMBER_OF_COLOURS-1, 100);
+
+  // the calls are genotyped too, on the threads, and the chromosomes share nodes
+  GraphAndModelInfo model_info;
+  initialise_model_info(&model_info, ginfo, 100000, 0.8, -1, 2*NUMBER_OF_COLOURS,
+                        EachColourADiploidSample, AssumeUncleaned);
+
+  // haplotype 1 twice, either side of the chromosome it was taken from. On one thread
+  // calling it visits their supernodes too, so they make no more calls; on several
+  // each chromosome is called afresh, numbered on from the earlier ones
+  char* ref_chroms[] = {"../data/test/sim/sim1_diploid_indiv_SNPS_only/haplotype_1.fa",
+                        "../data/test/sim/sim1_diploid_indiv_SNPS_only/Homo_sapiens.GRCh37.60.dna.chromosome.19.excerpt.fa",
+                        "../data/test/sim/sim1_diploid_indiv_SNPS_only/haplotype_1.fa"};
+  char* union_calls[] = {"../data/tempfiles_can_be_deleted/test_pd_threads.t1.calls",
+                         "../data/tempfiles_can_be_deleted/test_pd_threads.t4.calls"};
+  char* each_colour_calls[] = {"../data/tempfiles_can_be_deleted/test_pd_threads.each_colour.t1.calls",
+                               "../data/tempfiles_can_be_deleted/test_pd_threads.each_colour.t4.calls"};
+  int num_threads[] = {1, 4};
+  int num_vars[2];
+  int colours[] = {0, NUMBER_OF_COLOURS-1};
+  int i;
+
+  int call_chroms(char** chroms, int num_chroms, int len_list, boolean each_colour_separately, char* calls)
+  {
+    FILE* fout = fopen(calls, "w");
+    int num =
+      db_graph_make_reference_path_based_sv_calls_for_list_of_chroms(chroms, num_chroms, colours, len_list, each_colour_separately,
+                                                                     NUMBER_OF_COLOURS-1, 2, kmer_size,
+                                                                     max_var_len, 1, 10000000,
+                                                                     max_var_len, 2*max_var_len, db_graph, fout,
+                                                                     &make_reference_path_based_sv_calls_condition_always_true_in_subgraph_defined_by_func_of_colours,
+                                                                     &db_variant_action_do_nothing,
+                                                                     &print_no_extra_info, &model_info, AssumeUncleaned);
+    fclose(fout);
+    // one thread leaves its visited marks on the nodes
+    hash_table_traverse(&db_node_action_unset_status_visited_or_visited_and_exists_in_reference, db_graph);
+    return num;
+  }
+
+  for(i = 0; i < 2; i++)
+  {
+    NUM_THREADS = num_threads[i];
+    num_vars[i] = call_chroms(ref_chroms, 3, 1, false, union_calls[i]);
+    call_chroms(ref_chroms, 3, 2, true, each_colour_calls[i]);
+  }
+
+  NUM_THREADS = 1;
+
+  char* other_calls = "../data/tempfiles_can_be_deleted/test_pd_threads.other.calls";
+  int num_vars_hap1 = call_chroms(ref_chroms, 1, 1, false, other_calls);
+  int num_vars_chr19 = call_chroms(ref_chroms+1, 1, 1, false, other_calls);
+
+  // the SNPs between the haplotypes
+  FILE* fp = fopen(union_calls[0], "r");
+  int num_calls = 0;
+  char line[LINE_MAX];
+  char last_name[LINE_MAX] = "";
+  while(fgets(line, LINE_MAX, fp) != NULL)
+  {
+    if(strstr(line, "_5p_flank") != NULL)
+    {
+      num_calls++;
+      strcpy(last_name, line);
+    }
+  }
+  fclose(fp);
+  CU_ASSERT(num_calls > 10);
+  CU_ASSERT(num_vars[0] == num_vars_hap1);
+  CU_ASSERT(num_vars[1] == 2*num_vars_hap1 + num_vars_chr19);
+
+  fp = fopen(union_calls[1], "r");
+  while(fgets(line, LINE_MAX, fp) != NULL)
+  {
+    if(strstr(line, "_5p_flank") != NULL)
+    {
+      strcpy(last_name, line);
+    }
+  }
+  fclose(fp);
+  char expected_name[LINE_MAX];
+  sprintf(expected_name, ">var_%d_5p_flank ", num_vars[1]);
+  CU_ASSERT(strncmp(expected_name, last_name, strlen(expected_name)) == 0);
+
+  fp = fopen(each_colour_calls[0], "r");
+  int num_genotyped = 0;
+  while(fgets(line, LINE_MAX, fp) != NULL)
+  {
+    if(strncmp(line, "Colour/sample", 13) == 0)
+    {
+      num_genotyped++;
+    }
+  }
+  fclose(fp);
+  CU_ASSERT(num_genotyped > 10);
+  CU_ASSERT(files_are_identical(each_colour_calls[0], each_colour_calls[1]));
+
+  graph_info_free(ginfo);
+  hash_table_free(&db_graph);
+}
+
+
+void test_graph_passes_are_the_same_with_several_threads()
+{
+  int kmer_size = 31;
+  int number_of_bits = 18;
+  int bucket_size = 10;
+  int max_retries = 10;
+
+  unsigned int files_loaded = 0;
+  unsigned long long bad_reads = 0, dup_reads = 0;
+  unsigned long long seq_read = 0, seq_loaded = 0;
+
+  GraphInfo* ginfo = graph_info_alloc_and_init();
+  graph_info_set_seq(ginfo, 0, 1000);
+
+  Covg threshold = 12; // enough low coverage nodes next to ones which are kept
+
+  // Some low coverage nodes lose their forward edges, so that some edges have no
+  // edge back. A node keeps its edge to a pruned node which has no edge back to it
+  void remove_forward_edges_of_some_nodes(dBNode* node)
+  {
+    if(db_node_get_coverage(node, 0) <= threshold &&
+       (node->kmer[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1] & 1) == 0)
+    {
+      Nucleotide n;
+      for(n = Adenine; n <= Thymine; n++)
+        reset_one_edge(node, forward, n, 0);
+    }
+  }
+
+  // pruned one node at a time, as cortex always used to, then with 1 and 4 threads
+  dBGraph* graphs[3];
+  int i;
+  for(i = 0; i < 3; i++)
+  {
+    graphs[i] = hash_table_new(number_of_bits, bucket_size, max_retries, kmer_size);
+    load_se_filelist_into_graph_colour("../data/test/sim/sim1_diploid_indiv_SNPS_only/reads.falist",
+                                       0, 0, false, 33, 0, graphs[i], 0,
+                                       &files_loaded, &bad_reads, &dup_reads, &seq_read, &seq_loaded,
+                                       NULL, 0, &subsample_null);
+    hash_table_traverse(&remove_forward_edges_of_some_nodes, graphs[i]);
+  }
+
+  void prune_node(dBNode* node)
+  {
+    db_graph_db_node_prune_low_coverage_ignoring_colours(node, threshold,
+                                                         &db_node_action_set_status_pruned,
+                                                         graphs[0]);
+  }
+  hash_table_traverse(&prune_node, graphs[0]);
+
+  char* pruned[] = {"../data/tempfiles_can_be_deleted/test_passes_threads.pruned.expected.ctx",
+                    "../data/tempfiles_can_be_deleted/test_passes_threads.pruned.t1.ctx",
+                    "../data/tempfiles_can_be_deleted/test_passes_threads.pruned.t4.ctx"};
+  char* covg_distrib[] = {NULL,
+                          "../data/tempfiles_can_be_deleted/test_passes_threads.covg.t1",
+                          "../data/tempfiles_can_be_deleted/test_passes_threads.covg.t4"};
+  char* wiped[] = {NULL,
+                   "../data/tempfiles_can_be_deleted/test_passes_threads.wiped.t1.ctx",
+                   "../data/tempfiles_can_be_deleted/test_passes_threads.wiped.t4.ctx"};
+  int num_threads[] = {1, 1, 4};
+  long long num_covg1[3];
+
+  db_graph_dump_binary(pruned[0], &db_node_condition_always_true, graphs[0], ginfo, 6);
+  for(i = 1; i < 3; i++)
+  {
+    NUM_THREADS = num_threads[i];
+    num_covg1[i] = db_graph_count_covg1_kmers_in_func_of_colours(graphs[i], &element_get_covg_colour0);
+    db_graph_get_covg_distribution(covg_distrib[i], graphs[i], 0, &db_node_condition_always_true);
+
+    db_graph_remove_low_coverage_nodes_ignoring_colours(threshold, graphs[i]);
+    db_graph_dump_binary(pruned[i], &db_node_condition_always_true, graphs[i], ginfo, 6);
+
+    db_graph_wipe_colour(0, graphs[i]);
+    db_graph_dump_binary(wiped[i], &db_node_condition_always_true, graphs[i], ginfo, 6);
+  }
+  NUM_THREADS = 1;
+
+  CU_ASSERT(num_covg1[1] > 0);
+  CU_ASSERT(num_covg1[1] == num_covg1[2]);
+  CU_ASSERT(files_are_identical(covg_distrib[1], covg_distrib[2]));
+  CU_ASSERT(files_are_identical(pruned[0], pruned[1]));
+  CU_ASSERT(files_are_identical(pruned[0], pruned[2]));
+  CU_ASSERT(files_are_identical(wiped[1], wiped[2]));
+
+  graph_info_free(ginfo);
+  for(i = 0; i < 3; i++)
+    hash_table_free(&graphs[i]);
+}
+
+
+void test_colour_overlap_matrix()
+{
+  int kmer_size = 31;
+  int number_of_bits = 18;
+  int bucket_size = 10;
+  int max_retries = 10;
+
+  unsigned int files_loaded = 0;
+  unsigned long long bad_reads = 0, dup_reads = 0;
+  unsigned long long seq_read = 0, seq_loaded = 0;
+
+  dBGraph* db_graph = hash_table_new(number_of_bits, bucket_size, max_retries, kmer_size);
+  int last_col = NUMBER_OF_COLOURS-1;
+  load_se_filelist_into_graph_colour("../data/test/sim/sim1_diploid_indiv_SNPS_only/reads.falist",
+                                     0, 0, false, 33, 0, db_graph, 0,
+                                     &files_loaded, &bad_reads, &dup_reads, &seq_read, &seq_loaded,
+                                     NULL, 0, &subsample_null);
+  load_se_filelist_into_graph_colour("../data/test/sim/sim1_diploid_indiv_SNPS_only/haplotype_1.falist",
+                                     0, 0, false, 33, last_col, db_graph, 0,
+                                     &files_loaded, &bad_reads, &dup_reads, &seq_read, &seq_loaded,
+                                     NULL, 0, &subsample_null);
+
+  // prune some nodes, which must not be counted
+  db_graph_remove_low_coverage_nodes_ignoring_colours(1, db_graph);
+
+  int first_cols[] = {0, last_col, 0};
+  int second_cols[] = {last_col, 0};
+  long long overlaps[2][3];
+
+  // count each pair with a pass of its own, as cortex used to
+  long long expected[2][3];
+  int i, j;
+  for(j = 0; j < 2; j++)
+  {
+    for(i = 0; i < 3; i++)
+    {
+      long long in_both(dBNode* node)
+      {
+        if (db_node_is_this_node_in_this_person_or_populations_graph(node, first_cols[i])==true
+            && db_node_is_this_node_in_this_person_or_populations_graph(node, second_cols[j])==true)
+          return 1;
+        return 0;
+      }
+      expected[j][i] = hash_table_traverse_returning_sum(&in_both, db_graph);
+    }
+  }
+  CU_ASSERT(expected[0][0] > 0);
+  CU_ASSERT(expected[0][0] == expected[1][1]);
+
+  int num_threads[] = {1, 4};
+  int t;
+  for(t = 0; t < 2; t++)
+  {
+    NUM_THREADS = num_threads[t];
+    db_graph_get_colour_overlap_matrix(first_cols, 3, second_cols, 2, &overlaps[0][0], db_graph);
+    for(j = 0; j < 2; j++)
+    {
+      for(i = 0; i < 3; i++)
+      {
+        CU_ASSERT(overlaps[j][i] == expected[j][i]);
+      }
+    }
+  }
+  NUM_THREADS = 1;
+
+  hash_table_free(&db_graph);
+}
+
+
+static double seconds_since(struct timespec* start)
+{
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+
+// Every step the unitig index answers is the step a hash table lookup gives, and bubble
+// calls on an indexed graph are the same (and compare how long they take)
+void test_unitig_index_gives_the_same_steps_and_calls()
+{
+  int kmer_size = 31;
+  int number_of_bits = 18;
+  int bucket_size = 10;
+  int max_retries = 10;
+  int max_branch_len = 100;
+
+  unsigned int files_loaded = 0;
+  unsigned long long bad_reads = 0, dup_reads = 0;
+  unsigned long long seq_read = 0, seq_loaded = 0;
+
+  dBGraph* db_graph = hash_table_new(number_of_bits, bucket_size, max_retries, kmer_size);
+
+  load_se_filelist_into_graph_colour("../data/test/sim/sim1_diploid_indiv_SNPS_only/reads.falist",
+                                     0, 0, false, 33, 0, db_graph, 0,
+                                     &files_loaded, &bad_reads, &dup_reads, &seq_read, &seq_loaded,
+                                     NULL, 0, &subsample_null);
+  load_se_filelist_into_graph_colour("../data/test/sim/sim1_diploid_indiv_SNPS_only/haplotype_1.falist",
+                                     0, 0, false, 33, NUMBER_OF_COLOURS-1, db_graph, 0,
+                                     &files_loaded, &bad_reads, &dup_reads, &seq_read, &seq_loaded,
+                                     NULL, 0, &subsample_null);
+
+  char* calls[] = {"../data/tempfiles_can_be_deleted/test_unitig_index.hashed.bubbles",
+                   "../data/tempfiles_can_be_deleted/test_unitig_index.indexed.bubbles"};
+  double secs[2];
+  struct timespec start;
+  int i;
+
+  for(i = 0; i < 2; i++)
+  {
+    if(i == 1)
+    {
+      CU_ASSERT(db_graph_build_unitig_index(db_graph));
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    FILE* fout = fopen(calls[i], "w");
+    db_graph_detect_vars(fout, max_branch_len, db_graph, &detect_vars_condition_always_true,
+                         &db_node_action_set_status_visited, &db_node_action_set_status_visited,
+                         &element_get_colour_union_of_all_colours, &element_get_covg_union_of_all_covgs,
+                         &print_no_extra_info, false, NULL, NULL, &db_node_condition_always_true);
+    fclose(fout);
+    secs[i] = seconds_since(&start);
+    hash_table_traverse(&db_node_set_status_to_none, db_graph);
+  }
+
+  CU_ASSERT(files_are_identical(calls[0], calls[1]));
+  printf("\ndetect_vars: %.3f secs looking up kmers, %.3f secs with the unitig index\n", secs[0], secs[1]);
+
+  // every kmer is in one unitig, and most steps stay inside one
+  UnitigIndex* index = db_graph->unitig_index;
+  CU_ASSERT(index->num_positions == hash_table_get_unique_kmers(db_graph));
+  CU_ASSERT(index->num_unitigs < index->num_positions / 10);
+
+  long long num_steps = 0, num_answered = 0, num_wrong = 0;
+  void check_steps(dBNode* node)
+  {
+    Orientation o;
+    Nucleotide n;
+    for(o = forward; o <= reverse; o++)
+    {
+      for(n = Adenine; n <= Thymine; n++)
+      {
+        Orientation hashed_orientation = forward, indexed_orientation = forward;
+        Nucleotide hashed_reverse_edge, indexed_reverse_edge;
+        dBNode* indexed_node;
+        dBNode* hashed_node = db_graph_find_next_node(node, o, &hashed_orientation, n,
+                                                      &hashed_reverse_edge, db_graph);
+        num_steps++;
+        if(unitig_index_get_next_node(index, node, o, n, &indexed_node, &indexed_orientation,
+                                      &indexed_reverse_edge, db_graph))
+        {
+          num_answered++;
+          if(indexed_node != hashed_node || indexed_reverse_edge != hashed_reverse_edge ||
+             (hashed_node != NULL && indexed_orientation != hashed_orientation))
+            num_wrong++;
+        }
+      }
+    }
+  }
+  hash_table_traverse(&check_steps, db_graph);
+
+  CU_ASSERT(num_wrong == 0);
+  CU_ASSERT(num_answered > num_steps / 4);
+
+  // once there are new kmers the index is no longer used
+  BinaryKmer kmer, tmp_kmer;
+  seq_to_binary_kmer("ACGTTTTTTTTTTTTTTTTTTTTTTTTTTTT", kmer_size, &kmer);
+  boolean found;
+  hash_table_find_or_insert(element_get_key(&kmer, kmer_size, &tmp_kmer), &found, db_graph);
+  dBNode* indexed_node;
+  Orientation indexed_orientation;
+  Nucleotide indexed_reverse_edge;
+  CU_ASSERT(!unitig_index_get_next_node(index, index->positions[0].node, forward, Adenine,
+                                        &indexed_node, &indexed_orientation,
+                                        &indexed_reverse_edge, db_graph));
+
+  db_graph_free_unitig_index(db_graph);
+  CU_ASSERT(db_graph->unitig_index == NULL);
+  hash_table_free(&db_graph);
+}
+
+
+// Genotyping a callfile on a frozen graph gives the same output as on the open
+// hash table, and calling bubbles on it gives as many calls (in a different order,
+// as the kmers are in a different order)
+void test_frozen_graph_gives_the_same_genotypes_and_calls()
+{
+  int kmer_size = 31;
+  int number_of_bits = 18;
+  int bucket_size = 10;
+  int max_retries = 10;
+  int max_branch_len = 100;
+  int max_read_length = 1000;
+
+  unsigned int files_loaded = 0;
+  unsigned long long bad_reads = 0, dup_reads = 0;
+  unsigned long long seq_read = 0, seq_loaded = 0;
+
+  dBGraph* db_graph = hash_table_new(number_of_bits, bucket_size, max_retries, kmer_size);
+  GraphInfo* ginfo = graph_info_alloc_and_init();
+
+  load_se_filelist_into_graph_colour("../data/test/sim/sim1_diploid_indiv_SNPS_only/reads.falist",
+                                     0, 0, false, 33, 0, db_graph, 0,
+                                     &files_loaded, &bad_reads, &dup_reads, &seq_read, &seq_loaded,
+                                     NULL, 0, &subsample_null);
+  graph_info_set_seq(ginfo, 0, seq_loaded);
+  graph_info_set_mean_readlen(ginfo, 0, 100);
+  seq_loaded = 0;
+  load_se_filelist_into_graph_colour("../data/test/sim/sim1_diploid_indiv_SNPS_only/haplotype_1.falist",
+                                     0, 0, false, 33, NUMBER_OF_COLOURS-1, db_graph, 0,
+                                     &files_loaded, &bad_reads, &dup_reads, &seq_read, &seq_loaded,
+                                     NULL, 0, &subsample_null);
+  graph_info_set_seq(ginfo, NUMBER_OF_COLOURS-1, seq_loaded);
+  graph_info_set_mean_readlen(ginfo, NUMBER_OF_COLOURS-1, 100);
+
+  GraphAndModelInfo model_info;
+  initialise_model_info(&model_info, ginfo, 100000, 0.8, -1, 2*NUMBER_OF_COLOURS,
+                        EachColourADiploidSample, AssumeUncleaned);
+
+  char* calls[] = {"../data/tempfiles_can_be_deleted/test_frozen_graph.open.bubbles",
+                   "../data/tempfiles_can_be_deleted/test_frozen_graph.frozen.bubbles",
+                   "../data/tempfiles_can_be_deleted/test_frozen_graph.indexed.bubbles"};
+  char* genotyped[] = {"../data/tempfiles_can_be_deleted/test_frozen_graph.open.gt",
+                       "../data/tempfiles_can_be_deleted/test_frozen_graph.frozen.gt"};
+  long long num_sites[2];
+  int num_calls[3];
+  double secs[2];
+  struct timespec start;
+  long long unique_kmers = hash_table_get_unique_kmers(db_graph);
+  long long covg_sum(dBNode* e)
+  {
+    return element_get_covg_union_of_all_covgs(e);
+  }
+  long long sum_before = hash_table_traverse_returning_sum(&covg_sum, db_graph);
+  int i;
+
+  for(i = 0; i < 3; i++)
+  {
+    if(i == 1)
+    {
+      CU_ASSERT(hash_table_freeze(db_graph));
+      CU_ASSERT(hash_table_is_frozen(db_graph));
+      CU_ASSERT(hash_table_get_unique_kmers(db_graph) == unique_kmers);
+      CU_ASSERT(hash_table_get_capacity(db_graph) == unique_kmers);
+      CU_ASSERT(hash_table_traverse_returning_sum(&covg_sum, db_graph) == sum_before);
+    }
+    if(i == 2)
+    {
+      CU_ASSERT(db_graph_build_unitig_index(db_graph));
+    }
+
+    FILE* fout = fopen(calls[i], "w");
+    db_graph_detect_vars(fout, max_branch_len, db_graph, &detect_vars_condition_always_true,
+                         &db_node_action_set_status_visited, &db_node_action_set_status_visited,
+                         &element_get_colour_union_of_all_colours, &element_get_covg_union_of_all_covgs,
+                         &print_no_extra_info, false, NULL, NULL, &db_node_condition_always_true);
+    fclose(fout);
+    hash_table_traverse(&db_node_set_status_to_none, db_graph);
+
+    FILE* fp = fopen(calls[i], "r");
+    char line[LINE_MAX];
+    num_calls[i] = 0;
+    while(fgets(line, LINE_MAX, fp) != NULL)
+    {
+      if(strstr(line, "_5p_flank") != NULL)
+        num_calls[i]++;
+    }
+    fclose(fp);
+
+    // the calls made on the open table, genotyped on the open and the frozen table
+    if(i < 2)
+    {
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      fp = fopen(calls[0], "r");
+      fout = fopen(genotyped[i], "w");
+      num_sites[i] = db_graph_genotype_callfile(fp, fout, max_read_length, max_branch_len, BubbleCaller,
+                                                db_graph, &print_no_extra_info, &model_info);
+      fclose(fout);
+      fclose(fp);
+      secs[i] = seconds_since(&start);
+    }
+  }
+
+  CU_ASSERT(num_calls[0] > 10);
+  CU_ASSERT(num_calls[1] == num_calls[0]);
+  CU_ASSERT(files_are_identical(calls[1], calls[2]));
+  CU_ASSERT(num_sites[0] == num_calls[0]);
+  CU_ASSERT(num_sites[1] == num_sites[0]);
+  CU_ASSERT(files_are_identical(genotyped[0], genotyped[1]));
+  printf("\ngenotyping %lld sites: %.3f secs on the hash table, %.3f secs frozen\n", num_sites[0], secs[0], secs[1]);
+
+  // every slot of a frozen table holds a kmer, which find_or_insert still finds
+  boolean found = false;
+  dBNode* node = db_graph->table;
+  CU_ASSERT(hash_table_find_or_insert(&node->kmer, &found, db_graph) == node);
+  CU_ASSERT(found);
+
+  db_graph_free_unitig_index(db_graph);
+  graph_info_free(ginfo);
+  hash_table_free(&db_graph);
+}
+
+
+// A graph mapped from an image is the same as the one dumped, down to where each
+// kmer is in the table, so it gives the same calls in the same order - and writing
+// to it does not change the image. Likewise for an image of a frozen graph
+void test_graph_image_gives_the_same_graph_and_calls()
+{
+  int kmer_size = 31;
+  int number_of_bits = 18;
+  int bucket_size = 10;
+  int max_retries = 10;
+  int max_branch_len = 100;
+
+  unsigned int files_loaded = 0;
+  unsigned long long bad_reads = 0, dup_reads = 0;
+  unsigned long long seq_read = 0, seq_loaded = 0;
+
+  dBGraph* db_graph = hash_table_new(number_of_bits, bucket_size, max_retries, kmer_size);
+  GraphInfo* ginfo = graph_info_alloc_and_init();
+
+  load_se_filelist_into_graph_colour("../data/test/sim/sim1_diploid_indiv_SNPS_only/reads.falist",
+                                     0, 0, false, 33, 0, db_graph, 0,
+                                     &files_loaded, &bad_reads, &dup_reads, &seq_read, &seq_loaded,
+                                     NULL, 0, &subsample_null);
+  graph_info_set_seq(ginfo, 0, seq_loaded);
+  graph_info_set_mean_readlen(ginfo, 0, 100);
+  load_se_filelist_into_graph_colour("../data/test/sim/sim1_diploid_indiv_SNPS_only/haplotype_1.falist",
+                                     0, 0, false, 33, NUMBER_OF_COLOURS-1, db_graph, 0,
+                                     &files_loaded, &bad_reads, &dup_reads, &seq_read, &seq_loaded,
+                                     NULL, 0, &subsample_null);
+
+  char* binary = "../data/tempfiles_can_be_deleted/test_graph_image.ctx";
+  char* images[] = {"../data/tempfiles_can_be_deleted/test_graph_image.img",
+                    "../data/tempfiles_can_be_deleted/test_graph_image.frozen.img"};
+  char* calls[] = {"../data/tempfiles_can_be_deleted/test_graph_image.loaded.bubbles",
+                   "../data/tempfiles_can_be_deleted/test_graph_image.mapped.bubbles",
+                   "../data/tempfiles_can_be_deleted/test_graph_image.frozen.bubbles",
+                   "../data/tempfiles_can_be_deleted/test_graph_image.frozen_mapped.bubbles"};
+
+  void call_bubbles(char* filename, dBGraph* graph)
+  {
+    FILE* fout = fopen(filename, "w");
+    db_graph_detect_vars(fout, max_branch_len, graph, &detect_vars_condition_always_true,
+                         &db_node_action_set_status_visited, &db_node_action_set_status_visited,
+                         &element_get_colour_union_of_all_colours, &element_get_covg_union_of_all_covgs,
+                         &print_no_extra_info, false, NULL, NULL, &db_node_condition_always_true);
+    fclose(fout);
+    hash_table_traverse(&db_node_set_status_to_none, graph);
+  }
+
+  // compare loading the graph from a binary with mapping its image
+  db_graph_dump_binary(binary, &db_node_condition_always_true, db_graph, ginfo, BINVERSION);
+  db_graph_dump_image(images[0], db_graph, ginfo);
+
+  struct timespec start;
+  int num_cols = 0;
+  dBGraph* loaded = hash_table_new(number_of_bits, bucket_size, max_retries, kmer_size);
+  GraphInfo* loaded_ginfo = graph_info_alloc_and_init();
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  load_multicolour_binary_from_filename_into_graph(binary, loaded, loaded_ginfo, &num_cols);
+  double load_secs = seconds_since(&start);
+
+  GraphInfo* mapped_ginfo = graph_info_alloc_and_init();
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  dBGraph* mapped = load_graph_image(images[0], kmer_size, mapped_ginfo, &num_cols);
+  double map_secs = seconds_since(&start);
+  printf("\nopening a graph of %qd kmers: %.3f secs loading a binary, %.3f secs mapping an image\n",
+         hash_table_get_unique_kmers(db_graph), load_secs, map_secs);
+
+  CU_ASSERT(num_cols == NUMBER_OF_COLOURS);
+  CU_ASSERT(mapped_ginfo->total_sequence[0] == ginfo->total_sequence[0]);
+  CU_ASSERT(mapped_ginfo->mean_read_length[0] == 100);
+  CU_ASSERT(hash_table_get_unique_kmers(mapped) == hash_table_get_unique_kmers(db_graph));
+  CU_ASSERT(hash_table_get_capacity(mapped) == hash_table_get_capacity(db_graph));
+  CU_ASSERT(memcmp(mapped->table, db_graph->table, hash_table_get_capacity(db_graph) * sizeof(Element)) == 0);
+  CU_ASSERT(memcmp(mapped->next_element, db_graph->next_element, db_graph->number_buckets * sizeof(short)) == 0);
+
+  call_bubbles(calls[0], db_graph);
+  call_bubbles(calls[1], mapped);
+  CU_ASSERT(files_are_identical(calls[0], calls[1]));
+
+  // new kmers go into the mapped table but not the image
+  BinaryKmer kmer, tmp_kmer;
+  boolean found;
+  seq_to_binary_kmer("ACGTTTTTTTTTTTTTTTTTTTTTTTTTTTT", kmer_size, &kmer);
+  CU_ASSERT(hash_table_find(element_get_key(&kmer, kmer_size, &tmp_kmer), mapped) == NULL);
+  hash_table_find_or_insert(element_get_key(&kmer, kmer_size, &tmp_kmer), &found, mapped);
+  CU_ASSERT(hash_table_find(element_get_key(&kmer, kmer_size, &tmp_kmer), mapped) != NULL);
+  dBGraph* mapped_again = load_graph_image(images[0], kmer_size, mapped_ginfo, &num_cols);
+  CU_ASSERT(hash_table_find(element_get_key(&kmer, kmer_size, &tmp_kmer), mapped_again) == NULL);
+  hash_table_free(&mapped_again);
+
+  // a mapped table can still be frozen, and a frozen one mapped
+  CU_ASSERT(hash_table_freeze(db_graph));
+  CU_ASSERT(hash_table_freeze(mapped));
+  CU_ASSERT(mapped->image == NULL);
+  db_graph_dump_image(images[1], db_graph, ginfo);
+  dBGraph* frozen_mapped = load_graph_image(images[1], kmer_size, mapped_ginfo, &num_cols);
+  CU_ASSERT(hash_table_is_frozen(frozen_mapped));
+  CU_ASSERT(hash_table_get_unique_kmers(frozen_mapped) == hash_table_get_unique_kmers(db_graph));
+  CU_ASSERT(memcmp(frozen_mapped->table, db_graph->table, hash_table_get_unique_kmers(db_graph) * sizeof(Element)) == 0);
+
+  long long num_wrong = 0;
+  void check_found(dBNode* node)
+  {
+    dBNode* e = hash_table_find(&node->kmer, frozen_mapped);
+    if(e == NULL || e - frozen_mapped->table != node - db_graph->table)
+      num_wrong++;
+  }
+  hash_table_traverse(&check_found, db_graph);
+  CU_ASSERT(num_wrong == 0);
+
+  call_bubbles(calls[2], db_graph);
+  call_bubbles(calls[3], frozen_mapped);
+  CU_ASSERT(files_are_identical(calls[2], calls[3]));
+
+  // visited marks are only meaningful next to this process's epoch, so are not kept in an image
+  dBNode* visited_node = db_graph->table;
+  db_node_set_status(visited_node, visited);
+  db_graph_dump_image(images[1], db_graph, ginfo);
+  dBGraph* visited_mapped = load_graph_image(images[1], kmer_size, mapped_ginfo, &num_cols);
+  CU_ASSERT(db_node_check_status(visited_node, visited));
+  CU_ASSERT(db_node_check_status(&visited_mapped->table[0], none));
+  CU_ASSERT(memcmp(&visited_mapped->table[0].kmer, &visited_node->kmer, sizeof(BinaryKmer)) == 0);
+  hash_table_free(&visited_mapped);
+  db_node_set_status(visited_node, none);
+
+  graph_info_free(ginfo);
+  graph_info_free(loaded_ginfo);
+  graph_info_free(mapped_ginfo);
+  hash_table_free(&frozen_mapped);
+  hash_table_free(&mapped);
+  hash_table_free(&loaded);
+  hash_table_free(&db_graph);
+}
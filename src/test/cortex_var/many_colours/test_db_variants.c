@@ -31,6 +31,7 @@
 #include <stdlib.h>
 #include <time.h>
 #include <string.h>
+#include <math.h>
 
 #include <CUnit.h>
 
@@ -42,6 +43,10 @@
 #include "cmd_line.h"
 #include "graph_info.h"
 #include "db_differentiation.h"
+#include "maths.h"
+#include "model_info.h"
+#include "db_variants.h"
+#include "db_complex_genotyping.h"
 
 void test_count_reads_on_allele_in_specific_colour()
 {
@@ -103,6 +108,72 @@ void test_count_reads_on_allele_in_specific_colour()
 }
 
 
+//the allele each node is on is worked out per site, not written to the nodes, as
+//neighbouring sites genotyped on other threads may share them
+void test_unique_branch_covg_ignores_and_keeps_allele_status_of_nodes()
+{
+  dBNode* allele1[8];
+  dBNode* allele2[8];
+  int i;
+  for (i=0; i<8; i++)
+    {
+      allele1[i]=new_element();
+      allele2[i]=new_element();
+      db_node_set_coverage(allele1[i], 0, 10);
+      db_node_set_coverage(allele2[i], 0, 4);
+    }
+  //the branches meet at both ends, and share one interior node
+  free_element(&allele2[0]);
+  free_element(&allele2[3]);
+  free_element(&allele2[7]);
+  allele2[0]=allele1[0];
+  allele2[3]=allele1[3];
+  allele2[7]=allele1[7];
+  db_node_set_coverage(allele1[3], 0, 50);
+
+  GraphInfo* ginfo = graph_info_alloc_and_init();
+  graph_info_set_seq(ginfo, 0, 1000000);
+  graph_info_set_mean_readlen(ginfo, 0, 100);
+  CovgArray* working_ca = alloc_and_init_covg_array(20);
+
+  Covg clean1[NUMBER_OF_COLOURS];
+  Covg clean2[NUMBER_OF_COLOURS];
+  get_num_effective_reads_on_unique_part_of_branch(clean1, allele1, 7, clean2, allele2, 7,
+						   working_ca, ginfo, 31, false, -1, -1);
+  CU_ASSERT(clean1[0]==10);
+  CU_ASSERT(clean2[0]==4);
+
+  //as if another thread had left its marks on the nodes
+  for (i=0; i<8; i++)
+    {
+      db_node_set_allele_status(allele1[i], one);
+      db_node_set_allele_status(allele2[i], one);
+    }
+  Covg marked1[NUMBER_OF_COLOURS];
+  Covg marked2[NUMBER_OF_COLOURS];
+  get_num_effective_reads_on_unique_part_of_branch(marked1, allele1, 7, marked2, allele2, 7,
+						   working_ca, ginfo, 31, false, -1, -1);
+  CU_ASSERT(marked1[0]==clean1[0]);
+  CU_ASSERT(marked2[0]==clean2[0]);
+  for (i=0; i<8; i++)
+    {
+      CU_ASSERT(db_node_check_allele_status(allele1[i], one)==true);
+      CU_ASSERT(db_node_check_allele_status(allele2[i], one)==true);
+    }
+
+  free_covg_array(working_ca);
+  graph_info_free(ginfo);
+  for (i=0; i<8; i++)
+    {
+      free_element(&allele1[i]);
+      if ( (i!=0) && (i!=3) && (i!=7) )
+	{
+	  free_element(&allele2[i]);
+	}
+    }
+}
+
+
 void test_get_log_likelihood_of_genotype_on_variant_called_by_bubblecaller()
 {
   /*
@@ -182,6 +253,286 @@ void test_get_log_likelihood_of_genotype_on_variant_called_by_bubblecaller()
 }
 
 
+// log(n!) summed term by term, as log_factorial used to be
+static double log_factorial_summed(uint64_t number)
+{
+  uint64_t i;
+  double ret=0;
+  for (i=1; i<=number; i++)
+    {
+      ret+=log(i);
+    }
+  return ret;
+}
+
+void test_log_factorial_table_gives_unchanged_genotype_likelihoods()
+{
+  uint64_t n;
+  int num_differ = 0;
+
+  // the table holds exactly what log_factorial used to return (summing the
+  // logs as we go, rather than from 1 each time)
+  double summed = 0;
+  for (n=0; n<LOG_FACTORIAL_TABLE_SIZE; n++)
+    {
+      if (n>0)
+	{
+	  summed += log(n);
+	}
+      if (log_factorial_uint64_t(n) != summed)
+	{
+	  num_differ++;
+	}
+    }
+  CU_ASSERT(num_differ==0);
+  CU_ASSERT(log_factorial(0)==0);
+  CU_ASSERT(log_factorial(5)==log_factorial_summed(5));
+
+  // past the table, lgamma agrees with summing logs to the precision --gt
+  // output is printed at, for the genotype likelihoods at these coverages
+  Covg covgs[] = {0, 1, 7, 30, 250, 1000, 4000, 65535, 65536, 100000, 1000000};
+  int num_covgs = sizeof(covgs)/sizeof(Covg);
+  zygosity genotypes[] = {hom_one, het, hom_other};
+  double theta = 1000;
+  double error_rate = 0.01;
+  int i, j, g;
+  char printed[100], expected_printed[100];
+
+  for (i=0; i<num_covgs; i++)
+    {
+      for (j=0; j<num_covgs; j++)
+	{
+	  Covg c1 = covgs[i], c2 = covgs[j];
+	  double expected[3];
+	  double cb2 = max_of_doubles((double)c2 - error_rate*theta, 0);
+	  double cb1 = max_of_doubles((double)c1 - error_rate*theta, 0);
+	  expected[0] = (double)c1*log(theta) - theta - log_factorial_summed(c1) + cb2*log(error_rate);
+	  expected[1] = ((double)c1*log(theta/2) - theta/2 - log_factorial_summed(c1))
+	    + ((double)c2*log(theta/2) - theta/2 - log_factorial_summed(c2));
+	  expected[2] = (double)c2*log(theta) - theta - log_factorial_summed(c2) + cb1*log(error_rate);
+
+	  for (g=0; g<3; g++)
+	    {
+	      double llk = get_log_likelihood_of_genotype_on_variant_called_by_bubblecaller(genotypes[g], error_rate,
+											    c1, c2, theta, theta);
+	      sprintf(printed, "%.2f", llk);
+	      sprintf(expected_printed, "%.2f", expected[g]);
+	      CU_ASSERT_STRING_EQUAL(printed, expected_printed);
+	    }
+	}
+    }
+}
+
+
+static void random_seq(char* seq, int len)
+{
+  int i;
+  for (i=0; i<len; i++)
+    {
+      seq[i]="ACGT"[rand()%4];
+    }
+  seq[len]='\0';
+}
+
+// writes copies of each read to a fasta, and a filelist naming it (both in
+// the temp directory)
+static void write_reads_and_filelist(char* filelist_name, char* fasta_name, char** reads, int* copies, int num_reads)
+{
+  char filelist[200], fasta[200];
+  sprintf(filelist, "../data/tempfiles_can_be_deleted/%s", filelist_name);
+  sprintf(fasta, "../data/tempfiles_can_be_deleted/%s", fasta_name);
+
+  FILE* fp = fopen(fasta, "w");
+  if (fp==NULL)
+    {
+      die("Unable to open %s", fasta);
+    }
+  int i, j, count=0;
+  for (i=0; i<num_reads; i++)
+    {
+      for (j=0; j<copies[i]; j++)
+	{
+	  fprintf(fp, ">read%d\n%s\n", count++, reads[i]);
+	}
+    }
+  fclose(fp);
+  fp = fopen(filelist, "w");
+  if (fp==NULL)
+    {
+      die("Unable to open %s", filelist);
+    }
+  fprintf(fp, "%s\n", fasta_name);
+  fclose(fp);
+}
+
+// nodes of every kmer of seq, which must all be in the graph
+static int get_allele_nodes(char* seq, dBNode** nodes, Orientation* orientations, dBGraph* db_graph)
+{
+  short kmer_size = db_graph->kmer_size;
+  int num_kmers = strlen(seq)-kmer_size+1;
+  char kmer_str[kmer_size+1];
+  BinaryKmer kmer, key;
+  int i;
+  for (i=0; i<num_kmers; i++)
+    {
+      strncpy(kmer_str, seq+i, kmer_size);
+      kmer_str[kmer_size]='\0';
+      seq_to_binary_kmer(kmer_str, kmer_size, &kmer);
+      element_get_key(&kmer, kmer_size, &key);
+      nodes[i] = hash_table_find(&key, db_graph);
+      if (nodes[i]==NULL)
+	{
+	  die("Allele kmer %s is not in the graph", kmer_str);
+	}
+      orientations[i] = db_node_get_orientation(&kmer, nodes[i], kmer_size);
+    }
+  return num_kmers;
+}
+
+void test_complex_site_neighbourhood_gives_same_genotype_likelihoods_as_whole_graph()
+{
+  if (NUMBER_OF_COLOURS<2)
+    {
+      warn("Test needs 2 colours\n");
+      return;
+    }
 
+  int kmer_size = 31;
+  dBGraph* db_graph = hash_table_new(12, 20, 10, kmer_size);
+
+  // a site with alleles A and B between flanks L and R, and somewhere F far
+  // away in the genome. Colour 1 is the reference with the site taken out, and
+  // colour 0 a het sample, with one sequencing error on A, and another on F
+  srand(18);
+  char L[201], A[21], B[26], R[201], F[301];
+  random_seq(L, 200);
+  random_seq(A, 20);
+  random_seq(B, 25);
+  random_seq(R, 200);
+  random_seq(F, 300);
+
+  char LAR[500], LBR[500], LA_errR[500], LR[500], F_err[301];
+  sprintf(LAR, "%s%s%s", L, A, R);
+  sprintf(LBR, "%s%s%s", L, B, R);
+  strcpy(LA_errR, LAR);
+  LA_errR[210] = (LA_errR[210]=='A') ? 'C' : 'A';
+  sprintf(LR, "%s%s", L, R);
+  strcpy(F_err, F);
+  F_err[150] = (F_err[150]=='A') ? 'C' : 'A';
+
+  char* ref_reads[] = {LR, F};
+  int ref_copies[] = {1, 1};
+  char* sample_reads[] = {LAR, LBR, LA_errR, F};
+  int sample_copies[] = {10, 10, 1, 10};
+  char* far_error_reads[] = {F_err};
+  int far_error_copies[] = {1};
+  write_reads_and_filelist("nbhd_ref.falist", "nbhd_ref.fa", ref_reads, ref_copies, 2);
+  write_reads_and_filelist("nbhd_sample.falist", "nbhd_sample.fa", sample_reads, sample_copies, 4);
+  write_reads_and_filelist("nbhd_far_error.falist", "nbhd_far_error.fa", far_error_reads, far_error_copies, 1);
+
+  unsigned int files_loaded = 0;
+  unsigned long long bad_reads = 0, dup_reads = 0;
+  unsigned long long seq_read = 0, seq_loaded = 0;
+  load_se_filelist_into_graph_colour("../data/tempfiles_can_be_deleted/nbhd_ref.falist",
+				     0, 0, false, 33, 1, db_graph, 0,
+				     &files_loaded, &bad_reads, &dup_reads, &seq_read, &seq_loaded,
+				     NULL, 0, &subsample_null);
+  seq_read = 0;
+  load_se_filelist_into_graph_colour("../data/tempfiles_can_be_deleted/nbhd_sample.falist",
+				     0, 0, false, 33, 0, db_graph, 0,
+				     &files_loaded, &bad_reads, &dup_reads, &seq_read, &seq_loaded,
+				     NULL, 0, &subsample_null);
+
+  GraphInfo* ginfo = graph_info_alloc_and_init();
+  graph_info_set_seq(ginfo, 0, seq_read);
+  graph_info_set_mean_readlen(ginfo, 0, 425);
+  graph_info_set_seq_err(ginfo, 0, 0.01);
+  GraphAndModelInfo model_info;
+  initialise_model_info(&model_info, ginfo, 1000, 0.8, -1, 2, EachColourADiploidSample, AssumeUncleaned);
+
+  // alleles run from the last kmer of L to the first kmer of R
+  int max_allele_length = 1000;
+  dBNode* allele_nodes[2][max_allele_length];
+  Orientation allele_ors[2][max_allele_length];
+  char allele_seq[500];
+  int allele_lens[2];
+  sprintf(allele_seq, "%s%s%.*s", L+200-kmer_size+1, A, kmer_size-1, R);
+  allele_lens[0] = get_allele_nodes(allele_seq, allele_nodes[0], allele_ors[0], db_graph);
+  sprintf(allele_seq, "%s%s%.*s", L+200-kmer_size+1, B, kmer_size-1, R);
+  allele_lens[1] = get_allele_nodes(allele_seq, allele_nodes[1], allele_ors[1], db_graph);
+  dBNode** alleles[] = {allele_nodes[0], allele_nodes[1]};
+
+  dBNode* p_nodes[max_allele_length+1];
+  Orientation p_orientations[max_allele_length+1];
+  Nucleotide p_labels[max_allele_length];
+  char p_string[max_allele_length+1];
+  Covg working_array_self[max_allele_length];
+  Covg working_array_shared[max_allele_length];
+  MultiplicitiesAndOverlapsOfBiallelicVariant* mobv =
+    alloc_MultiplicitiesAndOverlapsOfBiallelicVariant(max_allele_length, max_allele_length);
+
+  ComplexSiteNeighbourhood* nbhd = alloc_complex_site_neighbourhood();
+
+  // llks[g][0] using the whole graph, llks[g][1] the neighbourhood
+  void get_llks(double llks[3][2])
+  {
+    get_complex_site_neighbourhood(nbhd, alleles, allele_lens, 2, 0, 1,
+				   p_nodes, p_orientations, p_labels, p_string, max_allele_length, db_graph);
+    CU_ASSERT(nbhd->num_supernodes>0);
+
+    int genotypes[3][2] = {{0,0}, {0,1}, {1,1}};
+    char* names[3] = {"A/A", "A/B", "B/B"};
+    int g, way;
+    for (g=0; g<3; g++)
+      {
+	int i = genotypes[g][0], j = genotypes[g][1];
+	VariantBranchesAndFlanks var;
+	set_variant_branches_but_flanks_to_null(&var, allele_nodes[i], allele_ors[i], allele_lens[i],
+						allele_nodes[j], allele_ors[j], allele_lens[j], unknown);
+	set_status_of_nodes_in_branches(&var, in_desired_genotype);
+	reset_MultiplicitiesAndOverlapsOfBiallelicVariant(mobv);
+	initialise_multiplicities_of_allele_nodes_wrt_both_alleles(&var, mobv, false, NULL);
+	for (way=0; way<2; way++)
+	  {
+	    double max_lik = -1e100, max_but_one_lik = -1e100;
+	    char max_name[300] = "", max_but_one_name[300] = "";
+	    llks[g][way] = calc_log_likelihood_of_genotype_with_complex_alleles(
+	      &var, names[g], mobv, &model_info, 0, 1, db_graph,
+	      working_array_self, working_array_shared,
+	      &max_lik, &max_but_one_lik, max_name, max_but_one_name,
+	      AssumeUncleaned, p_nodes, p_orientations, p_labels, p_string, max_allele_length,
+	      false, NULL, false, NULL, -1e100, (way==0) ? NULL : nbhd);
+	  }
+	set_status_of_nodes_in_branches(&var, none);
+      }
+  }
 
+  double llks[3][2], llks_far_error[3][2];
+  get_llks(llks);
+  int g;
+  for (g=0; g<3; g++)
+    {
+      CU_ASSERT(llks[g][0]==llks[g][1]);
+    }
+  // the error on A counts against the genotypes without A
+  CU_ASSERT(llks[1][1]>llks[2][1]);
+  int num_supernodes = nbhd->num_supernodes;
+
+  // an error far from the site only counts when traversing the whole graph
+  load_se_filelist_into_graph_colour("../data/tempfiles_can_be_deleted/nbhd_far_error.falist",
+				     0, 0, false, 33, 0, db_graph, 0,
+				     &files_loaded, &bad_reads, &dup_reads, &seq_read, &seq_loaded,
+				     NULL, 0, &subsample_null);
+  get_llks(llks_far_error);
+  CU_ASSERT(nbhd->num_supernodes==num_supernodes);
+  for (g=0; g<3; g++)
+    {
+      CU_ASSERT(llks_far_error[g][1]==llks[g][1]);
+      CU_ASSERT(llks_far_error[g][0]<llks[g][0]);
+    }
 
+  dealloc_complex_site_neighbourhood(nbhd);
+  dealloc_MultiplicitiesAndOverlapsOfBiallelicVariant(mobv);
+  graph_info_free(ginfo);
+  hash_table_free(&db_graph);
+}
@@ -36,6 +36,7 @@
 #include "string_buffer.h"
 #include "error_correction.h"
 #include "file_reader.h"
+#include "file_cmp.h"
 
 void test_base_mutator()
 {
@@ -1546,3 +1547,116 @@ void test_reverse_comp_according_ref_pos_strand()
 
 
 }
+
+
+void test_error_correct_file_is_the_same_with_several_threads()
+{
+  int kmer_size = 31;
+  int number_of_bits = 12;
+  int bucket_size = 20;
+  int max_retries = 10;
+
+  unsigned int files_loaded = 0;
+  unsigned long long bad_reads = 0, dup_reads = 0;
+  unsigned long long seq_read = 0, seq_loaded = 0;
+
+  dBGraph* db_graph = hash_table_new(number_of_bits, bucket_size, max_retries, kmer_size);
+  load_se_filelist_into_graph_colour("../data/test/sim/sim1_diploid_indiv_SNPS_only/haplotype_1.falist",
+                                     0, 0, false, 33, 0, db_graph, 0,
+                                     &files_loaded, &bad_reads, &dup_reads, &seq_read, &seq_loaded,
+                                     NULL, 0, &subsample_null);
+
+  // the haplotype, to take reads from
+  FILE* fp = fopen("../data/test/sim/sim1_diploid_indiv_SNPS_only/haplotype_1.fa", "r");
+  StrBuf* genome = strbuf_new();
+  char line[1000];
+  while(fgets(line, 1000, fp) != NULL)
+  {
+    if(line[0] != '>')
+    {
+      strbuf_append_str(genome, line);
+      strbuf_chomp(genome);
+    }
+  }
+  fclose(fp);
+
+  // enough reads for several batches, from both strands, with low quality errors
+  char* fastq = "../data/tempfiles_can_be_deleted/test_err_correct_threads.fq";
+  fp = fopen(fastq, "w");
+  int read_len = 60;
+  char bases[] = "ACGT";
+  char seq[read_len+1];
+  char qual[read_len+1];
+  int i, j;
+  srand(1);
+  for(i = 0; i < 10000; i++)
+  {
+    int start = rand() % (genome->len - read_len);
+    for(j = 0; j < read_len; j++)
+    {
+      seq[j] = genome->buff[start+j];
+      qual[j] = 'I';
+      if(rand() % 50 == 0)
+      {
+        seq[j] = bases[rand() % 4];
+        qual[j] = '#';
+      }
+    }
+    seq[read_len] = '\0';
+    qual[read_len] = '\0';
+    StrBuf* read = strbuf_create(seq);
+    StrBuf* read_qual = strbuf_create(qual);
+    if(i % 2 == 1)
+    {
+      strbuf_rev_comp(read);
+      strbuf_reverse(read_qual);
+    }
+    fprintf(fp, "@read%i\n%s\n+\n%s\n", i, read->buff, read_qual->buff);
+    strbuf_free(read);
+    strbuf_free(read_qual);
+  }
+  fclose(fp);
+  strbuf_free(genome);
+
+  char* outfiles[2] = {"../data/tempfiles_can_be_deleted/test_err_correct_threads.1.fq",
+                       "../data/tempfiles_can_be_deleted/test_err_correct_threads.4.fq"};
+  char* suffixes[3] = {".distrib_num_modified_bases", ".distrib_posn_modified_bases", ".read_stats"};
+  int threads[2] = {1, 4};
+  int array_size = 20;
+  uint64_t bases_modified[2][20];
+  uint64_t posn_modified[2][20];
+  HandleLowQualUncorrectable policies[2] = {DontWorryAboutLowQualBaseUnCorrectable,
+                                            DiscardReadIfLowQualBaseUnCorrectable};
+  int p, t;
+  int old_num_threads = NUM_THREADS;
+
+  for(p = 0; p < 2; p++)
+  {
+    for(t = 0; t < 2; t++)
+    {
+      NUM_THREADS = threads[t];
+      error_correct_file_against_graph(fastq, 10, 33, db_graph, outfiles[t],
+                                       bases_modified[t], posn_modified[t], array_size,
+                                       policies[p], false, 0, true);
+    }
+    NUM_THREADS = old_num_threads;
+
+    CU_ASSERT(files_are_identical(outfiles[0], outfiles[1]));
+    for(i = 0; i < 3; i++)
+    {
+      char stats[2][200];
+      for(t = 0; t < 2; t++)
+        sprintf(stats[t], "%s%s", outfiles[t], suffixes[i]);
+      CU_ASSERT(files_are_identical(stats[0], stats[1]));
+    }
+    for(i = 0; i < array_size; i++)
+    {
+      CU_ASSERT(bases_modified[0][i] == bases_modified[1][i]);
+      CU_ASSERT(posn_modified[0][i] == posn_modified[1][i]);
+    }
+    // some reads were corrected
+    CU_ASSERT(bases_modified[0][0] < 10000);
+  }
+
+  hash_table_free(&db_graph);
+}
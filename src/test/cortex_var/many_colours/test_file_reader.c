@@ -36,15 +36,18 @@
 #include <CUnit.h>
 #include <Basic.h>
 #include <string_buffer.h>
+#include <seq_file.h>
 
 // cortex_var headers
 #include "file_reader.h"
+#include "binary_blocks.h"
 #include "dB_graph_population.h"
 #include "element.h"
 #include "seq.h"
 #include "open_hash/hash_table.h"
 #include "test_file_reader.h"
 #include "graph_info.h"
+#include "file_cmp.h"
 
 void test_dump_load_sv_trio_binary()
 {
@@ -6543,3 +6546,734 @@ void test_load_binversion5_binary()
 
   }
 }
+
+
+void test_multithreaded_loading_gives_same_graph_as_single_threaded()
+{
+  int kmer_size = 31;
+  int number_of_bits = 14;
+  int bucket_size = 100;
+  int max_retries = 10;
+
+  int fq_quality_cutoff = 10;
+  int homopolymer_cutoff = 5;
+  char ascii_fq_offset = 33;
+  int into_colour = 0;
+
+  int readlen_distrib_arrlen = 200;
+  unsigned long readlens[2][200];
+
+  unsigned int files_loaded[2];
+  unsigned long long bad_reads[2], dup_reads[2];
+  unsigned long long seq_read[2], seq_loaded[2];
+
+  dBGraph *db_graphs[2];
+  int num_threads[] = {1, 4};
+  int i, j;
+
+  for(i = 0; i < 2; i++)
+  {
+    for(j = 0; j < readlen_distrib_arrlen; j++)
+      readlens[i][j] = 0;
+
+    files_loaded[i] = 0;
+    bad_reads[i] = dup_reads[i] = 0;
+    seq_read[i] = seq_loaded[i] = 0;
+
+    NUM_THREADS = num_threads[i];
+    db_graphs[i] = hash_table_new(number_of_bits, bucket_size, max_retries, kmer_size);
+
+    // ~1Mb of simulated reads, so more than one batch is handed to the threads
+    load_se_filelist_into_graph_colour(
+      "../data/test/sim/sim1_diploid_indiv_SNPS_only/reads.falist",
+      fq_quality_cutoff, homopolymer_cutoff, false, ascii_fq_offset,
+      into_colour, db_graphs[i], 0,
+      &files_loaded[i], &bad_reads[i], &dup_reads[i], &seq_read[i], &seq_loaded[i],
+      readlens[i], readlen_distrib_arrlen, &subsample_null);
+
+    // fastq with Ns and low quality bases
+    load_pe_filelists_into_graph_colour(
+      "../data/test/graph/paired_end_file1_1.fqlist",
+      "../data/test/graph/paired_end_file1_2.fqlist",
+      fq_quality_cutoff, homopolymer_cutoff, false, ascii_fq_offset,
+      into_colour, db_graphs[i], 0,
+      &files_loaded[i], &bad_reads[i], &dup_reads[i], &seq_read[i], &seq_loaded[i],
+      readlens[i], readlen_distrib_arrlen, &subsample_null);
+  }
+
+  NUM_THREADS = 1;
+
+  CU_ASSERT(hash_table_get_unique_kmers(db_graphs[0]) > 0);
+  CU_ASSERT(hash_table_get_unique_kmers(db_graphs[0]) ==
+            hash_table_get_unique_kmers(db_graphs[1]));
+  CU_ASSERT(files_loaded[0] == files_loaded[1]);
+  CU_ASSERT(bad_reads[0] == bad_reads[1]);
+  CU_ASSERT(seq_read[0] == seq_read[1]);
+  CU_ASSERT(seq_loaded[0] == seq_loaded[1]);
+
+  boolean readlens_match = true;
+  for(j = 0; j < readlen_distrib_arrlen; j++)
+    if(readlens[0][j] != readlens[1][j])
+      readlens_match = false;
+  CU_ASSERT(readlens_match == true);
+
+  int num_mismatches = 0;
+
+  void compare_with_multithreaded_graph(dBNode* node)
+  {
+    dBNode* other = hash_table_find(element_get_kmer(node), db_graphs[1]);
+
+    if(other == NULL)
+    {
+      num_mismatches++;
+      return;
+    }
+
+    int col;
+    for(col = 0; col < NUMBER_OF_COLOURS; col++)
+    {
+      if(db_node_get_coverage(node, col) != db_node_get_coverage(other, col) ||
+         get_edge_copy(*node, col) != get_edge_copy(*other, col))
+      {
+        num_mismatches++;
+      }
+    }
+  }
+
+  hash_table_traverse(&compare_with_multithreaded_graph, db_graphs[0]);
+  CU_ASSERT(num_mismatches == 0);
+
+  hash_table_free(&db_graphs[0]);
+  hash_table_free(&db_graphs[1]);
+}
+
+
+void test_parallel_loading_of_colour_list()
+{
+  if(NUMBER_OF_COLOURS < 2)
+  {
+    warn("Test not configured for NUMBER_OF_COLOURS < 2\n");
+    return;
+  }
+
+  int kmer_size = 31;
+  int number_of_bits = 14;
+  int bucket_size = 100;
+  int max_retries = 10;
+
+  unsigned int files_loaded = 0;
+  unsigned long long bad_reads = 0, dup_reads = 0;
+  unsigned long long seq_read = 0, seq_loaded = 0;
+
+  // Make single colour binaries of the simulated reads and of one haplotype
+  char* falists[] = {"../data/test/sim/sim1_diploid_indiv_SNPS_only/reads.falist",
+                     "../data/test/sim/sim1_diploid_indiv_SNPS_only/haplotype_1.falist"};
+  char* binaries[] = {"../data/tempfiles_can_be_deleted/test_parallel_colour_list_reads.ctx",
+                      "../data/tempfiles_can_be_deleted/test_parallel_colour_list_hap1.ctx"};
+  int i;
+
+  for(i = 0; i < 2; i++)
+  {
+    dBGraph* db_graph = hash_table_new(number_of_bits, bucket_size, max_retries, kmer_size);
+    GraphInfo* ginfo = graph_info_alloc_and_init();
+    seq_loaded = 0;
+
+    load_se_filelist_into_graph_colour(falists[i], 0, 0, false, 33, 0, db_graph, 0,
+                                       &files_loaded, &bad_reads, &dup_reads, &seq_read, &seq_loaded,
+                                       NULL, 0, &subsample_null);
+    graph_info_set_seq(ginfo, 0, seq_loaded);
+    db_graph_dump_single_colour_binary_of_colour0(binaries[i], &db_node_condition_always_true,
+                                                  db_graph, ginfo, BINVERSION);
+    graph_info_free(ginfo);
+    hash_table_free(&db_graph);
+  }
+
+  // colour 0 is reads+hap1, colour 1 is hap1+reads
+  FILE* fp = fopen("../data/tempfiles_can_be_deleted/test_parallel_colour_list_0.ctxlist", "w");
+  fprintf(fp, "test_parallel_colour_list_reads.ctx\ntest_parallel_colour_list_hap1.ctx\n");
+  fclose(fp);
+  fp = fopen("../data/tempfiles_can_be_deleted/test_parallel_colour_list_1.ctxlist", "w");
+  fprintf(fp, "test_parallel_colour_list_hap1.ctx\ntest_parallel_colour_list_reads.ctx\n");
+  fclose(fp);
+  fp = fopen("../data/tempfiles_can_be_deleted/test_parallel_colour_list.colours", "w");
+  fprintf(fp, "test_parallel_colour_list_0.ctxlist\ntest_parallel_colour_list_1.ctxlist\n");
+  fclose(fp);
+
+  int num_threads[] = {1, 2, 4};
+  dBGraph* db_graphs[3];
+  GraphInfo* ginfos[3];
+  long long loaded[3];
+
+  for(i = 0; i < 3; i++)
+  {
+    NUM_THREADS = num_threads[i];
+    db_graphs[i] = hash_table_new(number_of_bits, bucket_size, max_retries, kmer_size);
+    ginfos[i] = graph_info_alloc_and_init();
+    loaded[i] = load_population_as_binaries_from_graph(
+      "../data/tempfiles_can_be_deleted/test_parallel_colour_list.colours",
+      0, true, db_graphs[i], ginfos[i], false, 0, false);
+  }
+
+  NUM_THREADS = 1;
+
+  CU_ASSERT(hash_table_get_unique_kmers(db_graphs[0]) > 0);
+
+  for(i = 1; i < 3; i++)
+  {
+    CU_ASSERT(loaded[i] == loaded[0]);
+    CU_ASSERT(hash_table_get_unique_kmers(db_graphs[i]) == hash_table_get_unique_kmers(db_graphs[0]));
+    CU_ASSERT(ginfos[i]->total_sequence[0] == ginfos[0]->total_sequence[0]);
+    CU_ASSERT(ginfos[i]->total_sequence[1] == ginfos[0]->total_sequence[1]);
+  }
+
+  // same nodes, coverages and edges as loading one colour at a time, and with
+  // 2 and 4 threads every kmer is in the same place in the table
+  int num_mismatches = 0, num_moved = 0;
+
+  void compare_with_parallel_graphs(dBNode* node)
+  {
+    int g, col;
+    for(g = 1; g < 3; g++)
+    {
+      dBNode* other = hash_table_find(element_get_kmer(node), db_graphs[g]);
+
+      if(other == NULL)
+      {
+        num_mismatches++;
+        continue;
+      }
+
+      for(col = 0; col < NUMBER_OF_COLOURS; col++)
+      {
+        if(db_node_get_coverage(node, col) != db_node_get_coverage(other, col) ||
+           get_edge_copy(*node, col) != get_edge_copy(*other, col))
+        {
+          num_mismatches++;
+        }
+      }
+    }
+
+    if(hash_table_find(element_get_kmer(node), db_graphs[1]) - db_graphs[1]->table !=
+       hash_table_find(element_get_kmer(node), db_graphs[2]) - db_graphs[2]->table)
+    {
+      num_moved++;
+    }
+  }
+
+  hash_table_traverse(&compare_with_parallel_graphs, db_graphs[0]);
+  CU_ASSERT(num_mismatches == 0);
+  CU_ASSERT(num_moved == 0);
+
+  for(i = 0; i < 3; i++)
+  {
+    hash_table_free(&db_graphs[i]);
+    graph_info_free(ginfos[i]);
+  }
+}
+
+
+// Random kmers, with coverage and edges in colour 0 only
+static dBGraph* graph_of_random_kmers(int number_of_bits, int bucket_size, int max_retries,
+                                      int kmer_size, int num_kmers, unsigned int seed)
+{
+  dBGraph* db_graph = hash_table_new(number_of_bits, bucket_size, max_retries, kmer_size);
+  int i;
+
+  srand(seed);
+  for(i = 0; i < num_kmers; i++)
+  {
+    BinaryKmer kmer, tmp_kmer;
+    boolean found;
+    binary_kmer_initialise_to_zero(&kmer);
+    kmer[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1] =
+      (((bitfield_of_64bits)rand() << 31) ^ rand()) & (((bitfield_of_64bits)1 << (2*kmer_size)) - 1);
+
+    dBNode* node = hash_table_find_or_insert(element_get_key(&kmer, kmer_size, &tmp_kmer),
+                                             &found, db_graph);
+    db_node_update_coverage(node, 0, 1 + rand() % 50);
+    add_edges(node, 0, (Edges)(rand() & 0xff));
+  }
+
+  return db_graph;
+}
+
+void test_compressed_binary_matches_binversion6()
+{
+  int kmer_size = 31;
+  int number_of_bits = 16;
+  int bucket_size = 100;
+  int max_retries = 10;
+
+  // enough kmers for several blocks, and most of each record is zero
+  int num_kmers = 3*BINARY_BLOCK_RECORDS/2;
+  dBGraph* db_graph = graph_of_random_kmers(number_of_bits, bucket_size, max_retries,
+                                            kmer_size, num_kmers, 7);
+  GraphInfo* ginfo = graph_info_alloc_and_init();
+  int i;
+
+  graph_info_set_seq(ginfo, 0, 1000);
+
+  char* v6 = "../data/tempfiles_can_be_deleted/test_compressed_binary.v6.ctx";
+  char* v7 = "../data/tempfiles_can_be_deleted/test_compressed_binary.v7.ctx";
+  char* v6_single = "../data/tempfiles_can_be_deleted/test_compressed_binary.v6.colour0.ctx";
+  char* v7_single = "../data/tempfiles_can_be_deleted/test_compressed_binary.v7.colour0.ctx";
+
+  CU_ASSERT(db_graph_dump_binary(v6, &db_node_condition_always_true, db_graph, ginfo, 6) ==
+            (int)hash_table_get_unique_kmers(db_graph));
+  CU_ASSERT(db_graph_dump_binary(v7, &db_node_condition_always_true, db_graph, ginfo, 7) ==
+            (int)hash_table_get_unique_kmers(db_graph));
+  db_graph_dump_single_colour_binary_of_colour0(v6_single, &db_node_condition_always_true,
+                                                db_graph, ginfo, 6);
+  db_graph_dump_single_colour_binary_of_colour0(v7_single, &db_node_condition_always_true,
+                                                db_graph, ginfo, 7);
+
+  struct stat st6, st7;
+  CU_ASSERT(stat(v6, &st6) == 0 && stat(v7, &st7) == 0);
+  CU_ASSERT(st7.st_size < st6.st_size);
+  printf("\nmulticolour binary of %d kmers: %lld bytes as version 6, %lld as version 7\n",
+         num_kmers, (long long)st6.st_size, (long long)st7.st_size);
+
+  // Both versions load to the same graph, with the multicolour binaries decoded
+  // by one and by several threads
+  char* multicolour[] = {v6, v7, v7};
+  char* single_colour[] = {v6_single, v7_single, v7_single};
+  int num_threads[] = {1, 1, 4};
+  dBGraph* loaded[3];
+
+  for(i = 0; i < 3; i++)
+  {
+    int num_cols_in_binary = -1;
+    NUM_THREADS = num_threads[i];
+    loaded[i] = hash_table_new(number_of_bits, bucket_size, max_retries, kmer_size);
+    graph_info_initialise(ginfo);
+    load_multicolour_binary_from_filename_into_graph(multicolour[i], loaded[i], ginfo,
+                                                     &num_cols_in_binary);
+    CU_ASSERT(num_cols_in_binary == NUMBER_OF_COLOURS);
+    CU_ASSERT(ginfo->total_sequence[0] == 1000);
+
+    if(NUMBER_OF_COLOURS > 1)
+    {
+      load_single_colour_binary_data_from_filename_into_graph(single_colour[i], loaded[i], ginfo,
+                                                              false, 1, false, 0, false);
+    }
+  }
+  NUM_THREADS = 1;
+
+  int num_mismatches = 0;
+
+  void compare_with_loaded_graphs(dBNode* node)
+  {
+    int g, col;
+    for(g = 0; g < 3; g++)
+    {
+      dBNode* other = hash_table_find(element_get_kmer(node), loaded[g]);
+
+      if(other == NULL)
+      {
+        num_mismatches++;
+        continue;
+      }
+
+      for(col = 0; col < NUMBER_OF_COLOURS; col++)
+      {
+        // colour 1 was loaded from the single colour dump of colour 0
+        int orig_col = (col < 2 ? 0 : col);
+
+        if(db_node_get_coverage(other, col) != db_node_get_coverage(node, orig_col) ||
+           get_edge_copy(*other, col) != get_edge_copy(*node, orig_col))
+        {
+          num_mismatches++;
+        }
+      }
+    }
+  }
+
+  hash_table_traverse(&compare_with_loaded_graphs, db_graph);
+  CU_ASSERT(num_mismatches == 0);
+
+  for(i = 0; i < 3; i++)
+  {
+    CU_ASSERT(hash_table_get_unique_kmers(loaded[i]) == hash_table_get_unique_kmers(db_graph));
+    hash_table_free(&loaded[i]);
+  }
+
+  graph_info_free(ginfo);
+  hash_table_free(&db_graph);
+}
+
+
+void test_dump_binary_is_the_same_with_several_threads()
+{
+  int kmer_size = 31;
+  int number_of_bits = 16;
+  int bucket_size = 100;
+  int max_retries = 10;
+
+  // a big enough table to be dumped in several ranges
+  dBGraph* db_graph = graph_of_random_kmers(number_of_bits, bucket_size, max_retries,
+                                            kmer_size, 100000, 8);
+  GraphInfo* ginfo = graph_info_alloc_and_init();
+  graph_info_set_seq(ginfo, 0, 1000);
+
+  // version 6, written a record at a time as cortex always used to
+  char* expected = "../data/tempfiles_can_be_deleted/test_dump_threads.expected.ctx";
+  FILE* fp = fopen(expected, "w");
+  print_binary_signature_NEW(fp, kmer_size, NUMBER_OF_COLOURS, ginfo, 0, 6);
+  void print_node(dBNode* node)
+  {
+    db_node_print_multicolour_binary(fp, node);
+  }
+  hash_table_traverse(&print_node, db_graph);
+  fclose(fp);
+
+  char* v6[] = {"../data/tempfiles_can_be_deleted/test_dump_threads.v6.t1.ctx",
+                "../data/tempfiles_can_be_deleted/test_dump_threads.v6.t4.ctx"};
+  char* v7[] = {"../data/tempfiles_can_be_deleted/test_dump_threads.v7.t1.ctx",
+                "../data/tempfiles_can_be_deleted/test_dump_threads.v7.t4.ctx"};
+  char* v7_colour0[] = {"../data/tempfiles_can_be_deleted/test_dump_threads.v7.colour0.t1.ctx",
+                        "../data/tempfiles_can_be_deleted/test_dump_threads.v7.colour0.t4.ctx"};
+  int num_threads[] = {1, 4};
+  int i;
+
+  for(i = 0; i < 2; i++)
+  {
+    NUM_THREADS = num_threads[i];
+    CU_ASSERT(db_graph_dump_binary(v6[i], &db_node_condition_always_true, db_graph, ginfo, 6) ==
+              (int)hash_table_get_unique_kmers(db_graph));
+    CU_ASSERT(db_graph_dump_binary(v7[i], &db_node_condition_always_true, db_graph, ginfo, 7) ==
+              (int)hash_table_get_unique_kmers(db_graph));
+    db_graph_dump_single_colour_binary_of_specified_colour(v7_colour0[i], &db_node_condition_always_true,
+                                                           db_graph, ginfo, 0, 7);
+  }
+  NUM_THREADS = 1;
+
+  CU_ASSERT(files_are_identical(expected, v6[0]));
+  CU_ASSERT(files_are_identical(expected, v6[1]));
+  CU_ASSERT(files_are_identical(v7[0], v7[1]));
+  CU_ASSERT(files_are_identical(v7_colour0[0], v7_colour0[1]));
+
+  graph_info_free(ginfo);
+  hash_table_free(&db_graph);
+}
+
+
+// What cortex_var dumps by default (--dump_binary of reads loaded with --se_list, and of
+// a multicolour graph) is byte for byte what the old per-record writer gave
+void test_default_dump_of_real_data_is_the_same_as_the_per_record_writer()
+{
+  int kmer_size = 31;
+  int number_of_bits = 16;
+  int bucket_size = 100;
+  int max_retries = 10;
+
+  unsigned int files_loaded = 0;
+  unsigned long long bad_reads = 0, dup_reads = 0;
+  unsigned long long seq_read = 0, seq_loaded = 0;
+
+  CU_ASSERT(BINVERSION == 6);
+
+  dBGraph* db_graph = hash_table_new(number_of_bits, bucket_size, max_retries, kmer_size);
+  load_se_filelist_into_graph_colour(
+    "../data/test/sim/sim1_diploid_indiv_SNPS_only/reads.falist",
+    0, 0, false, 33, 0, db_graph, 0,
+    &files_loaded, &bad_reads, &dup_reads, &seq_read, &seq_loaded,
+    NULL, 0, &subsample_null);
+
+  CU_ASSERT(hash_table_get_unique_kmers(db_graph) > 0);
+
+  GraphInfo* ginfo = graph_info_alloc_and_init();
+  graph_info_set_seq(ginfo, 0, seq_read);
+  graph_info_set_mean_readlen(ginfo, 0, 100);
+
+  char* expected_multicol = "../data/tempfiles_can_be_deleted/test_default_dump.expected.ctx";
+  char* expected_colour0 = "../data/tempfiles_can_be_deleted/test_default_dump.expected.colour0.ctx";
+  FILE* fp_multicol = fopen(expected_multicol, "w");
+  FILE* fp_colour0 = fopen(expected_colour0, "w");
+  print_binary_signature_NEW(fp_multicol, kmer_size, NUMBER_OF_COLOURS, ginfo, 0, 6);
+  print_binary_signature_NEW(fp_colour0, kmer_size, 1, ginfo, 0, 6);
+  void print_node(dBNode* node)
+  {
+    if(db_node_check_status_not_pruned(node))
+    {
+      db_node_print_multicolour_binary(fp_multicol, node);
+      db_node_print_single_colour_binary_of_colour0(fp_colour0, node);
+    }
+  }
+  hash_table_traverse(&print_node, db_graph);
+  fclose(fp_multicol);
+  fclose(fp_colour0);
+
+  char* multicol[] = {"../data/tempfiles_can_be_deleted/test_default_dump.t1.ctx",
+                      "../data/tempfiles_can_be_deleted/test_default_dump.t4.ctx"};
+  char* colour0[] = {"../data/tempfiles_can_be_deleted/test_default_dump.colour0.t1.ctx",
+                     "../data/tempfiles_can_be_deleted/test_default_dump.colour0.t4.ctx"};
+  int num_threads[] = {1, 4};
+  int i;
+
+  for(i = 0; i < 2; i++)
+  {
+    NUM_THREADS = num_threads[i];
+    CU_ASSERT(db_graph_dump_binary(multicol[i], &db_node_check_status_not_pruned,
+                                   db_graph, ginfo, BINVERSION) ==
+              (int)hash_table_get_unique_kmers(db_graph));
+    db_graph_dump_single_colour_binary_of_colour0(colour0[i], &db_node_check_status_not_pruned,
+                                                  db_graph, ginfo, BINVERSION);
+    CU_ASSERT(files_are_identical(expected_multicol, multicol[i]));
+    CU_ASSERT(files_are_identical(expected_colour0, colour0[i]));
+  }
+  NUM_THREADS = 1;
+
+  graph_info_free(ginfo);
+  hash_table_free(&db_graph);
+}
+
+
+// The estimate of the number of kmers is close to the number actually loaded, and
+// loading into a table much too small for the data (which grows) gives the same graph
+void test_estimate_kmers_and_grow_table_while_loading()
+{
+  int kmer_size = 31;
+  int number_of_bits = 14;
+  int bucket_size = 100;
+  int max_retries = 10;
+
+  unsigned int files_loaded = 0;
+  unsigned long long bad_reads = 0, dup_reads = 0;
+  unsigned long long seq_read = 0, seq_loaded = 0;
+
+  char* falist = "../data/test/sim/sim1_diploid_indiv_SNPS_only/reads.falist";
+  char* filelists[] = {falist, NULL};
+
+  // with and without PCR duplicate removal, which loads a read at a time
+  dBGraph* expected[2];
+  int dups;
+  for(dups = 0; dups < 2; dups++)
+  {
+    expected[dups] = hash_table_new(number_of_bits, bucket_size, max_retries, kmer_size);
+    load_se_filelist_into_graph_colour(falist, 0, 0, dups == 1, 33, 0, expected[dups], 0,
+                                       &files_loaded, &bad_reads, &dup_reads, &seq_read, &seq_loaded,
+                                       NULL, 0, &subsample_null);
+  }
+
+  long long num_kmers = hash_table_get_unique_kmers(expected[0]);
+  long long estimate = estimate_distinct_kmers_in_filelists(filelists, kmer_size, 0, 0, 33);
+  CU_ASSERT(num_kmers > 1000);
+  CU_ASSERT(estimate > 0.97 * num_kmers && estimate < 1.03 * num_kmers);
+
+  int num_mismatches;
+  dBGraph* db_graph;
+
+  void compare_with_grown_graph(dBNode* node)
+  {
+    dBNode* other = hash_table_find(element_get_kmer(node), db_graph);
+
+    if(other == NULL ||
+       db_node_get_coverage(node, 0) != db_node_get_coverage(other, 0) ||
+       get_edge_copy(*node, 0) != get_edge_copy(*other, 0))
+    {
+      num_mismatches++;
+    }
+  }
+
+  // one and four threads without duplicate removal, then one with
+  int num_threads[] = {1, 4, 1};
+  int i;
+  for(i = 0; i < 3; i++)
+  {
+    dups = (i == 2);
+    NUM_THREADS = num_threads[i];
+    db_graph = hash_table_new(4, 10, 5, kmer_size);
+    hash_table_set_grow_when_full(db_graph, true);
+    load_se_filelist_into_graph_colour(falist, 0, 0, dups, 33, 0, db_graph, 0,
+                                       &files_loaded, &bad_reads, &dup_reads, &seq_read, &seq_loaded,
+                                       NULL, 0, &subsample_null);
+    NUM_THREADS = 1;
+
+    CU_ASSERT(db_graph->generation > 0);
+    CU_ASSERT(hash_table_get_unique_kmers(db_graph) == hash_table_get_unique_kmers(expected[dups]));
+    num_mismatches = 0;
+    hash_table_traverse(&compare_with_grown_graph, expected[dups]);
+    CU_ASSERT(num_mismatches == 0);
+    hash_table_free(&db_graph);
+  }
+
+  // and loading a colour list
+  GraphInfo* ginfo = graph_info_alloc_and_init();
+  graph_info_set_seq(ginfo, 0, seq_loaded);
+  db_graph_dump_single_colour_binary_of_colour0("../data/tempfiles_can_be_deleted/test_grow_table.ctx",
+                                                &db_node_condition_always_true, expected[0], ginfo, BINVERSION);
+  graph_info_free(ginfo);
+
+  FILE* fp = fopen("../data/tempfiles_can_be_deleted/test_grow_table.ctxlist", "w");
+  fprintf(fp, "test_grow_table.ctx\n");
+  fclose(fp);
+  fp = fopen("../data/tempfiles_can_be_deleted/test_grow_table.colours", "w");
+  fprintf(fp, "test_grow_table.ctxlist\n");
+  fclose(fp);
+
+  db_graph = hash_table_new(4, 10, 5, kmer_size);
+  hash_table_set_grow_when_full(db_graph, true);
+  ginfo = graph_info_alloc_and_init();
+  load_population_as_binaries_from_graph("../data/tempfiles_can_be_deleted/test_grow_table.colours",
+                                         0, true, db_graph, ginfo, false, 0, false);
+
+  CU_ASSERT(db_graph->generation > 0);
+  CU_ASSERT(hash_table_get_unique_kmers(db_graph) == num_kmers);
+  num_mismatches = 0;
+  hash_table_traverse(&compare_with_grown_graph, expected[0]);
+  CU_ASSERT(num_mismatches == 0);
+
+  graph_info_free(ginfo);
+  hash_table_free(&db_graph);
+  hash_table_free(&expected[0]);
+  hash_table_free(&expected[1]);
+}
+
+
+// Genotyping a callfile with several threads gives the same output, in the
+// same order, as with one - also when neighbouring sites share nodes
+void test_genotyping_callfile_is_the_same_with_several_threads()
+{
+  int kmer_size = 31;
+  int number_of_bits = 18;
+  int bucket_size = 10;
+  int max_retries = 10;
+  int max_branch_len = 100;
+  int max_read_length = 1000;
+
+  unsigned int files_loaded = 0;
+  unsigned long long bad_reads = 0, dup_reads = 0;
+  unsigned long long seq_read = 0, seq_loaded = 0;
+
+  dBGraph* db_graph = hash_table_new(number_of_bits, bucket_size, max_retries, kmer_size);
+  GraphInfo* ginfo = graph_info_alloc_and_init();
+
+  // a diploid individual in colour 0, and one of its haplotypes in the last colour
+  load_se_filelist_into_graph_colour("../data/test/sim/sim1_diploid_indiv_SNPS_only/reads.falist",
+                                     0, 0, false, 33, 0, db_graph, 0,
+                                     &files_loaded, &bad_reads, &dup_reads, &seq_read, &seq_loaded,
+                                     NULL, 0, &subsample_null);
+  graph_info_set_seq(ginfo, 0, seq_loaded);
+  graph_info_set_mean_readlen(ginfo, 0, 100);
+  seq_loaded = 0;
+  load_se_filelist_into_graph_colour("../data/test/sim/sim1_diploid_indiv_SNPS_only/haplotype_1.falist",
+                                     0, 0, false, 33, NUMBER_OF_COLOURS-1, db_graph, 0,
+                                     &files_loaded, &bad_reads, &dup_reads, &seq_read, &seq_loaded,
+                                     NULL, 0, &subsample_null);
+  graph_info_set_seq(ginfo, NUMBER_OF_COLOURS-1, seq_loaded);
+  graph_info_set_mean_readlen(ginfo, NUMBER_OF_COLOURS-1, 100);
+
+  GraphAndModelInfo model_info;
+  initialise_model_info(&model_info, ginfo, 100000, 0.8, -1, 2*NUMBER_OF_COLOURS,
+                        EachColourADiploidSample, AssumeUncleaned);
+
+  char* bubbles = "../data/tempfiles_can_be_deleted/test_gt_threads.bubbles";
+  FILE* fout = fopen(bubbles, "w");
+  db_graph_detect_vars(fout, max_branch_len, db_graph, &detect_vars_condition_always_true,
+                       &db_node_action_set_status_visited, &db_node_action_set_status_visited,
+                       &element_get_colour_union_of_all_colours, &element_get_covg_union_of_all_covgs,
+                       &print_no_extra_info, false, NULL, NULL, &db_node_condition_always_true);
+  fclose(fout);
+  hash_table_traverse(&db_node_set_status_to_none, db_graph);
+
+  // the calls enough times over to need several batches
+  FILE* fp = fopen(bubbles, "r");
+  int num_calls = 0;
+  char line[LINE_MAX];
+  while(fgets(line, LINE_MAX, fp) != NULL)
+  {
+    if(strstr(line, "_5p_flank") != NULL)
+      num_calls++;
+  }
+  CU_ASSERT(num_calls > 10);
+  int copies = 2*GENOTYPE_BATCH_SITES/num_calls + 1;
+  char* callfile = "../data/tempfiles_can_be_deleted/test_gt_threads.calls";
+  fout = fopen(callfile, "w");
+  int i;
+  for(i = 0; i < copies; i++)
+  {
+    rewind(fp);
+    while(fgets(line, LINE_MAX, fp) != NULL)
+      fputs(line, fout);
+  }
+  fclose(fout);
+  fclose(fp);
+
+  char* genotyped[] = {"../data/tempfiles_can_be_deleted/test_gt_threads.t1.gt",
+                       "../data/tempfiles_can_be_deleted/test_gt_threads.t4.gt"};
+  int num_threads[] = {1, 4};
+  long long num_sites[2];
+
+  for(i = 0; i < 2; i++)
+  {
+    NUM_THREADS = num_threads[i];
+    fp = fopen(callfile, "r");
+    fout = fopen(genotyped[i], "w");
+    num_sites[i] = db_graph_genotype_callfile(fp, fout, max_read_length, max_branch_len, BubbleCaller,
+                                              db_graph, &print_no_extra_info, &model_info);
+    fclose(fout);
+    fclose(fp);
+  }
+  NUM_THREADS = 1;
+
+  CU_ASSERT(num_sites[0] == (long long)copies * num_calls);
+  CU_ASSERT(num_sites[1] == num_sites[0]);
+
+  // every site is genotyped in colour 0
+  fp = fopen(genotyped[0], "r");
+  int num_genotyped = 0;
+  while(fgets(line, LINE_MAX, fp) != NULL)
+  {
+    if(strncmp(line, "0\tHOM1\t", 7) == 0 || strncmp(line, "0\tHET\t", 6) == 0 ||
+       strncmp(line, "0\tHOM2\t", 7) == 0)
+      num_genotyped++;
+  }
+  fclose(fp);
+  CU_ASSERT(num_genotyped == num_sites[0]);
+
+  CU_ASSERT(files_are_identical(genotyped[0], genotyped[1]));
+
+  // each site 8 times in a row, so the threads genotype sites on the same nodes at once
+  char* shared_callfile = "../data/tempfiles_can_be_deleted/test_gt_threads.shared.calls";
+  char* shared_genotyped[] = {"../data/tempfiles_can_be_deleted/test_gt_threads.shared.t1.gt",
+                              "../data/tempfiles_can_be_deleted/test_gt_threads.shared.t4.gt"};
+  StrBuf* site = strbuf_new();
+  fp = fopen(bubbles, "r");
+  fout = fopen(shared_callfile, "w");
+  void write_site()
+  {
+    int j;
+    for(j = 0; j < 8; j++)
+      fputs(site->buff, fout);
+    strbuf_reset(site);
+  }
+  while(fgets(line, LINE_MAX, fp) != NULL)
+  {
+    if(line[0] == '>' && strstr(line, "_5p_flank") != NULL && strbuf_len(site) > 0)
+      write_site();
+    strbuf_append_str(site, line);
+  }
+  write_site();
+  fclose(fout);
+  fclose(fp);
+  strbuf_free(site);
+
+  for(i = 0; i < 2; i++)
+  {
+    NUM_THREADS = num_threads[i];
+    fp = fopen(shared_callfile, "r");
+    fout = fopen(shared_genotyped[i], "w");
+    num_sites[i] = db_graph_genotype_callfile(fp, fout, max_read_length, max_branch_len, BubbleCaller,
+                                              db_graph, &print_no_extra_info, &model_info);
+    fclose(fout);
+    fclose(fp);
+  }
+  NUM_THREADS = 1;
+
+  CU_ASSERT(num_sites[0] == 8 * num_calls);
+  CU_ASSERT(num_sites[1] == num_sites[0]);
+  CU_ASSERT(files_are_identical(shared_genotyped[0], shared_genotyped[1]));
+
+  graph_info_free(ginfo);
+  hash_table_free(&db_graph);
+}
@@ -30,6 +30,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
 
 #include <CUnit.h>
 #include <Basic.h>
@@ -37,6 +38,7 @@
 // cortex_var headers
 #include "element.h"
 #include "open_hash/hash_table.h"
+#include "dB_graph.h"
 #include "test_pop_element.h"
 
 void test_get_edge_copy()
@@ -240,3 +242,152 @@ void test_element_assign()
   CU_ASSERT(binary_kmer_comparison_operator(e1.kmer,b2) );
   CU_ASSERT(e1.status==pruned );
 }
+
+
+static double seconds_between(struct timespec* start, struct timespec* end)
+{
+  return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec)/1e9;
+}
+
+// The node layout before coverages could be stored in fewer bits
+typedef struct{
+  BinaryKmer kmer;
+  Covg       coverage[NUMBER_OF_COLOURS];
+  Edges      individual_edges[NUMBER_OF_COLOURS];
+  char       status;
+  char       allele_status;
+} WideElement;
+
+void test_compact_coverage_saturates()
+{
+  dBNode* e = new_element();
+  int last = NUMBER_OF_COLOURS-1;
+
+  db_node_update_coverage(e, last, NODE_COVG_MAX-1);
+  CU_ASSERT(db_node_get_coverage(e, last)==NODE_COVG_MAX-1);
+  db_node_increment_coverage(e, last);
+  CU_ASSERT(db_node_get_coverage(e, last)==NODE_COVG_MAX);
+  db_node_increment_coverage(e, last);
+  CU_ASSERT(db_node_get_coverage(e, last)==NODE_COVG_MAX);
+  db_node_update_coverage_atomic(e, last, 1000);
+  CU_ASSERT(db_node_get_coverage(e, last)==NODE_COVG_MAX);
+
+  //coverage read from a binary is clamped rather than wrapped
+  if (NODE_COVG_MAX < COVG_MAX)
+    {
+      db_node_set_coverage(e, 0, (Covg) NODE_COVG_MAX + 2);
+      CU_ASSERT(db_node_get_coverage(e, 0)==NODE_COVG_MAX);
+    }
+  db_node_set_coverage(e, 0, 7);
+  CU_ASSERT(db_node_get_coverage(e, 0)==7);
+
+  free_element(&e);
+
+  //compare the size of a node, and the time to pass over every node summing
+  //coverages, with the 32-bit layout
+  long long num_nodes = (64LL<<20) / sizeof(WideElement);
+  Element* compact = calloc(num_nodes, sizeof(Element));
+  WideElement* wide = calloc(num_nodes, sizeof(WideElement));
+  if ( (compact==NULL) || (wide==NULL) )
+    {
+      die("Unable to allocate nodes for the coverage benchmark\n");
+    }
+
+  long long i;
+  int j;
+  for (i=0; i<num_nodes; i++)
+    {
+      for (j=0; j<NUMBER_OF_COLOURS; j++)
+	{
+	  Covg covg = (i+j) % 200;
+	  db_node_set_coverage(&compact[i], j, covg);
+	  wide[i].coverage[j] = covg;
+	}
+    }
+
+  struct timespec start, end;
+  long long compact_sum = 0, wide_sum = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i=0; i<num_nodes; i++)
+    {
+      for (j=0; j<NUMBER_OF_COLOURS; j++)
+	{
+	  compact_sum += compact[i].coverage[j];
+	}
+    }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double compact_secs = seconds_between(&start, &end);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i=0; i<num_nodes; i++)
+    {
+      for (j=0; j<NUMBER_OF_COLOURS; j++)
+	{
+	  wide_sum += wide[i].coverage[j];
+	}
+    }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double wide_secs = seconds_between(&start, &end);
+
+  CU_ASSERT(compact_sum==wide_sum);
+  CU_ASSERT(sizeof(Element) <= sizeof(WideElement));
+
+  printf("\n%d colours, %d-bit coverage: %zu bytes/kmer (%zu with 32-bit coverage)\n",
+	 NUMBER_OF_COLOURS, (int) (8*sizeof(NodeCovg)), sizeof(Element), sizeof(WideElement));
+  printf("summing coverages over %lld nodes: %.1f million nodes/sec (%.1f with 32-bit coverage)\n",
+	 num_nodes, num_nodes / compact_secs / 1e6, num_nodes / wide_secs / 1e6);
+
+  free(compact);
+  free(wide);
+}
+
+
+void test_unset_all_visited_status()
+{
+  dBGraph* db_graph = hash_table_new(4, 4, 10, 31);
+  dBNode* nodes[4];
+  boolean found;
+  int i;
+
+  for (i=0; i<4; i++)
+    {
+      BinaryKmer kmer;
+      binary_kmer_initialise_to_zero(&kmer);
+      kmer[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1] = (bitfield_of_64bits) (i+1);
+      nodes[i] = hash_table_find_or_insert(&kmer, &found, db_graph);
+    }
+
+  db_node_action_set_status_visited(nodes[0]);
+  db_node_set_status(nodes[1], exists_in_reference);
+  db_node_action_set_status_visited_or_visited_and_exists_in_reference(nodes[1]);
+  db_node_action_set_status_pruned(nodes[2]);
+  db_node_action_set_status_visited(nodes[3]);
+  CU_ASSERT(db_node_check_status_visited(nodes[0]));
+  CU_ASSERT(db_node_check_status_visited_and_exists_in_reference(nodes[1]));
+
+  db_graph_unset_all_visited_status(db_graph);
+  CU_ASSERT(db_node_check_status_none(nodes[0]));
+  CU_ASSERT(db_node_check_status_exists_in_reference(nodes[1]));
+  CU_ASSERT(db_node_check_status(nodes[2], pruned));
+  CU_ASSERT(db_node_check_status_none(nodes[3]));
+
+  // nodes[3] keeps its old mark while the epoch wraps round, and must not be
+  // read as visited again
+  for (i=0; i<600; i++)
+    {
+      db_node_action_set_status_visited(nodes[0]);
+      db_node_action_set_status_visited_or_visited_and_exists_in_reference(nodes[1]);
+      CU_ASSERT(db_node_check_status_visited(nodes[0]));
+      CU_ASSERT(db_node_check_status_visited_and_exists_in_reference(nodes[1]));
+      CU_ASSERT(db_node_check_status_none(nodes[3]));
+
+      db_graph_unset_all_visited_status(db_graph);
+      CU_ASSERT(db_node_check_status_none(nodes[0]));
+      CU_ASSERT(db_node_check_status_exists_in_reference(nodes[1]));
+      CU_ASSERT(db_node_check_status(nodes[2], pruned));
+      CU_ASSERT(db_node_check_status_none(nodes[3]));
+    }
+
+  hash_table_free(&db_graph);
+}
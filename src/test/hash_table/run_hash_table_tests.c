@@ -63,6 +63,35 @@ int  main()
     return CU_get_error();
   }
 
+  if (NULL == CU_add_test(pSuite, "test hash_table_find_or_insert_concurrent - many threads inserting the same kmers at once",  test_hash_table_find_or_insert_concurrent)){
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if (NULL == CU_add_test(pSuite, "test hash_table_find_or_insert_batch gives the same table as hash_table_find_or_insert, and compare speeds",  test_hash_table_find_or_insert_batch)){
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if (NULL == CU_add_test(pSuite, "test a hash table which is too small grows to fit the kmers",  test_hash_table_grow_when_full)){
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if (NULL == CU_add_test(pSuite, "test freezing a hash table behind a minimal perfect hash, and compare the speed of finds",  test_hash_table_freeze)){
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+  if (NULL == CU_add_test(pSuite, "test traversing the hash table with several threads, and compare speed with one thread",  test_hash_table_traverse_multithreaded)){
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if (NULL == CU_add_test(pSuite, "test and compare speed and bucket distribution of the kmer hash functions",  test_hash_value_speed_and_distribution)){
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
   /* Run all tests using the CUnit Basic interface */
   CU_basic_set_mode(CU_BRM_VERBOSE);
   CU_basic_run_tests();
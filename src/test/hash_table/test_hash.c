@@ -29,6 +29,10 @@
 */
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
 
 #include <CUnit.h>
 #include <Basic.h>
@@ -37,6 +41,7 @@
 #include "binary_kmer.h"
 #include "element.h"
 #include "open_hash/hash_table.h"
+#include "hash_value.h"
 
 void test_hash_table_find_or_insert()
 {
@@ -269,3 +274,799 @@ void test_hash_table_apply_or_insert()
 
   
 }
+
+
+// Used by test_hash_table_find_or_insert_concurrent - each thread inserts
+// all the kmers, starting at a different point in the list
+typedef struct {
+  HashTable* hash_table;
+  BinaryKmer* kmers;
+  long long num_kmers;
+  int thread_id;
+  int num_threads;
+  int num_passes;
+} ConcurrentInsertJob;
+
+static void* concurrent_insert_thread(void* arg)
+{
+  ConcurrentInsertJob* job = (ConcurrentInsertJob*) arg;
+  long long start = job->thread_id * job->num_kmers / job->num_threads;
+  long long i;
+  int pass;
+  boolean found;
+
+  for (pass=0; pass<job->num_passes; pass++)
+    {
+      for (i=0; i<job->num_kmers; i++)
+	{
+	  Element* e = hash_table_find_or_insert_concurrent(&job->kmers[(start+i) % job->num_kmers], &found, job->hash_table);
+	  db_node_update_coverage_atomic(e, 0, 1);
+	  add_edges_atomic(e, 0, (Edges) (1 << (job->thread_id % 8)));
+	}
+    }
+  return NULL;
+}
+
+void test_hash_table_find_or_insert_concurrent()
+{
+  short kmer_size = 31;
+  int number_of_bits = 10;
+  int bucket_size = 20;
+  int max_retries = 40;
+  long long num_kmers = 15000; //fills most of the table, so lots of rehashing
+  int num_threads = 8;
+  int num_passes = 4;
+
+  BinaryKmer tmp_kmer;
+  BinaryKmer* kmers = malloc(num_kmers * sizeof(BinaryKmer));
+  long long i;
+
+  //some of these will share a key with their reverse complement, which is fine
+  for (i=0; i<num_kmers; i++)
+    {
+      BinaryKmer b;
+      binary_kmer_initialise_to_zero(&b);
+      b[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1] = ((bitfield_of_64bits) i * 0x9E3779B97F4A7C15ULL) & 0x3FFFFFFFFFFFFFFFULL;
+      binary_kmer_assignment_operator(kmers[i], *element_get_key(&b, kmer_size, &tmp_kmer));
+    }
+
+  //single-threaded reference
+  HashTable* expected = hash_table_new(number_of_bits, bucket_size, max_retries, kmer_size);
+  boolean found;
+  for (i=0; i<num_kmers; i++)
+    {
+      Element* e = hash_table_find_or_insert(&kmers[i], &found, expected);
+      db_node_update_coverage(e, 0, num_threads*num_passes);
+    }
+
+  HashTable* hash_table = hash_table_new(number_of_bits, bucket_size, max_retries, kmer_size);
+
+  pthread_t threads[num_threads];
+  ConcurrentInsertJob jobs[num_threads];
+  int t;
+  for (t=0; t<num_threads; t++)
+    {
+      jobs[t].hash_table = hash_table;
+      jobs[t].kmers = kmers;
+      jobs[t].num_kmers = num_kmers;
+      jobs[t].thread_id = t;
+      jobs[t].num_threads = num_threads;
+      jobs[t].num_passes = num_passes;
+      pthread_create(&threads[t], NULL, concurrent_insert_thread, &jobs[t]);
+    }
+  for (t=0; t<num_threads; t++)
+    {
+      pthread_join(threads[t], NULL);
+    }
+
+  CU_ASSERT(hash_table_get_unique_kmers(hash_table) == hash_table_get_unique_kmers(expected));
+
+  //no key may have been inserted twice
+  long long num_elements = 0;
+  void count_elements(Element* e)
+  {
+    num_elements++;
+  }
+  hash_table_traverse(&count_elements, hash_table);
+  CU_ASSERT(num_elements == hash_table_get_unique_kmers(expected));
+
+  long long total_lookups = 0;
+  for (i=0; i<max_retries; i++)
+    {
+      total_lookups += hash_table->collisions[i];
+    }
+  CU_ASSERT(total_lookups == num_kmers * num_threads * num_passes);
+
+  int num_wrong = 0;
+  void compare_with_expected(Element* e)
+  {
+    Element* other = hash_table_find(&e->kmer, hash_table);
+    if (other == NULL ||
+	db_node_get_coverage(other, 0) != db_node_get_coverage(e, 0) ||
+	get_edge_copy(*other, 0) != (Edges) 0xFF)
+      {
+	num_wrong++;
+      }
+  }
+  hash_table_traverse(&compare_with_expected, expected);
+  CU_ASSERT(num_wrong == 0);
+
+  hash_table_free(&expected);
+  hash_table_free(&hash_table);
+  free(kmers);
+}
+
+
+typedef struct
+{
+  HashTable* hash_table;
+  BinaryKmer* kmers;
+  long long num_kmers;
+  boolean one_at_a_time; //rather than in batches
+} GrowingInsertJob;
+
+static void* growing_insert_thread(void* arg)
+{
+  GrowingInsertJob* job = (GrowingInsertJob*) arg;
+  Element* elements[64];
+  boolean found[64];
+  long long i;
+  int j, n;
+
+  for (i=0; i<job->num_kmers; i+=64)
+    {
+      n = job->num_kmers-i < 64 ? job->num_kmers-i : 64;
+      hash_table_begin_concurrent_inserts(job->hash_table);
+      if (job->one_at_a_time)
+	{
+	  //an element may move when the next insert grows the table, so use it straight away
+	  for (j=0; j<n; j++)
+	    {
+	      Element* e = hash_table_find_or_insert_concurrent(&job->kmers[i+j], &found[j], job->hash_table);
+	      db_node_update_coverage_atomic(e, 0, 1);
+	    }
+	}
+      else
+	{
+	  hash_table_find_or_insert_batch_concurrent(&job->kmers[i], n, elements, found, job->hash_table);
+	  for (j=0; j<n; j++)
+	    {
+	      db_node_update_coverage_atomic(elements[j], 0, 1);
+	    }
+	}
+      hash_table_end_concurrent_inserts(job->hash_table);
+    }
+  return NULL;
+}
+
+// A table much too small for the kmers grows to fit them, whether they are inserted
+// one at a time, in batches, by several threads at once, or by apply_or_insert
+void test_hash_table_grow_when_full()
+{
+  short kmer_size = 31;
+  int number_of_bits = 4;
+  int bucket_size = 8;
+  int max_retries = 5;
+  long long num_kmers = 20000;
+  int num_threads = 4;
+
+  BinaryKmer tmp_kmer;
+  BinaryKmer* kmers = malloc(num_kmers * sizeof(BinaryKmer));
+  Element** elements = malloc(num_kmers * sizeof(Element*));
+  boolean* found = malloc(num_kmers * sizeof(boolean));
+  long long i;
+
+  for (i=0; i<num_kmers; i++)
+    {
+      BinaryKmer b;
+      binary_kmer_initialise_to_zero(&b);
+      b[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1] = ((bitfield_of_64bits) i * 0x9E3779B97F4A7C15ULL) & 0x3FFFFFFFFFFFFFFFULL;
+      binary_kmer_assignment_operator(kmers[i], *element_get_key(&b, kmer_size, &tmp_kmer));
+    }
+
+  //reference, big enough not to need to grow
+  HashTable* expected = hash_table_new(14, 16, 40, kmer_size);
+  for (i=0; i<num_kmers; i++)
+    {
+      Element* e = hash_table_find_or_insert(&kmers[i], &found[0], expected);
+      db_node_update_coverage(e, 0, 1);
+    }
+
+  void add_one(Element* e)
+  {
+    db_node_update_coverage(e, 0, 1);
+  }
+
+  int method;
+  for (method=0; method<5; method++)
+    {
+      HashTable* hash_table = hash_table_new(number_of_bits, bucket_size, max_retries, kmer_size);
+      hash_table_set_grow_when_full(hash_table, true);
+      int covg_per_kmer = 1;
+
+      if (method==0)
+	{
+	  for (i=0; i<num_kmers; i++)
+	    {
+	      Element* e = hash_table_find_or_insert(&kmers[i], &found[i], hash_table);
+	      db_node_update_coverage(e, 0, 1);
+	    }
+	}
+      else if (method==1)
+	{
+	  //the elements of the whole batch must be right, though the table grows part way through
+	  hash_table_find_or_insert_batch(kmers, num_kmers, elements, found, hash_table);
+	  for (i=0; i<num_kmers; i++)
+	    {
+	      db_node_update_coverage(elements[i], 0, 1);
+	    }
+	}
+      else if (method==4)
+	{
+	  //a new kmer is only inserted, so apply again to count it
+	  for (i=0; i<num_kmers; i++)
+	    {
+	      if (!hash_table_apply_or_insert(&kmers[i], &add_one, hash_table))
+		{
+		  CU_ASSERT(hash_table_apply_or_insert(&kmers[i], &add_one, hash_table));
+		}
+	    }
+	}
+      else
+	{
+	  pthread_t threads[num_threads];
+	  GrowingInsertJob job = {hash_table, kmers, num_kmers, method==3};
+	  int t;
+	  for (t=0; t<num_threads; t++)
+	    {
+	      pthread_create(&threads[t], NULL, growing_insert_thread, &job);
+	    }
+	  for (t=0; t<num_threads; t++)
+	    {
+	      pthread_join(threads[t], NULL);
+	    }
+	  covg_per_kmer = num_threads;
+	}
+
+      CU_ASSERT(hash_table->generation > 0);
+      CU_ASSERT(hash_table_get_capacity(hash_table) > (long long) bucket_size << number_of_bits);
+      CU_ASSERT(hash_table_get_unique_kmers(hash_table) == hash_table_get_unique_kmers(expected));
+
+      long long num_elements = 0;
+      void count_elements(Element* e)
+      {
+	num_elements++;
+      }
+      hash_table_traverse(&count_elements, hash_table);
+      CU_ASSERT(num_elements == hash_table_get_unique_kmers(expected));
+
+      int num_wrong = 0;
+      void compare_with_expected(Element* e)
+      {
+	Element* other = hash_table_find(&e->kmer, hash_table);
+	if (other == NULL ||
+	    db_node_get_coverage(other, 0) != covg_per_kmer * db_node_get_coverage(e, 0))
+	  {
+	    num_wrong++;
+	  }
+      }
+      hash_table_traverse(&compare_with_expected, expected);
+      CU_ASSERT(num_wrong == 0);
+
+      hash_table_free(&hash_table);
+    }
+
+  //and the sizes chosen for an estimated number of kmers hold them
+  int bits, size;
+  hash_table_size_for_kmers(1000000, 100, &bits, &size);
+  CU_ASSERT(size >= 100 && size < 200);
+  CU_ASSERT(((long long) size << bits) * 0.8 >= 1000000);
+  CU_ASSERT(((long long) size << bits) * 0.8 < 2000000);
+
+  hash_table_free(&expected);
+  free(kmers);
+  free(elements);
+  free(found);
+}
+
+
+static double seconds_between(struct timespec* start, struct timespec* end)
+{
+  return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// Checks hash_table_find_or_insert_batch puts every kmer in the same slot as
+// hash_table_find_or_insert, and reports the speed of each on a table too big for cache
+void test_hash_table_find_or_insert_batch()
+{
+  short kmer_size = 31;
+  int number_of_bits = 17;
+  int bucket_size = 16;
+  int max_retries = 40;
+  long long num_kmers = 1500000; //about 70% full
+  int num_passes = 2; //second pass finds everything
+  int batch_size = 64;
+
+  BinaryKmer tmp_kmer;
+  BinaryKmer* kmers = malloc(num_kmers * sizeof(BinaryKmer));
+  Element** elements = malloc(num_kmers * sizeof(Element*));
+  boolean* found = malloc(num_kmers * sizeof(boolean));
+  long long i;
+  int pass;
+
+  for (i=0; i<num_kmers; i++)
+    {
+      BinaryKmer b;
+      binary_kmer_initialise_to_zero(&b);
+      b[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1] = ((bitfield_of_64bits) i * 0x9E3779B97F4A7C15ULL) & 0x3FFFFFFFFFFFFFFFULL;
+      binary_kmer_assignment_operator(kmers[i], *element_get_key(&b, kmer_size, &tmp_kmer));
+    }
+
+  struct timespec start, end;
+
+  HashTable* single = hash_table_new(number_of_bits, bucket_size, max_retries, kmer_size);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (pass=0; pass<num_passes; pass++)
+    {
+      for (i=0; i<num_kmers; i++)
+	{
+	  Element* e = hash_table_find_or_insert(&kmers[i], &found[i], single);
+	  db_node_update_coverage(e, 0, 1);
+	}
+    }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double single_secs = seconds_between(&start, &end);
+
+  HashTable* batched = hash_table_new(number_of_bits, bucket_size, max_retries, kmer_size);
+  int num_found_on_second_pass = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (pass=0; pass<num_passes; pass++)
+    {
+      for (i=0; i<num_kmers; i+=batch_size)
+	{
+	  int n = (num_kmers-i < batch_size) ? num_kmers-i : batch_size;
+	  hash_table_find_or_insert_batch(kmers+i, n, elements+i, found+i, batched);
+	  int j;
+	  for (j=0; j<n; j++)
+	    {
+	      db_node_update_coverage(elements[i+j], 0, 1);
+	      if ( (pass>0) && found[i+j] )
+		{
+		  num_found_on_second_pass++;
+		}
+	    }
+	}
+    }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double batched_secs = seconds_between(&start, &end);
+
+  printf("\nhash_table_find_or_insert:       %.2f million kmers/sec\n", num_passes*num_kmers / single_secs / 1e6);
+  printf("hash_table_find_or_insert_batch: %.2f million kmers/sec\n", num_passes*num_kmers / batched_secs / 1e6);
+
+  CU_ASSERT(num_found_on_second_pass == num_kmers);
+  CU_ASSERT(hash_table_get_unique_kmers(batched) == hash_table_get_unique_kmers(single));
+
+  //same slots, same coverages
+  for (i=0; i<num_kmers; i++)
+    {
+      Element* e1 = hash_table_find(&kmers[i], single);
+      Element* e2 = hash_table_find(&kmers[i], batched);
+      CU_ASSERT( (e1 != NULL) && (e2 != NULL) );
+      if ( (e1 != NULL) && (e2 != NULL) )
+	{
+	  CU_ASSERT(e1 - single->table == e2 - batched->table);
+	  CU_ASSERT(db_node_get_coverage(e2, 0) == db_node_get_coverage(e1, 0));
+	}
+    }
+
+  //and find_batch agrees with find
+  hash_table_find_batch(kmers, num_kmers, elements, batched);
+  for (i=0; i<num_kmers; i++)
+    {
+      CU_ASSERT(elements[i] == hash_table_find(&kmers[i], batched));
+    }
+
+  hash_table_free(&single);
+  hash_table_free(&batched);
+  free(kmers);
+  free(elements);
+  free(found);
+}
+
+
+// After freezing, every kmer is found with the same coverage, nothing else is found,
+// the table holds exactly the kmers, and compare the speed of finds before and after
+void test_hash_table_freeze()
+{
+  short kmer_size = 31;
+  int number_of_bits = 18;
+  int bucket_size = 16;
+  int max_retries = 40;
+  long long num_kmers = 1500000;
+
+  BinaryKmer tmp_kmer;
+  BinaryKmer* kmers = malloc(num_kmers * sizeof(BinaryKmer));
+  long long i;
+
+  for (i=0; i<num_kmers; i++)
+    {
+      BinaryKmer b;
+      binary_kmer_initialise_to_zero(&b);
+      b[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1] = ((bitfield_of_64bits) i * 0x9E3779B97F4A7C15ULL) & 0x3FFFFFFFFFFFFFFFULL;
+      binary_kmer_assignment_operator(kmers[i], *element_get_key(&b, kmer_size, &tmp_kmer));
+    }
+
+  HashTable* hash_table = hash_table_new(number_of_bits, bucket_size, max_retries, kmer_size);
+  for (i=0; i<num_kmers; i++)
+    {
+      boolean found;
+      Element* e = hash_table_find_or_insert(&kmers[i], &found, hash_table);
+      db_node_update_coverage(e, 0, 1 + i % 1000);
+    }
+
+  long long covg_sum(Element* e)
+  {
+    return db_node_get_coverage(e, 0);
+  }
+  long long sum_before = hash_table_traverse_returning_sum(&covg_sum, hash_table);
+  long long slots_before = hash_table_get_capacity(hash_table);
+
+  struct timespec start, end;
+  long long num_found = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i=0; i<num_kmers; i++)
+    {
+      num_found += (hash_table_find(&kmers[i], hash_table) != NULL);
+    }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double open_secs = seconds_between(&start, &end);
+  CU_ASSERT(num_found == num_kmers);
+
+  long long generation = hash_table->generation;
+  CU_ASSERT(!hash_table_is_frozen(hash_table));
+  CU_ASSERT(hash_table_freeze(hash_table));
+  CU_ASSERT(hash_table_is_frozen(hash_table));
+  CU_ASSERT(hash_table->generation == generation+1);
+  CU_ASSERT(hash_table_get_capacity(hash_table) == num_kmers);
+  CU_ASSERT(hash_table_get_unique_kmers(hash_table) == num_kmers);
+  CU_ASSERT(hash_table_traverse_returning_sum(&covg_sum, hash_table) == sum_before);
+
+  num_found = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i=0; i<num_kmers; i++)
+    {
+      num_found += (hash_table_find(&kmers[i], hash_table) != NULL);
+    }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double frozen_secs = seconds_between(&start, &end);
+  CU_ASSERT(num_found == num_kmers);
+
+  printf("\nhash_table_find: %.2f million kmers/sec in a table of %lld, %.2f million kmers/sec frozen (perfect hash of %.2f bits per kmer)\n",
+	 num_kmers / open_secs / 1e6, slots_before, num_kmers / frozen_secs / 1e6,
+	 8.0 * perfect_hash_get_bytes(hash_table->perfect_hash) / num_kmers);
+
+  //every kmer has its own place, and keeps its coverage
+  long long num_wrong = 0;
+  for (i=0; i<num_kmers; i++)
+    {
+      Element* e = hash_table_find(&kmers[i], hash_table);
+      if ( (e == NULL) || (e - hash_table->table != perfect_hash_lookup(&kmers[i], hash_table->perfect_hash))
+	   || (db_node_get_coverage(e, 0) != 1 + i % 1000) )
+	{
+	  num_wrong++;
+	}
+    }
+  CU_ASSERT(num_wrong == 0);
+
+  //kmers which were never added are not found
+  long long num_false_finds = 0;
+  for (i=num_kmers; i<num_kmers+100000; i++)
+    {
+      BinaryKmer b;
+      binary_kmer_initialise_to_zero(&b);
+      b[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1] = ((bitfield_of_64bits) i * 0x9E3779B97F4A7C15ULL) & 0x3FFFFFFFFFFFFFFFULL;
+      num_false_finds += (hash_table_find(element_get_key(&b, kmer_size, &tmp_kmer), hash_table) != NULL);
+    }
+  CU_ASSERT(num_false_finds == 0);
+
+  //kmers already there can still be "inserted"
+  boolean found = false;
+  Element* e = hash_table_find_or_insert(&kmers[7], &found, hash_table);
+  CU_ASSERT(found);
+  CU_ASSERT(e == hash_table_find(&kmers[7], hash_table));
+  found = false;
+  CU_ASSERT(hash_table_find_or_insert_concurrent(&kmers[8], &found, hash_table) == hash_table_find(&kmers[8], hash_table));
+  CU_ASSERT(found);
+
+  void add_one(Element* e)
+  {
+    db_node_update_coverage(e, 0, 1);
+  }
+  CU_ASSERT(hash_table_apply_or_insert(&kmers[9], &add_one, hash_table));
+  CU_ASSERT(db_node_get_coverage(hash_table_find(&kmers[9], hash_table), 0) == 1 + 9 % 1000 + 1);
+
+  //and the batched finds give the same elements as one at a time, with kmers
+  //which were never added in between
+  int num_keys = 1000;
+  BinaryKmer* keys = malloc(num_keys * sizeof(BinaryKmer));
+  Element** elements = malloc(num_keys * sizeof(Element*));
+  boolean* found_keys = malloc(num_keys * sizeof(boolean));
+  int j;
+  for (j=0; j<num_keys; j++)
+    {
+      if (j % 2 == 0)
+	{
+	  binary_kmer_assignment_operator(keys[j], kmers[j * 997]);
+	}
+      else
+	{
+	  BinaryKmer b;
+	  binary_kmer_initialise_to_zero(&b);
+	  b[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1] = ((bitfield_of_64bits) (num_kmers+j) * 0x9E3779B97F4A7C15ULL) & 0x3FFFFFFFFFFFFFFFULL;
+	  binary_kmer_assignment_operator(keys[j], *element_get_key(&b, kmer_size, &tmp_kmer));
+	}
+    }
+  hash_table_find_batch(keys, num_keys, elements, hash_table);
+  num_wrong = 0;
+  for (j=0; j<num_keys; j++)
+    {
+      num_wrong += (elements[j] != hash_table_find(&keys[j], hash_table));
+      num_wrong += ( (j % 2 == 0) != (elements[j] != NULL) );
+    }
+  CU_ASSERT(num_wrong == 0);
+
+  //only the kmers in the table can be "inserted" in batches
+  for (j=1; j<num_keys; j+=2)
+    {
+      binary_kmer_assignment_operator(keys[j], kmers[j * 997]);
+    }
+  hash_table_find_or_insert_batch(keys, num_keys, elements, found_keys, hash_table);
+  num_wrong = 0;
+  for (j=0; j<num_keys; j++)
+    {
+      num_wrong += ( (found_keys[j] != true) || (elements[j] != hash_table_find(&keys[j], hash_table)) );
+    }
+  CU_ASSERT(num_wrong == 0);
+  hash_table_find_or_insert_batch_concurrent(keys, num_keys, elements, found_keys, hash_table);
+  num_wrong = 0;
+  for (j=0; j<num_keys; j++)
+    {
+      num_wrong += ( (found_keys[j] != true) || (elements[j] != hash_table_find(&keys[j], hash_table)) );
+    }
+  CU_ASSERT(num_wrong == 0);
+
+  //freezing again changes nothing, and a frozen table does not grow
+  generation = hash_table->generation;
+  CU_ASSERT(hash_table_freeze(hash_table));
+  CU_ASSERT(!hash_table_grow(hash_table));
+  CU_ASSERT(hash_table->generation == generation);
+  CU_ASSERT(hash_table_get_capacity(hash_table) == num_kmers);
+
+  free(keys);
+  free(elements);
+  free(found_keys);
+  hash_table_free(&hash_table);
+  free(kmers);
+}
+
+// Traversing with several threads visits every element once, and sums the same
+// as traversing with one (and compare how long they take)
+void test_hash_table_traverse_multithreaded()
+{
+  short kmer_size = 31;
+  int number_of_bits = 18;
+  int bucket_size = 16;
+  int max_retries = 40;
+  long long num_kmers = 3000000;
+  int num_threads = 4;
+
+  BinaryKmer tmp_kmer;
+  HashTable* hash_table = hash_table_new(number_of_bits, bucket_size, max_retries, kmer_size);
+  boolean found;
+  long long i;
+
+  for (i=0; i<num_kmers; i++)
+    {
+      BinaryKmer b;
+      binary_kmer_initialise_to_zero(&b);
+      b[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1] = ((bitfield_of_64bits) i * 0x9E3779B97F4A7C15ULL) & 0x3FFFFFFFFFFFFFFFULL;
+      hash_table_find_or_insert(element_get_key(&b, kmer_size, &tmp_kmer), &found, hash_table);
+    }
+  long long num_elements = hash_table_get_unique_kmers(hash_table);
+
+  //every element is visited exactly once
+  void add_one(Element* e)
+  {
+    db_node_update_coverage(e, 0, 1);
+  }
+  hash_table_traverse_multithreaded(&add_one, hash_table, num_threads);
+
+  long long num_wrong = 0;
+  void check_covg_one(Element* e)
+  {
+    if (db_node_get_coverage(e, 0) != 1)
+      {
+	num_wrong++;
+      }
+  }
+  hash_table_traverse(&check_covg_one, hash_table);
+  CU_ASSERT(num_wrong == 0);
+
+  long long get_covg(Element* e)
+  {
+    return db_node_get_coverage(e, 0);
+  }
+  CU_ASSERT(hash_table_traverse_returning_sum_multithreaded(&get_covg, hash_table, num_threads) == num_elements);
+  CU_ASSERT(hash_table_traverse_returning_sum_multithreaded(&get_covg, hash_table, 1) == num_elements);
+
+  long long counts[num_threads];
+  boolean bad_index = false;
+  for (i=0; i<num_threads; i++)
+    {
+      counts[i] = 0;
+    }
+  void count_in_thread(Element* e, int thread_index)
+  {
+    if (thread_index < 0 || thread_index >= num_threads)
+      {
+	bad_index = true;
+	return;
+      }
+    counts[thread_index] += get_covg(e);
+  }
+  hash_table_traverse_multithreaded_with_thread_index(&count_in_thread, hash_table, num_threads);
+  CU_ASSERT(bad_index == false);
+  CU_ASSERT(counts[0] + counts[1] + counts[2] + counts[3] == num_elements);
+
+  //a pass which does a little work on each element
+  long long expensive(Element* e)
+  {
+    BinaryKmer rc;
+    binary_kmer_reverse_complement(&e->kmer, kmer_size, &rc);
+    return (long long) (rc[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1] & 1);
+  }
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  long long serial_sum = hash_table_traverse_returning_sum(&expensive, hash_table);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double serial_secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec)/1e9;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  long long threaded_sum = hash_table_traverse_returning_sum_multithreaded(&expensive, hash_table, num_threads);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double threaded_secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec)/1e9;
+  CU_ASSERT(serial_sum == threaded_sum);
+
+  printf("\nhash_table_traverse_returning_sum:                          %.2f million elements/sec\n", num_elements / serial_secs / 1e6);
+  printf("hash_table_traverse_returning_sum_multithreaded, %d threads: %.2f million elements/sec\n", num_threads, num_elements / threaded_secs / 1e6);
+
+  hash_table_free(&hash_table);
+}
+
+
+typedef uint32_t (*HashFunction)(Key, int, int);
+
+// Microbenchmark of the hashes available for the kmer hash table: prints
+// hashes/sec and how evenly the kmers of a random genome load the buckets.
+// Run it from builds with different MAXK to compare kmer widths.
+void test_hash_value_speed_and_distribution()
+{
+  short kmer_size = 32*NUMBER_OF_BITFIELDS_IN_BINARY_KMER - 1;
+  long long num_kmers = 1 << 20;
+  int number_buckets = 1 << 16; //16 kmers per bucket on average
+  int reps = 20;
+
+  const char* names[] = {"bob_jenkins", "mix64", "crc32c"};
+  HashFunction functions[3] = {&hash_value_bob_jenkins, &hash_value_mix64, NULL};
+  int num_functions = 2;
+#ifdef HASH_VALUE_HAVE_CRC32C
+  functions[2] = &hash_value_crc32c;
+  num_functions = 3;
+#endif
+
+  //kmers of a random sequence
+  BinaryKmer curr_kmer, tmp_kmer;
+  BinaryKmer* kmers = malloc(num_kmers * sizeof(BinaryKmer));
+  uint64_t rnd = 12345;
+  long long i;
+  binary_kmer_initialise_to_zero(&curr_kmer);
+  for (i=0; i<num_kmers+kmer_size; i++)
+    {
+      rnd = rnd * 6364136223846793005ULL + 1442695040888963407ULL;
+      binary_kmer_left_shift_one_base_and_insert_new_base_at_right_end(&curr_kmer, (Nucleotide) (rnd >> 62), kmer_size);
+      if (i >= kmer_size)
+	{
+	  binary_kmer_assignment_operator(kmers[i-kmer_size], *element_get_key(&curr_kmer, kmer_size, &tmp_kmer));
+	}
+    }
+
+  //the word-at-a-time version must give the same buckets as hashing a copy with the rehash added
+  int num_differ = 0;
+  int rehash;
+  for (i=0; i<10000; i++)
+    {
+      for (rehash=0; rehash<3; rehash++)
+	{
+	  BinaryKmer copy;
+	  binary_kmer_assignment_operator(copy, kmers[i]);
+	  copy[NUMBER_OF_BITFIELDS_IN_BINARY_KMER-1] += rehash;
+	  uint32_t expected = hashlittle(&copy, NUMBER_OF_BITFIELDS_IN_BINARY_KMER*sizeof(bitfield_of_64bits), 10) & (number_buckets-1);
+	  if (hash_value_bob_jenkins(&kmers[i], rehash, number_buckets) != expected)
+	    {
+	      num_differ++;
+	    }
+	}
+    }
+  CU_ASSERT(num_differ == 0);
+  CU_ASSERT(hash_value(&kmers[0], number_buckets) == hash_value_with_rehash(&kmers[0], 0, number_buckets));
+
+  int* loads = malloc(number_buckets * sizeof(int));
+  int f;
+  printf("\nMAXK=%d, %lld kmers into %d buckets\n", kmer_size, num_kmers, number_buckets);
+
+  for (f=0; f<num_functions; f++)
+    {
+      struct timespec start, end;
+      uint32_t sink = 0;
+      int r;
+
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for (r=0; r<reps; r++)
+	{
+	  for (i=0; i<num_kmers; i++)
+	    {
+	      sink += functions[f](&kmers[i], r & 1, number_buckets);
+	    }
+	}
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      double secs = seconds_between(&start, &end);
+
+      //chi-squared over degrees of freedom is about 1 for a uniform hash
+      memset(loads, 0, number_buckets * sizeof(int));
+      for (i=0; i<num_kmers; i++)
+	{
+	  loads[functions[f](&kmers[i], 0, number_buckets)]++;
+	}
+      double mean = (double) num_kmers / number_buckets;
+      double chi_sq = 0;
+      int max_load = 0;
+      int b;
+      for (b=0; b<number_buckets; b++)
+	{
+	  chi_sq += (loads[b]-mean) * (loads[b]-mean) / mean;
+	  if (loads[b] > max_load)
+	    {
+	      max_load = loads[b];
+	    }
+	}
+      chi_sq /= (number_buckets-1);
+
+      //kmers which share a bucket must be split up again when rehashed
+      int num_in_bucket = 0, num_still_together = 0;
+      uint32_t first_rehashed_bucket = 0;
+      for (i=0; i<num_kmers; i++)
+	{
+	  if (functions[f](&kmers[i], 0, number_buckets) == 0)
+	    {
+	      uint32_t rehashed_bucket = functions[f](&kmers[i], 1, number_buckets);
+	      if (num_in_bucket == 0)
+		{
+		  first_rehashed_bucket = rehashed_bucket;
+		}
+	      else if (rehashed_bucket == first_rehashed_bucket)
+		{
+		  num_still_together++;
+		}
+	      num_in_bucket++;
+	    }
+	}
+
+      printf("%-12s %7.1f million hashes/sec   chi-sq/df %.3f   max bucket load %d (mean %.0f)   [%u]\n",
+	     names[f], reps*num_kmers / secs / 1e6, chi_sq, max_load, mean, sink & 1);
+
+      CU_ASSERT(chi_sq < 1.2);
+      CU_ASSERT(num_still_together <= 2);
+    }
+
+  free(loads);
+  free(kmers);
+}